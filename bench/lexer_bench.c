@@ -0,0 +1,207 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "file.h"
+#include "lexer.h"
+#include "scan.h"
+#include "symbol_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_SOURCE_SIZE (32U * 1024U * 1024U)
+#define DEFAULT_ITERATIONS 5U
+
+/*
+ * A block of L that exercises every kind of token, with a good share of
+ * comments and whitespace, like our generated sources have.
+ * */
+static const char block[] =
+    "/* Generated block: the quick brown fox jumps over the lazy dog.\n"
+    " * Comments like this one are ** very ** common in generated code. */\n"
+    "int counter, total:=12, limit:=-3;\n"
+    "float ratio:=0.75, acc;\n"
+    "string message:=\"the quick brown fox, jumps over the lazy dog\";\n"
+    "char letter:='a', code:=0x4F;\n"
+    "boolean done:=false;\n"
+    "\n"
+    "while ((counter < limit) && !done) {\n"
+    "    acc := acc + float(counter) * ratio / .5;\n"
+    "    total := total mod 7 + counter div 3 - 42;\n"
+    "    if (message[counter] = letter || total >= 100) {\n"
+    "        writeln(\"total: \", total, \" ratio: \", acc);\n"
+    "    } else {\n"
+    "        counter := counter + 1;\n"
+    "    }\n"
+    "    done := total != 0 && counter <= 10;\n"
+    "}\n"
+    "readln(message);\n\n";
+
+static double
+now_in_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int
+generate_source(struct file *file, uint64_t size)
+{
+    const uint64_t block_size = sizeof(block) - 1;
+    const uint64_t blocks = size / block_size + 1;
+
+    char *buffer = malloc(blocks * block_size);
+    if (!buffer)
+        return -1;
+
+    for (uint64_t i = 0; i < blocks; ++i)
+        memcpy(buffer + i * block_size, block, block_size);
+
+    file->buffer = buffer;
+    file->size = blocks * block_size;
+    file->is_mapped = 0;
+    return 0;
+}
+
+/*
+ * Lexes the whole file once into a token buffer, like the compiler does.
+ * Returns the number of tokens found or -1 if the lexer reported an error.
+ * */
+static int64_t
+lex_file(const struct file *file, uint32_t threads)
+{
+    struct symbol_table table;
+    if (symbol_table_create(&table, 64) < 0)
+        return -1;
+
+    struct lexer lexer;
+    lexer_init(&lexer, file, &table);
+
+    struct token_buffer tokens = { 0 };
+    int64_t count = -1;
+
+    if (lexer_tokenize_all_parallel(&lexer, &tokens, threads) < 0) {
+        fputs("Failed to allocate the token buffer.\n", ERR_STREAM);
+    } else {
+        if (tokens.result == LEXER_RESULT_ERROR)
+            lexer_print_error(&lexer);
+        else
+            count = tokens.count;
+        token_buffer_destroy(&tokens);
+    }
+
+    symbol_table_destroy(&table);
+    return count;
+}
+
+/*
+ * Lexes the file once and prints every token, with its lines, followed by
+ * the error if there's one. The output doesn't depend on how many threads
+ * lexed it, which is what test.sh checks.
+ * */
+static int
+dump_tokens(const struct file *file, uint32_t threads)
+{
+    struct symbol_table table;
+    if (symbol_table_create(&table, 64) < 0)
+        return -1;
+
+    struct lexer lexer;
+    lexer_init(&lexer, file, &table);
+
+    struct token_buffer tokens = { 0 };
+    if (lexer_tokenize_all_parallel(&lexer, &tokens, threads) < 0) {
+        fputs("Failed to allocate the token buffer.\n", ERR_STREAM);
+        symbol_table_destroy(&table);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < tokens.count; ++i) {
+        const struct symbol *symbol = tokens.symbols[i];
+        printf("%u %u %u %u %u %.*s %.*s\n",
+               tokens.lines[i],
+               tokens.lexer_lines[i],
+               tokens.tokens[i],
+               tokens.constant_types[i],
+               tokens.is_new_identifier[i],
+               (int)tokens.lexeme_sizes[i],
+               file->buffer + tokens.lexeme_offsets[i],
+               symbol ? (int)symbol->lexeme_size : 0,
+               symbol ? symbol->lexeme : "");
+    }
+
+    // The error goes to ERR_STREAM, after the tokens.
+    fflush(stdout);
+    if (tokens.result == LEXER_RESULT_ERROR)
+        lexer_print_error(&lexer);
+
+    token_buffer_destroy(&tokens);
+    symbol_table_destroy(&table);
+    return 0;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    struct file file;
+    uint32_t iterations = DEFAULT_ITERATIONS;
+
+    // An empty path also means the generated source.
+    if (argc > 1 && argv[1][0] != '\0') {
+        if (read_file(&file, argv[1]) < 0) {
+            fprintf(ERR_STREAM, "Failed to read %s\n", argv[1]);
+            return -1;
+        }
+    } else if (generate_source(&file, DEFAULT_SOURCE_SIZE) < 0) {
+        fputs("Failed to generate source.\n", ERR_STREAM);
+        return -1;
+    }
+
+    if (argc > 2)
+        iterations = (uint32_t)strtoul(argv[2], NULL, 10);
+
+    // 1 lexes on a single thread, 0 lets the lexer pick.
+    uint32_t threads = 1;
+    if (argc > 3)
+        threads = (uint32_t)strtoul(argv[3], NULL, 10);
+
+    // "tokens" prints the tokens instead of timing the lexer.
+    if (argc > 4 && strcmp(argv[4], "tokens") == 0) {
+        const int status = dump_tokens(&file, threads);
+        destroy_file(&file);
+        return status;
+    }
+
+    double best = 0.0;
+    int64_t tokens = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const double start = now_in_seconds();
+        tokens = lex_file(&file, threads);
+        const double elapsed = now_in_seconds() - start;
+
+        if (tokens < 0) {
+            destroy_file(&file);
+            return -1;
+        }
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    const double mb = (double)file.size / (1024.0 * 1024.0);
+    printf("Source: %.2f MB, %ld tokens, %s kernels.\n",
+           mb,
+           tokens,
+           scan_kernels_name());
+    printf("Best of %u: %.3f s, %.1f MB/s, %.1f Mtokens/s.\n",
+           iterations,
+           best,
+           mb / best,
+           (double)tokens / best / 1e6);
+
+    destroy_file(&file);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 5U
+
+static double
+now_in_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Compiles and runs the program with the compiler, with backend_flag
+ * picking the backend. Its input comes from input (/dev/null if NULL) and
+ * its output is discarded. Returns the seconds it took or a negative
+ * number if it couldn't be run.
+ * */
+static double
+run_once(const char *compiler,
+         const char *program,
+         const char *input,
+         const char *backend_flag)
+{
+    const double start = now_in_seconds();
+
+    const pid_t pid = fork();
+    if (pid < 0)
+        return -1.0;
+
+    if (pid == 0) {
+        const int in = open(input ? input : "/dev/null", O_RDONLY);
+        const int out = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0)
+            _exit(127);
+
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        execl(compiler, compiler, program, backend_flag, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        return -1.0;
+
+    // The compiler's own failures, the program's exit code is always 0.
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1.0;
+
+    return now_in_seconds() - start;
+}
+
+static double
+best_of(const char *compiler,
+        const char *program,
+        const char *input,
+        const char *backend_flag,
+        uint32_t iterations)
+{
+    double best = 0.0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const double elapsed =
+            run_once(compiler, program, input, backend_flag);
+        if (elapsed < 0.0) {
+            fprintf(ERR_STREAM,
+                    "Failed to run %s %s %s\n",
+                    compiler,
+                    program,
+                    backend_flag);
+            return -1.0;
+        }
+
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    if (argc < 3) {
+        fprintf(ERR_STREAM,
+                "Usage: %s <compiler> <program_file> [input_file] "
+                "[iterations]\n",
+                argv[0]);
+        return -1;
+    }
+
+    // An empty path also means no input.
+    const char *input = NULL;
+    if (argc > 3 && argv[3][0] != '\0')
+        input = argv[3];
+
+    uint32_t iterations = DEFAULT_ITERATIONS;
+    if (argc > 4)
+        iterations = (uint32_t)strtoul(argv[4], NULL, 10);
+
+    // Both include compiling the program, which is the same for both.
+    const double native =
+        best_of(argv[1], argv[2], input, "--run", iterations);
+    if (native < 0.0)
+        return -1;
+
+    const double vm =
+        best_of(argv[1], argv[2], input, "--backend=vm", iterations);
+    if (vm < 0.0)
+        return -1;
+
+    printf("Best of %u, compiling included.\n", iterations);
+    printf("Native: %.4f s.\n", native);
+    printf("VM:     %.4f s, %.1fx native.\n", vm, vm / native);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "compile.h"
+
+#include <stdint.h>
+
+/*
+ * Compiles count files in a single process, on a work-stealing pool with a
+ * thread per processor. Every thread starts with its share of the files and
+ * takes files from the others once it runs out, so a few big files don't
+ * hold the rest back.
+ *
+ * The diagnostics of each file are collected while it's compiled and
+ * printed to ERR_STREAM in the order of pathnames, after a line with the
+ * file's pathname. A summary with the files that failed comes at the end.
+ *
+ * Outputs are named after the file without its directory, so no two files
+ * can have the same name. If they do, nothing is compiled.
+ *
+ * options->run isn't supported. Returns how many files failed, or -1 if
+ * the batch couldn't be started.
+ * */
+int
+batch_compile(const char *const *pathnames,
+              uint32_t count,
+              const struct compile_options *options);
+
+/*
+ * Same as batch_compile, with the pathnames read from the file at
+ * list_pathname, one per line. Empty lines are ignored.
+ * */
+int
+batch_compile_list(const char *list_pathname,
+                   const struct compile_options *options);
+
+#endif
@@ -0,0 +1,111 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Content-addressed cache of compiled programs, kept in the directory named
+ * by $L_CACHE_DIR and shared by every compiler that uses it, even at the
+ * same time.
+ *
+ * Programs are looked up by a hash of the compiler itself, the outputs that
+ * were asked for and the source. Each entry is a directory named after the
+ * hash with a copy of every output, made read-only. Entries are written
+ * into a temporary directory that is renamed into place, so they are
+ * either complete or missing. Outputs are restored as hard links (copies
+ * if that's not possible), which the compiler replaces instead of writing
+ * through when it writes them again.
+ *
+ * The cache is bounded by $L_CACHE_SIZE bytes (CACHE_DEFAULT_SIZE if it's
+ * not set). When it grows past it, the least recently used entries are
+ * evicted.
+ * */
+
+#define CACHE_DEFAULT_SIZE (256ULL * 1024ULL * 1024ULL)
+
+/*
+ * Outputs of a program, next to the working directory, named after the
+ * program's file.
+ * */
+enum cache_output
+{
+    /* <name>.asm */
+    CACHE_OUTPUT_ASSEMBLY = 1 << 0,
+    /* <name>-unoptimized.asm */
+    CACHE_OUTPUT_UNOPTIMIZED = 1 << 1,
+    /* <name>.asm.o */
+    CACHE_OUTPUT_OBJECT = 1 << 2,
+    /* <name>.asm.out */
+    CACHE_OUTPUT_EXECUTABLE = 1 << 3,
+};
+
+#define CACHE_OUTPUT_COUNT 4U
+
+/*
+ * What the outputs of a program hold, indexed by the position of their bit
+ * in enum cache_output. Only the outputs in the key are used.
+ * */
+struct cache_contents
+{
+    const void *buffers[CACHE_OUTPUT_COUNT];
+    uint64_t sizes[CACHE_OUTPUT_COUNT];
+};
+
+struct cache_key
+{
+    /* 128 bits FNV-1a. */
+    uint8_t bytes[16];
+    /* Mask of enum cache_output. */
+    uint8_t outputs;
+};
+
+/*
+ * The cache's directory, NULL if caching is disabled.
+ * */
+const char *
+cache_directory(void);
+
+/*
+ * Computes the key of the source with the outputs. Returns -1 if the
+ * compiler can't be identified, in which case nothing should be cached.
+ * */
+int
+cache_key_compute(struct cache_key *key,
+                  const char *source,
+                  uint64_t source_size,
+                  uint8_t outputs);
+
+/*
+ * Looks the key up and, on a hit, restores the outputs for name and marks
+ * the entry as used. Counts a hit or a miss.
+ *
+ * Returns 1 on a hit and 0 on a miss.
+ * */
+int
+cache_restore(const char *directory,
+              const struct cache_key *key,
+              const char *name,
+              FILE *diagnostics);
+
+/*
+ * Adds the outputs under the key, from their contents rather than from the
+ * files, which another compiler may be writing over. The least recently used
+ * entries are then evicted if the cache is too big. Failing to add them
+ * isn't an error, they are just not cached.
+ * */
+void
+cache_store(const char *directory,
+            const struct cache_key *key,
+            const struct cache_contents *contents);
+
+/*
+ * Prints the hits and misses so far, the number of entries and their size.
+ * */
+int
+cache_print_stats(const char *directory, FILE *stream);
+
+#endif
@@ -4,10 +4,20 @@
 #ifndef CODEGEN_H_
 #define CODEGEN_H_
 
+#include "ir.h"
+#include "promote.h"
 #include "symbol_table.h"
 
 #include <stdint.h>
+#include <stdio.h>
 
+/*
+ * Where a value is. Values computed by expressions are in IR temporaries
+ * (section SYMBOL_SECTION_TEMPORARY), and address is the temporary's
+ * number. Literals, constants and what's computed only from them are
+ * folded instead (section SYMBOL_SECTION_CONSTANT), and address holds
+ * their bits.
+ * */
 struct codegen_value_info
 {
     uint64_t address;
@@ -16,34 +26,211 @@ struct codegen_value_info
     enum symbol_section section;
 };
 
+struct codegen_loop
+{
+    uint32_t start_label;
+    uint32_t end_label;
+    /* ctx->string_index_writes when the loop started. */
+    uint32_t string_index_writes;
+};
+
+struct codegen_if
+{
+    uint32_t false_label;
+    uint32_t end_label;
+};
+
+#define CODEGEN_NO_LABEL UINT32_MAX
+
+/*
+ * Where the next instruction of the program went when this was taken.
+ * */
+struct codegen_position
+{
+    struct ir_block *block;
+    uint32_t index;
+};
+
+/*
+ * A boolean known only from where its code goes: it's true if the code
+ * jumps to true_label or falls through with condition holding for the
+ * flags, and false if it jumps to false_label or falls through without it.
+ * Either label can be CODEGEN_NO_LABEL, when nothing jumps to it.
+ * */
+struct codegen_condition
+{
+    /* enum ir_condition */
+    uint8_t condition;
+    uint32_t true_label;
+    uint32_t false_label;
+};
+
+/*
+ * The last boolean set from a condition. The code that sets it starts at
+ * start and ends at end, which can be dropped to branch on the condition
+ * instead.
+ * */
+struct codegen_boolean
+{
+    uint64_t temporary;
+    struct codegen_condition condition;
+    struct codegen_position start;
+    /* NULL if there hasn't been any. */
+    const struct ir_instruction *end;
+};
+
+/*
+ * A && or || whose right operand is being generated. It's skipped, by a
+ * jump to skip_label, when the left operand decides the result.
+ * */
+struct codegen_logical
+{
+    enum token operation_tok;
+    uint32_t skip_label;
+    struct codegen_position rhs_start;
+};
+
+/*
+ * A float known at compile time that has been put in .rodata, see
+ * codegen_ctx.floats.
+ * */
+struct codegen_float
+{
+    uint64_t address;
+    uint32_t bits;
+    uint8_t is_used;
+};
+
+/*
+ * Everything the code generator keeps while a program is compiled. Each
+ * program gets its own, so that many can be compiled at the same time, on
+ * different threads.
+ * */
+struct codegen_ctx
+{
+    /* The program generated so far. */
+    struct ir program;
+    uint32_t invalid_input_handler_label;
+
+    /* Next free addresses of each memory area. */
+    uint64_t current_bss_tmp_address;
+    uint64_t current_data_address;
+    uint64_t current_bss_address;
+    uint64_t current_rodata_address;
+
+    /* Loops whose variables can be promoted (see promote.h), and how many
+     * string indexes have been written to so far, since loops writing to
+     * them can't be promoted. */
+    struct promote_loop *loops;
+    uint32_t loop_count;
+    uint32_t loop_capacity;
+    uint32_t string_index_writes;
+
+    /* Lets if, while, && and || branch on a condition right before them
+     * without setting its boolean. */
+    struct codegen_boolean last_boolean;
+
+    /* Hash table of the floats in .rodata by their bits, so that each value
+     * is put there once. float_capacity is a power of two, or 0. */
+    struct codegen_float *floats;
+    uint32_t float_count;
+    uint32_t float_capacity;
+
+    /* Where messages are printed, ERR_STREAM unless it's changed after
+     * codegen_init. */
+    FILE *diagnostics;
+};
+
+/*
+ * Sets up ctx for a new program. Every other function takes a ctx that has
+ * been initialized, until codegen_destroy.
+ * */
 int
-codegen_init(void);
+codegen_init(struct codegen_ctx *ctx);
+
+/*
+ * Files codegen_dump can write, see its options.
+ * */
+enum codegen_file_kind
+{
+    /* <pathname>.asm */
+    CODEGEN_FILE_ASSEMBLY,
+    /* <pathname>-unoptimized.asm */
+    CODEGEN_FILE_UNOPTIMIZED,
+    /* <pathname>.asm.o */
+    CODEGEN_FILE_OBJECT,
+    /* <pathname>.asm.out */
+    CODEGEN_FILE_EXECUTABLE,
+    CODEGEN_FILE_COUNT,
+};
+
+/*
+ * The contents of a file written by codegen_dump. buffer is NULL if it
+ * wasn't asked for.
+ * */
+struct codegen_file
+{
+    uint8_t *buffer;
+    uint64_t size;
+};
 
 /*
  * Dumps all the assembly that has been generated to the file
  * at pathname.
  *
- * Optionally keeps the unoptimized version of the assembly and
- * assembles and link the final assembly into an executable by
- * using nasm and ld.
+ * Optionally keeps the unoptimized version of the assembly, writes the
+ * program as an ELF object and assembles it into a static executable,
+ * without any external assembler or linker.
+ *
+ * If files isn't NULL, it's an array of CODEGEN_FILE_COUNT files which, on
+ * success, is left with the contents of every file that was written, to be
+ * freed with codegen_files_destroy.
  * */
 int
-codegen_dump(const char *pathname,
+codegen_dump(struct codegen_ctx *ctx,
+             const char *pathname,
              uint8_t keep_unoptimized,
-             uint8_t assemble_and_link);
+             uint8_t emit_object,
+             uint8_t assemble_and_link,
+             struct codegen_file *files);
+
+/*
+ * Frees the files left by codegen_dump.
+ * */
+void
+codegen_files_destroy(struct codegen_file files[CODEGEN_FILE_COUNT]);
+
+/*
+ * Where codegen_run runs the program.
+ * */
+enum codegen_backend
+{
+    /* Assembled to machine code, run in memory. */
+    CODEGEN_BACKEND_NATIVE,
+    /* Translated to bytecode, run by the interpreter in vm.h. */
+    CODEGEN_BACKEND_VM,
+};
+
+/*
+ * Runs the program that has been generated right away, inside the
+ * compiler's process, with the backend. The program's exit code is the
+ * process' exit code, this only returns -1 if it couldn't be run.
+ * */
+int
+codegen_run(struct codegen_ctx *ctx, enum codegen_backend backend);
 
 /*
  * Finishes the codegen process without generating any assembly.
  * */
 void
-codegen_destroy(void);
+codegen_destroy(struct codegen_ctx *ctx);
 
 /*
  * Reset the temporary address counter. Should be used before processing
  * commands.
  * */
 void
-codegen_reset_tmp(void);
+codegen_reset_tmp(struct codegen_ctx *ctx);
 
 /*
  * Adds an unitialized value. It works more like a reservation: storage is
@@ -56,109 +243,134 @@ codegen_reset_tmp(void);
  * use of unitialized values is safe.
  * */
 void
-codegen_add_unnit_value(enum symbol_type type, struct codegen_value_info *info);
+codegen_add_unnit_value(struct codegen_ctx *ctx,
+                        enum symbol_type type,
+                        struct codegen_value_info *info);
 
 /*
- * Adds an initialized value.
+ * Adds an initialized value. The lexeme doesn't need to be null terminated,
+ * it has lexeme_size characters.
  *
  * Address and other information is stored in info.
  *
  * Variables that are initialized are placed in .data.
- * Constants are placed in .rodata.
+ * Constant strings are placed in .rodata, other constants are folded.
  * */
 void
-codegen_add_value(enum symbol_type type,
+codegen_add_value(struct codegen_ctx *ctx,
+                  enum symbol_type type,
                   enum symbol_class class,
                   uint8_t has_minus,
                   const char *lexeme,
+                  uint32_t lexeme_size,
                   struct codegen_value_info *info);
 
 /*
- * Adds an initialized value to temporary storage (first 64kB of .bss).
+ * Adds a literal, which is folded unless it's a string. Strings go to
+ * .rodata. The lexeme doesn't need to be null terminated, it has
+ * lexeme_size characters.
  * */
 void
-codegen_add_tmp(enum symbol_type type,
+codegen_add_tmp(struct codegen_ctx *ctx,
+                enum symbol_type type,
                 const char *lexeme,
+                uint32_t lexeme_size,
                 struct codegen_value_info *info);
 
 /*
  * Generates code to negate the boolean value at f.
  * */
 void
-codegen_logic_negate(struct codegen_value_info *f);
+codegen_logic_negate(struct codegen_ctx *ctx, struct codegen_value_info *f);
 
 /*
  * Generates code to convert the integer at info to float.
  * */
 void
-codegen_convert_to_floating_point(struct codegen_value_info *info);
+codegen_convert_to_floating_point(struct codegen_ctx *ctx,
+                                  struct codegen_value_info *info);
 
 /*
  * Generates code to convert the float at info to integer.
  * */
 void
-codegen_convert_to_integer(struct codegen_value_info *info);
+codegen_convert_to_integer(struct codegen_ctx *ctx,
+                           struct codegen_value_info *info);
 
 /*
  * Generates code to perform the addition of exps_info and t_info.
  * */
 void
-codegen_perform_addition(struct codegen_value_info *exps_info,
+codegen_perform_addition(struct codegen_ctx *ctx,
+                         struct codegen_value_info *exps_info,
                          const struct codegen_value_info *t_info);
 
 /*
  * Generates code to perform the subtraction of exps_info and t_info.
  * */
 void
-codegen_perform_subtraction(struct codegen_value_info *exps_info,
+codegen_perform_subtraction(struct codegen_ctx *ctx,
+                            struct codegen_value_info *exps_info,
                             const struct codegen_value_info *t_info);
 
 /*
- * Generates code to perform the logical or of exps_info and t_info.
+ * Generates code to start the && or || (operation_tok) of lhs_info and an
+ * operand that comes next. The code of the right operand is skipped when
+ * lhs_info decides the result.
  * */
 void
-codegen_perform_logical_or(struct codegen_value_info *exps_info,
-                           const struct codegen_value_info *t_info);
+codegen_start_logical(struct codegen_ctx *ctx,
+                      enum token operation_tok,
+                      struct codegen_logical *logical,
+                      const struct codegen_value_info *lhs_info);
+
+/*
+ * Generates code to finish a logical started with codegen_start_logical,
+ * once the code of rhs_info has been generated. The result is kept in
+ * lhs_info.
+ * */
+void
+codegen_finish_logical(struct codegen_ctx *ctx,
+                       const struct codegen_logical *logical,
+                       struct codegen_value_info *lhs_info,
+                       const struct codegen_value_info *rhs_info);
 
 /*
  * Generates code to negate the integer / float value in t_info.
  * */
 void
-codegen_negate(struct codegen_value_info *t_info);
+codegen_negate(struct codegen_ctx *ctx, struct codegen_value_info *t_info);
 
 /*
  * Generates code to perform the multiplication of t_info and f_info.
  * */
 void
-codegen_perform_multiplication(struct codegen_value_info *t_info,
+codegen_perform_multiplication(struct codegen_ctx *ctx,
+                               struct codegen_value_info *t_info,
                                const struct codegen_value_info *f_info);
 
 /*
  * Generates code to perform the division of t_info and f_info.
  * */
 void
-codegen_perform_division(struct codegen_value_info *t_info,
+codegen_perform_division(struct codegen_ctx *ctx,
+                         struct codegen_value_info *t_info,
                          const struct codegen_value_info *f_info);
 
 /*
  * Generates code to perform the integer division of t_info and f_info.
  * */
 void
-codegen_perform_integer_division(struct codegen_value_info *t_info,
+codegen_perform_integer_division(struct codegen_ctx *ctx,
+                                 struct codegen_value_info *t_info,
                                  const struct codegen_value_info *f_info);
 
 /*
  * Generates code to perform the mod of t_info and f_info.
  * */
 void
-codegen_perform_mod(struct codegen_value_info *t_info,
-                    const struct codegen_value_info *f_info);
-
-/*
- * Generates code to perform the logical and of t_info and f_info.
- * */
-void
-codegen_perform_and(struct codegen_value_info *t_info,
+codegen_perform_mod(struct codegen_ctx *ctx,
+                    struct codegen_value_info *t_info,
                     const struct codegen_value_info *f_info);
 
 /*
@@ -166,7 +378,8 @@ codegen_perform_and(struct codegen_value_info *t_info,
  * The kind of comparison that'll be made depends on operation_tok.
  * */
 void
-codegen_perform_comparison(enum token operation_tok,
+codegen_perform_comparison(struct codegen_ctx *ctx,
+                           enum token operation_tok,
                            struct codegen_value_info *exp_info,
                            const struct codegen_value_info *exps_info);
 
@@ -175,7 +388,8 @@ codegen_perform_comparison(enum token operation_tok,
  * the storage of a variable.
  * */
 void
-codegen_move_to_id_entry(struct symbol *id_entry,
+codegen_move_to_id_entry(struct codegen_ctx *ctx,
+                         struct symbol *id_entry,
                          const struct codegen_value_info *exp);
 
 /*
@@ -183,7 +397,8 @@ codegen_move_to_id_entry(struct symbol *id_entry,
  * the storage of a variable at specific index.
  * */
 void
-codegen_move_to_id_entry_idx(struct symbol *id_entry,
+codegen_move_to_id_entry_idx(struct codegen_ctx *ctx,
+                             struct symbol *id_entry,
                              const struct codegen_value_info *exp,
                              const struct codegen_value_info *idx_expr_info);
 
@@ -192,64 +407,76 @@ codegen_move_to_id_entry_idx(struct symbol *id_entry,
  * Uses the write syscall, with fd = 1 = stdout.
  * */
 void
-codegen_write(const struct codegen_value_info *exp, uint8_t needs_new_line);
+codegen_write(struct codegen_ctx *ctx,
+              const struct codegen_value_info *exp,
+              uint8_t needs_new_line);
 
 /*
  * Generates code to move a value at an specific index of the variable to
- * temporary storage.
+ * a temporary.
  * */
 void
-codegen_move_idx_to_tmp(const struct symbol *id_entry,
+codegen_move_idx_to_tmp(struct codegen_ctx *ctx,
+                        const struct symbol *id_entry,
                         const struct codegen_value_info *idx_expr_info,
                         struct codegen_value_info *f_info);
 
 /*
- * Generates code to start a loop.
+ * Generates code to start a loop. The labels of the loop are kept in loop,
+ * which has to be passed to the functions that continue it, so that loops
+ * can be nested.
  * */
 void
-codegen_start_loop(void);
+codegen_start_loop(struct codegen_ctx *ctx, struct codegen_loop *loop);
 
 /*
  * Generates code to evaluate a loop's expression.
  * */
 void
-codegen_eval_loop_expr(const struct codegen_value_info *exp);
+codegen_eval_loop_expr(struct codegen_ctx *ctx,
+                       struct codegen_loop *loop,
+                       const struct codegen_value_info *exp);
 
 /*
  * Generates code to finish a loop.
  * */
 void
-codegen_finish_loop(void);
+codegen_finish_loop(struct codegen_ctx *ctx, const struct codegen_loop *loop);
 
 /*
- * Generates code start an if.
+ * Generates code start an if. Like loops, the labels of the if are kept in
+ * if_info.
  * */
 void
-codegen_start_if(const struct codegen_value_info *exp);
+codegen_start_if(struct codegen_ctx *ctx,
+                 struct codegen_if *if_info,
+                 const struct codegen_value_info *exp);
 
 /*
  * Generates code to perform the if jmp.
  * */
 void
-codegen_if_jmp(void);
+codegen_if_jmp(struct codegen_ctx *ctx, const struct codegen_if *if_info);
 
 /*
  * Generates code to start an else.
  * */
 void
-codegen_start_else(void);
+codegen_start_else(struct codegen_ctx *ctx, const struct codegen_if *if_info);
 
 /*
  * Generates code to finish an if / else.
  * */
 void
-codegen_finish_if(uint8_t had_else);
+codegen_finish_if(struct codegen_ctx *ctx,
+                  const struct codegen_if *if_info,
+                  uint8_t had_else);
 
 /*
  * Reads a value into a variable.
  * Uses read syscall, with fd = 0 = stdin.
  * */
 void
-codegen_read_into(struct symbol *id_entry);
+codegen_read_into(struct codegen_ctx *ctx, struct symbol *id_entry);
 
 #endif
@@ -0,0 +1,85 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef COMPILE_H_
+#define COMPILE_H_
+
+#include "codegen.h"
+#include "file.h"
+#include "lexer.h"
+#include "symbol_table.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * What is done with a program once it's compiled, see main.c for what each
+ * option means.
+ * */
+struct compile_options
+{
+    uint8_t keep_unoptimized;
+    uint8_t emit_object;
+    uint8_t assemble_and_link;
+    /* Runs the program instead of writing any file. */
+    uint8_t run;
+    enum codegen_backend backend;
+    /* Threads the lexer may use, 0 lets it pick. */
+    uint32_t lexer_threads;
+};
+
+/*
+ * Compiles the program at pathname, from reading it to writing its output
+ * files next to the working directory, named after the file. Everything the
+ * compiler has to say about it is printed to diagnostics.
+ *
+ * Nothing is shared between calls, so many files can be compiled at the same
+ * time on different threads, as long as they aren't run.
+ *
+ * Returns 0 if the program was compiled and its files were written, -1
+ * otherwise. With options->run, it only returns if the program couldn't be
+ * run.
+ * */
+int
+compile_file(const char *pathname,
+             const struct compile_options *options,
+             FILE *diagnostics);
+
+/*
+ * Memory a compilation needs that can be kept for the next one, so that a
+ * process compiling many programs doesn't allocate it every time. A set of
+ * buffers is only used by one compilation at a time.
+ * */
+struct compile_buffers
+{
+    struct symbol_table table;
+    struct token_buffer tokens;
+};
+
+int
+compile_buffers_create(struct compile_buffers *buffers);
+
+void
+compile_buffers_destroy(struct compile_buffers *buffers);
+
+/*
+ * Same as compile_file, for a source that has already been read. Its output
+ * files are named after name, which may include the directory they go to.
+ * */
+int
+compile_source(const struct file *source,
+               const char *name,
+               const struct compile_options *options,
+               FILE *diagnostics,
+               struct compile_buffers *buffers);
+
+/*
+ * Prints the pathname of every file compile_source writes for name with
+ * options, one per line.
+ * */
+void
+compile_print_outputs(const char *name,
+                      const struct compile_options *options,
+                      FILE *stream);
+
+#endif
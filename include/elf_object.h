@@ -0,0 +1,34 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef ELF_OBJECT_H_
+#define ELF_OBJECT_H_
+
+#include "x86_64.h"
+
+/*
+ * Encodes the assembled program as an ELF64 relocatable object, ready to be
+ * linked with ld. It has .text, .data, .bss and .rodata, the relocations of
+ * .text and the same symbols NASM would write: _start as the only global one
+ * and the labels of the memory areas as locals.
+ *
+ * The file is returned in *file, which the caller frees, and its size in
+ * *file_size. Returns -1 if it can't be allocated.
+ * */
+int
+elf_object_encode(const struct x86_64_object *object,
+                  uint8_t **file,
+                  uint64_t *file_size);
+
+/*
+ * Encodes the assembled program as a static executable, laid out and
+ * relocated without a linker, returned like elf_object_encode does. It only
+ * depends on the kernel: .text, .rodata and .data with .bss are loaded in
+ * their own segments and the program starts at _start.
+ * */
+int
+elf_executable_encode(const struct x86_64_object *object,
+                      uint8_t **file,
+                      uint64_t *file_size);
+
+#endif
@@ -8,25 +8,46 @@
 
 struct file
 {
-    char *buffer;
-    uint32_t size;
+    const char *buffer;
+    uint64_t size;
+    /* Set when buffer is a read-only mapping of the file, otherwise buffer
+     * was allocated with malloc. */
+    uint8_t is_mapped;
 };
 
 /*
  * Reads input from stdin. Since we can't know the size of the input
- * beforehand, a capacity needs to be specified for the allocated buffer.
+ * beforehand, it's read in chunks into a buffer that grows as needed.
  * */
 int
-read_file_from_stdin(struct file *file, uint32_t capacity);
+read_file_from_stdin(struct file *file);
 
 /*
  * Reads a file at pathname.
+ *
+ * Regular files are mapped read-only into memory, so no copy is made and
+ * there is no limit to their size. Anything else (pipes, character devices...)
+ * is read in chunks, just like stdin.
  * */
 int
 read_file(struct file *file, const char *pathname);
 
 /*
- * Destroys the file by deallocating it's buffer.
+ * Writes size bytes of buffer to the file at pathname, replacing any file
+ * that was there. The whole buffer is handed to the kernel at once, it's only
+ * split if the kernel doesn't take it all.
+ * */
+int
+write_file(const char *pathname, const void *buffer, uint64_t size);
+
+/*
+ * Same as write_file, but the file is recreated with execute permission.
+ * */
+int
+write_executable_file(const char *pathname, const void *buffer, uint64_t size);
+
+/*
+ * Destroys the file by unmapping or deallocating it's buffer.
  * */
 void
 destroy_file(struct file *file);
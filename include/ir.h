@@ -0,0 +1,395 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef IR_H_
+#define IR_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * In-memory representation of the generated program. The code generator
+ * appends records to it as the parser goes, and the assembly text is only
+ * printed from it once everything has been generated.
+ *
+ * Instructions map one to one to x86-64 instructions (in NASM syntax), the
+ * rest of the records are the labels, data, section switches and comments
+ * that go around them.
+ * */
+
+enum ir_opcode
+{
+    /* Not instructions. */
+    IR_OPCODE_SECTION,
+    IR_OPCODE_LABEL,
+    IR_OPCODE_COMMENT,
+    /* Reserves zeroed storage in .bss. */
+    IR_OPCODE_RESERVE,
+    /* Initialized storage in .data or .rodata. */
+    IR_OPCODE_DATA,
+    /* Removed by an optimization, it's neither printed nor assembled. */
+    IR_OPCODE_DELETED,
+
+    IR_OPCODE_MOV,
+    /* Between two registers it's movaps, which copies the whole register
+     * instead of merging into it, so it doesn't wait for the destination's
+     * last value. */
+    IR_OPCODE_MOVSS,
+    IR_OPCODE_ADD,
+    IR_OPCODE_SUB,
+    IR_OPCODE_IMUL,
+    IR_OPCODE_IDIV,
+    IR_OPCODE_NEG,
+    IR_OPCODE_CMP,
+    IR_OPCODE_COMISS,
+    IR_OPCODE_ADDSS,
+    IR_OPCODE_SUBSS,
+    IR_OPCODE_MULSS,
+    IR_OPCODE_DIVSS,
+    /* Only between registers, xorps of a register with itself zeroes it
+     * whatever it held, unlike subss with NaN or infinity. */
+    IR_OPCODE_XORPS,
+    IR_OPCODE_CVTSI2SS,
+    IR_OPCODE_CVTSS2SI,
+    IR_OPCODE_ROUNDSS,
+    IR_OPCODE_CDQ,
+    IR_OPCODE_CDQE,
+    IR_OPCODE_PUSH,
+    IR_OPCODE_POP,
+    IR_OPCODE_JMP,
+    /* Conditional jump, see ir_instruction.condition. */
+    IR_OPCODE_JCC,
+    /* Sets a byte to whether the condition holds, see
+     * ir_instruction.condition. */
+    IR_OPCODE_SETCC,
+    IR_OPCODE_SYSCALL,
+};
+
+enum ir_condition
+{
+    IR_CONDITION_E,
+    IR_CONDITION_NE,
+    IR_CONDITION_L,
+    IR_CONDITION_LE,
+    IR_CONDITION_G,
+    IR_CONDITION_GE,
+    IR_CONDITION_B,
+    IR_CONDITION_BE,
+    IR_CONDITION_A,
+    IR_CONDITION_AE,
+};
+
+enum ir_section
+{
+    IR_SECTION_TEXT,
+    IR_SECTION_BSS,
+    IR_SECTION_DATA,
+    IR_SECTION_RODATA,
+};
+
+/*
+ * Registers are numbered like the processor numbers them, the size of the
+ * part that is used is kept in the operand.
+ * */
+enum ir_register
+{
+    IR_REGISTER_A,
+    IR_REGISTER_C,
+    IR_REGISTER_D,
+    IR_REGISTER_B,
+    IR_REGISTER_SP,
+    IR_REGISTER_BP,
+    IR_REGISTER_SI,
+    IR_REGISTER_DI,
+    IR_REGISTER_R8,
+    IR_REGISTER_R9,
+    IR_REGISTER_R10,
+    IR_REGISTER_R11,
+    IR_REGISTER_R12,
+    IR_REGISTER_R13,
+    IR_REGISTER_R14,
+    IR_REGISTER_R15,
+    IR_REGISTER_XMM0,
+    IR_REGISTER_XMM15 = IR_REGISTER_XMM0 + 15,
+};
+
+/*
+ * Size of the temporary storage at the beginning of .bss.
+ * */
+#define IR_TMP_SIZE 0x10000U
+
+/*
+ * Where memory operands and addresses point to. Every base but
+ * IR_BASE_REGISTER is the label at the beginning of one of the program's
+ * memory areas.
+ * */
+enum ir_base
+{
+    /* Temporary storage, the first 64kB of .bss. */
+    IR_BASE_TMP,
+    /* Rest of .bss. */
+    IR_BASE_UNNIT_MEM,
+    /* .data */
+    IR_BASE_INIT_MEM,
+    /* .rodata */
+    IR_BASE_CONST_MEM,
+    /* The address is in a register. */
+    IR_BASE_REGISTER,
+};
+
+enum ir_operand_kind
+{
+    IR_OPERAND_NONE,
+    IR_OPERAND_REGISTER,
+    IR_OPERAND_MEMORY,
+    IR_OPERAND_IMMEDIATE,
+    /* An address used as an immediate, like in mov esi, TMP + 8. */
+    IR_OPERAND_ADDRESS,
+    IR_OPERAND_LABEL,
+    /* Value of an expression, see ir_new_temporary. The register allocator
+     * replaces every one of them with a register or memory, nothing else
+     * ever sees them. */
+    IR_OPERAND_TEMPORARY,
+};
+
+struct ir_operand
+{
+    uint8_t kind;
+    /* Size in bytes of a register or of the memory that is accessed. */
+    uint8_t size;
+    /* Register of IR_OPERAND_REGISTER, or holding the address of memory
+     * operands based on IR_BASE_REGISTER. */
+    uint8_t reg;
+    /* Size in bytes of the register holding an address. */
+    uint8_t reg_size;
+    /* enum ir_base of memory and address operands. */
+    uint8_t base;
+    /* Immediate value, offset from the base or label. */
+    int64_t value;
+};
+
+enum ir_data_kind
+{
+    /* One byte, in value. */
+    IR_DATA_BYTE,
+    /* Four bytes, in value. */
+    IR_DATA_DWORD,
+    /* Four bytes with the bits of a float, in value. */
+    IR_DATA_FLOAT,
+    /* count bytes, in bytes. */
+    IR_DATA_STRING,
+};
+
+struct ir_data
+{
+    /* Offset from the beginning of the memory area. */
+    uint64_t address;
+    /* Total size, anything past the initialized bytes is zeroed. */
+    uint32_t size;
+    uint32_t align;
+    /* enum ir_section, .data or .rodata. */
+    uint8_t section;
+    uint8_t kind;
+    uint32_t count;
+    union
+    {
+        uint32_t value;
+        const uint8_t *bytes;
+    };
+};
+
+#define IR_MAX_OPERANDS 3
+
+struct ir_instruction
+{
+    uint8_t opcode;
+    /* enum ir_condition of IR_OPCODE_JCC and IR_OPCODE_SETCC. */
+    uint8_t condition;
+    union
+    {
+        struct ir_operand operands[IR_MAX_OPERANDS];
+        /* IR_OPCODE_COMMENT, a string that outlives the program. */
+        const char *comment;
+        /* IR_OPCODE_SECTION. */
+        uint8_t section;
+        /* IR_OPCODE_RESERVE and IR_OPCODE_DATA. */
+        struct ir_data data;
+    };
+};
+
+/*
+ * Records are allocated in blocks that are never reallocated, in the order
+ * they were appended.
+ * */
+#define IR_BLOCK_SIZE 256U
+
+struct ir_block
+{
+    struct ir_block *next;
+    uint32_t count;
+    struct ir_instruction instructions[IR_BLOCK_SIZE];
+};
+
+/*
+ * Bytes of strings are copied into blocks of this size, one after the other.
+ * */
+#define IR_BYTES_BLOCK_SIZE (16U * 1024U)
+
+struct ir_bytes_block
+{
+    struct ir_bytes_block *next;
+    uint32_t used;
+    uint8_t bytes[IR_BYTES_BLOCK_SIZE];
+};
+
+/*
+ * Memory of a temporary that isn't given a register.
+ * */
+struct ir_temporary
+{
+    /* enum ir_base, never IR_BASE_REGISTER. */
+    uint8_t base;
+    uint64_t address;
+};
+
+struct ir
+{
+    struct ir_block *first_block;
+    struct ir_block *last_block;
+    struct ir_bytes_block *bytes;
+    uint32_t label_count;
+    /* Where every temporary is kept when it doesn't get a register. */
+    struct ir_temporary *temporaries;
+    uint32_t temporary_count;
+    uint32_t temporary_capacity;
+    /* Set when memory ran out while appending, the program is incomplete. */
+    uint8_t failed;
+};
+
+static inline struct ir_operand
+ir_register(enum ir_register reg, uint8_t size)
+{
+    return (struct ir_operand){
+        .kind = IR_OPERAND_REGISTER, .size = size, .reg = reg};
+}
+
+static inline struct ir_operand
+ir_memory(enum ir_base base, int64_t offset, uint8_t size)
+{
+    return (struct ir_operand){
+        .kind = IR_OPERAND_MEMORY, .size = size, .base = base, .value = offset};
+}
+
+/*
+ * Memory at the address held by reg, which has reg_size bytes.
+ * */
+static inline struct ir_operand
+ir_register_memory(enum ir_register reg, uint8_t reg_size, uint8_t size)
+{
+    return (struct ir_operand){.kind = IR_OPERAND_MEMORY,
+                               .size = size,
+                               .reg = reg,
+                               .reg_size = reg_size,
+                               .base = IR_BASE_REGISTER};
+}
+
+static inline struct ir_operand
+ir_immediate(int64_t value)
+{
+    return (struct ir_operand){.kind = IR_OPERAND_IMMEDIATE, .value = value};
+}
+
+static inline struct ir_operand
+ir_address(enum ir_base base, int64_t offset)
+{
+    return (struct ir_operand){
+        .kind = IR_OPERAND_ADDRESS, .base = base, .value = offset};
+}
+
+static inline struct ir_operand
+ir_label(uint32_t label)
+{
+    return (struct ir_operand){.kind = IR_OPERAND_LABEL, .value = label};
+}
+
+/*
+ * The temporary number temporary, accessed size bytes at a time. Either
+ * IR_OPERAND_REGISTER or IR_OPERAND_MEMORY once registers are allocated.
+ * */
+static inline struct ir_operand
+ir_temporary(uint32_t temporary, uint8_t size)
+{
+    return (struct ir_operand){
+        .kind = IR_OPERAND_TEMPORARY, .size = size, .value = temporary};
+}
+
+void
+ir_init(struct ir *ir);
+
+/*
+ * Appends a record to the end of the program and returns it, zeroed.
+ * Returns NULL and sets ir->failed if there's no memory for it.
+ * */
+struct ir_instruction *
+ir_append(struct ir *ir);
+
+/*
+ * Copies size bytes into the program's storage, so that data records can
+ * point to them. Returns NULL and sets ir->failed if there's no memory for
+ * them.
+ * */
+const uint8_t *
+ir_copy_bytes(struct ir *ir, const void *bytes, uint32_t size);
+
+/*
+ * Returns a label that hasn't been used yet.
+ * */
+static inline uint32_t
+ir_new_label(struct ir *ir)
+{
+    return ir->label_count++;
+}
+
+/*
+ * Returns a temporary that hasn't been used yet, kept at address from base
+ * if it's not given a register. Sets ir->failed if there's no memory for
+ * it.
+ * */
+uint32_t
+ir_new_temporary(struct ir *ir, enum ir_base base, uint64_t address);
+
+/*
+ * Whether the record is an instruction or a label, the others keep
+ * something else where the operands would be.
+ * */
+uint8_t
+ir_has_operands(const struct ir_instruction *instruction);
+
+/*
+ * Whether the operand at index is in an xmm register when it's a register.
+ * */
+uint8_t
+ir_is_float_operand(const struct ir_instruction *instruction, uint32_t index);
+
+/*
+ * Name of the label at the beginning of the memory area.
+ * */
+const char *
+ir_base_name(enum ir_base base);
+
+/*
+ * Prints a record as NASM assembly, followed by a new line.
+ * */
+void
+ir_print_instruction(const struct ir_instruction *instruction, FILE *file);
+
+/*
+ * Prints every record of the program, in order.
+ * */
+void
+ir_print(const struct ir *ir, FILE *file);
+
+void
+ir_destroy(struct ir *ir);
+
+#endif
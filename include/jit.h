@@ -0,0 +1,20 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef JIT_H_
+#define JIT_H_
+
+#include "x86_64.h"
+
+/*
+ * Runs the assembled program inside the compiler's process.
+ *
+ * The sections are loaded into a single mapping in the low 2GB, since the
+ * generated code addresses memory with 32 bit addresses, and the program
+ * starts at _start. It ends with the exit syscall, so this only returns -1
+ * if the program couldn't be loaded.
+ * */
+int
+jit_run(const struct x86_64_object *object);
+
+#endif
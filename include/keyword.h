@@ -0,0 +1,22 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef KEYWORD_H_
+#define KEYWORD_H_
+
+#include "token.h"
+
+#include <stdint.h>
+
+/*
+ * Checks whether the lexeme, which has lexeme_size characters and doesn't
+ * need to be null terminated, is one of l's keywords. Upper and lower case
+ * characters are *not* distinguished.
+ *
+ * Returns the keyword's token, or TOKEN_IDENTIFIER if it isn't a keyword.
+ * true and false are returned as TOKEN_CONSTANT.
+ * */
+enum token
+keyword_lookup(const char *lexeme, uint32_t lexeme_size);
+
+#endif
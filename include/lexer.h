@@ -8,6 +8,7 @@
 #include "token.h"
 
 #include <stdint.h>
+#include <stdio.h>
 
 enum lexer_state
 {
@@ -45,7 +46,8 @@ enum lexer_error
     LEXER_ERROR_NONE,
     LEXER_ERROR_UNEXPECTED_EOF,
     LEXER_ERROR_INVALID_LEXEME,
-    LEXER_ERROR_INVALID_CHARACTER
+    LEXER_ERROR_INVALID_CHARACTER,
+    LEXER_ERROR_LEXEME_TOO_BIG
 };
 
 enum constant_type
@@ -57,9 +59,13 @@ enum constant_type
     CONSTANT_TYPE_FLOAT
 };
 
+/*
+ * Lexemes are never copied out of the source. A lexeme is the span of
+ * size characters that starts at offset in the file's buffer.
+ * */
 struct lexeme
 {
-    char buffer[MAX_LEXEME_SIZE + 1];
+    uint64_t offset;
     uint32_t size;
 };
 
@@ -67,10 +73,12 @@ struct lexer
 {
     const struct file *file;
     struct symbol_table *symbol_table;
-    enum lexer_state state;
+    /* Where errors are printed, ERR_STREAM unless it's changed after
+     * lexer_init. */
+    FILE *diagnostics;
     enum lexer_error error;
     struct lexeme lexeme;
-    uint32_t cursor;
+    uint64_t cursor;
     uint32_t line;
 };
 
@@ -86,6 +94,34 @@ struct lexical_entry
     uint8_t is_new_identifier;
 };
 
+/*
+ * Every token of a file, as a structure of arrays. Index i of every array
+ * describes the i-th token.
+ *
+ * There is one more entry than count in every array, describing where the
+ * lexer stopped: the contents of the lexical_entry after the last call to
+ * lexer_get_next_token, and the lexer's line at that point.
+ * */
+struct token_buffer
+{
+    uint8_t *tokens;            /* enum token */
+    uint8_t *constant_types;    /* enum constant_type */
+    uint8_t *is_new_identifier;
+    uint32_t *lines;
+    /* The lexer's line right after the token was found, which is what
+     * errors about the token report. */
+    uint32_t *lexer_lines;
+    uint64_t *lexeme_offsets;
+    uint32_t *lexeme_sizes;
+    struct symbol **symbols;
+    uint32_t count;
+    uint32_t capacity;
+    /* LEXER_RESULT_EMPTY if the whole file was read, LEXER_RESULT_ERROR if
+     * the lexer stopped at an error. In that case, the lexer still has the
+     * error's information. */
+    enum lexer_result result;
+};
+
 /*
  * Sets up the lexer structure.
  * */
@@ -104,6 +140,54 @@ lexer_init(struct lexer *lexer,
 enum lexer_result
 lexer_get_next_token(struct lexer *lexer, struct lexical_entry *entry);
 
+/*
+ * Lexes the whole file at once into tokens, stopping at the first error.
+ * tokens must be zeroed, or a buffer from an earlier call, whose arrays are
+ * then reused.
+ *
+ * Returns -1 if the buffer couldn't be allocated, otherwise 0. In that case,
+ * the buffer is destroyed.
+ * */
+int
+lexer_tokenize_all(struct lexer *lexer, struct token_buffer *tokens);
+
+/*
+ * Same as lexer_tokenize_all, but the file is split into chunks at new lines
+ * and the chunks are lexed on up to threads threads, each with its own
+ * symbol table. The results are then stitched together and the identifiers
+ * merged into the lexer's symbol table, so tokens, lines, symbols and errors
+ * end up exactly as lexer_tokenize_all would leave them.
+ *
+ * If threads is 0, it's picked from the number of processors and the size
+ * of the file. Small files are always lexed on the calling thread.
+ * */
+int
+lexer_tokenize_all_parallel(struct lexer *lexer,
+                            struct token_buffer *tokens,
+                            uint32_t threads);
+
+/*
+ * Makes sure the buffer has room for at least capacity tokens.
+ * Returns -1 if the buffer couldn't be allocated, otherwise 0.
+ * */
+int
+token_buffer_reserve(struct token_buffer *tokens, uint32_t capacity);
+
+/*
+ * Fills entry with the information of the token at index, which can be at
+ * most tokens->count.
+ * */
+void
+token_buffer_get(const struct token_buffer *tokens,
+                 uint32_t index,
+                 struct lexical_entry *entry);
+
+/*
+ * Deallocates the arrays of the buffer.
+ * */
+void
+token_buffer_destroy(struct token_buffer *tokens);
+
 /*
  * If the last call to lexer_get_next_token returned LEXER_RESULT_ERROR,
  * this function will report the error that happened to ERR_STREAM.
@@ -111,6 +195,13 @@ lexer_get_next_token(struct lexer *lexer, struct lexical_entry *entry);
 void
 lexer_print_error(const struct lexer *lexer);
 
+/*
+ * Returns a pointer to the first character of lexeme inside the source.
+ * The lexeme is *not* null terminated, it has exactly lexeme->size characters.
+ * */
+const char *
+lexer_lexeme_start(const struct lexer *lexer, const struct lexeme *lexeme);
+
 /*
  * Returned a lexeme from a token. Some tokens only have one lexeme and this
  * function will return it.
@@ -0,0 +1,55 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef PROMOTE_H_
+#define PROMOTE_H_
+
+#include "ir.h"
+
+#include <stdint.h>
+
+/*
+ * Promotion of the variables used in loops to temporaries, so that the
+ * register allocator (see regalloc.h) can keep them in registers while the
+ * loop runs.
+ *
+ * A promoted variable is loaded into its temporary right before the loop's
+ * start label and stored back right after its end label, the loop's only
+ * way out. The temporary is kept at the variable itself when it doesn't get
+ * a register, and the loop is left as it was.
+ *
+ * Only loops the code generator vouches for are promoted: scalar variables
+ * are accessed directly, by their address, everywhere but through string
+ * indexes past the end of a string, so loops writing to a string index
+ * aren't given here. Variables accessed with different sizes or as both
+ * integers and floats are left in memory.
+ * */
+
+/*
+ * A loop of the program, from the instruction at start_label to the one at
+ * end_label. Nothing else jumps into it, and it's only left through
+ * end_label.
+ * */
+struct promote_loop
+{
+    uint32_t start_label;
+    uint32_t end_label;
+};
+
+struct promote_stats
+{
+    uint32_t loops;
+    uint32_t variables;
+};
+
+/*
+ * Promotes the variables of the loops, which must be nested in one
+ * another or not overlap at all. Returns -1 if there's no memory for it.
+ * */
+int
+promote_run(struct ir *ir,
+            const struct promote_loop *loops,
+            uint32_t count,
+            struct promote_stats *stats);
+
+#endif
@@ -0,0 +1,38 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef REGALLOC_H_
+#define REGALLOC_H_
+
+#include "ir.h"
+
+#include <stdint.h>
+
+/*
+ * Linear scan register allocation of the temporaries of a program (see
+ * ir_new_temporary), after Poletto and Sarkar.
+ *
+ * A temporary lives from the first to the last instruction that uses it, in
+ * program order, stretched to the end of every loop it's live at the
+ * beginning of. Integer temporaries get r8 to r15 but r11, floats get xmm4
+ * to xmm15: the code generator keeps its own work in the registers below
+ * them, and syscall overwrites r11. When a class runs out, the temporary
+ * that lives the longest stays in memory (see struct ir_temporary), and
+ * moves between it and that memory are dropped.
+ * */
+
+struct regalloc_stats
+{
+    uint32_t temporaries;
+    /* Temporaries left in memory. */
+    uint32_t spilled;
+};
+
+/*
+ * Replaces every temporary of the program with its register or memory.
+ * Returns -1 if there's no memory for it, the program is left untouched.
+ * */
+int
+regalloc_run(struct ir *ir, struct regalloc_stats *stats);
+
+#endif
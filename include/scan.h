@@ -0,0 +1,63 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stdint.h>
+
+/*
+ * Vectorized kernels used by the lexer to go through the boring parts of the
+ * source (comments, indentation and string constants) many bytes at a time.
+ *
+ * Every kernel starts at cursor and returns the offset of the first byte the
+ * lexer has to look at by itself. That byte is never past size, but the
+ * kernels are allowed to stop early (on bytes that are rare but not
+ * necessarily interesting, or when less than a whole vector is left), so the
+ * byte at the returned offset must still go through the lexer's state
+ * machine. Bytes that are not part of the alphabet always stop a kernel.
+ *
+ * The best kernels for the running CPU (AVX2 or SSE2) are picked once, when
+ * the program starts.
+ * */
+
+/*
+ * Skips the inside of a comment, stopping at the next '*'.
+ * The number of new lines skipped is stored in new_lines.
+ * */
+uint64_t
+scan_comment(const char *buffer,
+             uint64_t cursor,
+             uint64_t size,
+             uint64_t *new_lines);
+
+/*
+ * Skips spaces and new lines.
+ * The number of new lines skipped is stored in new_lines.
+ * */
+uint64_t
+scan_whitespace(const char *buffer,
+                uint64_t cursor,
+                uint64_t size,
+                uint64_t *new_lines);
+
+/*
+ * Skips the inside of a string constant, stopping at the next '"' or new
+ * line.
+ * */
+uint64_t
+scan_string(const char *buffer, uint64_t cursor, uint64_t size);
+
+/*
+ * Counts the new lines in the size bytes starting at buffer.
+ * */
+uint64_t
+scan_count_new_lines(const char *buffer, uint64_t size);
+
+/*
+ * Name of the kernels that were picked for the running CPU.
+ * */
+const char *
+scan_kernels_name(void);
+
+#endif
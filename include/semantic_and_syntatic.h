@@ -18,16 +18,26 @@ enum syntatic_result
 struct syntatic_ctx
 {
     struct lexer *lexer;
+    const struct token_buffer *tokens;
+    /* Where the code of the program goes. */
+    struct codegen_ctx *codegen;
+    /* Index of entry in tokens. */
+    uint32_t index;
     struct lexical_entry entry;
     struct lexical_entry last_entry;
     uint8_t found_last_token;
 };
 
 /*
- * Initializes the syntatic_ctx structure.
+ * Initializes the syntatic_ctx structure. tokens must have been filled by
+ * lexer_tokenize_all with lexer, and have at least one token. The code is
+ * generated into codegen, which must have been initialized.
  * */
 void
-syntatic_init(struct syntatic_ctx *ctx, struct lexer *lexer);
+syntatic_init(struct syntatic_ctx *ctx,
+              struct lexer *lexer,
+              const struct token_buffer *tokens,
+              struct codegen_ctx *codegen);
 
 /*
  * Kickstarts the syntatic analysis.
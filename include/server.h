@@ -0,0 +1,82 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "compile.h"
+
+#include <stdint.h>
+
+/*
+ * Compile server, a long-lived compiler that takes programs from clients
+ * connected to a Unix socket. Clients don't pay for starting a process, and
+ * the server keeps what it has already set up: the compile buffers (see
+ * compile.h) are pooled and handed from one request to the next, and the
+ * cache (see cache.h) only identifies the compiler once.
+ *
+ * Every connection is served by its own thread and may carry any number of
+ * requests, one after the other. A request is a struct server_request
+ * followed by the program's pathname, the client's working directory and,
+ * for inline sources, the source itself. Relative pathnames are taken from
+ * the client's working directory, and outputs are written there.
+ *
+ * The reply is a struct server_reply followed by the diagnostics, exactly
+ * as compile_file would print them, and the pathnames of the outputs, one
+ * per line. Both ends are the same compiler on the same machine, so the
+ * structures are sent as they are, and SERVER_MAGIC changes whenever they
+ * do.
+ * */
+
+#define SERVER_MAGIC 0x4C430001U
+
+enum server_flag
+{
+    SERVER_FLAG_KEEP_UNOPTIMIZED = 1 << 0,
+    SERVER_FLAG_EMIT_OBJECT = 1 << 1,
+    SERVER_FLAG_ASSEMBLE_AND_LINK = 1 << 2,
+    /* The source comes with the request, the pathname only names it. */
+    SERVER_FLAG_INLINE_SOURCE = 1 << 3,
+};
+
+struct server_request
+{
+    uint32_t magic;
+    /* Mask of enum server_flag. */
+    uint32_t flags;
+    uint32_t pathname_size;
+    uint32_t directory_size;
+    uint64_t source_size;
+};
+
+struct server_reply
+{
+    /* What compile_source returned. */
+    int32_t status;
+    uint32_t diagnostics_size;
+    uint32_t outputs_size;
+};
+
+/*
+ * Serves compile requests on a socket at socket_path until SIGINT or
+ * SIGTERM, replacing a socket a server that died left there. Returns -1 if
+ * the socket can't be set up.
+ * */
+int
+server_serve(const char *socket_path);
+
+/*
+ * Compiles count programs on the server at socket_path. A pathname of "-"
+ * sends stdin as an inline source named "stdin". Diagnostics are printed to
+ * ERR_STREAM and the outputs to stdout.
+ *
+ * options->run isn't supported. Returns how many programs failed, or -1 if
+ * the server couldn't be reached.
+ * */
+int
+server_compile(const char *socket_path,
+               const char *const *pathnames,
+               uint32_t count,
+               const struct compile_options *options);
+
+#endif
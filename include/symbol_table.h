@@ -32,67 +32,155 @@ enum symbol_section
     SYMBOL_SECTION_DATA,
     SYMBOL_SECTION_BSS,
     SYMBOL_SECTION_RODATA,
+    /* Values of expressions in an IR temporary, whose number is their
+     * address. Never the section of a symbol. */
+    SYMBOL_SECTION_TEMPORARY,
+    /* Values known at compile time, integers, chars, booleans and floats,
+     * whose bits are their address. They aren't anywhere at runtime. */
+    SYMBOL_SECTION_CONSTANT,
 };
 
 /**
  * @brief A symbol that belongs to the symbol table.
- * Each symbol may be linked in a singly linked list.
+ * Symbols never move once inserted, so pointers to them stay valid until
+ * the table is destroyed. A symbol fits in a single cache line.
  */
 struct symbol
 {
-    char lexeme[MAX_LEXEME_SIZE + 1];
+    uint64_t address;
+    uint64_t size;
     enum token token;
     enum symbol_class symbol_class;
     enum symbol_type symbol_type;
     enum symbol_section symbol_section;
-    uint64_t address;
-    uint64_t size;
-    struct symbol *next;
+    /* Null terminated, lives in the table's name arena. */
+    const char *lexeme;
+    uint32_t lexeme_size;
+    /* When the table is merged into another one, the symbol in the other
+     * table. Only used by the parallel lexer. */
+    struct symbol *merged;
+};
+
+/*
+ * A slot of the hash table. An empty slot has symbol = NULL.
+ * */
+struct symbol_slot
+{
+    struct symbol *symbol;
+    uint32_t hash;
+};
+
+/*
+ * Symbols are allocated in blocks that are never reallocated, in insertion
+ * order.
+ * */
+#define SYMBOL_BLOCK_SIZE 64U
+
+struct symbol_block
+{
+    struct symbol_block *next;
+    uint32_t count;
+    struct symbol symbols[SYMBOL_BLOCK_SIZE];
+};
+
+/*
+ * Lexemes of the symbols are copied into blocks of this size, one after the
+ * other.
+ * */
+#define SYMBOL_NAME_BLOCK_SIZE (16U * 1024U)
+
+struct symbol_name_block
+{
+    struct symbol_name_block *next;
+    uint32_t used;
+    char names[SYMBOL_NAME_BLOCK_SIZE];
 };
 
 struct symbol_table
 {
-    struct symbol *symbols;
+    struct symbol_slot *slots;
+    /* Always a power of two. */
     uint32_t capacity;
+    uint32_t count;
+    struct symbol_block *first_block;
+    struct symbol_block *last_block;
+    /* The block names are currently being copied into, which points to the
+     * ones that were filled before it. */
+    struct symbol_name_block *names;
 };
 
 /*
- * Creates a symbol table with the specified capacity. The symbol table
- * is a hash table which handles collision by adding the entry into a singly
- * linked list. This table does *not* distinguish upper and lower case
- * characters.
+ * Creates a symbol table with the specified initial capacity. The symbol
+ * table is a flat hash table that uses robin hood hashing to handle
+ * collisions, and grows by itself once it's 3/4 full. This table does *not*
+ * distinguish upper and lower case characters.
  *
  * table is Pointer to the table structure which will be created.
  *
- * capacity is Capacity of the table. The capacity is directly related to
- * the collision rates... A smaller capacity will undoubtely result in a higher
- * rate of collisions.
+ * capacity is Initial capacity of the table. It's rounded up to a power of
+ * two. Picking a capacity close to the number of symbols avoids growing the
+ * table later, but isn't necessary.
  *
  * */
 int
 symbol_table_create(struct symbol_table *table, uint32_t capacity);
 
 /*
- * Searches for a symbol with the specific lexeme in the table.
- * If a symbol is found, returns a pointer to it, otherwise returns NULL.
+ * The table hashes lexemes with 64 bit FNV-1a over their lowercase
+ * characters, folded into 32 bits. It can be computed a character at a time,
+ * while the lexeme is being read:
+ *
+ * uint64_t hash = SYMBOL_HASH_INIT;
+ * for each character c: hash = symbol_hash_step(hash, c);
+ * symbol_hash_finish(hash);
  * */
-struct symbol *
-symbol_table_search(struct symbol_table *table, const char *lexeme);
+#define SYMBOL_HASH_INIT 0xCBF29CE484222325ULL
+
+static inline uint64_t
+symbol_hash_step(uint64_t hash, char c)
+{
+    // Setting the 0x20 bit lowercases letters. Other characters may change
+    // too, but never into a letter, so lexemes that are equal ignoring case
+    // still hash the same.
+    hash ^= (unsigned char)c | 0x20U;
+    return hash * 0x100000001B3ULL;
+}
+
+static inline uint32_t
+symbol_hash_finish(uint64_t hash)
+{
+    return (uint32_t)(hash ^ (hash >> 32));
+}
 
 /*
- * Inserts a symbol in the table and returns a pointer to it.
- * If the symbol could not be inserted, returns NULL.
+ * Hashes the whole lexeme, which has lexeme_size characters.
+ * */
+uint32_t
+symbol_table_hash(const char *lexeme, uint32_t lexeme_size);
+
+/*
+ * Searches for a symbol with the specific lexeme in the table, inserting it
+ * with token if it's not there yet. The lexeme doesn't need to be null
+ * terminated, it has lexeme_size characters. hash must be
+ * symbol_table_hash(lexeme, lexeme_size), usually computed while the lexeme
+ * was read.
+ *
+ * Returns a pointer to the symbol and sets is_new when it was inserted.
  * */
 struct symbol *
-symbol_table_insert(struct symbol_table *table,
-                    const char *lexeme,
-                    enum token token);
+symbol_table_find_or_insert(struct symbol_table *table,
+                            const char *lexeme,
+                            uint32_t lexeme_size,
+                            uint32_t hash,
+                            enum token token,
+                            uint8_t *is_new);
 
 /*
- * Perform insertion of l's language keywords into the symbol table.
+ * Removes every symbol from the table, keeping its slots and a block of each
+ * kind, so that it can be filled again without allocating.
  * */
 void
-symbol_table_populate_with_keywords(struct symbol_table *table);
+symbol_table_clear(struct symbol_table *table);
 
 /*
  * Destroy the table and deallocated memory used by it.
@@ -5,8 +5,12 @@
 #define UTILS_H_
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most threads the parallel lexer and the batch compiler run on. */
+#define MAX_THREADS 64U
+
 #if defined(NDEBUG)
 
 #define UNREACHABLE() __builtin_unreachable()
@@ -27,4 +31,28 @@
 uint8_t
 is_case_insensitive_equal(const char *lhs, const char *rhs);
 
+/*
+ * Same as is_case_insensitive_equal, but rhs is not null terminated and
+ * has exactly rhs_size characters.
+ * */
+uint8_t
+is_case_insensitive_equal_n(const char *lhs, const char *rhs, uint32_t rhs_size);
+
+/*
+ * Rounds value up to a multiple of alignment, which is a power of two.
+ * */
+static inline uint64_t
+align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * Calls fn with each of the count elements of size bytes in args, the first
+ * one on the calling thread. If a thread can't be created, its element also
+ * runs on the calling thread. count is at most MAX_THREADS.
+ * */
+void
+run_on_threads(void *args, uint32_t count, size_t size, void *(*fn)(void *));
+
 #endif
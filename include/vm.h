@@ -0,0 +1,61 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef VM_H_
+#define VM_H_
+
+#include "ir.h"
+
+#include <stdint.h>
+
+/*
+ * Bytecode interpreter, a backend that runs the program without an
+ * assembler or a linker, on any machine.
+ *
+ * The IR is translated into a compact register-based bytecode that keeps
+ * the semantics of the x86-64 instructions it comes from: the same
+ * registers, the same memory model (TMP, UNNIT_MEM, INIT_MEM and
+ * CONST_MEM, plus a stack) and the same system calls. Memory operands are
+ * lowered into loads and stores to scratch registers, so that most
+ * instructions only deal with registers and immediates, and every size of
+ * an instruction gets its own opcode. The interpreter dispatches with
+ * computed gotos.
+ * */
+
+struct vm_program
+{
+    uint8_t *code;
+    uint64_t code_size;
+    uint64_t code_capacity;
+
+    /* Memory of the program, already initialized. */
+    uint8_t *memory;
+    uint64_t memory_size;
+    /* Address the stack grows down from. */
+    uint64_t stack_top;
+
+    /* Set when memory ran out while translating. */
+    uint8_t failed;
+};
+
+/*
+ * Translates the program into bytecode. Returns -1 if there's no memory for
+ * it, program is left empty.
+ * */
+int
+vm_compile(const struct ir *ir, struct vm_program *program);
+
+/*
+ * Runs the program until it makes the exit system call and returns its exit
+ * code. Faults (division by zero, memory out of the program's memory) raise
+ * the same signals the native program would get.
+ *
+ * The program's memory is changed as it runs, so it can only be run once.
+ * */
+int
+vm_run(struct vm_program *program);
+
+void
+vm_program_destroy(struct vm_program *program);
+
+#endif
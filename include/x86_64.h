@@ -0,0 +1,108 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#ifndef X86_64_H_
+#define X86_64_H_
+
+#include "ir.h"
+
+#include <stdint.h>
+
+/*
+ * Encoder from the IR into x86-64 machine code, replacing the assembler.
+ *
+ * Instructions are encoded just like NASM (with its default optimizations)
+ * encodes the assembly printed from the same program: the shortest form is
+ * picked for immediates and jumps, memory is addressed with absolute 32 bit
+ * displacements and data sections are aligned with NOPs.
+ * */
+
+enum x86_64_section
+{
+    X86_64_SECTION_TEXT,
+    X86_64_SECTION_DATA,
+    X86_64_SECTION_RODATA,
+    X86_64_SECTION_BSS,
+    X86_64_SECTION_COUNT,
+};
+
+enum x86_64_relocation_type
+{
+    /* 32 bit address, zero extended. */
+    X86_64_RELOCATION_32,
+    /* 32 bit address, sign extended. */
+    X86_64_RELOCATION_32S,
+    /* 64 bit address. */
+    X86_64_RELOCATION_64,
+};
+
+/*
+ * A field in .text that has to be filled with the address of a section
+ * plus addend once the sections are placed in memory.
+ * */
+struct x86_64_relocation
+{
+    uint64_t offset;
+    int64_t addend;
+    /* enum x86_64_relocation_type */
+    uint8_t type;
+    /* enum x86_64_section the address points into. */
+    uint8_t section;
+};
+
+struct x86_64_buffer
+{
+    uint8_t *bytes;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+struct x86_64_object
+{
+    /* Contents of every section but .bss, which is only a size. */
+    struct x86_64_buffer sections[X86_64_SECTION_COUNT];
+    uint64_t bss_size;
+    uint32_t alignments[X86_64_SECTION_COUNT];
+
+    struct x86_64_relocation *relocations;
+    uint64_t relocation_count;
+    uint64_t relocation_capacity;
+};
+
+/*
+ * Section of the memory area and offset of its beginning in that section.
+ * */
+enum x86_64_section
+x86_64_base_section(enum ir_base base);
+
+uint64_t
+x86_64_base_offset(enum ir_base base);
+
+/*
+ * Encodes the whole program into object, starting at _start (offset 0 of
+ * .text). Returns -1 if there's no memory for it, object is left empty.
+ * */
+int
+x86_64_assemble(const struct ir *ir, struct x86_64_object *object);
+
+/*
+ * Same as x86_64_assemble, but only for .data, .rodata and .bss, .text is
+ * left empty.
+ * */
+int
+x86_64_assemble_data(const struct ir *ir, struct x86_64_object *object);
+
+/*
+ * Fills the fields of text (a copy of .text) that hold addresses, given the
+ * address every section is loaded at. Returns -1 if an address doesn't fit
+ * in its field, the generated code only addresses memory in the low 2GB.
+ * */
+int
+x86_64_relocate(const struct x86_64_object *object,
+                const uint64_t *addresses,
+                uint8_t *text);
+
+void
+x86_64_object_destroy(struct x86_64_object *object);
+
+#endif
@@ -0,0 +1,333 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "batch.h"
+
+#include "compile.h"
+#include "file.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct job
+{
+    const char *pathname;
+    /* Everything compile_file printed. */
+    char *diagnostics;
+    size_t diagnostics_size;
+    int status;
+    uint8_t is_done;
+};
+
+/*
+ * Jobs [top, bottom) that still belong to a worker. The worker takes them
+ * from the bottom, thieves from the top.
+ * */
+struct deque
+{
+    pthread_mutex_t lock;
+    uint32_t top;
+    uint32_t bottom;
+};
+
+struct pool
+{
+    struct job *jobs;
+    uint32_t count;
+    const struct compile_options *options;
+
+    struct deque deques[MAX_THREADS];
+    uint32_t worker_count;
+
+    /* Jobs are printed in order, as soon as every job before them is. */
+    pthread_mutex_t print_lock;
+    uint32_t next_to_print;
+};
+
+struct worker
+{
+    struct pool *pool;
+    uint32_t index;
+};
+
+/*
+ * Takes a job from the bottom of the worker's own deque. Returns 0 if it's
+ * empty.
+ * */
+static uint8_t
+take(struct deque *deque, uint32_t *job)
+{
+    uint8_t found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        *job = --deque->bottom;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+/*
+ * Takes a job from the top of another worker's deque, going through all of
+ * them. Returns 0 if every deque is empty, which means there's nothing left
+ * to do as jobs are never added.
+ * */
+static uint8_t
+steal(struct pool *pool, uint32_t thief, uint32_t *job)
+{
+    for (uint32_t i = 1; i < pool->worker_count; ++i) {
+        struct deque *victim =
+            &pool->deques[(thief + i) % pool->worker_count];
+
+        uint8_t found = 0;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->top < victim->bottom) {
+            *job = victim->top++;
+            found = 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (found)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void
+print_job(const struct job *job)
+{
+    fprintf(ERR_STREAM, "%s:\n", job->pathname);
+    if (job->diagnostics_size)
+        fwrite(job->diagnostics, 1, job->diagnostics_size, ERR_STREAM);
+}
+
+static void
+run_job(struct pool *pool, struct job *job)
+{
+    FILE *diagnostics =
+        open_memstream(&job->diagnostics, &job->diagnostics_size);
+    if (diagnostics) {
+        job->status = compile_file(job->pathname, pool->options, diagnostics);
+        if (fclose(diagnostics) != 0)
+            job->status = -1;
+    } else {
+        job->status = -1;
+    }
+
+    pthread_mutex_lock(&pool->print_lock);
+    job->is_done = 1;
+    while (pool->next_to_print < pool->count &&
+           pool->jobs[pool->next_to_print].is_done) {
+        struct job *next = &pool->jobs[pool->next_to_print++];
+        print_job(next);
+        free(next->diagnostics);
+        next->diagnostics = NULL;
+    }
+    pthread_mutex_unlock(&pool->print_lock);
+}
+
+static void *
+work(void *arg)
+{
+    struct worker *worker = arg;
+    struct pool *pool = worker->pool;
+
+    uint32_t job;
+    while (take(&pool->deques[worker->index], &job) ||
+           steal(pool, worker->index, &job)) {
+        run_job(pool, &pool->jobs[job]);
+    }
+
+    return NULL;
+}
+
+/*
+ * Number of workers for count jobs.
+ * */
+static uint32_t
+worker_count(uint32_t count)
+{
+    const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workers = processors > 0 ? (uint32_t)processors : 1;
+    if (workers > MAX_THREADS)
+        workers = MAX_THREADS;
+    if (workers > count)
+        workers = count;
+    return workers ? workers : 1;
+}
+
+static uint32_t
+print_summary(const struct pool *pool)
+{
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < pool->count; ++i)
+        failed += pool->jobs[i].status != 0;
+
+    fprintf(ERR_STREAM,
+            "Batch: %u files, %u compiled, %u failed.\n",
+            pool->count,
+            pool->count - failed,
+            failed);
+
+    for (uint32_t i = 0; i < pool->count; ++i) {
+        if (pool->jobs[i].status != 0)
+            fprintf(ERR_STREAM, "Failed: %s\n", pool->jobs[i].pathname);
+    }
+
+    return failed;
+}
+
+/*
+ * The name of pathname's outputs, which is its filename (see compile_file).
+ * */
+static const char *
+output_name(const char *pathname)
+{
+    const char *last_separator = strrchr(pathname, '/');
+    return last_separator ? last_separator + 1 : pathname;
+}
+
+static int
+compare_output_names(const void *lhs, const void *rhs)
+{
+    return strcmp(output_name(*(const char *const *)lhs),
+                  output_name(*(const char *const *)rhs));
+}
+
+/*
+ * Files with the same name in different directories would write their
+ * outputs over each other's, at the same time. Prints the first two that do
+ * and returns -1 if there are any.
+ * */
+static int
+check_output_names(const char *const *pathnames, uint32_t count)
+{
+    if (count < 2)
+        return 0;
+
+    const char **sorted = malloc(count * sizeof(*sorted));
+    if (!sorted)
+        return -1;
+
+    memcpy(sorted, pathnames, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), compare_output_names);
+
+    int status = 0;
+    for (uint32_t i = 1; i < count && status == 0; ++i) {
+        if (compare_output_names(&sorted[i - 1], &sorted[i]) == 0) {
+            fprintf(ERR_STREAM,
+                    "%s and %s have the same name, their outputs would be "
+                    "written over each other's.\n",
+                    sorted[i - 1],
+                    sorted[i]);
+            status = -1;
+        }
+    }
+
+    free(sorted);
+    return status;
+}
+
+int
+batch_compile(const char *const *pathnames,
+              uint32_t count,
+              const struct compile_options *options)
+{
+    assert(!options->run && "Programs can't be run in a batch.");
+
+    if (check_output_names(pathnames, count) < 0)
+        return -1;
+
+    struct pool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.count = count;
+    pool.options = options;
+    pool.worker_count = worker_count(count);
+
+    pool.jobs = calloc(count ? count : 1, sizeof(*pool.jobs));
+    if (!pool.jobs)
+        return -1;
+
+    for (uint32_t i = 0; i < count; ++i)
+        pool.jobs[i].pathname = pathnames[i];
+
+    // Every worker starts with a contiguous share of the jobs.
+    struct worker workers[MAX_THREADS];
+    for (uint32_t i = 0; i < pool.worker_count; ++i) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].top =
+            (uint32_t)((uint64_t)count * i / pool.worker_count);
+        pool.deques[i].bottom =
+            (uint32_t)((uint64_t)count * (i + 1) / pool.worker_count);
+        workers[i].pool = &pool;
+        workers[i].index = i;
+    }
+    pthread_mutex_init(&pool.print_lock, NULL);
+
+    // If a thread can't be created, its jobs are stolen by the others
+    // before it runs.
+    run_on_threads(workers, pool.worker_count, sizeof(*workers), work);
+
+    const uint32_t failed = print_summary(&pool);
+
+    for (uint32_t i = 0; i < pool.worker_count; ++i)
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    pthread_mutex_destroy(&pool.print_lock);
+    free(pool.jobs);
+
+    return (int)failed;
+}
+
+int
+batch_compile_list(const char *list_pathname,
+                   const struct compile_options *options)
+{
+    struct file list;
+    if (read_file(&list, list_pathname) < 0) {
+        fprintf(ERR_STREAM, "Failed to read %s\n", list_pathname);
+        return -1;
+    }
+
+    // A copy of the list with its lines null terminated.
+    char *names = malloc(list.size + 1);
+    const char **pathnames = malloc((list.size / 2 + 1) * sizeof(*pathnames));
+    int status = -1;
+    if (!names || !pathnames)
+        goto out;
+
+    memcpy(names, list.buffer, list.size);
+    names[list.size] = '\0';
+
+    uint32_t count = 0;
+    for (char *line = names; *line;) {
+        char *end = strchr(line, '\n');
+        char *next = end ? end + 1 : line + strlen(line);
+        if (!end)
+            end = next;
+
+        // Also takes care of \r\n.
+        while (end > line && (end[-1] == '\r' || end[-1] == ' '))
+            --end;
+        *end = '\0';
+
+        if (end > line)
+            pathnames[count++] = line;
+        line = next;
+    }
+
+    status = batch_compile(pathnames, count, options);
+
+out:
+    free(pathnames);
+    free(names);
+    destroy_file(&list);
+    return status;
+}
@@ -0,0 +1,489 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "cache.h"
+
+#include "file.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FNV128_OFFSET                                                          \
+    (((unsigned __int128)0x6C62272E07BB0142ULL << 64) | 0x62B821756295C58DULL)
+#define FNV128_PRIME (((unsigned __int128)1 << 88) | 0x13BU)
+
+/* Entries are named after their key, in hexadecimal. */
+#define ENTRY_NAME_SIZE 32U
+
+/* Suffix of each enum cache_output, in the order of their bits. Inside an
+ * entry, the outputs are named program<suffix>. */
+static const char *const output_suffixes[CACHE_OUTPUT_COUNT] = {
+    ".asm",
+    "-unoptimized.asm",
+    ".asm.o",
+    ".asm.out",
+};
+
+static pthread_once_t compiler_hash_once = PTHREAD_ONCE_INIT;
+static unsigned __int128 compiler_hash;
+static uint8_t has_compiler_hash;
+
+/* Makes the names of temporary directories unique inside a process. */
+static atomic_uint temporary_counter;
+
+static unsigned __int128
+fnv128(unsigned __int128 hash, const void *bytes, uint64_t size)
+{
+    const uint8_t *ptr = bytes;
+    for (uint64_t i = 0; i < size; ++i) {
+        hash ^= ptr[i];
+        hash *= FNV128_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * The compiler is identified by its own executable, so that any change to
+ * it invalidates what it cached.
+ * */
+static void
+hash_compiler(void)
+{
+    struct file self;
+    if (read_file(&self, "/proc/self/exe") < 0)
+        return;
+
+    compiler_hash = fnv128(FNV128_OFFSET, self.buffer, self.size);
+    has_compiler_hash = 1;
+    destroy_file(&self);
+}
+
+const char *
+cache_directory(void)
+{
+    const char *directory = getenv("L_CACHE_DIR");
+    return directory && directory[0] ? directory : NULL;
+}
+
+int
+cache_key_compute(struct cache_key *key,
+                  const char *source,
+                  uint64_t source_size,
+                  uint8_t outputs)
+{
+    pthread_once(&compiler_hash_once, hash_compiler);
+    if (!has_compiler_hash)
+        return -1;
+
+    unsigned __int128 hash = fnv128(
+        FNV128_OFFSET, &compiler_hash, sizeof(compiler_hash));
+    hash = fnv128(hash, &outputs, sizeof(outputs));
+    hash = fnv128(hash, source, source_size);
+
+    for (uint32_t i = 0; i < sizeof(key->bytes); ++i)
+        key->bytes[i] = (uint8_t)(hash >> (8 * i));
+    key->outputs = outputs;
+    return 0;
+}
+
+static void
+entry_name(const struct cache_key *key, char name[ENTRY_NAME_SIZE + 1])
+{
+    static const char digits[] = "0123456789abcdef";
+    for (uint32_t i = 0; i < sizeof(key->bytes); ++i) {
+        name[2 * i] = digits[key->bytes[i] >> 4];
+        name[2 * i + 1] = digits[key->bytes[i] & 0xF];
+    }
+    name[ENTRY_NAME_SIZE] = '\0';
+}
+
+/*
+ * Path of an output inside the entry at entry_path. Returns -1 if it doesn't
+ * fit in PATH_MAX.
+ * */
+static int
+output_path(char pathname[PATH_MAX], const char *entry_path, uint32_t output)
+{
+    const int size = snprintf(pathname,
+                              PATH_MAX,
+                              "%s/program%s",
+                              entry_path,
+                              output_suffixes[output]);
+    return size < PATH_MAX ? 0 : -1;
+}
+
+static uint8_t
+is_entry_name(const char *name)
+{
+    uint32_t i = 0;
+    for (; name[i]; ++i) {
+        if (!((name[i] >= '0' && name[i] <= '9') ||
+              (name[i] >= 'a' && name[i] <= 'f')))
+            return 0;
+    }
+    return i == ENTRY_NAME_SIZE;
+}
+
+/*
+ * Adds one to the hits or the misses, kept in the stats file as text. The
+ * file is locked, as other compilers may be updating it too.
+ * */
+static void
+count_lookup(const char *directory, uint8_t is_hit)
+{
+    // The first lookup creates the cache.
+    mkdir(directory, 0755);
+
+    char pathname[PATH_MAX];
+    snprintf(pathname, sizeof(pathname), "%s/stats", directory);
+
+    const int fd = open(pathname, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+
+    if (flock(fd, LOCK_EX) == 0) {
+        char buffer[64] = { 0 };
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        if (pread(fd, buffer, sizeof(buffer) - 1, 0) > 0)
+            sscanf(buffer, "%" SCNu64 " %" SCNu64, &hits, &misses);
+
+        if (is_hit)
+            ++hits;
+        else
+            ++misses;
+
+        const int size = snprintf(
+            buffer, sizeof(buffer), "%" PRIu64 " %" PRIu64 "\n", hits, misses);
+        if (pwrite(fd, buffer, (size_t)size, 0) == size)
+            ftruncate(fd, size);
+    }
+
+    close(fd);
+}
+
+/*
+ * Copies the file at from to to, keeping the execute permission.
+ * */
+static int
+copy_file(const char *from, const char *to, uint8_t is_executable)
+{
+    struct file file;
+    if (read_file(&file, from) < 0)
+        return -1;
+
+    const int status =
+        is_executable ? write_executable_file(to, file.buffer, file.size)
+                      : write_file(to, file.buffer, file.size);
+    destroy_file(&file);
+    return status;
+}
+
+int
+cache_restore(const char *directory,
+              const struct cache_key *key,
+              const char *name,
+              FILE *diagnostics)
+{
+    char entry[ENTRY_NAME_SIZE + 1];
+    entry_name(key, entry);
+
+    char entry_path[PATH_MAX];
+    snprintf(entry_path, sizeof(entry_path), "%s/%s", directory, entry);
+
+    uint8_t is_hit = access(entry_path, F_OK) == 0;
+    for (uint32_t i = 0; is_hit && i < CACHE_OUTPUT_COUNT; ++i) {
+        if (!(key->outputs & (1U << i)))
+            continue;
+
+        char from[PATH_MAX];
+        char to[PATH_MAX];
+        snprintf(to, sizeof(to), "%s%s", name, output_suffixes[i]);
+
+        if (output_path(from, entry_path, i) < 0 ||
+            (unlink(to) < 0 && errno != ENOENT)) {
+            is_hit = 0;
+        } else if (link(from, to) < 0) {
+            // Another file system, or the entry has just been evicted.
+            const uint8_t is_executable = 1U << i == CACHE_OUTPUT_EXECUTABLE;
+            is_hit = copy_file(from, to, is_executable) == 0;
+        }
+
+        if (is_hit)
+            fprintf(diagnostics, "Output from cache in: %s.\n", to);
+    }
+
+    // Marks the entry as the most recently used.
+    if (is_hit)
+        utimensat(AT_FDCWD, entry_path, NULL, 0);
+
+    count_lookup(directory, is_hit);
+    return is_hit;
+}
+
+/*
+ * Removes an entry, or a temporary one, and everything in it.
+ * */
+static void
+remove_entry(const char *entry_path)
+{
+    DIR *dir = opendir(entry_path);
+    if (dir) {
+        struct dirent *dirent;
+        while ((dirent = readdir(dir))) {
+            if (dirent->d_name[0] == '.')
+                continue;
+
+            char pathname[PATH_MAX];
+            snprintf(pathname,
+                     sizeof(pathname),
+                     "%s/%s",
+                     entry_path,
+                     dirent->d_name);
+            unlink(pathname);
+        }
+        closedir(dir);
+    }
+
+    rmdir(entry_path);
+}
+
+/*
+ * Size of the files in an entry.
+ * */
+static uint64_t
+entry_size(const char *entry_path)
+{
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < CACHE_OUTPUT_COUNT; ++i) {
+        char pathname[PATH_MAX];
+        struct stat st;
+        if (output_path(pathname, entry_path, i) == 0 &&
+            stat(pathname, &st) == 0)
+            size += (uint64_t)st.st_size;
+    }
+    return size;
+}
+
+struct entry_info
+{
+    char name[ENTRY_NAME_SIZE + 1];
+    /* Last time it was used. */
+    struct timespec used;
+    uint64_t size;
+};
+
+/*
+ * Lists every entry in the cache. Returns how many there are, or -1 if the
+ * directory can't be read. entries must be freed.
+ * */
+static int64_t
+list_entries(const char *directory, struct entry_info **entries)
+{
+    DIR *dir = opendir(directory);
+    if (!dir)
+        return -1;
+
+    int64_t count = 0;
+    int64_t capacity = 0;
+    *entries = NULL;
+
+    struct dirent *dirent;
+    while ((dirent = readdir(dir))) {
+        if (!is_entry_name(dirent->d_name))
+            continue;
+
+        char entry_path[PATH_MAX];
+        snprintf(
+            entry_path, sizeof(entry_path), "%s/%s", directory, dirent->d_name);
+
+        struct stat st;
+        if (stat(entry_path, &st) < 0 || !S_ISDIR(st.st_mode))
+            continue;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct entry_info *grown =
+                realloc(*entries, (size_t)capacity * sizeof(**entries));
+            if (!grown)
+                break;
+            *entries = grown;
+        }
+
+        struct entry_info *info = &(*entries)[count++];
+        memcpy(info->name, dirent->d_name, sizeof(info->name));
+        info->used = st.st_mtim;
+        info->size = entry_size(entry_path);
+    }
+
+    closedir(dir);
+    return count;
+}
+
+static int
+compare_used(const void *lhs, const void *rhs)
+{
+    const struct timespec *a = &((const struct entry_info *)lhs)->used;
+    const struct timespec *b = &((const struct entry_info *)rhs)->used;
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    if (a->tv_nsec != b->tv_nsec)
+        return a->tv_nsec < b->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+static uint64_t
+size_limit(void)
+{
+    const char *limit = getenv("L_CACHE_SIZE");
+    if (!limit || !limit[0])
+        return CACHE_DEFAULT_SIZE;
+    return strtoull(limit, NULL, 10);
+}
+
+/*
+ * Evicts the least recently used entries until the cache fits in its size
+ * limit. An entry is renamed before it's removed, so that nobody finds it
+ * half removed.
+ * */
+static void
+evict(const char *directory)
+{
+    struct entry_info *entries;
+    const int64_t count = list_entries(directory, &entries);
+    if (count < 0)
+        return;
+
+    uint64_t total = 0;
+    for (int64_t i = 0; i < count; ++i)
+        total += entries[i].size;
+
+    const uint64_t limit = size_limit();
+    if (total > limit) {
+        qsort(entries, (size_t)count, sizeof(*entries), compare_used);
+
+        for (int64_t i = 0; i < count && total > limit; ++i) {
+            char entry_path[PATH_MAX];
+            char evicted_path[PATH_MAX];
+            snprintf(entry_path,
+                     sizeof(entry_path),
+                     "%s/%s",
+                     directory,
+                     entries[i].name);
+            snprintf(evicted_path,
+                     sizeof(evicted_path),
+                     "%s/%s.evicted.%d.%u",
+                     directory,
+                     entries[i].name,
+                     (int)getpid(),
+                     atomic_fetch_add(&temporary_counter, 1));
+
+            // Someone else may have evicted it first.
+            if (rename(entry_path, evicted_path) == 0)
+                remove_entry(evicted_path);
+            total -= entries[i].size;
+        }
+    }
+
+    free(entries);
+}
+
+void
+cache_store(const char *directory,
+            const struct cache_key *key,
+            const struct cache_contents *contents)
+{
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST)
+        return;
+
+    char entry[ENTRY_NAME_SIZE + 1];
+    entry_name(key, entry);
+
+    char entry_path[PATH_MAX];
+    char temporary_path[PATH_MAX];
+    snprintf(entry_path, sizeof(entry_path), "%s/%s", directory, entry);
+    snprintf(temporary_path,
+             sizeof(temporary_path),
+             "%s/%s.tmp.%d.%u",
+             directory,
+             entry,
+             (int)getpid(),
+             atomic_fetch_add(&temporary_counter, 1));
+
+    if (mkdir(temporary_path, 0755) < 0)
+        return;
+
+    uint8_t is_complete = 1;
+    for (uint32_t i = 0; is_complete && i < CACHE_OUTPUT_COUNT; ++i) {
+        if (!(key->outputs & (1U << i)))
+            continue;
+
+        // Read-only, as they are going to be hard linked.
+        char to[PATH_MAX];
+        const void *buffer = contents->buffers[i];
+        const uint64_t size = contents->sizes[i];
+        const uint8_t is_executable = 1U << i == CACHE_OUTPUT_EXECUTABLE;
+        is_complete =
+            buffer && output_path(to, temporary_path, i) == 0 &&
+            (is_executable ? write_executable_file(to, buffer, size)
+                           : write_file(to, buffer, size)) == 0 &&
+            chmod(to, is_executable ? 0555 : 0444) == 0;
+    }
+
+    // If someone else has just added the same entry, theirs stays.
+    if (!is_complete || rename(temporary_path, entry_path) < 0) {
+        remove_entry(temporary_path);
+        return;
+    }
+
+    evict(directory);
+}
+
+int
+cache_print_stats(const char *directory, FILE *stream)
+{
+    char pathname[PATH_MAX];
+    snprintf(pathname, sizeof(pathname), "%s/stats", directory);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    FILE *stats = fopen(pathname, "r");
+    if (stats) {
+        if (fscanf(stats, "%" SCNu64 " %" SCNu64, &hits, &misses) != 2)
+            hits = misses = 0;
+        fclose(stats);
+    }
+
+    struct entry_info *entries;
+    const int64_t count = list_entries(directory, &entries);
+    if (count < 0) {
+        fprintf(stream, "Cache at %s is empty.\n", directory);
+        return 0;
+    }
+
+    uint64_t size = 0;
+    for (int64_t i = 0; i < count; ++i)
+        size += entries[i].size;
+    free(entries);
+
+    fprintf(stream,
+            "Cache at %s: %" PRIu64 " hits, %" PRIu64 " misses, %" PRId64
+            " entries, %" PRIu64 " of %" PRIu64 " bytes.\n",
+            directory,
+            hits,
+            misses,
+            count,
+            size,
+            size_limit());
+    return 0;
+}
@@ -2,11 +2,20 @@
  * José Guilherme de Castro Rodrigues - 651201
  * */
 #include "codegen.h"
+#include "elf_object.h"
+#include "file.h"
+#include "ir.h"
+#include "jit.h"
+#include "promote.h"
+#include "regalloc.h"
 #include "symbol_table.h"
 #include "token.h"
 #include "utils.h"
+#include "vm.h"
+#include "x86_64.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,19 +33,128 @@
  * assembly on the code generator.
  * */
 
-static FILE *tmp_file;
-static char template_filename[] = "XXXXXX.asm";
+#define AL ir_register(IR_REGISTER_A, 1)
+#define BL ir_register(IR_REGISTER_B, 1)
+#define DL ir_register(IR_REGISTER_D, 1)
+#define CX ir_register(IR_REGISTER_C, 2)
+#define DX ir_register(IR_REGISTER_D, 2)
+#define EAX ir_register(IR_REGISTER_A, 4)
+#define EBX ir_register(IR_REGISTER_B, 4)
+#define ECX ir_register(IR_REGISTER_C, 4)
+#define EDX ir_register(IR_REGISTER_D, 4)
+#define ESI ir_register(IR_REGISTER_SI, 4)
+#define EDI ir_register(IR_REGISTER_DI, 4)
+#define RAX ir_register(IR_REGISTER_A, 8)
+#define RBX ir_register(IR_REGISTER_B, 8)
+#define RCX ir_register(IR_REGISTER_C, 8)
+#define RDX ir_register(IR_REGISTER_D, 8)
+#define RSI ir_register(IR_REGISTER_SI, 8)
+#define RDI ir_register(IR_REGISTER_DI, 8)
+#define XMM(n) ir_register(IR_REGISTER_XMM0 + (n), 4)
+#define NO_OPERAND ((struct ir_operand){.kind = IR_OPERAND_NONE})
 
-static uint64_t current_bss_tmp_address;
-static uint64_t current_data_address;
-static uint64_t current_bss_address;
-static uint64_t current_rodata_address;
-static uint64_t current_label_counter;
+static void
+emit3(struct codegen_ctx *ctx,
+      enum ir_opcode opcode,
+      struct ir_operand first,
+      struct ir_operand second,
+      struct ir_operand third)
+{
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
+
+    instruction->opcode = opcode;
+    instruction->operands[0] = first;
+    instruction->operands[1] = second;
+    instruction->operands[2] = third;
+}
+
+static void
+emit2(struct codegen_ctx *ctx,
+      enum ir_opcode opcode,
+      struct ir_operand first,
+      struct ir_operand second)
+{
+    emit3(ctx, opcode, first, second, NO_OPERAND);
+}
+
+static void
+emit1(struct codegen_ctx *ctx, enum ir_opcode opcode, struct ir_operand operand)
+{
+    emit3(ctx, opcode, operand, NO_OPERAND, NO_OPERAND);
+}
+
+static void
+emit0(struct codegen_ctx *ctx, enum ir_opcode opcode)
+{
+    emit3(ctx, opcode, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+}
+
+static void
+emit_jcc(struct codegen_ctx *ctx, enum ir_condition condition, uint32_t label)
+{
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
+
+    instruction->opcode = IR_OPCODE_JCC;
+    instruction->condition = condition;
+    instruction->operands[0] = ir_label(label);
+}
+
+static void
+emit_setcc(struct codegen_ctx *ctx,
+           enum ir_condition condition,
+           struct ir_operand operand)
+{
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
+
+    instruction->opcode = IR_OPCODE_SETCC;
+    instruction->condition = condition;
+    instruction->operands[0] = operand;
+}
+
+static void
+emit_jmp(struct codegen_ctx *ctx, uint32_t label)
+{
+    emit1(ctx, IR_OPCODE_JMP, ir_label(label));
+}
+
+static void
+emit_label(struct codegen_ctx *ctx, uint32_t label)
+{
+    emit1(ctx, IR_OPCODE_LABEL, ir_label(label));
+}
+
+static void
+emit_section(struct codegen_ctx *ctx, enum ir_section section)
+{
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
+
+    instruction->opcode = IR_OPCODE_SECTION;
+    instruction->section = section;
+}
 
 static void
-get_next_label(char *buffer, uint32_t size)
+emit_comment(struct codegen_ctx *ctx, const char *comment)
 {
-    snprintf(buffer, size, "L%lu", current_label_counter++);
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
+
+    instruction->opcode = IR_OPCODE_COMMENT;
+    instruction->comment = comment;
+}
+
+static uint32_t
+get_next_label(struct codegen_ctx *ctx)
+{
+    return ir_new_label(&ctx->program);
 }
 
 static uint64_t
@@ -70,20 +188,461 @@ size_from_type(enum symbol_type type)
     }
 }
 
+static enum ir_base
+base_from_section(enum symbol_section section)
+{
+    switch (section) {
+        case SYMBOL_SECTION_NONE:
+            return IR_BASE_TMP;
+        case SYMBOL_SECTION_BSS:
+            return IR_BASE_UNNIT_MEM;
+        case SYMBOL_SECTION_DATA:
+            return IR_BASE_INIT_MEM;
+        case SYMBOL_SECTION_RODATA:
+            return IR_BASE_CONST_MEM;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static uint8_t
+is_constant(const struct codegen_value_info *info)
+{
+    return info->section == SYMBOL_SECTION_CONSTANT;
+}
+
+static void
+set_constant(struct codegen_value_info *info, uint32_t bits)
+{
+    info->section = SYMBOL_SECTION_CONSTANT;
+    info->address = bits;
+}
+
+static int32_t
+constant_integer(const struct codegen_value_info *info)
+{
+    return (int32_t)(uint32_t)info->address;
+}
+
+static float
+constant_float(const struct codegen_value_info *info)
+{
+    const uint32_t bits = (uint32_t)info->address;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void
+set_float_constant(struct codegen_value_info *info, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    set_constant(info, bits);
+}
+
+/*
+ * The temporary, memory or immediate holding the value, accessed size bytes
+ * at a time. Floats known at compile time need float_operand.
+ * */
+static struct ir_operand
+value_operand(const struct codegen_value_info *info, uint8_t size)
+{
+    if (info->section == SYMBOL_SECTION_TEMPORARY)
+        return ir_temporary((uint32_t)info->address, size);
+    if (is_constant(info)) {
+        assert(info->type != SYMBOL_TYPE_FLOATING_POINT);
+        return ir_immediate(size == 1 ? (int64_t)(uint8_t)info->address
+                                      : (int64_t)constant_integer(info));
+    }
+    return ir_memory(base_from_section(info->section), info->address, size);
+}
+
+/*
+ * The slot of ctx->floats for bits, which is empty if it's not there.
+ * There has to be a table.
+ * */
+static struct codegen_float *
+find_float(const struct codegen_ctx *ctx, uint32_t bits)
+{
+    const uint32_t mask = ctx->float_capacity - 1;
+    uint32_t idx = (bits * UINT32_C(2654435761)) & mask;
+    while (ctx->floats[idx].is_used && ctx->floats[idx].bits != bits)
+        idx = (idx + 1) & mask;
+    return &ctx->floats[idx];
+}
+
+/*
+ * Makes sure there's room for one more float. Returns -1 if there's no
+ * memory for it.
+ * */
+static int
+reserve_float(struct codegen_ctx *ctx)
+{
+    // At most three quarters full.
+    if ((ctx->float_count + 1) * 4 <= ctx->float_capacity * 3)
+        return 0;
+
+    const uint32_t capacity =
+        ctx->float_capacity ? ctx->float_capacity * 2 : 64;
+    struct codegen_float *floats = calloc(capacity, sizeof(*floats));
+    if (!floats)
+        return -1;
+
+    struct codegen_float *old = ctx->floats;
+    const uint32_t old_capacity = ctx->float_capacity;
+    ctx->floats = floats;
+    ctx->float_capacity = capacity;
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+        if (old[i].is_used)
+            *find_float(ctx, old[i].bits) = old[i];
+    }
+
+    free(old);
+    return 0;
+}
+
+/*
+ * The temporary or memory holding a float. Floats can't be immediates, so
+ * one known at compile time is put in .rodata the first time it's used at
+ * runtime, and every use of the same value shares it.
+ * */
+static struct ir_operand
+float_operand(struct codegen_ctx *ctx, const struct codegen_value_info *info)
+{
+    assert(info->type == SYMBOL_TYPE_FLOATING_POINT);
+    if (!is_constant(info))
+        return value_operand(info, 4);
+
+    const uint32_t bits = (uint32_t)info->address;
+
+    // Without memory for the table, the value is put there again.
+    struct codegen_float *slot = NULL;
+    if (reserve_float(ctx) == 0) {
+        slot = find_float(ctx, bits);
+        if (slot->is_used)
+            return ir_memory(IR_BASE_CONST_MEM, (int64_t)slot->address, 4);
+    }
+
+    const uint64_t address = get_next_address(&ctx->current_rodata_address, 4);
+    if (slot) {
+        *slot = (struct codegen_float){
+            .address = address, .bits = bits, .is_used = 1};
+        ++ctx->float_count;
+    }
+
+    emit_section(ctx, IR_SECTION_RODATA);
+    emit_comment(ctx, "float_operand.");
+
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (instruction) {
+        instruction->opcode = IR_OPCODE_DATA;
+        instruction->data = (struct ir_data){.address = address,
+                                             .size = 4,
+                                             .align = 4,
+                                             .section = IR_SECTION_RODATA,
+                                             .kind = IR_DATA_FLOAT,
+                                             .value = bits};
+    }
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    return ir_memory(IR_BASE_CONST_MEM, (int64_t)address, 4);
+}
+
+/*
+ * Puts the value in a new temporary of its size. It's given a register if
+ * there's one for it (see regalloc.h), the temporary storage is only
+ * reserved in case there isn't.
+ * */
 static void
-dump_template(void)
+new_temporary(struct codegen_ctx *ctx, struct codegen_value_info *info)
+{
+    const uint64_t address =
+        get_next_address(&ctx->current_bss_tmp_address, info->size);
+
+    info->section = SYMBOL_SECTION_TEMPORARY;
+    info->address = ir_new_temporary(&ctx->program, IR_BASE_TMP, address);
+}
+
+static struct ir_instruction *
+last_instruction(struct codegen_ctx *ctx)
+{
+    struct ir_block *block = ctx->program.last_block;
+    return block && block->count ? &block->instructions[block->count - 1]
+                                 : NULL;
+}
+
+static struct codegen_position
+next_position(const struct codegen_ctx *ctx)
+{
+    struct ir_block *block = ctx->program.last_block;
+    return (struct codegen_position){.block = block,
+                                     .index = block ? block->count : 0};
+}
+
+/*
+ * The instruction at position, which is moved past it. NULL once the end of
+ * the program is reached.
+ * */
+static struct ir_instruction *
+next_instruction(struct codegen_ctx *ctx, struct codegen_position *position)
+{
+    if (!position->block) {
+        position->block = ctx->program.first_block;
+        position->index = 0;
+        if (!position->block)
+            return NULL;
+    }
+
+    while (position->index == position->block->count) {
+        if (!position->block->next)
+            return NULL;
+        position->block = position->block->next;
+        position->index = 0;
+    }
+
+    return &position->block->instructions[position->index++];
+}
+
+/*
+ * Makes the jumps to label from, from position on, jump to label to.
+ * */
+static void
+rename_label(struct codegen_ctx *ctx,
+             struct codegen_position position,
+             uint32_t from,
+             uint32_t to)
+{
+    struct ir_instruction *instruction;
+    while ((instruction = next_instruction(ctx, &position))) {
+        if ((instruction->opcode == IR_OPCODE_JMP ||
+             instruction->opcode == IR_OPCODE_JCC) &&
+            instruction->operands[0].value == from) {
+            instruction->operands[0] = ir_label(to);
+        }
+    }
+}
+
+static struct codegen_condition
+flags_condition(enum ir_condition condition)
+{
+    return (struct codegen_condition){.condition = condition,
+                                      .true_label = CODEGEN_NO_LABEL,
+                                      .false_label = CODEGEN_NO_LABEL};
+}
+
+static enum ir_condition
+invert_condition(enum ir_condition condition)
+{
+    switch (condition) {
+        case IR_CONDITION_E:
+            return IR_CONDITION_NE;
+        case IR_CONDITION_NE:
+            return IR_CONDITION_E;
+        case IR_CONDITION_L:
+            return IR_CONDITION_GE;
+        case IR_CONDITION_LE:
+            return IR_CONDITION_G;
+        case IR_CONDITION_G:
+            return IR_CONDITION_LE;
+        case IR_CONDITION_GE:
+            return IR_CONDITION_L;
+        case IR_CONDITION_B:
+            return IR_CONDITION_AE;
+        case IR_CONDITION_BE:
+            return IR_CONDITION_A;
+        case IR_CONDITION_A:
+            return IR_CONDITION_BE;
+        case IR_CONDITION_AE:
+            return IR_CONDITION_B;
+        default:
+            UNREACHABLE();
+    }
+}
+
+/*
+ * Sets the boolean temporary info from the condition, and remembers it in
+ * case it's branched on right away.
+ * */
+static void
+set_from_condition(struct codegen_ctx *ctx,
+                   const struct codegen_value_info *info,
+                   const struct codegen_condition *condition)
+{
+    const struct codegen_position start = next_position(ctx);
+
+    emit_setcc(ctx, condition->condition, AL);
+    if (condition->true_label != CODEGEN_NO_LABEL ||
+        condition->false_label != CODEGEN_NO_LABEL) {
+        const uint32_t set_label = get_next_label(ctx);
+        if (condition->true_label != CODEGEN_NO_LABEL) {
+            emit_jmp(ctx, set_label);
+            emit_label(ctx, condition->true_label);
+            emit2(ctx, IR_OPCODE_MOV, AL, ir_immediate(1));
+        }
+        if (condition->false_label != CODEGEN_NO_LABEL) {
+            emit_jmp(ctx, set_label);
+            emit_label(ctx, condition->false_label);
+            emit2(ctx, IR_OPCODE_MOV, AL, ir_immediate(0));
+        }
+        emit_label(ctx, set_label);
+    }
+    emit2(ctx, IR_OPCODE_MOV, value_operand(info, 1), AL);
+
+    ctx->last_boolean = (struct codegen_boolean){.temporary = info->address,
+                                                 .condition = *condition,
+                                                 .start = start,
+                                                 .end = last_instruction(ctx)};
+}
+
+/*
+ * The condition under which the boolean info is true. When info was just
+ * set from a condition, that condition is taken and the code that set it is
+ * dropped, otherwise info is compared to false.
+ * */
+static struct codegen_condition
+take_condition(struct codegen_ctx *ctx, const struct codegen_value_info *info)
+{
+    struct codegen_boolean *boolean = &ctx->last_boolean;
+    if (info->section == SYMBOL_SECTION_TEMPORARY &&
+        info->address == boolean->temporary && boolean->end &&
+        boolean->end == last_instruction(ctx)) {
+        struct ir_instruction *instruction;
+        while ((instruction = next_instruction(ctx, &boolean->start)))
+            instruction->opcode = IR_OPCODE_DELETED;
+
+        boolean->end = NULL;
+        return boolean->condition;
+    }
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "take_condition.");
+    emit2(ctx, IR_OPCODE_MOV, AL, value_operand(info, 1));
+    emit2(ctx, IR_OPCODE_CMP, AL, ir_immediate(0));
+    return flags_condition(IR_CONDITION_NE);
+}
+
+/*
+ * Jumps away if the boolean exp is false, and returns the label it jumps
+ * to, which is left to be emitted.
+ * */
+static uint32_t
+emit_jump_if_false(struct codegen_ctx *ctx,
+                   const char *comment,
+                   const struct codegen_value_info *exp)
+{
+    if (is_constant(exp)) {
+        const uint32_t label = get_next_label(ctx);
+        emit_section(ctx, IR_SECTION_TEXT);
+        emit_comment(ctx, comment);
+        if (!exp->address)
+            emit_jmp(ctx, label);
+        return label;
+    }
+
+    const struct codegen_condition condition = take_condition(ctx, exp);
+    const uint32_t label = condition.false_label != CODEGEN_NO_LABEL
+                               ? condition.false_label
+                               : get_next_label(ctx);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, comment);
+    emit_jcc(ctx, invert_condition(condition.condition), label);
+    if (condition.true_label != CODEGEN_NO_LABEL)
+        emit_label(ctx, condition.true_label);
+    return label;
+}
+
+static struct ir_operand
+tmp_memory(uint64_t address, uint8_t size)
+{
+    return ir_memory(IR_BASE_TMP, address, size);
+}
+
+/*
+ * Packs up to eight characters into an immediate, the first one in the
+ * lowest byte. That's how NASM reads a string used as a number.
+ * */
+static int64_t
+string_immediate(const char *string)
+{
+    uint64_t value = 0;
+    for (uint32_t i = 0; string[i]; ++i)
+        value |= (uint64_t)(unsigned char)string[i] << (8 * i);
+    return (int64_t)value;
+}
+
+/*
+ * Value of a hexadecimal digit, which the lexer has already checked.
+ * */
+static uint32_t
+hex_digit_value(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return (uint32_t)(digit - '0');
+    return (uint32_t)((digit | 0x20) - 'a' + 10);
+}
+
+/*
+ * Value of a constant of the given type, as it's stored in memory. Floats
+ * are returned as their bits. The lexeme doesn't need to be null
+ * terminated, it has lexeme_size characters.
+ * */
+static uint32_t
+constant_value(enum symbol_type type,
+               uint8_t has_minus,
+               const char *lexeme,
+               uint32_t lexeme_size)
+{
+    switch (type) {
+        case SYMBOL_TYPE_LOGIC:
+            return is_case_insensitive_equal_n("true", lexeme, lexeme_size);
+        case SYMBOL_TYPE_CHAR:
+            // Either 'c' or 0xHH.
+            if (lexeme[0] == '\'')
+                return (unsigned char)lexeme[1];
+            // The span isn't null terminated, so exactly two digits are read.
+            return (hex_digit_value(lexeme[2]) << 4) |
+                   hex_digit_value(lexeme[3]);
+        case SYMBOL_TYPE_INTEGER: {
+            // Like NASM, keep only the lower bits of numbers that don't fit.
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < lexeme_size; ++i)
+                value = value * 10 + (uint32_t)(lexeme[i] - '0');
+            return has_minus ? 0U - value : value;
+        }
+        case SYMBOL_TYPE_FLOATING_POINT: {
+            char buffer[MAX_LEXEME_SIZE + 1];
+            memcpy(buffer, lexeme, lexeme_size);
+            buffer[lexeme_size] = '\0';
+
+            float value = strtof(buffer, NULL);
+            if (has_minus)
+                value = -value;
+
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+        default:
+            UNREACHABLE();
+    }
+}
+
+static void
+dump_template(FILE *file)
 {
     time_t now = time(NULL);
 
     struct tm tm;
     localtime_r(&now, &tm);
 
-    fprintf(tmp_file,
+    fprintf(file,
             "\t; Generated on %04u/%02u/%02u - %02u:%02u\n"
             "\tglobal _start\n"
             "\tsection .bss\n"
             "TMP:\n"
-            "\tresb 0x10000\n"
+            "\tresb 0x%x\n"
             "UNNIT_MEM:\n"
             "\tsection .data\n"
             "INIT_MEM:\n"
@@ -95,404 +654,503 @@ dump_template(void)
             tm.tm_mon,
             tm.tm_mday,
             tm.tm_hour,
-            tm.tm_min);
+            tm.tm_min,
+            IR_TMP_SIZE);
 }
 
 static void
-add_error_handler(const char *error_handler_name,
+add_error_handler(struct codegen_ctx *ctx,
+                  uint32_t handler_label,
                   const char *error_message,
                   uint8_t exit_code)
 {
     assert(exit_code && "Zero exit code might mean success to the user.");
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "%s_HANDLER:\n"
-            // Write Syscall.
-            "\tmov rax, 1\n"
-            "\tmov rdi, 2\n"
-            "\tmov rsi, %s_MSG\n"
-            "\tmov rdx, %s_MSG_LEN\n"
-            "\tsyscall\n"
-            // Exit Syscall.
-            "\tmov rax, 60\n"
-            "\tmov rdi, %u\n"
-            "\tsyscall\n"
-            // Data for Error.
-            "\tsection .rodata\n"
-            "%s_MSG: db \"Error: %s\",0xA,0x0\n"
-            "%s_MSG_LEN: equ $-INVALID_INPUT_MSG\n",
-            error_handler_name,
-            error_handler_name,
-            error_handler_name,
-            exit_code,
-            error_handler_name,
-            error_message,
-            error_handler_name);
+    char message[128];
+    const int message_size =
+        snprintf(message, sizeof(message), "Error: %s\n", error_message);
+    assert(message_size > 0 && (size_t)message_size < sizeof(message));
+
+    const uint64_t message_address =
+        get_next_address(&ctx->current_rodata_address, 1);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_label(ctx, handler_label);
+    // Write Syscall.
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, RDI, ir_immediate(2));
+    emit2(ctx,
+          IR_OPCODE_MOV,
+          RSI,
+          ir_address(IR_BASE_CONST_MEM, message_address));
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(message_size + 1));
+    emit0(ctx, IR_OPCODE_SYSCALL);
+    // Exit Syscall.
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(60));
+    emit2(ctx, IR_OPCODE_MOV, RDI, ir_immediate(exit_code));
+    emit0(ctx, IR_OPCODE_SYSCALL);
+    // Data for Error, written with its null terminator.
+    emit_section(ctx, IR_SECTION_RODATA);
+
+    const uint8_t *bytes =
+        ir_copy_bytes(&ctx->program, message, (uint32_t)message_size + 1);
+    struct ir_instruction *data = bytes ? ir_append(&ctx->program) : NULL;
+    if (!data)
+        return;
+
+    data->opcode = IR_OPCODE_DATA;
+    data->data.address = message_address;
+    data->data.size = data->data.count = (uint32_t)message_size + 1;
+    data->data.align = 1;
+    data->data.section = IR_SECTION_RODATA;
+    data->data.kind = IR_DATA_STRING;
+    data->data.bytes = bytes;
 }
 
 static void
-add_error_handlers(void)
+add_error_handlers(struct codegen_ctx *ctx)
 {
-    fputs("\t; Error Handlers\n", tmp_file);
-    add_error_handler("INVALID_INPUT", "Invalid Input. Exitting...", 1);
+    emit_comment(ctx, "Error Handlers");
+    add_error_handler(ctx,
+                      ctx->invalid_input_handler_label,
+                      "Invalid Input. Exitting...",
+                      1);
 }
 
 static void
-add_exit_syscall(uint8_t error_code)
+add_exit_syscall(struct codegen_ctx *ctx, uint8_t error_code)
 {
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; add_exit_syscall.\n"
-            "\tmov rax, 60\n"
-            "\tmov rdi, %u\n"
-            "\tsyscall\n",
-            error_code);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "add_exit_syscall.");
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(60));
+    emit2(ctx, IR_OPCODE_MOV, RDI, ir_immediate(error_code));
+    emit0(ctx, IR_OPCODE_SYSCALL);
 }
 
 int
-codegen_init(void)
+codegen_init(struct codegen_ctx *ctx)
 {
-    const int fd = mkstemps(template_filename, 4);
-    if (fd < 0)
-        return -1;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->diagnostics = ERR_STREAM;
+    ir_init(&ctx->program);
+    ctx->invalid_input_handler_label = get_next_label(ctx);
+    return 0;
+}
 
-    tmp_file = fdopen(fd, "w+");
-    if (!tmp_file)
-        return -1;
+/*
+ * State of the optimizations that are done while the program is printed.
+ * */
+struct dump_state
+{
+    /* enum ir_section we're currently in. */
+    uint8_t section;
+    /* Store that was the last instruction, if any. */
+    const struct ir_instruction *store;
+    uint32_t avoided_moves;
+};
+
+static uint8_t
+is_same_operand(const struct ir_operand *lhs, const struct ir_operand *rhs)
+{
+    return lhs->kind == rhs->kind && lhs->size == rhs->size &&
+           lhs->reg == rhs->reg && lhs->reg_size == rhs->reg_size &&
+           lhs->base == rhs->base && lhs->value == rhs->value;
+}
 
-    dump_template();
+/*
+ * Removes section commands to the section we're already in.
+ * */
+static uint8_t
+is_unnecessary_section(struct dump_state *state,
+                       const struct ir_instruction *instruction)
+{
+    if (instruction->section == state->section)
+        return 1;
+
+    state->section = instruction->section;
     return 0;
 }
 
-static void
-remove_unnecessary_section_commands(FILE *file, FILE *dump_file)
-{
-    enum section
-    {
-        NONE,
-        TEXT,
-        BSS,
-        RODATA,
-        DATA,
-    } section = NONE;
-
-    fseek(file, 0, SEEK_SET);
-
-    char line_buffer[512];
-    memset(line_buffer, 0, sizeof(line_buffer));
-
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
-        uint8_t unnecesary_line = 0;
-
-        if (strncmp(line_buffer, "\tsection .data", 14) == 0) {
-            if (section == DATA)
-                unnecesary_line = 1;
-            else
-                section = DATA;
-        } else if (strncmp(line_buffer, "\tsection .rodata", 16) == 0) {
-            if (section == RODATA)
-                unnecesary_line = 1;
-            else
-                section = RODATA;
-        } else if (strncmp(line_buffer, "\tsection .bss", 13) == 0) {
-            if (section == BSS)
-                unnecesary_line = 1;
-            else
-                section = BSS;
-        } else if (strncmp(line_buffer, "\tsection .text", 14) == 0) {
-            if (section == TEXT)
-                unnecesary_line = 1;
-            else
-                section = TEXT;
-        }
+/*
+ * A very naive peephole in which we look for consecutive stores and loads
+ * and remove the loads that have no impact in execution, i.e. loads of the
+ * register that has just been stored to the same memory. Copies to the
+ * registers of temporaries count as stores too.
+ * */
+static uint8_t
+is_unnecessary_load(struct dump_state *state,
+                    const struct ir_instruction *instruction)
+{
+    switch (instruction->opcode) {
+        case IR_OPCODE_LABEL:
+            // We can jump here with anything in the registers.
+            state->store = NULL;
+            return 0;
+        case IR_OPCODE_SECTION:
+        case IR_OPCODE_COMMENT:
+        case IR_OPCODE_RESERVE:
+        case IR_OPCODE_DATA:
+        case IR_OPCODE_DELETED:
+            return 0;
+        default:
+            break;
+    }
 
-        if (!unnecesary_line)
-            fputs(line_buffer, dump_file);
+    const struct ir_instruction *store = state->store;
+    state->store = NULL;
+
+    if (instruction->opcode != IR_OPCODE_MOV &&
+        instruction->opcode != IR_OPCODE_MOVSS) {
+        return 0;
+    }
+
+    const struct ir_operand *dst = &instruction->operands[0];
+    const struct ir_operand *src = &instruction->operands[1];
+
+    if (store && store->opcode == instruction->opcode &&
+        dst->kind == IR_OPERAND_REGISTER &&
+        is_same_operand(dst, &store->operands[1]) &&
+        is_same_operand(src, &store->operands[0])) {
+        ++state->avoided_moves;
+        return 1;
     }
 
-    fflush(dump_file);
+    if (src->kind == IR_OPERAND_REGISTER && !is_same_operand(dst, src))
+        state->store = instruction;
+    return 0;
 }
 
+/*
+ * Prints the program in a single pass. Unnecessary section commands are
+ * removed from both outputs. The loads removed by the peephole are deleted
+ * from the program, so that it matches output when it's assembled.
+ * Both outputs are optional, without them only the peephole is applied.
+ * */
 static void
-perform_peephole(FILE *file, FILE *dump_file)
-{
-    // A very naive implementation in which we look for consecutive loads and
-    // stores and remove those instructions that have no impact in execution.
-    fseek(file, 0, SEEK_SET);
-
-    enum
-    {
-        WAITING_FIRST_MOV,
-        WAITING_SECOND_MOV,
-    } state = WAITING_FIRST_MOV;
-
-    char line[512];
-    char tmp_line[512];
-    char store_mem_dst[32];
-    char store_reg_src[32];
-    char load_mem_src[32];
-    char load_reg_dst[32];
-
-    uint32_t avoided_moves = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-    check_again:
-        switch (state) {
-            case WAITING_FIRST_MOV:
-                if (strncmp(line, "\tmov", 4) != 0 &&
-                    strncmp(line, "\tmovss", 6) != 0) {
-                    fputs(line, dump_file);
-                } else {
-                    fputs(line, dump_file);
-
-                    const uint8_t is_store = strstr(line, "],") != NULL;
-                    if (is_store) {
-                        strtok(line, "[");
-                        const char *ptr = strtok(NULL, "[");
-
-                        char *mem_dst = store_mem_dst;
-                        while (*ptr != ']')
-                            *mem_dst++ = *ptr++;
-                        *mem_dst = 0;
-
-                        // Skip ",] ".
-                        ptr += 3;
-
-                        char *reg_src = store_reg_src;
-                        while (*ptr != '\n')
-                            *reg_src++ = *ptr++;
-                        *reg_src = 0;
-
-                        state = WAITING_SECOND_MOV;
-                    }
-                }
-                break;
-            case WAITING_SECOND_MOV:
-                if (strncmp(line, "\tmov", 4) == 0 ||
-                    strncmp(line, "\tmovss", 6) == 0) {
-                    state = WAITING_FIRST_MOV;
-
-                    const uint8_t is_load = strstr(line, ", [") != NULL;
-                    if (is_load) {
-                        strncpy(tmp_line, line, sizeof(line));
-
-                        strtok(tmp_line, " ");
-                        const char *ptr = strtok(NULL, " ");
-
-                        char *load_dst = load_reg_dst;
-                        while (*ptr != ',')
-                            *load_dst++ = *ptr++;
-                        *load_dst = 0;
-
-                        // Skip ", [".
-                        ptr += 3;
-
-                        char *mem_src = load_mem_src;
-                        while (*ptr != ']')
-                            *mem_src++ = *ptr++;
-                        *mem_src = 0;
-
-                        if (strcmp(load_mem_src, store_mem_dst) == 0 &&
-                            strcmp(load_reg_dst, store_reg_src) == 0) {
-                            ++avoided_moves;
-                        } else {
-                            fputs(line, dump_file);
-                        }
-                    } else {
-                        // Ok, this is not a load and therefore we can't remove
-                        // it... but is it a store that's followed by a load? We
-                        // can check that by checking this line again in the
-                        // first state!
-                        goto check_again;
-                    }
-                } else {
-                    uint8_t instruction_line = 1;
-
-                    if (strncmp(line, "\tsection", 8) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\t;", 2) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\talign", 6) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\talignb", 7) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\tdb", 3) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\tdd", 3) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\ttimes", 6) == 0) {
-                        instruction_line = 0;
-                    } else if (strncmp(line, "\tresb", 5) == 0) {
-                        instruction_line = 0;
-                    } else if (line[0] != '\t') {
-                        // LABEL.
-                        instruction_line = 0;
-                    }
-
-                    fputs(line, dump_file);
-                    if (instruction_line) {
-                        state = WAITING_FIRST_MOV;
-                    }
-                }
-                break;
+print_program(struct codegen_ctx *ctx, FILE *output, FILE *unoptimized)
+{
+    // The template leaves us in .text.
+    struct dump_state state = {.section = IR_SECTION_TEXT};
+
+    if (output)
+        dump_template(output);
+    if (unoptimized)
+        dump_template(unoptimized);
+
+    for (struct ir_block *block = ctx->program.first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            struct ir_instruction *instruction = &block->instructions[i];
+
+            if (instruction->opcode == IR_OPCODE_SECTION &&
+                is_unnecessary_section(&state, instruction)) {
+                continue;
+            }
+
+            if (unoptimized)
+                ir_print_instruction(instruction, unoptimized);
+
+            if (is_unnecessary_load(&state, instruction))
+                instruction->opcode = IR_OPCODE_DELETED;
+            else if (output)
+                ir_print_instruction(instruction, output);
         }
     }
 
-    fprintf(ERR_STREAM, "Peephole avoided moves: %u.\n", avoided_moves);
+    fprintf(ctx->diagnostics,
+            "Peephole avoided moves: %u.\n",
+            state.avoided_moves);
 }
 
-int
-codegen_dump(const char *pathname,
-             uint8_t keep_unoptimized,
-             uint8_t assemble_and_link)
+/*
+ * Closes a stream opened with open_memstream, leaving everything that has
+ * been printed to it in file.
+ * */
+static int
+close_stream(FILE *stream,
+             char *const *buffer,
+             const size_t *size,
+             struct codegen_file *file)
 {
-    if (!tmp_file)
-        return -1;
+    const int status = fclose(stream);
+    file->buffer = (uint8_t *)*buffer;
+    file->size = *size;
+    return status == 0 ? 0 : -1;
+}
 
-    int err = 0;
-
-    add_exit_syscall(0);
-    add_error_handlers();
-    fflush(tmp_file);
-
-    char remove_section_filename[256];
-    char peephole_filename[256];
-
-    snprintf(remove_section_filename,
-             sizeof(remove_section_filename),
-             "%s-removed-sections-%s",
-             pathname,
-             template_filename);
-    snprintf(peephole_filename,
-             sizeof(peephole_filename),
-             "%s-peephole-%s",
-             pathname,
-             template_filename);
-
-    FILE *unnecessary_sections_removed_file =
-        fopen(remove_section_filename, "w+");
-    if (!unnecessary_sections_removed_file)
+/*
+ * Ends the program, which is complete after this.
+ * */
+static int
+finish_program(struct codegen_ctx *ctx)
+{
+    add_exit_syscall(ctx, 0);
+    add_error_handlers(ctx);
+    if (ctx->program.failed)
         return -1;
 
-    FILE *peephole_file = fopen(peephole_filename, "w+");
-    if (!peephole_file) {
-        err = -1;
-        goto peephole_file_err;
+    struct promote_stats promote_stats;
+    if (promote_run(&ctx->program,
+                    ctx->loops,
+                    ctx->loop_count,
+                    &promote_stats) < 0) {
+        return -1;
     }
 
-    remove_unnecessary_section_commands(tmp_file,
-                                        unnecessary_sections_removed_file);
-    perform_peephole(unnecessary_sections_removed_file, peephole_file);
+    struct regalloc_stats stats;
+    if (regalloc_run(&ctx->program, &stats) < 0)
+        return -1;
 
-    char output_filename[256];
-    snprintf(output_filename, sizeof(output_filename), "%s.asm", pathname);
+    fprintf(ctx->diagnostics,
+            "Loop variables promoted: %u in %u loops.\n",
+            promote_stats.variables,
+            promote_stats.loops);
+    fprintf(ctx->diagnostics,
+            "Temporaries in registers: %u of %u.\n",
+            stats.temporaries - stats.spilled,
+            stats.temporaries);
+    return 0;
+}
+
+/*
+ * Makes every file codegen_dump was asked for in memory, in files, and
+ * writes it. files is left with whatever was made, even on errors.
+ * */
+static int
+dump_files(struct codegen_ctx *ctx,
+           const char *pathname,
+           uint8_t keep_unoptimized,
+           uint8_t emit_object,
+           uint8_t assemble_and_link,
+           struct codegen_file files[CODEGEN_FILE_COUNT])
+{
+    char *output_buffer = NULL;
+    size_t output_size = 0;
+    FILE *output = open_memstream(&output_buffer, &output_size);
+    if (!output)
+        return -1;
 
-    FILE *output = fopen(output_filename, "w+");
-    if (!output) {
-        err = -1;
-        goto output_file_err;
+    char *unoptimized_buffer = NULL;
+    size_t unoptimized_size = 0;
+    FILE *unoptimized = NULL;
+    if (keep_unoptimized) {
+        unoptimized = open_memstream(&unoptimized_buffer, &unoptimized_size);
+        if (!unoptimized) {
+            fclose(output);
+            free(output_buffer);
+            return -1;
+        }
     }
 
-    fseek(peephole_file, 0, SEEK_SET);
-    while (1) {
-        const char c = fgetc(peephole_file);
-        if (c == EOF)
-            break;
-        fputc(c, output);
+    print_program(ctx, output, unoptimized);
+
+    struct codegen_file *assembly = &files[CODEGEN_FILE_ASSEMBLY];
+    char output_filename[PATH_MAX];
+    snprintf(output_filename, sizeof(output_filename), "%s.asm", pathname);
+
+    int err = close_stream(output, &output_buffer, &output_size, assembly);
+    if (err == 0)
+        err = write_file(output_filename, assembly->buffer, assembly->size);
+
+    struct codegen_file *unoptimized_file = &files[CODEGEN_FILE_UNOPTIMIZED];
+    char unoptimized_filename[PATH_MAX];
+    if (unoptimized) {
+        snprintf(unoptimized_filename,
+                 sizeof(unoptimized_filename),
+                 "%s-unoptimized.asm",
+                 pathname);
+
+        if (close_stream(unoptimized,
+                         &unoptimized_buffer,
+                         &unoptimized_size,
+                         unoptimized_file) < 0 ||
+            write_file(unoptimized_filename,
+                       unoptimized_file->buffer,
+                       unoptimized_file->size) < 0) {
+            err = -1;
+        }
     }
 
-    fclose(output);
-    output = NULL;
+    if (err)
+        return -1;
 
-    fprintf(ERR_STREAM, "Assembly output in: %s.\n", output_filename);
+    fprintf(ctx->diagnostics, "Assembly output in: %s.\n", output_filename);
 
     if (keep_unoptimized) {
-        fprintf(ERR_STREAM,
+        fprintf(ctx->diagnostics,
                 "Assembly without peephole in: %s.\n",
-                remove_section_filename);
+                unoptimized_filename);
     }
 
-    if (assemble_and_link) {
-        char buffer[1024];
+    if (!emit_object && !assemble_and_link)
+        return 0;
+
+    // The program is assembled straight from the IR, the assembly file is
+    // only there to be read.
+    struct x86_64_object object;
+    if (x86_64_assemble(&ctx->program, &object) < 0)
+        return -1;
 
-        snprintf(buffer,
-                 sizeof(buffer),
-                 "nasm -f elf64 %s -o %s.o",
-                 output_filename,
+    if (emit_object) {
+        struct codegen_file *file = &files[CODEGEN_FILE_OBJECT];
+        char object_filename[sizeof(output_filename) + 2];
+        snprintf(object_filename,
+                 sizeof(object_filename),
+                 "%s.o",
+                 output_filename);
+
+        err = elf_object_encode(&object, &file->buffer, &file->size);
+        if (err == 0)
+            err = write_file(object_filename, file->buffer, file->size);
+        if (err == 0)
+            fprintf(ctx->diagnostics,
+                    "Object output in: %s.\n",
+                    object_filename);
+    }
+
+    if (assemble_and_link && err == 0) {
+        struct codegen_file *file = &files[CODEGEN_FILE_EXECUTABLE];
+        char executable_filename[sizeof(output_filename) + 4];
+        snprintf(executable_filename,
+                 sizeof(executable_filename),
+                 "%s.out",
                  output_filename);
-        fprintf(ERR_STREAM, "Running: \"%s\".\n", buffer);
-
-        if (system(buffer) == 0) {
-            snprintf(buffer,
-                     sizeof(buffer),
-                     "ld %s.o -o %s.out",
-                     output_filename,
-                     output_filename);
-            fprintf(ERR_STREAM, "Running: \"%s\".\n", buffer);
-
-            if (system(buffer) == 0)
-                fprintf(ERR_STREAM,
-                        "Successfully assembled and linked. Executable in: "
-                        "%s.out.\n",
-                        output_filename);
-        }
 
-        // Remove the assembled but not linked file.
-        snprintf(buffer, sizeof(buffer), "%s.o", output_filename);
-        remove(buffer);
+        err = elf_executable_encode(&object, &file->buffer, &file->size);
+        if (err == 0)
+            err = write_executable_file(
+                executable_filename, file->buffer, file->size);
+        if (err == 0)
+            fprintf(ctx->diagnostics,
+                    "Successfully assembled and linked. Executable in: "
+                    "%s.\n",
+                    executable_filename);
     }
 
-output_file_err:
-    fclose(peephole_file);
-    peephole_file = NULL;
-    remove(peephole_filename);
+    x86_64_object_destroy(&object);
+    return err;
+}
+
+int
+codegen_dump(struct codegen_ctx *ctx,
+             const char *pathname,
+             uint8_t keep_unoptimized,
+             uint8_t emit_object,
+             uint8_t assemble_and_link,
+             struct codegen_file *files)
+{
+    if (finish_program(ctx) < 0)
+        return -1;
+
+    // Everything is made in memory and then written at once.
+    struct codegen_file made[CODEGEN_FILE_COUNT];
+    memset(made, 0, sizeof(made));
+
+    const int err = dump_files(
+        ctx, pathname, keep_unoptimized, emit_object, assemble_and_link, made);
 
-peephole_file_err:
-    fclose(unnecessary_sections_removed_file);
-    unnecessary_sections_removed_file = NULL;
-    if (err || !keep_unoptimized)
-        remove(remove_section_filename);
+    if (files && err == 0)
+        memcpy(files, made, sizeof(made));
+    else
+        codegen_files_destroy(made);
 
     return err;
 }
 
 void
-codegen_destroy(void)
+codegen_files_destroy(struct codegen_file files[CODEGEN_FILE_COUNT])
 {
-    if (!tmp_file)
-        return;
+    for (uint32_t i = 0; i < CODEGEN_FILE_COUNT; ++i) {
+        free(files[i].buffer);
+        files[i].buffer = NULL;
+        files[i].size = 0;
+    }
+}
 
-    fclose(tmp_file);
-    tmp_file = NULL;
+/*
+ * Translates the program to bytecode and interprets it, exiting with its
+ * exit code.
+ * */
+static int
+run_in_vm(struct codegen_ctx *ctx)
+{
+    struct vm_program vm_program;
+    if (vm_compile(&ctx->program, &vm_program) < 0)
+        return -1;
+
+    // The program writes with system calls, anything the compiler buffered
+    // goes first.
+    fflush(NULL);
+    const int exit_code = vm_run(&vm_program);
+    vm_program_destroy(&vm_program);
+    exit(exit_code);
+}
+
+int
+codegen_run(struct codegen_ctx *ctx, enum codegen_backend backend)
+{
+    if (finish_program(ctx) < 0)
+        return -1;
+
+    print_program(ctx, NULL, NULL);
 
-    remove(template_filename);
+    if (backend == CODEGEN_BACKEND_VM)
+        return run_in_vm(ctx);
+
+    struct x86_64_object object;
+    if (x86_64_assemble(&ctx->program, &object) < 0)
+        return -1;
+
+    // Only returns if the program couldn't be started.
+    jit_run(&object);
+    x86_64_object_destroy(&object);
+    return -1;
+}
+
+void
+codegen_destroy(struct codegen_ctx *ctx)
+{
+    free(ctx->loops);
+    free(ctx->floats);
+    ir_destroy(&ctx->program);
 }
 
 void
-codegen_reset_tmp(void)
+codegen_reset_tmp(struct codegen_ctx *ctx)
 {
-    current_bss_tmp_address = 0;
+    ctx->current_bss_tmp_address = 0;
 }
 
 void
-codegen_add_unnit_value(enum symbol_type type, struct codegen_value_info *info)
+codegen_add_unnit_value(struct codegen_ctx *ctx,
+                        enum symbol_type type,
+                        struct codegen_value_info *info)
 {
     info->size = size_from_type(type);
 
-    info->address = get_next_address(&current_bss_address, info->size);
-    fputs("\tsection .bss\n\t; codegen_add_unnit_value.\n", tmp_file);
-    fprintf(tmp_file, "\talignb %lu\n", info->size);
-    fprintf(tmp_file, "\tresb %lu\t; @ 0x%lx\n", info->size, info->address);
+    info->address = get_next_address(&ctx->current_bss_address, info->size);
+    emit_section(ctx, IR_SECTION_BSS);
+    emit_comment(ctx, "codegen_add_unnit_value.");
+
+    struct ir_instruction *reserve = ir_append(&ctx->program);
+    if (reserve) {
+        reserve->opcode = IR_OPCODE_RESERVE;
+        reserve->data.address = info->address;
+        reserve->data.size = (uint32_t)info->size;
+        reserve->data.align = (uint32_t)info->size;
+        reserve->data.section = IR_SECTION_BSS;
+    }
 
     info->section = SYMBOL_SECTION_BSS;
 }
 
 void
-codegen_add_value(enum symbol_type type,
+codegen_add_value(struct codegen_ctx *ctx,
+                  enum symbol_type type,
                   enum symbol_class class,
                   uint8_t has_minus,
                   const char *lexeme,
+                  uint32_t lexeme_size,
                   struct codegen_value_info *info)
 {
     if (type != SYMBOL_TYPE_FLOATING_POINT && type != SYMBOL_TYPE_INTEGER &&
@@ -502,796 +1160,796 @@ codegen_add_value(enum symbol_type type,
 
     info->size = size_from_type(type);
 
+    // Constants are only kept around when they can't be folded.
+    if (class == SYMBOL_CLASS_CONST && type != SYMBOL_TYPE_STRING) {
+        set_constant(info,
+                     constant_value(type, has_minus, lexeme, lexeme_size));
+        return;
+    }
+
     uint64_t *addr_counter;
-    const char *section_name;
+    enum ir_section section;
     if (class == SYMBOL_CLASS_VAR) {
         info->section = SYMBOL_SECTION_DATA;
-        addr_counter = &current_data_address;
-        section_name = ".data";
+        addr_counter = &ctx->current_data_address;
+        section = IR_SECTION_DATA;
     } else if (class == SYMBOL_CLASS_CONST) {
         info->section = SYMBOL_SECTION_RODATA;
-        addr_counter = &current_rodata_address;
-        section_name = ".rodata";
+        addr_counter = &ctx->current_rodata_address;
+        section = IR_SECTION_RODATA;
     } else {
         UNREACHABLE();
     }
 
     info->address = get_next_address(addr_counter, info->size);
 
-    fprintf(tmp_file, "\tsection %s\n\t; codegen_add_value.\n", section_name);
-    fprintf(tmp_file, "\talign %lu\n", info->size);
+    emit_section(ctx, section);
+    emit_comment(ctx, "codegen_add_value.");
+
+    struct ir_data data = {.address = info->address,
+                           .size = (uint32_t)info->size,
+                           .align = (uint32_t)info->size,
+                           .section = section};
 
     switch (type) {
         case SYMBOL_TYPE_LOGIC:
         case SYMBOL_TYPE_CHAR:
-        case SYMBOL_TYPE_STRING:
-            fputs("\tdb ", tmp_file);
+            data.kind = IR_DATA_BYTE;
+            data.value = constant_value(type, has_minus, lexeme, lexeme_size);
             break;
-        case SYMBOL_TYPE_FLOATING_POINT:
         case SYMBOL_TYPE_INTEGER:
-            fputs("\tdd ", tmp_file);
-            break;
-        default:
-            UNREACHABLE();
-    }
-
-    if (has_minus)
-        fputc('-', tmp_file);
-
-    switch (type) {
-        case SYMBOL_TYPE_LOGIC:
-            if (is_case_insensitive_equal("true", lexeme))
-                fputc('1', tmp_file);
-            else
-                fputc('0', tmp_file);
+            data.kind = IR_DATA_DWORD;
+            data.value = constant_value(type, has_minus, lexeme, lexeme_size);
             break;
-        case SYMBOL_TYPE_STRING:
-            fprintf(tmp_file, "%s,0", lexeme);
-            break;
-        case SYMBOL_TYPE_CHAR:
         case SYMBOL_TYPE_FLOATING_POINT:
-        case SYMBOL_TYPE_INTEGER:
-            fputs(lexeme, tmp_file);
+            data.kind = IR_DATA_FLOAT;
+            data.value = constant_value(type, has_minus, lexeme, lexeme_size);
+            break;
+        case SYMBOL_TYPE_STRING: {
+            // Only the portion between the quotes and the \0 are initialized,
+            // the rest of the string is zeroed.
+            char string[MAX_VALUE_SIZE];
+            const uint32_t string_size = lexeme_size - 2;
+            assert(string_size < sizeof(string));
+            memcpy(string, lexeme + 1, string_size);
+            string[string_size] = '\0';
+
+            data.kind = IR_DATA_STRING;
+            data.count = string_size + 1;
+            data.bytes = ir_copy_bytes(&ctx->program, string, data.count);
+            if (!data.bytes)
+                return;
             break;
+        }
         default:
             UNREACHABLE();
     }
 
-    fprintf(tmp_file, "\t; @ 0x%lx\n", info->address);
-
-    if (type == SYMBOL_TYPE_STRING) {
-        // Reserve enough space for the unnitialized portion of the string.
-        // At this point, we've only reserved space for the portion that we
-        // explicitly initialized with "db".
+    struct ir_instruction *instruction = ir_append(&ctx->program);
+    if (!instruction)
+        return;
 
-        // strlen(lexeme)
-        // -2 because of ""
-        // +1 because of \0
-        const uint64_t already_reserved_size = strlen(lexeme) - 1;
-        const uint64_t to_reserve = info->size - already_reserved_size;
-        fprintf(tmp_file, "\ttimes %lu db 0\n", to_reserve);
-    }
+    instruction->opcode = IR_OPCODE_DATA;
+    instruction->data = data;
 }
 
 void
-codegen_add_tmp(enum symbol_type type,
+codegen_add_tmp(struct codegen_ctx *ctx,
+                enum symbol_type type,
                 const char *lexeme,
+                uint32_t lexeme_size,
                 struct codegen_value_info *info)
 {
-    // We can't move strings / floating points from registers to memory,
-    // declare them in memory.
-    if (type == SYMBOL_TYPE_STRING || type == SYMBOL_TYPE_FLOATING_POINT) {
-        const uint8_t has_minus = 0;
-        codegen_add_value(type, SYMBOL_CLASS_CONST, has_minus, lexeme, info);
-        return;
-    }
-
-    // Otherwise, move them to a register and then into memory.
-    info->section = SYMBOL_SECTION_NONE;
-    info->size = size_from_type(type);
-    info->address = get_next_address(&current_bss_tmp_address, info->size);
-
-    fputs("\tsection .text\n\t; codegen_add_tmp.\n", tmp_file);
-
-    const char *reg;
-    if (type == SYMBOL_TYPE_INTEGER)
-        reg = "eax";
-    else if (type == SYMBOL_TYPE_CHAR || type == SYMBOL_TYPE_LOGIC)
-        reg = "al";
-    else
-        UNREACHABLE();
-
-    if (type != SYMBOL_TYPE_LOGIC) {
-        fprintf(tmp_file, "\tmov %s, %s\n", reg, lexeme);
-    } else {
-        if (is_case_insensitive_equal("true", lexeme)) {
-            fputs("\tmov al, 1\n", tmp_file);
-        } else if (is_case_insensitive_equal("false", lexeme)) {
-            fputs("\tmov al, 0\n", tmp_file);
-        } else {
-            UNREACHABLE();
-        }
-    }
-
-    fprintf(tmp_file, "\tmov [TMP + %lu], %s\n", info->address, reg);
-}
-
-static const char *
-label_from_section(enum symbol_section section)
-{
-    switch (section) {
-        case SYMBOL_SECTION_NONE:
-            return "TMP";
-        case SYMBOL_SECTION_BSS:
-            return "UNNIT_MEM";
-        case SYMBOL_SECTION_DATA:
-            return "INIT_MEM";
-        case SYMBOL_SECTION_RODATA:
-            return "CONST_MEM";
-        default:
-            UNREACHABLE();
-    }
+    // Literals are constants without a name, and only strings end up in
+    // .rodata.
+    const uint8_t has_minus = 0;
+    codegen_add_value(ctx,
+                      type,
+                      SYMBOL_CLASS_CONST,
+                      has_minus,
+                      lexeme,
+                      lexeme_size,
+                      info);
 }
 
 void
-codegen_logic_negate(struct codegen_value_info *f)
+codegen_logic_negate(struct codegen_ctx *ctx, struct codegen_value_info *f)
 {
     assert(f->type == SYMBOL_TYPE_LOGIC);
 
-    const uint64_t original_address = f->address;
-    const char *label = label_from_section(f->section);
+    if (is_constant(f)) {
+        set_constant(f, (uint8_t)(1 - (uint8_t)f->address));
+        return;
+    }
 
-    // Generate a new temporary address.
-    f->address = get_next_address(&current_bss_tmp_address, f->size);
-    f->section = SYMBOL_SECTION_NONE;
+    const struct codegen_condition condition = take_condition(ctx, f);
+    const struct codegen_condition negated = {
+        .condition = invert_condition(condition.condition),
+        .true_label = condition.false_label,
+        .false_label = condition.true_label,
+    };
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_logic_negate.\n"
-            "\tmov al, [%s + %lu]\n"
-            "\tneg al\n"
-            "\tadd al, 1\n"
-            "\tmov [TMP + %lu], al\n",
-            label,
-            original_address,
-            f->address);
+    new_temporary(ctx, f);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_logic_negate.");
+    set_from_condition(ctx, f, &negated);
 }
 
 void
-codegen_convert_to_integer(struct codegen_value_info *info)
+codegen_convert_to_integer(struct codegen_ctx *ctx,
+                           struct codegen_value_info *info)
 {
     assert(info->type == SYMBOL_TYPE_FLOATING_POINT);
 
-    const uint64_t original_address = info->address;
-    const char *label = label_from_section(info->section);
+    if (is_constant(info)) {
+        const float value = constant_float(info);
+        info->type = SYMBOL_TYPE_INTEGER;
+        // Like cvtss2si, floats that don't fit give the smallest integer.
+        set_constant(info,
+                     value >= -2147483648.0f && value < 2147483648.0f
+                         ? (uint32_t)(int32_t)value
+                         : UINT32_C(0x80000000));
+        return;
+    }
+
+    const struct codegen_value_info original = *info;
 
     // Update value information.
-    info->section = SYMBOL_SECTION_NONE;
     info->type = SYMBOL_TYPE_INTEGER;
-    info->address = get_next_address(&current_bss_tmp_address, info->size);
+    new_temporary(ctx, info);
 
     // We definitely want to truncate here and the right instruction
     // would be cvttss2si (the extra t is for truncation).
     // Since I can't use it, I'm gonna round the number before converting... :(
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_convert_to_integer.\n"
-            "\tmovss xmm0, [%s + %lu]\n"
-            "\troundss xmm0, xmm0, 0b0011\n"
-            "\tcvtss2si eax, xmm0\n"
-            "\tmov [TMP + %lu], eax\n",
-            label,
-            original_address,
-            info->address);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_convert_to_integer.");
+    emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, &original));
+    emit3(ctx, IR_OPCODE_ROUNDSS, XMM(0), XMM(0), ir_immediate(3));
+    emit2(ctx, IR_OPCODE_CVTSS2SI, EAX, XMM(0));
+    emit2(ctx, IR_OPCODE_MOV, value_operand(info, 4), EAX);
 }
 
 void
-codegen_convert_to_floating_point(struct codegen_value_info *info)
+codegen_convert_to_floating_point(struct codegen_ctx *ctx,
+                                  struct codegen_value_info *info)
 {
     assert(info->type == SYMBOL_TYPE_INTEGER);
 
-    const uint64_t original_address = info->address;
-    const char *label = label_from_section(info->section);
+    if (is_constant(info)) {
+        info->type = SYMBOL_TYPE_FLOATING_POINT;
+        set_float_constant(info, (float)constant_integer(info));
+        return;
+    }
+
+    const struct codegen_value_info original = *info;
 
     // Update value information.
-    info->section = SYMBOL_SECTION_NONE;
     info->type = SYMBOL_TYPE_FLOATING_POINT;
-    info->address = get_next_address(&current_bss_tmp_address, info->size);
-
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_convert_to_floating_point.\n"
-            "\tmov eax, [%s + %lu]\n"
-            "\tcdqe\n"
-            "\tcvtsi2ss xmm0, rax\n"
-            "\tmovss [TMP + %lu], xmm0\n",
-            label,
-            original_address,
-            info->address);
+    new_temporary(ctx, info);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_convert_to_floating_point.");
+    emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(&original, 4));
+    emit0(ctx, IR_OPCODE_CDQE);
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(0), RAX);
+    emit2(ctx, IR_OPCODE_MOVSS, value_operand(info, 4), XMM(0));
 }
 
 static void
-perform_addition_or_subtraction(const char *instr,
+perform_addition_or_subtraction(struct codegen_ctx *ctx,
+                                enum ir_opcode integer_opcode,
+                                enum ir_opcode float_opcode,
                                 struct codegen_value_info *exps_info,
                                 const struct codegen_value_info *t_info)
 {
     assert(exps_info->type == t_info->type);
 
-    const uint64_t original_address = exps_info->address;
-    const char *exps_label = label_from_section(exps_info->section);
-    const char *t_label = label_from_section(t_info->section);
+    if (is_constant(exps_info) && is_constant(t_info)) {
+        const uint8_t is_addition = integer_opcode == IR_OPCODE_ADD;
+        if (exps_info->type == SYMBOL_TYPE_FLOATING_POINT) {
+            const float lhs = constant_float(exps_info);
+            const float rhs = constant_float(t_info);
+            set_float_constant(exps_info, is_addition ? lhs + rhs : lhs - rhs);
+        } else {
+            const uint32_t lhs = (uint32_t)exps_info->address;
+            const uint32_t rhs = (uint32_t)t_info->address;
+            set_constant(exps_info, is_addition ? lhs + rhs : lhs - rhs);
+        }
+        return;
+    }
+
+    const struct codegen_value_info original = *exps_info;
 
-    exps_info->section = SYMBOL_SECTION_NONE;
-    exps_info->address =
-        get_next_address(&current_bss_tmp_address, exps_info->size);
+    new_temporary(ctx, exps_info);
 
-    fputs("\tsection .text\n"
-          "\t; perform_addition_or_subtraction.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "perform_addition_or_subtraction.");
 
     if (exps_info->type == SYMBOL_TYPE_FLOATING_POINT) {
-        fprintf(tmp_file,
-                "\tmovss xmm0, [%s + %lu]\n"
-                "\tmovss xmm1, [%s + %lu]\n"
-                "\t%sss xmm0, xmm1\n"
-                "\tmovss [TMP + %lu], xmm0\n",
-                exps_label,
-                original_address,
-                t_label,
-                t_info->address,
-                instr,
-                exps_info->address);
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, &original));
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(1), float_operand(ctx, t_info));
+        emit2(ctx, float_opcode, XMM(0), XMM(1));
+        emit2(ctx, IR_OPCODE_MOVSS, value_operand(exps_info, 4), XMM(0));
     } else if (exps_info->type == SYMBOL_TYPE_INTEGER) {
-        fprintf(tmp_file,
-                "\tmov eax, [%s + %lu]\n"
-                "\tmov ebx, [%s + %lu]\n"
-                "\t%s eax, ebx\n"
-                "\tmov [TMP + %lu], eax\n",
-                exps_label,
-                original_address,
-                t_label,
-                t_info->address,
-                instr,
-                exps_info->address);
+        emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(&original, 4));
+        emit2(ctx, IR_OPCODE_MOV, EBX, value_operand(t_info, 4));
+        emit2(ctx, integer_opcode, EAX, EBX);
+        emit2(ctx, IR_OPCODE_MOV, value_operand(exps_info, 4), EAX);
     } else {
         UNREACHABLE();
     }
 }
 
 void
-codegen_perform_addition(struct codegen_value_info *exps_info,
+codegen_perform_addition(struct codegen_ctx *ctx,
+                         struct codegen_value_info *exps_info,
                          const struct codegen_value_info *t_info)
 {
-    perform_addition_or_subtraction("add", exps_info, t_info);
+    perform_addition_or_subtraction(
+        ctx, IR_OPCODE_ADD, IR_OPCODE_ADDSS, exps_info, t_info);
 }
 
 void
-codegen_perform_subtraction(struct codegen_value_info *exps_info,
+codegen_perform_subtraction(struct codegen_ctx *ctx,
+                            struct codegen_value_info *exps_info,
                             const struct codegen_value_info *t_info)
 {
-    perform_addition_or_subtraction("sub", exps_info, t_info);
+    perform_addition_or_subtraction(
+        ctx, IR_OPCODE_SUB, IR_OPCODE_SUBSS, exps_info, t_info);
 }
 
 void
-codegen_perform_logical_or(struct codegen_value_info *exps_info,
-                           const struct codegen_value_info *t_info)
+codegen_start_logical(struct codegen_ctx *ctx,
+                      enum token operation_tok,
+                      struct codegen_logical *logical,
+                      const struct codegen_value_info *lhs_info)
 {
-    assert(exps_info->type == t_info->type);
+    assert(lhs_info->type == SYMBOL_TYPE_LOGIC);
+
+    const uint8_t is_and = operation_tok == TOKEN_LOGICAL_AND;
+    logical->operation_tok = operation_tok;
+
+    if (is_constant(lhs_info)) {
+        logical->skip_label = get_next_label(ctx);
+        // false && and true || don't need the right operand.
+        if ((lhs_info->address != 0) != is_and) {
+            emit_section(ctx, IR_SECTION_TEXT);
+            emit_comment(ctx, "codegen_start_logical.");
+            emit_jmp(ctx, logical->skip_label);
+        }
+        logical->rhs_start = next_position(ctx);
+        return;
+    }
 
-    const uint64_t original_address = exps_info->address;
-    const char *exps_label = label_from_section(exps_info->section);
-    const char *t_label = label_from_section(t_info->section);
+    const struct codegen_condition condition = take_condition(ctx, lhs_info);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_start_logical.");
+
+    // The right operand is skipped when the left one is false for && and
+    // true for ||, and starts where the left one goes otherwise.
+    if (is_and) {
+        logical->skip_label = condition.false_label != CODEGEN_NO_LABEL
+                                  ? condition.false_label
+                                  : get_next_label(ctx);
+        emit_jcc(
+            ctx, invert_condition(condition.condition), logical->skip_label);
+        if (condition.true_label != CODEGEN_NO_LABEL)
+            emit_label(ctx, condition.true_label);
+    } else {
+        logical->skip_label = condition.true_label != CODEGEN_NO_LABEL
+                                  ? condition.true_label
+                                  : get_next_label(ctx);
+        emit_jcc(ctx, condition.condition, logical->skip_label);
+        if (condition.false_label != CODEGEN_NO_LABEL)
+            emit_label(ctx, condition.false_label);
+    }
 
-    exps_info->section = SYMBOL_SECTION_NONE;
-    exps_info->address =
-        get_next_address(&current_bss_tmp_address, exps_info->size);
+    logical->rhs_start = next_position(ctx);
+}
 
-    char je_label_buffer[16];
-    get_next_label(je_label_buffer, sizeof(je_label_buffer));
+void
+codegen_finish_logical(struct codegen_ctx *ctx,
+                       const struct codegen_logical *logical,
+                       struct codegen_value_info *lhs_info,
+                       const struct codegen_value_info *rhs_info)
+{
+    assert(lhs_info->type == rhs_info->type);
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_perform_logical_or.\n"
-            "\tmov al, [%s + %lu]\n"
-            "\tmov bl, [%s + %lu]\n"
-            "\tadd al, bl\n"
-            "\tcmp al, 0\n"
-            "\tje %s\n"
-            "\tmov al, 1\n"
-            "%s:\n"
-            "\tmov [TMP + %lu], al\n",
-            exps_label,
-            original_address,
-            t_label,
-            t_info->address,
-            je_label_buffer,
-            je_label_buffer,
-            exps_info->address);
+    const uint8_t is_and = logical->operation_tok == TOKEN_LOGICAL_AND;
+
+    if (is_constant(lhs_info)) {
+        if ((lhs_info->address != 0) == is_and) {
+            *lhs_info = *rhs_info;
+            return;
+        }
+
+        // Nothing to skip when the right operand had no code.
+        const struct codegen_position position = next_position(ctx);
+        if (position.block == logical->rhs_start.block &&
+            position.index == logical->rhs_start.index) {
+            last_instruction(ctx)->opcode = IR_OPCODE_DELETED;
+        } else {
+            emit_section(ctx, IR_SECTION_TEXT);
+            emit_comment(ctx, "codegen_finish_logical.");
+            emit_label(ctx, logical->skip_label);
+        }
+        return;
+    }
+
+    struct codegen_condition condition = take_condition(ctx, rhs_info);
+
+    // The right operand's own jumps that decide the result the way the
+    // left one does are sent to the same place.
+    if (is_and) {
+        if (condition.false_label != CODEGEN_NO_LABEL) {
+            rename_label(ctx,
+                         logical->rhs_start,
+                         condition.false_label,
+                         logical->skip_label);
+        }
+        condition.false_label = logical->skip_label;
+    } else {
+        if (condition.true_label != CODEGEN_NO_LABEL) {
+            rename_label(ctx,
+                         logical->rhs_start,
+                         condition.true_label,
+                         logical->skip_label);
+        }
+        condition.true_label = logical->skip_label;
+    }
+
+    new_temporary(ctx, lhs_info);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_finish_logical.");
+    set_from_condition(ctx, lhs_info, &condition);
 }
 
 void
-codegen_negate(struct codegen_value_info *t_info)
+codegen_negate(struct codegen_ctx *ctx, struct codegen_value_info *t_info)
 {
-    const uint64_t original_address = t_info->address;
-    const char *label = label_from_section(t_info->section);
+    if (is_constant(t_info)) {
+        // The float is subtracted from 0 like below, so -0.0 is 0.0.
+        if (t_info->type == SYMBOL_TYPE_FLOATING_POINT)
+            set_float_constant(t_info, 0.0f - constant_float(t_info));
+        else
+            set_constant(t_info, 0U - (uint32_t)t_info->address);
+        return;
+    }
+
+    const struct codegen_value_info original = *t_info;
 
-    t_info->section = SYMBOL_SECTION_NONE;
-    t_info->address = get_next_address(&current_bss_tmp_address, t_info->size);
+    new_temporary(ctx, t_info);
 
-    fputs("\tsection .text\n"
-          "\t; codegen_negate.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_negate.");
 
     if (t_info->type == SYMBOL_TYPE_FLOATING_POINT) {
-        fprintf(tmp_file,
-                "\tmov rax, 0\n"
-                "\tcvtsi2ss xmm0, rax\n"
-                "\tmovss xmm1, [%s + %lu]\n"
-                "\tsubss xmm0, xmm1\n"
-                "\tmovss [TMP + %lu], xmm0\n",
-                label,
-                original_address,
-                t_info->address);
+        emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(0));
+        emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(0), RAX);
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(1), float_operand(ctx, &original));
+        emit2(ctx, IR_OPCODE_SUBSS, XMM(0), XMM(1));
+        emit2(ctx, IR_OPCODE_MOVSS, value_operand(t_info, 4), XMM(0));
     } else if (t_info->type == SYMBOL_TYPE_INTEGER) {
-        fprintf(tmp_file,
-                "\tmov eax, [%s + %lu]\n"
-                "\tneg eax\n"
-                "\tmov [TMP + %lu], eax\n",
-                label,
-                original_address,
-                t_info->address);
+        emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(&original, 4));
+        emit1(ctx, IR_OPCODE_NEG, EAX);
+        emit2(ctx, IR_OPCODE_MOV, value_operand(t_info, 4), EAX);
     } else {
         UNREACHABLE();
     }
 }
 
 void
-codegen_perform_multiplication(struct codegen_value_info *t_info,
+codegen_perform_multiplication(struct codegen_ctx *ctx,
+                               struct codegen_value_info *t_info,
                                const struct codegen_value_info *f_info)
 {
     assert(t_info->type == f_info->type);
 
-    const uint64_t original_address = t_info->address;
-    const char *t_label = label_from_section(t_info->section);
-    const char *f_label = label_from_section(f_info->section);
+    if (is_constant(t_info) && is_constant(f_info)) {
+        if (t_info->type == SYMBOL_TYPE_FLOATING_POINT) {
+            set_float_constant(t_info,
+                               constant_float(t_info) * constant_float(f_info));
+        } else {
+            set_constant(t_info,
+                         (uint32_t)t_info->address * (uint32_t)f_info->address);
+        }
+        return;
+    }
+
+    const struct codegen_value_info original = *t_info;
 
-    fputs("\tsection .text\n"
-          "\t; codegen_perform_multiplication.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_perform_multiplication.");
 
-    t_info->section = SYMBOL_SECTION_NONE;
-    t_info->address = get_next_address(&current_bss_tmp_address, t_info->size);
+    new_temporary(ctx, t_info);
 
     if (t_info->type == SYMBOL_TYPE_FLOATING_POINT) {
-        fprintf(tmp_file,
-                "\tmovss xmm0, [%s + %lu]\n"
-                "\tmovss xmm1, [%s + %lu]\n"
-                "\tmulss xmm0, xmm1\n"
-                "\tmovss [TMP + %lu], xmm0\n",
-                t_label,
-                original_address,
-                f_label,
-                f_info->address,
-                t_info->address);
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, &original));
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(1), float_operand(ctx, f_info));
+        emit2(ctx, IR_OPCODE_MULSS, XMM(0), XMM(1));
+        emit2(ctx, IR_OPCODE_MOVSS, value_operand(t_info, 4), XMM(0));
     } else if (t_info->type == SYMBOL_TYPE_INTEGER) {
-        fprintf(tmp_file,
-                "\tmov eax, [%s + %lu]\n"
-                "\tmov ebx, [%s + %lu]\n"
-                "\timul ebx\n"
-                "\tmov [TMP + %lu], eax\n",
-                t_label,
-                original_address,
-                f_label,
-                f_info->address,
-                t_info->address);
+        emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(&original, 4));
+        emit2(ctx, IR_OPCODE_MOV, EBX, value_operand(f_info, 4));
+        emit1(ctx, IR_OPCODE_IMUL, EBX);
+        emit2(ctx, IR_OPCODE_MOV, value_operand(t_info, 4), EAX);
     } else {
         UNREACHABLE();
     }
 }
 
 void
-codegen_perform_division(struct codegen_value_info *t_info,
+codegen_perform_division(struct codegen_ctx *ctx,
+                         struct codegen_value_info *t_info,
                          const struct codegen_value_info *f_info)
 {
     assert(t_info->type == f_info->type);
 
     if (t_info->type == SYMBOL_TYPE_INTEGER) {
-        codegen_perform_integer_division(t_info, f_info);
+        codegen_perform_integer_division(ctx, t_info, f_info);
+        return;
+    }
+
+    if (is_constant(t_info) && is_constant(f_info)) {
+        set_float_constant(t_info,
+                           constant_float(t_info) / constant_float(f_info));
         return;
     }
 
-    const uint64_t original_address = t_info->address;
-    const char *t_label = label_from_section(t_info->section);
-    const char *f_label = label_from_section(f_info->section);
+    const struct codegen_value_info original = *t_info;
 
-    fputs("\tsection .text ; codegen_perform_division.\n", tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_perform_division.");
 
-    t_info->section = SYMBOL_SECTION_NONE;
-    t_info->address = get_next_address(&current_bss_tmp_address, t_info->size);
+    new_temporary(ctx, t_info);
 
     if (t_info->type == SYMBOL_TYPE_FLOATING_POINT) {
-        fprintf(tmp_file,
-                "\tmovss xmm0, [%s + %lu]\n"
-                "\tmovss xmm1, [%s + %lu]\n"
-                "\tdivss xmm0, xmm1\n"
-                "\tmovss [TMP + %lu], xmm0\n",
-                t_label,
-                original_address,
-                f_label,
-                f_info->address,
-                t_info->address);
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, &original));
+        emit2(ctx, IR_OPCODE_MOVSS, XMM(1), float_operand(ctx, f_info));
+        emit2(ctx, IR_OPCODE_DIVSS, XMM(0), XMM(1));
+        emit2(ctx, IR_OPCODE_MOVSS, value_operand(t_info, 4), XMM(0));
     } else {
         UNREACHABLE();
     }
 }
 
 static void
-perform_integer_division(struct codegen_value_info *t_info,
+perform_integer_division(struct codegen_ctx *ctx,
+                         struct codegen_value_info *t_info,
                          const struct codegen_value_info *f_info)
 {
     assert(t_info->type == f_info->type);
 
-    const uint64_t original_address = t_info->address;
-    const char *t_label = label_from_section(t_info->section);
-    const char *f_label = label_from_section(f_info->section);
+    const struct codegen_value_info original = *t_info;
 
-    fputs("\tsection .text\n"
-          "\t; perform_integer_division.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "perform_integer_division.");
 
-    t_info->section = SYMBOL_SECTION_NONE;
-    t_info->address = get_next_address(&current_bss_tmp_address, t_info->size);
+    new_temporary(ctx, t_info);
 
     if (t_info->type == SYMBOL_TYPE_INTEGER) {
-        fprintf(tmp_file,
-                "\tmov eax, [%s + %lu]\n"
-                "\tmov ebx, [%s + %lu]\n"
-                "\tcdq\n"
-                "\tidiv ebx\n",
-                t_label,
-                original_address,
-                f_label,
-                f_info->address);
+        emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(&original, 4));
+        emit2(ctx, IR_OPCODE_MOV, EBX, value_operand(f_info, 4));
+        emit0(ctx, IR_OPCODE_CDQ);
+        emit1(ctx, IR_OPCODE_IDIV, EBX);
     } else {
         UNREACHABLE();
     }
 }
 
-void
-codegen_perform_integer_division(struct codegen_value_info *t_info,
-                                 const struct codegen_value_info *f_info)
+/*
+ * Whether t div f is known at compile time. Dividing by zero and INT32_MIN
+ * div -1 are left to fault at runtime.
+ * */
+static uint8_t
+is_constant_division(const struct codegen_value_info *t_info,
+                     const struct codegen_value_info *f_info)
 {
-    perform_integer_division(t_info, f_info);
-    fprintf(tmp_file,
-            "\tmov [TMP + %lu], eax ; codegen_perform_integer_division\n",
-            t_info->address);
+    return is_constant(t_info) && is_constant(f_info) &&
+           constant_integer(f_info) != 0 &&
+           !(constant_integer(t_info) == INT32_MIN &&
+             constant_integer(f_info) == -1);
 }
 
 void
-codegen_perform_mod(struct codegen_value_info *t_info,
-                    const struct codegen_value_info *f_info)
+codegen_perform_integer_division(struct codegen_ctx *ctx,
+                                 struct codegen_value_info *t_info,
+                                 const struct codegen_value_info *f_info)
 {
-    perform_integer_division(t_info, f_info);
-    fprintf(tmp_file,
-            "\tmov [TMP + %lu], edx ; codegen_perform_integer_division\n",
-            t_info->address);
+    if (is_constant_division(t_info, f_info)) {
+        set_constant(t_info,
+                     (uint32_t)(constant_integer(t_info) /
+                                constant_integer(f_info)));
+        return;
+    }
+
+    perform_integer_division(ctx, t_info, f_info);
+    emit2(ctx, IR_OPCODE_MOV, value_operand(t_info, 4), EAX);
 }
 
 void
-codegen_perform_and(struct codegen_value_info *t_info,
+codegen_perform_mod(struct codegen_ctx *ctx,
+                    struct codegen_value_info *t_info,
                     const struct codegen_value_info *f_info)
 {
-    assert(t_info->type == f_info->type);
-
-    const uint64_t original_address = t_info->address;
-    const char *t_label = label_from_section(t_info->section);
-    const char *f_label = label_from_section(f_info->section);
-
-    t_info->section = SYMBOL_SECTION_NONE;
-    t_info->address = get_next_address(&current_bss_tmp_address, t_info->size);
-
-    char jne_label_buffer[16];
-    get_next_label(jne_label_buffer, sizeof(jne_label_buffer));
-
-    char end_label_buffer[16];
-    get_next_label(end_label_buffer, sizeof(end_label_buffer));
+    if (is_constant_division(t_info, f_info)) {
+        set_constant(t_info,
+                     (uint32_t)(constant_integer(t_info) %
+                                constant_integer(f_info)));
+        return;
+    }
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_perform_logical_and.\n"
-            "\tmov al, [%s + %lu]\n"
-            "\tmov bl, [%s + %lu]\n"
-            "\tadd al, bl\n"
-            "\tcmp al, 2\n"
-            "\tjne %s\n"
-            "\tmov al, 1\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov al, 0\n"
-            "%s:\n"
-            "\tmov [TMP + %lu], al\n",
-            t_label,
-            original_address,
-            f_label,
-            f_info->address,
-            jne_label_buffer,
-            end_label_buffer,
-            jne_label_buffer,
-            end_label_buffer,
-            t_info->address);
+    perform_integer_division(ctx, t_info, f_info);
+    emit2(ctx, IR_OPCODE_MOV, value_operand(t_info, 4), EDX);
 }
 
 static void
 change_value_to_bool(struct codegen_value_info *info)
 {
-    info->section = SYMBOL_SECTION_NONE;
     info->type = SYMBOL_TYPE_LOGIC;
     info->size = size_from_type(info->type);
 }
 
 static void
-load_and_compare(struct codegen_value_info *exp_info,
+load_and_compare(struct codegen_ctx *ctx,
+                 const struct codegen_value_info *exp_info,
                  const struct codegen_value_info *exps_info)
 {
-    const char *exp_label = label_from_section(exp_info->section);
-    const char *exps_label = label_from_section(exps_info->section);
-
-    fputs("\tsection .text\n"
-          "\t; load_and_compare.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "load_and_compare.");
 
     switch (exp_info->type) {
         case SYMBOL_TYPE_CHAR:
         case SYMBOL_TYPE_LOGIC:
-            fprintf(tmp_file,
-                    "\tmov al, [%s + %lu]\n"
-                    "\tmov bl, [%s + %lu]\n"
-                    "\tcmp al, bl\n",
-                    exp_label,
-                    exp_info->address,
-                    exps_label,
-                    exps_info->address);
+            emit2(ctx, IR_OPCODE_MOV, AL, value_operand(exp_info, 1));
+            emit2(ctx, IR_OPCODE_MOV, BL, value_operand(exps_info, 1));
+            emit2(ctx, IR_OPCODE_CMP, AL, BL);
             break;
         case SYMBOL_TYPE_INTEGER:
-            fprintf(tmp_file,
-                    "\tmov eax, [%s + %lu]\n"
-                    "\tmov ebx, [%s + %lu]\n"
-                    "\tcmp eax, ebx\n",
-                    exp_label,
-                    exp_info->address,
-                    exps_label,
-                    exps_info->address);
+            emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(exp_info, 4));
+            emit2(ctx, IR_OPCODE_MOV, EBX, value_operand(exps_info, 4));
+            emit2(ctx, IR_OPCODE_CMP, EAX, EBX);
             break;
         case SYMBOL_TYPE_FLOATING_POINT:
-            fprintf(tmp_file,
-                    "\tmovss xmm0, [%s + %lu]\n"
-                    "\tmovss xmm1, [%s + %lu]\n"
-                    "\tcomiss xmm0, xmm1\n",
-                    exp_label,
-                    exp_info->address,
-                    exps_label,
-                    exps_info->address);
+            emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, exp_info));
+            emit2(ctx, IR_OPCODE_MOVSS, XMM(1), float_operand(ctx, exps_info));
+            emit2(ctx, IR_OPCODE_COMISS, XMM(0), XMM(1));
             break;
         default:
             UNREACHABLE();
     }
 }
 
-static void
-generate_comparison_jump(enum token operation_tok, enum symbol_type type)
+/*
+ * Condition of the flags set by load_and_compare under which the
+ * comparison holds.
+ * */
+static enum ir_condition
+comparison_condition(enum token operation_tok, enum symbol_type type)
 {
-    const char *instr;
+    // Floats are compared with comiss, that sets the flags like an unsigned
+    // comparison.
+    const uint8_t is_unsigned = type == SYMBOL_TYPE_FLOATING_POINT;
     switch (operation_tok) {
         case TOKEN_EQUAL:
-            instr = "je";
-            break;
+            return IR_CONDITION_E;
         case TOKEN_NOT_EQUAL:
-            instr = "jne";
-            break;
+            return IR_CONDITION_NE;
         case TOKEN_LESS:
-            if (type != SYMBOL_TYPE_FLOATING_POINT)
-                instr = "jl";
-            else
-                instr = "jb";
-            break;
+            return is_unsigned ? IR_CONDITION_B : IR_CONDITION_L;
         case TOKEN_LESS_EQUAL:
-            if (type != SYMBOL_TYPE_FLOATING_POINT)
-                instr = "jle";
-            else
-                instr = "jbe";
-            break;
+            return is_unsigned ? IR_CONDITION_BE : IR_CONDITION_LE;
         case TOKEN_GREATER:
-            if (type != SYMBOL_TYPE_FLOATING_POINT)
-                instr = "jg";
-            else
-                instr = "ja";
-            break;
+            return is_unsigned ? IR_CONDITION_A : IR_CONDITION_G;
         case TOKEN_GREATER_EQUAL:
-            if (type != SYMBOL_TYPE_FLOATING_POINT)
-                instr = "jge";
-            else
-                instr = "jae";
-            break;
+            return is_unsigned ? IR_CONDITION_AE : IR_CONDITION_GE;
         default:
             UNREACHABLE();
     }
+}
 
-    char cmp_ok_label[16];
-    get_next_label(cmp_ok_label, sizeof(cmp_ok_label));
-
-    char cmp_not_ok_label[16];
-    get_next_label(cmp_not_ok_label, sizeof(cmp_not_ok_label));
+/*
+ * Compares two values known at compile time like load_and_compare and
+ * comparison_condition would. Chars and booleans are signed bytes, and
+ * comiss finds NaN equal to and less than anything.
+ * */
+static uint8_t
+constant_comparison(enum token operation_tok,
+                    const struct codegen_value_info *exp_info,
+                    const struct codegen_value_info *exps_info)
+{
+    uint8_t is_equal;
+    uint8_t is_less;
+    switch (exp_info->type) {
+        case SYMBOL_TYPE_CHAR:
+        case SYMBOL_TYPE_LOGIC: {
+            const int8_t lhs = (int8_t)(uint8_t)exp_info->address;
+            const int8_t rhs = (int8_t)(uint8_t)exps_info->address;
+            is_equal = lhs == rhs;
+            is_less = lhs < rhs;
+            break;
+        }
+        case SYMBOL_TYPE_INTEGER: {
+            const int32_t lhs = constant_integer(exp_info);
+            const int32_t rhs = constant_integer(exps_info);
+            is_equal = lhs == rhs;
+            is_less = lhs < rhs;
+            break;
+        }
+        case SYMBOL_TYPE_FLOATING_POINT: {
+            const float lhs = constant_float(exp_info);
+            const float rhs = constant_float(exps_info);
+            const uint8_t is_unordered = lhs != lhs || rhs != rhs;
+            is_equal = is_unordered || lhs == rhs;
+            is_less = is_unordered || lhs < rhs;
+            break;
+        }
+        default:
+            UNREACHABLE();
+    }
 
-    fputs("\t; generate_comparison_jump.\n", tmp_file);
-    fprintf(tmp_file,
-            "\t%s %s\n"
-            "\tmov al, 0\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov al, 1\n"
-            "%s:\n",
-            instr,
-            cmp_ok_label,
-            cmp_not_ok_label,
-            cmp_ok_label,
-            cmp_not_ok_label);
+    switch (operation_tok) {
+        case TOKEN_EQUAL:
+            return is_equal;
+        case TOKEN_NOT_EQUAL:
+            return !is_equal;
+        case TOKEN_LESS:
+            return is_less;
+        case TOKEN_LESS_EQUAL:
+            return is_less || is_equal;
+        case TOKEN_GREATER:
+            return !is_less && !is_equal;
+        case TOKEN_GREATER_EQUAL:
+            return !is_less;
+        default:
+            UNREACHABLE();
+    }
 }
 
 static void
-compare_string(enum token operation_tok,
-               struct codegen_value_info *exp_info,
+compare_string(struct codegen_ctx *ctx,
+               enum token operation_tok,
+               const struct codegen_value_info *exp_info,
                const struct codegen_value_info *exps_info)
 {
-    const char *exp_label = label_from_section(exp_info->section);
-    const char *exps_label = label_from_section(exps_info->section);
-
-    char loop_beg_label[16];
-    get_next_label(loop_beg_label, sizeof(loop_beg_label));
-
-    char ne_label[16];
-    get_next_label(ne_label, sizeof(ne_label));
-
-    char e_label[16];
-    get_next_label(e_label, sizeof(e_label));
-
-    char end_label[16];
-    get_next_label(end_label, sizeof(end_label));
-
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; compare_string.\n"
-            "\tmov rsi, %s\n"
-            "\tadd rsi, %lu\n"
-            "\tmov rdi, %s\n"
-            "\tadd rdi, %lu\n"
-            "%s:\n"
-            "\tmov al, [rsi]\n"
-            "\tmov bl, [rdi]\n"
-            "\tcmp al, bl\n"
-            "\tjne %s\n"
-            "\tcmp al, 0\n"
-            "\tje %s\n"
-            "\tadd rsi, 1\n"
-            "\tadd rdi, 1\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov al, %u\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov al, %u\n"
-            "%s:\n",
-            exp_label,
-            exp_info->address,
-            exps_label,
-            exps_info->address,
-            loop_beg_label,
-            ne_label,
-            e_label,
-            loop_beg_label,
-            ne_label,
-            operation_tok == TOKEN_EQUAL ? 0 : 1,
-            end_label,
-            e_label,
-            operation_tok == TOKEN_EQUAL ? 1 : 0,
-            end_label);
+    const uint32_t loop_beg_label = get_next_label(ctx);
+    const uint32_t ne_label = get_next_label(ctx);
+    const uint32_t e_label = get_next_label(ctx);
+    const uint32_t end_label = get_next_label(ctx);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "compare_string.");
+    emit2(ctx,
+          IR_OPCODE_MOV,
+          RSI,
+          ir_address(base_from_section(exp_info->section), 0));
+    emit2(ctx, IR_OPCODE_ADD, RSI, ir_immediate((int64_t)exp_info->address));
+    emit2(ctx,
+          IR_OPCODE_MOV,
+          RDI,
+          ir_address(base_from_section(exps_info->section), 0));
+    emit2(ctx, IR_OPCODE_ADD, RDI, ir_immediate((int64_t)exps_info->address));
+    emit_label(ctx, loop_beg_label);
+    emit2(ctx, IR_OPCODE_MOV, AL, ir_register_memory(IR_REGISTER_SI, 8, 1));
+    emit2(ctx, IR_OPCODE_MOV, BL, ir_register_memory(IR_REGISTER_DI, 8, 1));
+    emit2(ctx, IR_OPCODE_CMP, AL, BL);
+    emit_jcc(ctx, IR_CONDITION_NE, ne_label);
+    emit2(ctx, IR_OPCODE_CMP, AL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_E, e_label);
+    emit2(ctx, IR_OPCODE_ADD, RSI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_ADD, RDI, ir_immediate(1));
+    emit_jmp(ctx, loop_beg_label);
+    emit_label(ctx, ne_label);
+    emit2(ctx, IR_OPCODE_MOV, AL, ir_immediate(operation_tok != TOKEN_EQUAL));
+    emit_jmp(ctx, end_label);
+    emit_label(ctx, e_label);
+    emit2(ctx, IR_OPCODE_MOV, AL, ir_immediate(operation_tok == TOKEN_EQUAL));
+    emit_label(ctx, end_label);
 }
 
 void
-codegen_perform_comparison(enum token operation_tok,
+codegen_perform_comparison(struct codegen_ctx *ctx,
+                           enum token operation_tok,
                            struct codegen_value_info *exp_info,
                            const struct codegen_value_info *exps_info)
 {
     assert(exp_info->type == exps_info->type);
 
-    const uint64_t new_address = get_next_address(
-        &current_bss_tmp_address, size_from_type(SYMBOL_TYPE_LOGIC));
+    const struct codegen_value_info original = *exp_info;
+
+    change_value_to_bool(exp_info);
+    if (is_constant(&original) && is_constant(exps_info)) {
+        set_constant(exp_info,
+                     constant_comparison(operation_tok, &original, exps_info));
+        return;
+    }
+
+    new_temporary(ctx, exp_info);
 
-    if (exp_info->type != SYMBOL_TYPE_STRING) {
-        load_and_compare(exp_info, exps_info);
-        generate_comparison_jump(operation_tok, exp_info->type);
+    if (original.type != SYMBOL_TYPE_STRING) {
+        load_and_compare(ctx, &original, exps_info);
+        const struct codegen_condition condition = flags_condition(
+            comparison_condition(operation_tok, original.type));
+        set_from_condition(ctx, exp_info, &condition);
     } else {
-        compare_string(operation_tok, exp_info, exps_info);
+        compare_string(ctx, operation_tok, &original, exps_info);
+        emit2(ctx, IR_OPCODE_MOV, value_operand(exp_info, 1), AL);
     }
+}
 
-    fprintf(tmp_file,
-            "\tmov [TMP + %lu], al ; codegen_perform_comparison.\n",
-            new_address);
+static struct ir_operand
+symbol_memory(const struct symbol *id_entry, uint8_t size)
+{
+    return ir_memory(
+        base_from_section(id_entry->symbol_section), id_entry->address, size);
+}
 
-    exp_info->address = new_address;
-    change_value_to_bool(exp_info);
+static struct ir_operand
+symbol_address(const struct symbol *id_entry)
+{
+    return ir_address(base_from_section(id_entry->symbol_section),
+                      id_entry->address);
 }
 
 void
-codegen_move_to_id_entry(struct symbol *id_entry,
+codegen_move_to_id_entry(struct codegen_ctx *ctx,
+                         struct symbol *id_entry,
                          const struct codegen_value_info *exp)
 {
     assert(id_entry->symbol_type == exp->type);
 
-    const char *id_label = label_from_section(id_entry->symbol_section);
-    const char *exp_label = label_from_section(exp->section);
-
-    fputs("\tsection .text\n"
-          "\t; codegen_move_to_id_entry.\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_move_to_id_entry.");
 
     switch (id_entry->symbol_type) {
         case SYMBOL_TYPE_FLOATING_POINT:
-            fprintf(tmp_file,
-                    "\tmovss xmm0, [%s + %lu]\n"
-                    "\tmovss [%s + %lu], xmm0\n",
-                    exp_label,
-                    exp->address,
-                    id_label,
-                    id_entry->address);
+            emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, exp));
+            emit2(ctx, IR_OPCODE_MOVSS, symbol_memory(id_entry, 4), XMM(0));
             break;
         case SYMBOL_TYPE_INTEGER:
-            fprintf(tmp_file,
-                    "\tmov eax, [%s + %lu]\n"
-                    "\tmov [%s + %lu], eax\n",
-                    exp_label,
-                    exp->address,
-                    id_label,
-                    id_entry->address);
+            emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(exp, 4));
+            emit2(ctx, IR_OPCODE_MOV, symbol_memory(id_entry, 4), EAX);
             break;
         case SYMBOL_TYPE_LOGIC:
         case SYMBOL_TYPE_CHAR:
-            fprintf(tmp_file,
-                    "\tmov al, [%s + %lu]\n"
-                    "\tmov [%s + %lu], al\n",
-                    exp_label,
-                    exp->address,
-                    id_label,
-                    id_entry->address);
+            emit2(ctx, IR_OPCODE_MOV, AL, value_operand(exp, 1));
+            emit2(ctx, IR_OPCODE_MOV, symbol_memory(id_entry, 1), AL);
             break;
         case SYMBOL_TYPE_STRING: {
-            char loop_beg_label[16];
-            get_next_label(loop_beg_label, sizeof(loop_beg_label));
-
-            char loop_end_label[16];
-            get_next_label(loop_end_label, sizeof(loop_end_label));
-
-            fprintf(tmp_file,
-                    "\tmov rsi, %s\n"
-                    "\tadd rsi, %lu\n"
-                    "\tmov rdi, %s\n"
-                    "\tadd rdi, %lu\n"
-                    "%s:\n"
-                    "\tmov al, [rdi]\n"
-                    "\tmov [rsi], al\n"
-                    "\tcmp al, 0\n"
-                    "\tje %s\n"
-                    "\tadd rdi, 1\n"
-                    "\tadd rsi, 1\n"
-                    "\tjmp %s\n"
-                    "%s:\n",
-                    id_label,
-                    id_entry->address,
-                    exp_label,
-                    exp->address,
-                    loop_beg_label,
-                    loop_end_label,
-                    loop_beg_label,
-                    loop_end_label);
+            const uint32_t loop_beg_label = get_next_label(ctx);
+            const uint32_t loop_end_label = get_next_label(ctx);
+
+            emit2(ctx,
+                  IR_OPCODE_MOV,
+                  RSI,
+                  ir_address(base_from_section(id_entry->symbol_section), 0));
+            emit2(ctx,
+                  IR_OPCODE_ADD,
+                  RSI,
+                  ir_immediate((int64_t)id_entry->address));
+            emit2(ctx,
+                  IR_OPCODE_MOV,
+                  RDI,
+                  ir_address(base_from_section(exp->section), 0));
+            emit2(ctx, IR_OPCODE_ADD, RDI, ir_immediate((int64_t)exp->address));
+            emit_label(ctx, loop_beg_label);
+            emit2(ctx,
+                  IR_OPCODE_MOV,
+                  AL,
+                  ir_register_memory(IR_REGISTER_DI, 8, 1));
+            emit2(ctx,
+                  IR_OPCODE_MOV,
+                  ir_register_memory(IR_REGISTER_SI, 8, 1),
+                  AL);
+            emit2(ctx, IR_OPCODE_CMP, AL, ir_immediate(0));
+            emit_jcc(ctx, IR_CONDITION_E, loop_end_label);
+            emit2(ctx, IR_OPCODE_ADD, RDI, ir_immediate(1));
+            emit2(ctx, IR_OPCODE_ADD, RSI, ir_immediate(1));
+            emit_jmp(ctx, loop_beg_label);
+            emit_label(ctx, loop_end_label);
             break;
         }
         default:
@@ -1300,7 +1958,8 @@ codegen_move_to_id_entry(struct symbol *id_entry,
 }
 
 void
-codegen_move_to_id_entry_idx(struct symbol *id_entry,
+codegen_move_to_id_entry_idx(struct codegen_ctx *ctx,
+                             struct symbol *id_entry,
                              const struct codegen_value_info *exp,
                              const struct codegen_value_info *idx_expr_info)
 {
@@ -1308,367 +1967,296 @@ codegen_move_to_id_entry_idx(struct symbol *id_entry,
     assert(exp->type == SYMBOL_TYPE_CHAR);
     assert(idx_expr_info->type == SYMBOL_TYPE_INTEGER);
 
-    const char *id_label = label_from_section(id_entry->symbol_section);
-    const char *exp_label = label_from_section(exp->section);
-    const char *idx_expr_info_label =
-        label_from_section(idx_expr_info->section);
-
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_move_to_id_entry_idx.\n"
-            "\tmov eax, [%s + %lu]\n"
-            "\tadd eax, %s + %lu\n"
-            "\tmov bl, [%s + %lu]\n"
-            "\tmov [eax], bl\n",
-            idx_expr_info_label,
-            idx_expr_info->address,
-            id_label,
-            id_entry->address,
-            exp_label,
-            exp->address);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_move_to_id_entry_idx.");
+    emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(idx_expr_info, 4));
+    emit2(ctx, IR_OPCODE_ADD, EAX, symbol_address(id_entry));
+    emit2(ctx, IR_OPCODE_MOV, BL, value_operand(exp, 1));
+    emit2(ctx, IR_OPCODE_MOV, ir_register_memory(IR_REGISTER_A, 4, 1), BL);
+    ++ctx->string_index_writes;
 }
 
 static void
-write_string(const struct codegen_value_info *exp)
+write_string(struct codegen_ctx *ctx, const struct codegen_value_info *exp)
 {
     const uint64_t tmp_address =
-        get_next_address(&current_bss_tmp_address, 257);
-
-    const char *label = label_from_section(exp->section);
-
-    char loop_label[16];
-    get_next_label(loop_label, sizeof(loop_label));
-
-    fprintf(tmp_file,
-            "\t; write_string\n"
-            "\tmov esi, %s + %lu\n"
-            "\tmov edi, TMP + %lu\n"
-            "%s:\n"
-            "\tmov al, [esi]\n"
-            "\tmov [edi], al\n"
-            "\tadd esi, 1\n"
-            "\tadd edi, 1\n"
-            "\tcmp al, 0\n"
-            "\tjne %s\n"
-            "\tmov esi, TMP + %lu\n"
-            "\tmov edx, edi\n"
-            "\tsub edx, esi\n"
-            "\tsub edx, 1\n",
-            label,
-            exp->address,
-            tmp_address,
-            loop_label,
-            loop_label,
-            tmp_address);
+        get_next_address(&ctx->current_bss_tmp_address, 257);
+
+    const uint32_t loop_label = get_next_label(ctx);
+
+    emit_comment(ctx, "write_string");
+    emit2(ctx,
+          IR_OPCODE_MOV,
+          ESI,
+          ir_address(base_from_section(exp->section), exp->address));
+    emit2(ctx, IR_OPCODE_MOV, EDI, ir_address(IR_BASE_TMP, tmp_address));
+    emit_label(ctx, loop_label);
+    emit2(ctx, IR_OPCODE_MOV, AL, ir_register_memory(IR_REGISTER_SI, 4, 1));
+    emit2(ctx, IR_OPCODE_MOV, ir_register_memory(IR_REGISTER_DI, 4, 1), AL);
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_CMP, AL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, loop_label);
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, EDX, EDI);
+    emit2(ctx, IR_OPCODE_SUB, EDX, ESI);
+    emit2(ctx, IR_OPCODE_SUB, EDX, ir_immediate(1));
 }
 
 static void
-write_char(const struct codegen_value_info *exp)
-{
-    const uint64_t tmp_address = get_next_address(&current_bss_tmp_address, 4);
-
-    const char *label = label_from_section(exp->section);
-    fprintf(tmp_file,
-            "\t; write_char\n"
-            // Recover char from memory.
-            "\tmov al, [%s + %lu]\n"
-            // Place it followed by a \0 in the temporary area.
-            "\tmov esi, TMP + %lu\n"
-            "\tmov [esi], al\n"
-            "\tadd esi, 1\n"
-            "\tmov al, 0\n"
-            "\tmov [esi], al\n"
-            // Address of buffer and size for syscall.
-            "\tmov esi, TMP + %lu\n"
-            "\tmov edx, 1\n",
-            label,
-            exp->address,
-            tmp_address,
-            tmp_address);
+write_char(struct codegen_ctx *ctx, const struct codegen_value_info *exp)
+{
+    const uint64_t tmp_address =
+        get_next_address(&ctx->current_bss_tmp_address, 4);
+
+    emit_comment(ctx, "write_char");
+    // Recover char from memory.
+    emit2(ctx, IR_OPCODE_MOV, AL, value_operand(exp, 1));
+    // Place it followed by a \0 in the temporary area.
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, ir_register_memory(IR_REGISTER_SI, 4, 1), AL);
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, AL, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, ir_register_memory(IR_REGISTER_SI, 4, 1), AL);
+    // Address of buffer and size for syscall.
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, EDX, ir_immediate(1));
 }
 
 static void
-write_logic(const struct codegen_value_info *exp)
-{
-    const char *exp_label = label_from_section(exp->section);
-    const uint64_t tmp_address = get_next_address(&current_bss_tmp_address, 8);
-
-    char jne_label[16];
-    get_next_label(jne_label, sizeof(jne_label));
-
-    char jmp_label[16];
-    get_next_label(jmp_label, sizeof(jmp_label));
-
-    fprintf(tmp_file,
-            "\t ; write_logic\n"
-            "\tmov rax, [%s + %lu]\n"
-            "\tcmp rax, 0\n"
-            "\tjne %s\n"
-            "\tmov rax, \"false\"\n"
-            "\tmov [TMP + %lu], rax\n"
-            "\tmov rsi, TMP + %lu\n"
-            "\tmov rdx, 5\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov rax, \"true\"\n"
-            "\tmov [TMP + %lu], rax\n"
-            "\tmov rsi, TMP + %lu\n"
-            "\tmov rdx, 5\n"
-            "%s:\n",
-            exp_label,
-            exp->address,
-            jne_label,
-            tmp_address,
-            tmp_address,
-            jmp_label,
-            jne_label,
-            tmp_address,
-            tmp_address,
-            jmp_label);
+write_logic(struct codegen_ctx *ctx, const struct codegen_value_info *exp)
+{
+    const uint64_t tmp_address =
+        get_next_address(&ctx->current_bss_tmp_address, 8);
+
+    const uint32_t jne_label = get_next_label(ctx);
+    const uint32_t jmp_label = get_next_label(ctx);
+
+    emit_comment(ctx, "write_logic");
+    emit2(ctx, IR_OPCODE_MOV, AL, value_operand(exp, 1));
+    emit2(ctx, IR_OPCODE_CMP, AL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, jne_label);
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(string_immediate("false")));
+    emit2(ctx, IR_OPCODE_MOV, tmp_memory(tmp_address, 8), RAX);
+    emit2(ctx, IR_OPCODE_MOV, RSI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(5));
+    emit_jmp(ctx, jmp_label);
+    emit_label(ctx, jne_label);
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_immediate(string_immediate("true")));
+    emit2(ctx, IR_OPCODE_MOV, tmp_memory(tmp_address, 8), RAX);
+    emit2(ctx, IR_OPCODE_MOV, RSI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(5));
+    emit_label(ctx, jmp_label);
 }
 
 static void
-write_integer(const struct codegen_value_info *exp)
-{
-    const char *exp_label = label_from_section(exp->section);
-    const uint64_t tmp_address = get_next_address(&current_bss_tmp_address, 32);
-
-    char jge_label[16];
-    get_next_label(jge_label, sizeof(jge_label));
-
-    char loop_beg_label[16];
-    get_next_label(loop_beg_label, sizeof(loop_beg_label));
-
-    char loop_1_beg_label[16];
-    get_next_label(loop_1_beg_label, sizeof(loop_1_beg_label));
-
-    fprintf(tmp_file,
-            "\t; write_integer\n"
-            // Number we will convert.
-            "\tmov eax, [%s + %lu]\n"
-            // String destination buffer.
-            "\tmov edi, TMP + %lu\n"
-            // Stack counter.
-            "\tmov ecx, 0\n"
-            // Size of converted string.
-            "\tmov esi, 0\n"
-            // Check if we need to place the - sign.
-            "\tcmp eax, 0\n"
-            "\tjge %s\n"
-            // We do need!
-            "\tmov bl, '-'\n"
-            "\tmov [edi], bl\n"
-            "\tadd edi, 1\n"
-            "\tadd esi, 1\n"
-            "\tneg eax\n"
-            // Actually convert the number.
-            "%s:\n"
-            "\tmov ebx, 10\n"
-            // Divide and push the rest into the stack
-            // until the result is non zero.
-            "%s:\n"
-            "\tadd ecx, 1\n"
-            "\tcdq\n"
-            "\tidiv ebx\n"
-            "\tpush dx\n"
-            "\tcmp eax, 0\n"
-            "\tjne %s\n"
-            // Total length of string.
-            // Our stack counter + original length.
-            "\tadd esi, ecx\n"
-            // Now we pop every element into the string buffer.
-            "%s:\n"
-            "\tpop dx\n"
-            "\tadd dl, '0'\n"
-            "\tmov [edi], dl\n"
-            "\tadd edi, 1\n"
-            "\tsub ecx, 1\n"
-            "\tcmp ecx, 0\n"
-            "\tjne %s\n"
-            // Place '\0' in the end.
-            "\tmov dl, 0\n"
-            "\tmov [edi], dl\n"
-            // Size from esi to edx for syscall.
-            // esi receives buffer adress.
-            "\tmov edx, esi\n"
-            "\tmov esi, TMP + %lu\n",
-            exp_label,
-            exp->address,
-            tmp_address,
-            jge_label,
-            jge_label,
-            loop_beg_label,
-            loop_beg_label,
-            loop_1_beg_label,
-            loop_1_beg_label,
-            tmp_address);
+write_integer(struct codegen_ctx *ctx, const struct codegen_value_info *exp)
+{
+    const uint64_t tmp_address =
+        get_next_address(&ctx->current_bss_tmp_address, 32);
+
+    const uint32_t jge_label = get_next_label(ctx);
+    const uint32_t loop_beg_label = get_next_label(ctx);
+    const uint32_t loop_1_beg_label = get_next_label(ctx);
+
+    const struct ir_operand edi_byte = ir_register_memory(IR_REGISTER_DI, 4, 1);
+
+    emit_comment(ctx, "write_integer");
+    // Number we will convert.
+    emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(exp, 4));
+    // String destination buffer.
+    emit2(ctx, IR_OPCODE_MOV, EDI, ir_address(IR_BASE_TMP, tmp_address));
+    // Stack counter.
+    emit2(ctx, IR_OPCODE_MOV, ECX, ir_immediate(0));
+    // Size of converted string.
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_immediate(0));
+    // Check if we need to place the - sign.
+    emit2(ctx, IR_OPCODE_CMP, EAX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_GE, jge_label);
+    // We do need!
+    emit2(ctx, IR_OPCODE_MOV, BL, ir_immediate('-'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, BL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit1(ctx, IR_OPCODE_NEG, EAX);
+    // Actually convert the number.
+    emit_label(ctx, jge_label);
+    emit2(ctx, IR_OPCODE_MOV, EBX, ir_immediate(10));
+    // Divide and push the rest into the stack
+    // until the result is non zero.
+    emit_label(ctx, loop_beg_label);
+    emit2(ctx, IR_OPCODE_ADD, ECX, ir_immediate(1));
+    emit0(ctx, IR_OPCODE_CDQ);
+    emit1(ctx, IR_OPCODE_IDIV, EBX);
+    emit1(ctx, IR_OPCODE_PUSH, DX);
+    emit2(ctx, IR_OPCODE_CMP, EAX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, loop_beg_label);
+    // Total length of string.
+    // Our stack counter + original length.
+    emit2(ctx, IR_OPCODE_ADD, ESI, ECX);
+    // Now we pop every element into the string buffer.
+    emit_label(ctx, loop_1_beg_label);
+    emit1(ctx, IR_OPCODE_POP, DX);
+    emit2(ctx, IR_OPCODE_ADD, DL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_SUB, ECX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_CMP, ECX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, loop_1_beg_label);
+    // Place '\0' in the end.
+    emit2(ctx, IR_OPCODE_MOV, DL, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    // Size from esi to edx for syscall.
+    // esi receives buffer adress.
+    emit2(ctx, IR_OPCODE_MOV, EDX, ESI);
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
 }
 
 static void
-write_float(const struct codegen_value_info *exp)
-{
-    const char *exp_label = label_from_section(exp->section);
-    const uint64_t tmp_address = get_next_address(&current_bss_tmp_address, 32);
-
-    char jae_label[16];
-    get_next_label(jae_label, sizeof(jae_label));
-
-    char int_conversion_beg_label[16];
-    get_next_label(int_conversion_beg_label, sizeof(int_conversion_beg_label));
-
-    char int_string_put_label[16];
-    get_next_label(int_string_put_label, sizeof(int_string_put_label));
-
-    char print_label[16];
-    get_next_label(print_label, sizeof(print_label));
-
-    char float_conversion_beg_label[16];
-    get_next_label(float_conversion_beg_label,
-                   sizeof(float_conversion_beg_label));
-
-    fprintf(tmp_file,
-            "\t; write_float\n"
-            // Number we will convert.
-            "\tmovss xmm0, [%s + %lu]\n"
-            // String destination buffer.
-            "\tmov edi, TMP + %lu\n"
-            // Stack counter.
-            "\tmov ecx, 0\n"
-            // Precision of 6 digits (shared between integer and fraction).
-            "\tmov esi, 6\n"
-            // Set the divisor.
-            "\tmov ebx, 10\n"
-            "\tcvtsi2ss xmm2, ebx\n"
-            // Check if we need to place the - sign.
-            "\tsubss xmm1, xmm1\n"
-            "\tcomiss xmm0, xmm1\n"
-            "\tjae %s\n"
-            "\tmov bl, '-'\n"
-            "\tmov [edi], bl\n"
-            "\tadd edi, 1\n"
-            // Also negate the value.
-            "\tmov edx, -1\n"
-            "\tcvtsi2ss xmm1, edx\n"
-            "\tmulss xmm0, xmm1\n"
-            "%s:\n"
-            // Place the integer into xmm1 and leave the fraction in xmm0.
-            "\troundss xmm1, xmm0, 0b0011\n"
-            "\tsubss xmm0, xmm1\n"
-            // Convert integer
-            "\tcvtss2si eax, xmm1\n"
-            "\tmov ebx, 10\n"
-            "%s:\n"
-            "\tadd ecx, 1\n"
-            "\tcdq\n"
-            "\tidiv ebx\n"
-            "\tpush dx\n"
-            "\tcmp eax, 0\n"
-            "\tjne %s\n"
-            // Calculate the precision (digits we still have to write).
-            "\tsub esi, ecx\n"
-            // Place integer into buffer.
-            "%s:\n"
-            "\tpop dx\n"
-            "\tadd dl, '0'\n"
-            "\tmov [edi], dl\n"
-            "\tadd edi, 1\n"
-            "\tsub ecx, 1\n"
-            "\tcmp ecx, 0\n"
-            "\tjne %s\n"
-            // Place decimal point.
-            "\tmov dl, '.'\n"
-            "\tmov [edi], dl\n"
-            "\tadd edi, 1\n"
-            // Check if we still have precision to convert the fraction.
-            "%s:\n"
-            "\tcmp esi, 0\n"
-            "\tjle %s\n"
-            // Multiply the fraction by ten so we can get the next digit.
-            "\tmulss xmm0, xmm2\n"
-            "\troundss xmm1, xmm0, 0b0011\n"
-            // Update xmm0 so that it has only fraction.
-            "\tsubss xmm0, xmm1\n"
-            // Converted digit in edx.
-            "\tcvtss2si edx, xmm1\n"
-            "\tadd dl, '0'\n"
-            "\tmov [edi], dl\n"
-            "\tadd edi, 1\n"
-            "\tsub esi, 1\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            // Place NULL terminator.
-            "\tmov dl, 0\n"
-            "\tmov [edi], dl\n"
-            // Beginning of buffer in esi for syscall.
-            "\tmov esi, TMP + %lu\n"
-            // Calculate size of converted string.
-            "\tsub edi, esi\n"
-            "\tmov edx, edi\n",
-            exp_label,
-            exp->address,
-            tmp_address,
-            jae_label,
-            jae_label,
-            int_conversion_beg_label,
-            int_conversion_beg_label,
-            int_string_put_label,
-            int_string_put_label,
-            float_conversion_beg_label,
-            print_label,
-            float_conversion_beg_label,
-            print_label,
-            tmp_address);
+write_float(struct codegen_ctx *ctx, const struct codegen_value_info *exp)
+{
+    const uint64_t tmp_address =
+        get_next_address(&ctx->current_bss_tmp_address, 32);
+
+    const uint32_t jae_label = get_next_label(ctx);
+    const uint32_t int_conversion_beg_label = get_next_label(ctx);
+    const uint32_t int_string_put_label = get_next_label(ctx);
+    const uint32_t print_label = get_next_label(ctx);
+    const uint32_t float_conversion_beg_label = get_next_label(ctx);
+
+    const struct ir_operand edi_byte = ir_register_memory(IR_REGISTER_DI, 4, 1);
+
+    emit_comment(ctx, "write_float");
+    // Number we will convert.
+    emit2(ctx, IR_OPCODE_MOVSS, XMM(0), float_operand(ctx, exp));
+    // String destination buffer.
+    emit2(ctx, IR_OPCODE_MOV, EDI, ir_address(IR_BASE_TMP, tmp_address));
+    // Stack counter.
+    emit2(ctx, IR_OPCODE_MOV, ECX, ir_immediate(0));
+    // Precision of 6 digits (shared between integer and fraction).
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_immediate(6));
+    // Set the divisor.
+    emit2(ctx, IR_OPCODE_MOV, EBX, ir_immediate(10));
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(2), EBX);
+    // Check if we need to place the - sign.
+    emit2(ctx, IR_OPCODE_XORPS, XMM(1), XMM(1));
+    emit2(ctx, IR_OPCODE_COMISS, XMM(0), XMM(1));
+    emit_jcc(ctx, IR_CONDITION_AE, jae_label);
+    emit2(ctx, IR_OPCODE_MOV, BL, ir_immediate('-'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, BL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    // Also negate the value.
+    emit2(ctx, IR_OPCODE_MOV, EDX, ir_immediate(-1));
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(1), EDX);
+    emit2(ctx, IR_OPCODE_MULSS, XMM(0), XMM(1));
+    emit_label(ctx, jae_label);
+    // Place the integer into xmm1 and leave the fraction in xmm0.
+    emit3(ctx, IR_OPCODE_ROUNDSS, XMM(1), XMM(0), ir_immediate(3));
+    emit2(ctx, IR_OPCODE_SUBSS, XMM(0), XMM(1));
+    // Convert integer
+    emit2(ctx, IR_OPCODE_CVTSS2SI, EAX, XMM(1));
+    emit2(ctx, IR_OPCODE_MOV, EBX, ir_immediate(10));
+    emit_label(ctx, int_conversion_beg_label);
+    emit2(ctx, IR_OPCODE_ADD, ECX, ir_immediate(1));
+    emit0(ctx, IR_OPCODE_CDQ);
+    emit1(ctx, IR_OPCODE_IDIV, EBX);
+    emit1(ctx, IR_OPCODE_PUSH, DX);
+    emit2(ctx, IR_OPCODE_CMP, EAX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, int_conversion_beg_label);
+    // Calculate the precision (digits we still have to write).
+    emit2(ctx, IR_OPCODE_SUB, ESI, ECX);
+    // Place integer into buffer.
+    emit_label(ctx, int_string_put_label);
+    emit1(ctx, IR_OPCODE_POP, DX);
+    emit2(ctx, IR_OPCODE_ADD, DL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_SUB, ECX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_CMP, ECX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, int_string_put_label);
+    // Place decimal point.
+    emit2(ctx, IR_OPCODE_MOV, DL, ir_immediate('.'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    // Check if we still have precision to convert the fraction.
+    emit_label(ctx, float_conversion_beg_label);
+    emit2(ctx, IR_OPCODE_CMP, ESI, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_LE, print_label);
+    // Multiply the fraction by ten so we can get the next digit.
+    emit2(ctx, IR_OPCODE_MULSS, XMM(0), XMM(2));
+    emit3(ctx, IR_OPCODE_ROUNDSS, XMM(1), XMM(0), ir_immediate(3));
+    // Update xmm0 so that it has only fraction.
+    emit2(ctx, IR_OPCODE_SUBSS, XMM(0), XMM(1));
+    // Converted digit in edx.
+    emit2(ctx, IR_OPCODE_CVTSS2SI, EDX, XMM(1));
+    emit2(ctx, IR_OPCODE_ADD, DL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    emit2(ctx, IR_OPCODE_ADD, EDI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_SUB, ESI, ir_immediate(1));
+    emit_jmp(ctx, float_conversion_beg_label);
+    emit_label(ctx, print_label);
+    // Place NULL terminator.
+    emit2(ctx, IR_OPCODE_MOV, DL, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, edi_byte, DL);
+    // Beginning of buffer in esi for syscall.
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
+    // Calculate size of converted string.
+    emit2(ctx, IR_OPCODE_SUB, EDI, ESI);
+    emit2(ctx, IR_OPCODE_MOV, EDX, EDI);
 }
 
 void
-codegen_write(const struct codegen_value_info *exp, uint8_t needs_new_line)
+codegen_write(struct codegen_ctx *ctx,
+              const struct codegen_value_info *exp,
+              uint8_t needs_new_line)
 {
-    fputs("\tsection .text\n"
-          "\t; codegen_write\n",
-          tmp_file);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_write");
 
     switch (exp->type) {
         case SYMBOL_TYPE_FLOATING_POINT:
-            write_float(exp);
+            write_float(ctx, exp);
             break;
         case SYMBOL_TYPE_INTEGER:
-            write_integer(exp);
+            write_integer(ctx, exp);
             break;
         case SYMBOL_TYPE_STRING:
-            write_string(exp);
+            write_string(ctx, exp);
             break;
         case SYMBOL_TYPE_CHAR:
-            write_char(exp);
+            write_char(ctx, exp);
             break;
         case SYMBOL_TYPE_LOGIC:
-            write_logic(exp);
+            write_logic(ctx, exp);
             break;
         default:
             UNREACHABLE();
     }
 
     if (needs_new_line) {
+        const struct ir_operand eax_byte =
+            ir_register_memory(IR_REGISTER_A, 4, 1);
+
         // Append a \n to the buffer.
-        fputs("\t; Appending \\n to the buffer.\n"
-              "\tmov eax, esi\n"
-              "\tadd eax, edx\n"
-              "\tmov bl, 0x0A\n"
-              "\tmov [eax], bl\n"
-              "\tadd eax, 1\n"
-              "\tmov bl, 0\n"
-              "\tmov [eax], bl\n"
-              "\tadd edx, 1\n",
-              tmp_file);
+        emit_comment(ctx, "Appending \\n to the buffer.");
+        emit2(ctx, IR_OPCODE_MOV, EAX, ESI);
+        emit2(ctx, IR_OPCODE_ADD, EAX, EDX);
+        emit2(ctx, IR_OPCODE_MOV, BL, ir_immediate(0x0A));
+        emit2(ctx, IR_OPCODE_MOV, eax_byte, BL);
+        emit2(ctx, IR_OPCODE_ADD, EAX, ir_immediate(1));
+        emit2(ctx, IR_OPCODE_MOV, BL, ir_immediate(0));
+        emit2(ctx, IR_OPCODE_MOV, eax_byte, BL);
+        emit2(ctx, IR_OPCODE_ADD, EDX, ir_immediate(1));
     }
 
-    fputs("\tmov eax, 1\n"
-          "\tmov edi, 1\n"
-          "\tsyscall\n",
-          tmp_file);
+    emit2(ctx, IR_OPCODE_MOV, EAX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, EDI, ir_immediate(1));
+    emit0(ctx, IR_OPCODE_SYSCALL);
 }
 
 void
-codegen_move_idx_to_tmp(const struct symbol *id_entry,
+codegen_move_idx_to_tmp(struct codegen_ctx *ctx,
+                        const struct symbol *id_entry,
                         const struct codegen_value_info *idx_expr_info,
                         struct codegen_value_info *f_info)
 {
@@ -1677,389 +2265,323 @@ codegen_move_idx_to_tmp(const struct symbol *id_entry,
 
     f_info->type = SYMBOL_TYPE_CHAR;
     f_info->size = size_from_type(f_info->type);
-    f_info->address = get_next_address(&current_bss_tmp_address, f_info->size);
-    f_info->section = SYMBOL_SECTION_NONE;
+    new_temporary(ctx, f_info);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_move_idx_to_tmp.");
+    emit2(ctx, IR_OPCODE_MOV, EAX, value_operand(idx_expr_info, 4));
+    emit2(ctx, IR_OPCODE_ADD, EAX, symbol_address(id_entry));
+    emit2(ctx, IR_OPCODE_MOV, BL, ir_register_memory(IR_REGISTER_A, 4, 1));
+    emit2(ctx, IR_OPCODE_MOV, value_operand(f_info, 1), BL);
+}
 
-    const char *idx_expr_info_label =
-        label_from_section(idx_expr_info->section);
-    const char *id_entry_label = label_from_section(id_entry->symbol_section);
+/*
+ * Remembers the loop for promote_run. The loop is just left in memory if
+ * there's no room for it.
+ * */
+static void
+add_promotable_loop(struct codegen_ctx *ctx, const struct codegen_loop *loop)
+{
+    if (ctx->loop_count == ctx->loop_capacity) {
+        const uint32_t capacity =
+            ctx->loop_capacity ? ctx->loop_capacity * 2 : 16;
+        struct promote_loop *loops =
+            realloc(ctx->loops, capacity * sizeof(*loops));
+        if (!loops)
+            return;
+
+        ctx->loops = loops;
+        ctx->loop_capacity = capacity;
+    }
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_move_idx_to_tmp.\n"
-            "\tmov eax, [%s + %lu]\n"
-            "\tadd eax, %s + %lu\n"
-            "\tmov bl, [eax]\n"
-            "\tmov [TMP + %lu], bl\n",
-            idx_expr_info_label,
-            idx_expr_info->address,
-            id_entry_label,
-            id_entry->address,
-            f_info->address);
+    ctx->loops[ctx->loop_count++] = (struct promote_loop){
+        .start_label = loop->start_label, .end_label = loop->end_label};
 }
 
-static char while_loop_start_label[16];
-static char while_loop_end_label[16];
-
 void
-codegen_start_loop(void)
+codegen_start_loop(struct codegen_ctx *ctx, struct codegen_loop *loop)
 {
-    get_next_label(while_loop_start_label, sizeof(while_loop_start_label));
-    get_next_label(while_loop_end_label, sizeof(while_loop_end_label));
+    loop->start_label = get_next_label(ctx);
+    loop->string_index_writes = ctx->string_index_writes;
 
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_start_loop.\n"
-            "%s:\n",
-            while_loop_start_label);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_start_loop.");
+    emit_label(ctx, loop->start_label);
 }
 
 void
-codegen_eval_loop_expr(const struct codegen_value_info *exp)
+codegen_eval_loop_expr(struct codegen_ctx *ctx,
+                       struct codegen_loop *loop,
+                       const struct codegen_value_info *exp)
 {
     assert(exp->type == SYMBOL_TYPE_LOGIC);
 
-    const char *exp_label = label_from_section(exp->section);
-
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_eval_loop_expr.\n"
-            "\tmov al, [%s + %lu]\n"
-            "\tcmp al, 0\n"
-            "\tje %s\n",
-            exp_label,
-            exp->address,
-            while_loop_end_label);
+    loop->end_label = emit_jump_if_false(ctx, "codegen_eval_loop_expr.", exp);
 }
 
 void
-codegen_finish_loop(void)
+codegen_finish_loop(struct codegen_ctx *ctx, const struct codegen_loop *loop)
 {
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_finish_loop.\n"
-            "\tjmp %s\n"
-            "%s:\n",
-            while_loop_start_label,
-            while_loop_end_label);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_finish_loop.");
+    emit_jmp(ctx, loop->start_label);
+    emit_label(ctx, loop->end_label);
+
+    // An index past the end of a string could write to any variable.
+    if (loop->string_index_writes == ctx->string_index_writes)
+        add_promotable_loop(ctx, loop);
 }
 
-static char if_end_label[16];
-static char if_false_label[16];
-
 void
-codegen_start_if(const struct codegen_value_info *exp)
+codegen_start_if(struct codegen_ctx *ctx,
+                 struct codegen_if *if_info,
+                 const struct codegen_value_info *exp)
 {
     assert(exp->type == SYMBOL_TYPE_LOGIC);
 
-    const char *exp_label = label_from_section(exp->section);
-
-    get_next_label(if_end_label, sizeof(if_end_label));
-    get_next_label(if_false_label, sizeof(if_false_label));
-
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_start_if.\n"
-            "\tmov al, [%s + %lu]\n"
-            "\tcmp al, 0\n"
-            "\tje %s\n",
-            exp_label,
-            exp->address,
-            if_false_label);
+    if_info->end_label = get_next_label(ctx);
+    if_info->false_label = emit_jump_if_false(ctx, "codegen_start_if.", exp);
 }
 
 void
-codegen_if_jmp(void)
+codegen_if_jmp(struct codegen_ctx *ctx, const struct codegen_if *if_info)
 {
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_if_jmp.\n"
-            "\tjmp %s\n",
-            if_end_label);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_if_jmp.");
+    emit_jmp(ctx, if_info->end_label);
 }
 
 void
-codegen_start_else(void)
+codegen_start_else(struct codegen_ctx *ctx, const struct codegen_if *if_info)
 {
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_start_else.\n"
-            "%s:\n",
-            if_false_label);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_start_else.");
+    emit_label(ctx, if_info->false_label);
 }
 
 void
-codegen_finish_if(uint8_t had_else)
+codegen_finish_if(struct codegen_ctx *ctx,
+                  const struct codegen_if *if_info,
+                  uint8_t had_else)
 {
-    fprintf(tmp_file,
-            "\tsection .text\n"
-            "\t; codegen_finish_if.\n"
-            "%s:\n",
-            had_else ? if_end_label : if_false_label);
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_finish_if.");
+    emit_label(ctx, had_else ? if_info->end_label : if_info->false_label);
 }
 
-uint64_t
-read_logic(uint64_t buffer_addr)
+static void
+read_logic(struct codegen_ctx *ctx,
+           uint64_t buffer_addr,
+           struct codegen_value_info *info)
 {
     // For now, accepts false/true as input.
-    const uint64_t logic_addr = get_next_address(&current_bss_tmp_address, 1);
-
-    char false_label[16];
-    get_next_label(false_label, sizeof(false_label));
-
-    char true_label[16];
-    get_next_label(true_label, sizeof(true_label));
-
-    char end_label[16];
-    get_next_label(end_label, sizeof(end_label));
-
-    fprintf(tmp_file,
-            "\t; read_logic\n"
-            "\tmov esi, TMP + %lu\n"
-            "\tmov rax, [esi]\n"
-            // Checks for false.
-            "\tmov rbx, \"false\"\n"
-            "\tcmp rax, rbx\n"
-            "\tje %s\n"
-            // Checks for true.
-            "\tmov rbx, \"true\"\n"
-            "\tcmp rax, rbx\n"
-            "\tje %s\n"
-            "\tjmp INVALID_INPUT_HANDLER\n"
-            "%s:\n"
-            "\tmov byte [TMP + %lu], 0\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tmov byte [TMP + %lu], 1\n"
-            "%s:\n",
-
-            buffer_addr,
-            false_label,
-            true_label,
-            false_label,
-            logic_addr,
-            end_label,
-            true_label,
-            logic_addr,
-            end_label);
-
-    return logic_addr;
-}
-
-uint64_t
-read_int(uint64_t buffer_addr)
+    new_temporary(ctx, info);
+
+    const uint32_t false_label = get_next_label(ctx);
+    const uint32_t true_label = get_next_label(ctx);
+    const uint32_t end_label = get_next_label(ctx);
+
+    emit_comment(ctx, "read_logic");
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, buffer_addr));
+    emit2(ctx, IR_OPCODE_MOV, RAX, ir_register_memory(IR_REGISTER_SI, 4, 8));
+    // Checks for false.
+    emit2(ctx, IR_OPCODE_MOV, RBX, ir_immediate(string_immediate("false")));
+    emit2(ctx, IR_OPCODE_CMP, RAX, RBX);
+    emit_jcc(ctx, IR_CONDITION_E, false_label);
+    // Checks for true.
+    emit2(ctx, IR_OPCODE_MOV, RBX, ir_immediate(string_immediate("true")));
+    emit2(ctx, IR_OPCODE_CMP, RAX, RBX);
+    emit_jcc(ctx, IR_CONDITION_E, true_label);
+    emit_jmp(ctx, ctx->invalid_input_handler_label);
+    emit_label(ctx, false_label);
+    emit2(ctx, IR_OPCODE_MOV, value_operand(info, 1), ir_immediate(0));
+    emit_jmp(ctx, end_label);
+    emit_label(ctx, true_label);
+    emit2(ctx, IR_OPCODE_MOV, value_operand(info, 1), ir_immediate(1));
+    emit_label(ctx, end_label);
+
+}
+
+static void
+read_int(struct codegen_ctx *ctx,
+         uint64_t buffer_addr,
+         struct codegen_value_info *info)
 {
     // FIXME:
     // This assumes the first character might be a '-', but
     // apart from that, we assume every character after that
     // is a *valid* digit.
 
-    const uint64_t int_address = get_next_address(&current_bss_tmp_address, 4);
-
-    char loop_start[16];
-    get_next_label(loop_start, sizeof(loop_start));
-
-    char loop_end[16];
-    get_next_label(loop_end, sizeof(loop_end));
-
-    char no_signal_label[16];
-    get_next_label(no_signal_label, sizeof(no_signal_label));
-
-    char end_label[16];
-    get_next_label(end_label, sizeof(end_label));
-
-    fprintf(tmp_file,
-            "\t; read_int\n"
-            "\tmov eax, 0\n"
-            "\tmov ebx, 0\n"
-            "\tmov ecx, 10\n"
-            "\tmov dx, 1\n"
-            "\tmov esi, TMP + %lu\n"
-            // Take a look at the first character to verify if it's a '-'.
-            "\tmov bl, [esi]\n"
-            "\tcmp bl, '-'\n"
-            "\tjne %s\n"
-            // In case it is, store a -1 in the stack...
-            "\tmov dx, -1\n"
-            "\tadd esi, 1\n"
-            "\tmov bl, [esi]\n"
-            "%s:\n"
-            "\tpush dx\n"
-            "\tmov edx, 0\n"
-            "%s:\n"
-            "\tcmp bl, 0\n"
-            "\tje %s\n"
-            "\timul ecx\n"
-            // We have zeroed edx, if it's not zero after imul,
-            // it means an overflow happened.
-            "\tcmp edx, 0\n"
-            "\tjne INVALID_INPUT_HANDLER\n"
-            "\tsub bl, '0'\n"
-            "\tadd eax, ebx\n"
-            "\tadd esi, 1\n"
-            "\tmov bl, [esi]\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tpop cx\n"
-            "\tcmp cx, 0\n"
-            "\tjg %s\n"
-            "\tneg eax\n"
-            "%s:\n"
-            "\tmov [TMP + %lu], eax\n",
-            buffer_addr,
-            no_signal_label,
-            no_signal_label,
-            loop_start,
-            loop_end,
-            loop_start,
-            loop_end,
-            end_label,
-            end_label,
-            int_address);
-
-    return int_address;
-}
-
-uint64_t
-read_float(uint64_t buffer_addr)
+    new_temporary(ctx, info);
+
+    const uint32_t loop_start = get_next_label(ctx);
+    const uint32_t loop_end = get_next_label(ctx);
+    const uint32_t no_signal_label = get_next_label(ctx);
+    const uint32_t end_label = get_next_label(ctx);
+
+    const struct ir_operand esi_byte = ir_register_memory(IR_REGISTER_SI, 4, 1);
+
+    emit_comment(ctx, "read_int");
+    emit2(ctx, IR_OPCODE_MOV, EAX, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, EBX, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, ECX, ir_immediate(10));
+    emit2(ctx, IR_OPCODE_MOV, DX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, buffer_addr));
+    // Take a look at the first character to verify if it's a '-'.
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate('-'));
+    emit_jcc(ctx, IR_CONDITION_NE, no_signal_label);
+    // In case it is, store a -1 in the stack...
+    emit2(ctx, IR_OPCODE_MOV, DX, ir_immediate(-1));
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit_label(ctx, no_signal_label);
+    emit1(ctx, IR_OPCODE_PUSH, DX);
+    emit2(ctx, IR_OPCODE_MOV, EDX, ir_immediate(0));
+    emit_label(ctx, loop_start);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_E, loop_end);
+    emit1(ctx, IR_OPCODE_IMUL, ECX);
+    // We have zeroed edx, if it's not zero after imul,
+    // it means an overflow happened.
+    emit2(ctx, IR_OPCODE_CMP, EDX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_NE, ctx->invalid_input_handler_label);
+    emit2(ctx, IR_OPCODE_SUB, BL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_ADD, EAX, EBX);
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit_jmp(ctx, loop_start);
+    emit_label(ctx, loop_end);
+    emit1(ctx, IR_OPCODE_POP, CX);
+    emit2(ctx, IR_OPCODE_CMP, CX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_G, end_label);
+    emit1(ctx, IR_OPCODE_NEG, EAX);
+    emit_label(ctx, end_label);
+    emit2(ctx, IR_OPCODE_MOV, value_operand(info, 4), EAX);
+
+}
+
+static void
+read_float(struct codegen_ctx *ctx,
+           uint64_t buffer_addr,
+           struct codegen_value_info *info)
 {
     // FIXME:
     // This assumes the first character might be a '-' and that
     // we might find a '.' amidst the input, but no further validation
     // is done... we assume every other character is a *valid* digit.
-    const uint64_t float_address =
-        get_next_address(&current_bss_tmp_address, 4);
-
-    char int_loop_start[16];
-    get_next_label(int_loop_start, sizeof(int_loop_start));
-
-    char float_loop_start[16];
-    get_next_label(float_loop_start, sizeof(float_loop_start));
-
-    char loop_end[16];
-    get_next_label(loop_end, sizeof(loop_end));
-
-    char no_signal_label[16];
-    get_next_label(no_signal_label, sizeof(no_signal_label));
-
-    fprintf(tmp_file,
-            "\t; read_float.\n"
-            "\tmov eax, 0\n"
-            "\tsubss xmm0, xmm0\n"
-            "\tmov ebx, 0\n"
-            "\tmov ecx, 10\n"
-            "\tcvtsi2ss xmm3, ecx\n"
-            "\tmovss xmm2, xmm3\n"
-            "\tmov rdx, 1\n"
-            "\tmov esi, TMP + %lu\n"
-            "\tmov bl, [esi]\n"
-            "\tcmp bl, '-'\n"
-            "\tjne %s\n"
-            "\tmov rdx, -1\n"
-            "\tadd esi, 1\n"
-            "\tmov bl, [esi]\n"
-            "%s:\n"
-            "\tpush rdx\n"
-            "\tmov rdx, 0\n"
-            "%s:\n"
-            "\tcmp bl, 0\n"
-            "\tje %s\n"
-            "\tcmp bl, '.'\n"
-            "\tje %s\n"
-            "\timul ecx\n"
-            "\tsub bl, '0'\n"
-            "\tadd eax, ebx\n"
-            "\tadd esi, 1\n"
-            "\tmov bl, [esi]\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tadd esi, 1\n"
-            "\tmov bl, [esi]\n"
-            "\tcmp bl, 0\n"
-            "\tje %s\n"
-            "\tsub bl, '0'\n"
-            "\tcvtsi2ss xmm1, rbx\n"
-            "\tdivss xmm1, xmm2\n"
-            "\taddss xmm0, xmm1\n"
-            "\tmulss xmm2, xmm3\n"
-            "\tjmp %s\n"
-            "%s:\n"
-            "\tcvtsi2ss xmm1, rax\n"
-            "\taddss xmm0, xmm1\n"
-            "\tpop rcx\n"
-            "\tcvtsi2ss xmm1, rcx\n"
-            "\tmulss xmm0, xmm1\n"
-            "\tmovss [TMP + %lu], xmm0\n",
-            buffer_addr,
-            no_signal_label,
-            no_signal_label,
-            int_loop_start,
-            loop_end,
-            float_loop_start,
-            int_loop_start,
-            float_loop_start,
-            loop_end,
-            float_loop_start,
-            loop_end,
-            float_address);
-
-    return float_address;
+    new_temporary(ctx, info);
+
+    const uint32_t int_loop_start = get_next_label(ctx);
+    const uint32_t float_loop_start = get_next_label(ctx);
+    const uint32_t loop_end = get_next_label(ctx);
+    const uint32_t no_signal_label = get_next_label(ctx);
+
+    const struct ir_operand esi_byte = ir_register_memory(IR_REGISTER_SI, 4, 1);
+
+    emit_comment(ctx, "read_float.");
+    emit2(ctx, IR_OPCODE_MOV, EAX, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_XORPS, XMM(0), XMM(0));
+    emit2(ctx, IR_OPCODE_MOV, EBX, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, ECX, ir_immediate(10));
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(3), ECX);
+    emit2(ctx, IR_OPCODE_MOVSS, XMM(2), XMM(3));
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, buffer_addr));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate('-'));
+    emit_jcc(ctx, IR_CONDITION_NE, no_signal_label);
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(-1));
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit_label(ctx, no_signal_label);
+    emit1(ctx, IR_OPCODE_PUSH, RDX);
+    emit2(ctx, IR_OPCODE_MOV, RDX, ir_immediate(0));
+    emit_label(ctx, int_loop_start);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_E, loop_end);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate('.'));
+    emit_jcc(ctx, IR_CONDITION_E, float_loop_start);
+    emit1(ctx, IR_OPCODE_IMUL, ECX);
+    emit2(ctx, IR_OPCODE_SUB, BL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_ADD, EAX, EBX);
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit_jmp(ctx, int_loop_start);
+    emit_label(ctx, float_loop_start);
+    emit2(ctx, IR_OPCODE_ADD, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_MOV, BL, esi_byte);
+    emit2(ctx, IR_OPCODE_CMP, BL, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_E, loop_end);
+    emit2(ctx, IR_OPCODE_SUB, BL, ir_immediate('0'));
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(1), RBX);
+    emit2(ctx, IR_OPCODE_DIVSS, XMM(1), XMM(2));
+    emit2(ctx, IR_OPCODE_ADDSS, XMM(0), XMM(1));
+    emit2(ctx, IR_OPCODE_MULSS, XMM(2), XMM(3));
+    emit_jmp(ctx, float_loop_start);
+    emit_label(ctx, loop_end);
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(1), RAX);
+    emit2(ctx, IR_OPCODE_ADDSS, XMM(0), XMM(1));
+    emit1(ctx, IR_OPCODE_POP, RCX);
+    emit2(ctx, IR_OPCODE_CVTSI2SS, XMM(1), RCX);
+    emit2(ctx, IR_OPCODE_MULSS, XMM(0), XMM(1));
+    emit2(ctx, IR_OPCODE_MOVSS, value_operand(info, 4), XMM(0));
+
 }
 
 void
-codegen_read_into(struct symbol *id_entry)
+codegen_read_into(struct codegen_ctx *ctx, struct symbol *id_entry)
 {
     const uint32_t buffer_size = 257;
     const uint64_t tmp_address =
-        get_next_address(&current_bss_tmp_address, buffer_size);
-
-    char je_label[16];
-    get_next_label(je_label, sizeof(je_label));
-
-    fprintf(
-        tmp_file,
-        "\tsection .text\n"
-        "\t; codegen_read_into.\n"
-        "\tmov eax, 0\n"
-        "\tmov edi, 0\n"
-        "\tmov esi, TMP + %lu\n"
-        "\tmov edx, %u\n"
-        "\tsyscall\n"
-        // Check if we've read something. If so, remove the trailing new line.
-        "\tcmp eax, 0\n"
-        "\tje %s\n"
-        "\tsub esi, 1\n"
-        "\tadd esi, eax\n"
-        "\tmov byte [esi], 0\n"
-        "%s:\n",
-        tmp_address,
-        buffer_size,
-        je_label,
-        je_label);
+        get_next_address(&ctx->current_bss_tmp_address, buffer_size);
+
+    const uint32_t je_label = get_next_label(ctx);
+
+    emit_section(ctx, IR_SECTION_TEXT);
+    emit_comment(ctx, "codegen_read_into.");
+    // read_logic compares the first 8 bytes, whatever comes after a short
+    // input must be zeroes.
+    if (id_entry->symbol_type == SYMBOL_TYPE_LOGIC)
+        emit2(ctx, IR_OPCODE_MOV, tmp_memory(tmp_address, 8), ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, EAX, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, EDI, ir_immediate(0));
+    emit2(ctx, IR_OPCODE_MOV, ESI, ir_address(IR_BASE_TMP, tmp_address));
+    emit2(ctx, IR_OPCODE_MOV, EDX, ir_immediate(buffer_size));
+    emit0(ctx, IR_OPCODE_SYSCALL);
+    // Check if we've read something. If so, remove the trailing new line.
+    emit2(ctx, IR_OPCODE_CMP, EAX, ir_immediate(0));
+    emit_jcc(ctx, IR_CONDITION_E, je_label);
+    emit2(ctx, IR_OPCODE_SUB, ESI, ir_immediate(1));
+    emit2(ctx, IR_OPCODE_ADD, ESI, EAX);
+    emit2(ctx,
+          IR_OPCODE_MOV,
+          ir_register_memory(IR_REGISTER_SI, 4, 1),
+          ir_immediate(0));
+    emit_label(ctx, je_label);
 
     struct codegen_value_info info;
+    info.type = id_entry->symbol_type;
+    info.size = size_from_type(info.type);
 
     switch (id_entry->symbol_type) {
         case SYMBOL_TYPE_INTEGER:
-            info.address = read_int(tmp_address);
+            read_int(ctx, tmp_address, &info);
             break;
         case SYMBOL_TYPE_FLOATING_POINT:
-            info.address = read_float(tmp_address);
+            read_float(ctx, tmp_address, &info);
             break;
         case SYMBOL_TYPE_LOGIC:
-            info.address = read_logic(tmp_address);
+            read_logic(ctx, tmp_address, &info);
             break;
         case SYMBOL_TYPE_CHAR:
         case SYMBOL_TYPE_STRING:
             info.address = tmp_address;
+            info.section = SYMBOL_SECTION_NONE;
             break;
         default:
             UNREACHABLE();
     }
 
-    info.type = id_entry->symbol_type;
-    info.size = size_from_type(info.type);
-    info.section = SYMBOL_SECTION_NONE;
-
-    codegen_move_to_id_entry(id_entry, &info);
+    codegen_move_to_id_entry(ctx, id_entry, &info);
 }
@@ -0,0 +1,240 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "compile.h"
+
+#include "cache.h"
+#include "codegen.h"
+#include "file.h"
+#include "lexer.h"
+#include "semantic_and_syntatic.h"
+#include "symbol_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Extracts a filename from pathname. The returned buffer must be freed.
+ * Examples:
+ *  /home/user/file.txt -> file.txt
+ * ./file.txt -> file.txt
+ *   file.txt -> file.txt
+ * */
+static char *
+extract_filename(const char *pathname)
+{
+    const char *last_separator = strrchr(pathname, '/');
+    if (last_separator)
+        ++last_separator;
+    else
+        last_separator = pathname;
+
+    return strdup(last_separator);
+}
+
+/*
+ * Outputs that the options ask for, see cache.h.
+ * */
+static uint8_t
+cache_outputs(const struct compile_options *options)
+{
+    uint8_t outputs = CACHE_OUTPUT_ASSEMBLY;
+    if (options->keep_unoptimized)
+        outputs |= CACHE_OUTPUT_UNOPTIMIZED;
+    if (options->emit_object)
+        outputs |= CACHE_OUTPUT_OBJECT;
+    if (options->assemble_and_link)
+        outputs |= CACHE_OUTPUT_EXECUTABLE;
+    return outputs;
+}
+
+/*
+ * Adds the files codegen_dump has just written to the cache. Both are in the
+ * order of enum cache_output's bits.
+ * */
+static void
+cache_files(const char *cache,
+            const struct cache_key *key,
+            const struct codegen_file files[CODEGEN_FILE_COUNT])
+{
+    struct cache_contents contents;
+    for (uint32_t i = 0; i < CACHE_OUTPUT_COUNT; ++i) {
+        contents.buffers[i] = files[i].buffer;
+        contents.sizes[i] = files[i].size;
+    }
+
+    cache_store(cache, key, &contents);
+}
+
+/*
+ * Runs or writes the program that has been generated. files is passed on
+ * to codegen_dump.
+ * */
+static int
+finish_compilation(struct codegen_ctx *codegen,
+                   const char *filename,
+                   const struct compile_options *options,
+                   FILE *diagnostics,
+                   struct codegen_file *files)
+{
+    if (options->run) {
+        // Only comes back if the program couldn't be run.
+        codegen_run(codegen, options->backend);
+        fputs("codegen_run failed.\n", diagnostics);
+        return -1;
+    }
+
+    const int status = codegen_dump(codegen,
+                                    filename,
+                                    options->keep_unoptimized,
+                                    options->emit_object,
+                                    options->assemble_and_link,
+                                    files);
+    if (status < 0)
+        fputs("codegen_dump failed.\n", diagnostics);
+
+    return status;
+}
+
+int
+compile_buffers_create(struct compile_buffers *buffers)
+{
+    memset(&buffers->tokens, 0, sizeof(buffers->tokens));
+    return symbol_table_create(&buffers->table, 64);
+}
+
+void
+compile_buffers_destroy(struct compile_buffers *buffers)
+{
+    token_buffer_destroy(&buffers->tokens);
+    symbol_table_destroy(&buffers->table);
+}
+
+int
+compile_file(const char *pathname,
+             const struct compile_options *options,
+             FILE *diagnostics)
+{
+    int status = 0;
+
+    // Read the l's program source file.
+    struct file file;
+    status = read_file(&file, pathname);
+    if (status < 0) {
+        fprintf(diagnostics, "Failed to read %s\n", pathname);
+        return -1;
+    }
+
+    status = -1;
+    char *filename = extract_filename(pathname);
+    if (!filename)
+        goto filename_err;
+
+    // Initialize compiler's main structures.
+    struct compile_buffers buffers;
+    if (compile_buffers_create(&buffers) < 0) {
+        fputs("Failed to create symbol table.\n", diagnostics);
+        goto buffers_err;
+    }
+
+    status = compile_source(&file, filename, options, diagnostics, &buffers);
+    compile_buffers_destroy(&buffers);
+
+buffers_err:
+    free(filename);
+
+filename_err:
+    destroy_file(&file);
+    return status;
+}
+
+int
+compile_source(const struct file *source,
+               const char *name,
+               const struct compile_options *options,
+               FILE *diagnostics,
+               struct compile_buffers *buffers)
+{
+    // A program that has been compiled before is restored from the cache,
+    // without even lexing it.
+    const char *cache = options->run ? NULL : cache_directory();
+    const uint8_t outputs = cache_outputs(options);
+    struct cache_key key;
+    if (cache &&
+        cache_key_compute(&key, source->buffer, source->size, outputs) < 0)
+        cache = NULL;
+
+    if (cache && cache_restore(cache, &key, name, diagnostics))
+        return 0;
+
+    // Whatever the last program left in the buffers is gone.
+    struct symbol_table *table = &buffers->table;
+    symbol_table_clear(table);
+
+    struct lexer lexer;
+    lexer_init(&lexer, source, table);
+    lexer.diagnostics = diagnostics;
+
+    // Lex everything up front, the parser then goes through the tokens.
+    // Big files are lexed on many threads.
+    struct token_buffer *tokens = &buffers->tokens;
+    int status =
+        lexer_tokenize_all_parallel(&lexer, tokens, options->lexer_threads);
+    if (status < 0) {
+        fputs("Failed to allocate the token buffer.\n", diagnostics);
+        return -1;
+    }
+
+    if (tokens->count == 0 && tokens->result == LEXER_RESULT_ERROR) {
+        lexer_print_error(&lexer);
+        return -1;
+    }
+
+    struct codegen_ctx codegen;
+    codegen_init(&codegen);
+    codegen.diagnostics = diagnostics;
+
+    // When caching, the files are kept to be added to the cache.
+    struct codegen_file files[CODEGEN_FILE_COUNT];
+    memset(files, 0, sizeof(files));
+
+    // If we've found the first token, kickstart the syntatic analyzer.
+    // All the rest will be done inside it.
+    status = -1;
+    if (tokens->count != 0) {
+        struct syntatic_ctx syntatic_ctx;
+        syntatic_init(&syntatic_ctx, &lexer, tokens, &codegen);
+
+        status = syntatic_start(&syntatic_ctx);
+        if (status == 0) {
+            // Compilation occurred successfully!
+            fprintf(diagnostics, "Compiled lines: %u\n", lexer.line);
+            status = finish_compilation(
+                &codegen, name, options, diagnostics, cache ? files : NULL);
+        }
+    }
+
+    if (cache && status == 0)
+        cache_files(cache, &key, files);
+
+    codegen_files_destroy(files);
+    codegen_destroy(&codegen);
+    return status;
+}
+
+void
+compile_print_outputs(const char *name,
+                      const struct compile_options *options,
+                      FILE *stream)
+{
+    if (options->run)
+        return;
+
+    fprintf(stream, "%s.asm\n", name);
+    if (options->keep_unoptimized)
+        fprintf(stream, "%s-unoptimized.asm\n", name);
+    if (options->emit_object)
+        fprintf(stream, "%s.asm.o\n", name);
+    if (options->assemble_and_link)
+        fprintf(stream, "%s.asm.out\n", name);
+}
@@ -0,0 +1,495 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "elf_object.h"
+
+#include "utils.h"
+
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Index of every section header in the object. */
+enum section_index
+{
+    SECTION_NULL,
+    SECTION_TEXT,
+    SECTION_DATA,
+    SECTION_BSS,
+    SECTION_RODATA,
+    SECTION_RELA_TEXT,
+    SECTION_SYMTAB,
+    SECTION_STRTAB,
+    SECTION_SHSTRTAB,
+    SECTION_COUNT,
+};
+
+/* Index of every symbol in .symtab, locals must come first. */
+enum symbol_index
+{
+    SYMBOL_NULL,
+    SYMBOL_SECTION_TEXT,
+    SYMBOL_SECTION_DATA,
+    SYMBOL_SECTION_BSS,
+    SYMBOL_SECTION_RODATA,
+    SYMBOL_TMP,
+    SYMBOL_UNNIT_MEM,
+    SYMBOL_INIT_MEM,
+    SYMBOL_CONST_MEM,
+    SYMBOL_START,
+    SYMBOL_COUNT,
+};
+
+static const char section_names[] = "\0.text\0.data\0.bss\0.rodata\0.rela.text"
+                                    "\0.symtab\0.strtab\0.shstrtab";
+
+static const char symbol_names[] =
+    "\0TMP\0UNNIT_MEM\0INIT_MEM\0CONST_MEM\0_start";
+
+static const uint16_t section_indexes[X86_64_SECTION_COUNT] = {
+    [X86_64_SECTION_TEXT] = SECTION_TEXT,
+    [X86_64_SECTION_DATA] = SECTION_DATA,
+    [X86_64_SECTION_RODATA] = SECTION_RODATA,
+    [X86_64_SECTION_BSS] = SECTION_BSS,
+};
+
+static const uint32_t section_symbols[X86_64_SECTION_COUNT] = {
+    [X86_64_SECTION_TEXT] = SYMBOL_SECTION_TEXT,
+    [X86_64_SECTION_DATA] = SYMBOL_SECTION_DATA,
+    [X86_64_SECTION_RODATA] = SYMBOL_SECTION_RODATA,
+    [X86_64_SECTION_BSS] = SYMBOL_SECTION_BSS,
+};
+
+static const uint32_t relocation_types[] = {
+    [X86_64_RELOCATION_32] = R_X86_64_32,
+    [X86_64_RELOCATION_32S] = R_X86_64_32S,
+    [X86_64_RELOCATION_64] = R_X86_64_64,
+};
+
+/*
+ * Offset of name in a string table made of null terminated strings.
+ * */
+static uint32_t
+name_offset(const char *table, uint64_t table_size, const char *name)
+{
+    for (uint64_t offset = 1; offset < table_size;
+         offset += strlen(table + offset) + 1) {
+        if (strcmp(table + offset, name) == 0)
+            return (uint32_t)offset;
+    }
+
+    UNREACHABLE();
+}
+
+static void
+fill_elf_header(Elf64_Ehdr *header, uint16_t type)
+{
+    memcpy(header->e_ident, ELFMAG, SELFMAG);
+    header->e_ident[EI_CLASS] = ELFCLASS64;
+    header->e_ident[EI_DATA] = ELFDATA2LSB;
+    header->e_ident[EI_VERSION] = EV_CURRENT;
+    header->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header->e_type = type;
+    header->e_machine = EM_X86_64;
+    header->e_version = EV_CURRENT;
+    header->e_ehsize = sizeof(Elf64_Ehdr);
+    header->e_shentsize = sizeof(Elf64_Shdr);
+}
+
+static void
+copy_section(uint8_t *destination, const struct x86_64_buffer *section)
+{
+    // Empty sections were never allocated.
+    if (section->size)
+        memcpy(destination, section->bytes, section->size);
+}
+
+static void
+fill_symbols(Elf64_Sym *symbols)
+{
+    memset(symbols, 0, SYMBOL_COUNT * sizeof(*symbols));
+
+    for (uint32_t i = 0; i < X86_64_SECTION_COUNT; ++i) {
+        Elf64_Sym *symbol = &symbols[section_symbols[i]];
+        symbol->st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        symbol->st_shndx = section_indexes[i];
+    }
+
+    static const struct
+    {
+        uint32_t index;
+        enum ir_base base;
+    } areas[] = {
+        {SYMBOL_TMP, IR_BASE_TMP},
+        {SYMBOL_UNNIT_MEM, IR_BASE_UNNIT_MEM},
+        {SYMBOL_INIT_MEM, IR_BASE_INIT_MEM},
+        {SYMBOL_CONST_MEM, IR_BASE_CONST_MEM},
+    };
+
+    for (uint32_t i = 0; i < sizeof(areas) / sizeof(*areas); ++i) {
+        Elf64_Sym *symbol = &symbols[areas[i].index];
+        symbol->st_name = name_offset(
+            symbol_names, sizeof(symbol_names), ir_base_name(areas[i].base));
+        symbol->st_info = ELF64_ST_INFO(STB_LOCAL, STT_NOTYPE);
+        symbol->st_shndx =
+            section_indexes[x86_64_base_section(areas[i].base)];
+        symbol->st_value = x86_64_base_offset(areas[i].base);
+    }
+
+    Elf64_Sym *start = &symbols[SYMBOL_START];
+    start->st_name = name_offset(symbol_names, sizeof(symbol_names), "_start");
+    start->st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+    start->st_shndx = SECTION_TEXT;
+}
+
+int
+elf_object_encode(const struct x86_64_object *object,
+                  uint8_t **file,
+                  uint64_t *file_size)
+{
+    const struct x86_64_buffer *text =
+        &object->sections[X86_64_SECTION_TEXT];
+    const struct x86_64_buffer *data =
+        &object->sections[X86_64_SECTION_DATA];
+    const struct x86_64_buffer *rodata =
+        &object->sections[X86_64_SECTION_RODATA];
+
+    // Contents follow the ELF header in the order of the section headers,
+    // which go at the end of the file.
+    Elf64_Shdr headers[SECTION_COUNT];
+    memset(headers, 0, sizeof(headers));
+
+    const struct
+    {
+        uint32_t index;
+        const char *name;
+        uint32_t type;
+        uint64_t flags;
+        uint64_t size;
+        uint64_t alignment;
+        uint64_t entry_size;
+    } sections[] = {
+        {SECTION_TEXT,
+         ".text",
+         SHT_PROGBITS,
+         SHF_ALLOC | SHF_EXECINSTR,
+         text->size,
+         object->alignments[X86_64_SECTION_TEXT],
+         0},
+        {SECTION_DATA,
+         ".data",
+         SHT_PROGBITS,
+         SHF_ALLOC | SHF_WRITE,
+         data->size,
+         object->alignments[X86_64_SECTION_DATA],
+         0},
+        {SECTION_BSS,
+         ".bss",
+         SHT_NOBITS,
+         SHF_ALLOC | SHF_WRITE,
+         object->bss_size,
+         object->alignments[X86_64_SECTION_BSS],
+         0},
+        {SECTION_RODATA,
+         ".rodata",
+         SHT_PROGBITS,
+         SHF_ALLOC,
+         rodata->size,
+         object->alignments[X86_64_SECTION_RODATA],
+         0},
+        {SECTION_RELA_TEXT,
+         ".rela.text",
+         SHT_RELA,
+         SHF_INFO_LINK,
+         object->relocation_count * sizeof(Elf64_Rela),
+         8,
+         sizeof(Elf64_Rela)},
+        {SECTION_SYMTAB,
+         ".symtab",
+         SHT_SYMTAB,
+         0,
+         SYMBOL_COUNT * sizeof(Elf64_Sym),
+         8,
+         sizeof(Elf64_Sym)},
+        {SECTION_STRTAB,
+         ".strtab",
+         SHT_STRTAB,
+         0,
+         sizeof(symbol_names),
+         1,
+         0},
+        {SECTION_SHSTRTAB,
+         ".shstrtab",
+         SHT_STRTAB,
+         0,
+         sizeof(section_names),
+         1,
+         0},
+    };
+
+    uint64_t offset = sizeof(Elf64_Ehdr);
+    for (uint32_t i = 0; i < sizeof(sections) / sizeof(*sections); ++i) {
+        Elf64_Shdr *header = &headers[sections[i].index];
+        header->sh_name = name_offset(
+            section_names, sizeof(section_names), sections[i].name);
+        header->sh_type = sections[i].type;
+        header->sh_flags = sections[i].flags;
+        header->sh_size = sections[i].size;
+        header->sh_addralign = sections[i].alignment;
+        header->sh_entsize = sections[i].entry_size;
+
+        offset = align_up(offset, sections[i].alignment);
+        header->sh_offset = offset;
+        if (sections[i].type != SHT_NOBITS)
+            offset += sections[i].size;
+    }
+
+    headers[SECTION_RELA_TEXT].sh_link = SECTION_SYMTAB;
+    headers[SECTION_RELA_TEXT].sh_info = SECTION_TEXT;
+    headers[SECTION_SYMTAB].sh_link = SECTION_STRTAB;
+    headers[SECTION_SYMTAB].sh_info = SYMBOL_START;
+
+    const uint64_t headers_offset = align_up(offset, 8);
+    const uint64_t size = headers_offset + sizeof(headers);
+
+    // Zeroed, so that padding between sections is zero.
+    uint8_t *buffer = calloc(1, size);
+    if (!buffer)
+        return -1;
+
+    Elf64_Ehdr *elf_header = (Elf64_Ehdr *)buffer;
+    fill_elf_header(elf_header, ET_REL);
+    elf_header->e_shoff = headers_offset;
+    elf_header->e_shnum = SECTION_COUNT;
+    elf_header->e_shstrndx = SECTION_SHSTRTAB;
+
+    copy_section(buffer + headers[SECTION_TEXT].sh_offset, text);
+    copy_section(buffer + headers[SECTION_DATA].sh_offset, data);
+    copy_section(buffer + headers[SECTION_RODATA].sh_offset, rodata);
+
+    Elf64_Rela *relas =
+        (Elf64_Rela *)(buffer + headers[SECTION_RELA_TEXT].sh_offset);
+    for (uint64_t i = 0; i < object->relocation_count; ++i) {
+        const struct x86_64_relocation *relocation = &object->relocations[i];
+        relas[i].r_offset = relocation->offset;
+        relas[i].r_info = ELF64_R_INFO(section_symbols[relocation->section],
+                                       relocation_types[relocation->type]);
+        relas[i].r_addend = relocation->addend;
+    }
+
+    fill_symbols((Elf64_Sym *)(buffer + headers[SECTION_SYMTAB].sh_offset));
+
+    memcpy(buffer + headers[SECTION_STRTAB].sh_offset,
+           symbol_names,
+           sizeof(symbol_names));
+    memcpy(buffer + headers[SECTION_SHSTRTAB].sh_offset,
+           section_names,
+           sizeof(section_names));
+    memcpy(buffer + headers_offset, headers, sizeof(headers));
+
+    *file = buffer;
+    *file_size = size;
+    return 0;
+}
+
+/* Where the executable is loaded, the same address ld uses. */
+#define EXECUTABLE_BASE 0x400000U
+#define PAGE_SIZE 0x1000U
+
+/* Segments of the executable, in the order they are in the file. */
+enum segment_index
+{
+    SEGMENT_TEXT,
+    SEGMENT_RODATA,
+    /* .data followed by .bss. */
+    SEGMENT_DATA,
+    SEGMENT_STACK,
+    SEGMENT_COUNT,
+};
+
+/* Index of every section header in the executable. */
+enum executable_section_index
+{
+    EXECUTABLE_SECTION_NULL,
+    EXECUTABLE_SECTION_TEXT,
+    EXECUTABLE_SECTION_RODATA,
+    EXECUTABLE_SECTION_DATA,
+    EXECUTABLE_SECTION_BSS,
+    EXECUTABLE_SECTION_SHSTRTAB,
+    EXECUTABLE_SECTION_COUNT,
+};
+
+int
+elf_executable_encode(const struct x86_64_object *object,
+                      uint8_t **file,
+                      uint64_t *file_size)
+{
+    const struct x86_64_buffer *text =
+        &object->sections[X86_64_SECTION_TEXT];
+    const struct x86_64_buffer *data =
+        &object->sections[X86_64_SECTION_DATA];
+    const struct x86_64_buffer *rodata =
+        &object->sections[X86_64_SECTION_RODATA];
+
+    // The ELF and program headers are loaded with .text, and every section
+    // is loaded at the same offset in its page it has in the file. Each
+    // segment is moved one page further than the previous one, so that
+    // segments with different permissions never share a page.
+    uint64_t offsets[X86_64_SECTION_COUNT];
+    uint64_t addresses[X86_64_SECTION_COUNT];
+
+    const uint64_t headers_size =
+        sizeof(Elf64_Ehdr) + SEGMENT_COUNT * sizeof(Elf64_Phdr);
+    offsets[X86_64_SECTION_TEXT] =
+        align_up(headers_size, object->alignments[X86_64_SECTION_TEXT]);
+    addresses[X86_64_SECTION_TEXT] =
+        EXECUTABLE_BASE + offsets[X86_64_SECTION_TEXT];
+
+    offsets[X86_64_SECTION_RODATA] =
+        align_up(offsets[X86_64_SECTION_TEXT] + text->size,
+                 object->alignments[X86_64_SECTION_RODATA]);
+    addresses[X86_64_SECTION_RODATA] =
+        EXECUTABLE_BASE + PAGE_SIZE + offsets[X86_64_SECTION_RODATA];
+
+    offsets[X86_64_SECTION_DATA] =
+        align_up(offsets[X86_64_SECTION_RODATA] + rodata->size,
+                 object->alignments[X86_64_SECTION_DATA]);
+    addresses[X86_64_SECTION_DATA] =
+        EXECUTABLE_BASE + 2 * PAGE_SIZE + offsets[X86_64_SECTION_DATA];
+
+    // .bss takes no space in the file.
+    addresses[X86_64_SECTION_BSS] =
+        align_up(addresses[X86_64_SECTION_DATA] + data->size,
+                 object->alignments[X86_64_SECTION_BSS]);
+    offsets[X86_64_SECTION_BSS] = offsets[X86_64_SECTION_DATA] + data->size;
+
+    // The names of the sections of the object include the ones used here,
+    // so the same table is reused. It goes at the end, before the section
+    // headers.
+    const uint64_t names_offset = offsets[X86_64_SECTION_BSS];
+    const uint64_t headers_offset =
+        align_up(names_offset + sizeof(section_names), 8);
+    const uint64_t size =
+        headers_offset + EXECUTABLE_SECTION_COUNT * sizeof(Elf64_Shdr);
+
+    uint8_t *buffer = calloc(1, size);
+    if (!buffer)
+        return -1;
+
+    Elf64_Ehdr *elf_header = (Elf64_Ehdr *)buffer;
+    fill_elf_header(elf_header, ET_EXEC);
+    // _start is at the beginning of .text.
+    elf_header->e_entry = addresses[X86_64_SECTION_TEXT];
+    elf_header->e_phoff = sizeof(Elf64_Ehdr);
+    elf_header->e_phentsize = sizeof(Elf64_Phdr);
+    elf_header->e_phnum = SEGMENT_COUNT;
+    elf_header->e_shoff = headers_offset;
+    elf_header->e_shnum = EXECUTABLE_SECTION_COUNT;
+    elf_header->e_shstrndx = EXECUTABLE_SECTION_SHSTRTAB;
+
+    Elf64_Phdr *segments = (Elf64_Phdr *)(buffer + sizeof(Elf64_Ehdr));
+
+    Elf64_Phdr *segment = &segments[SEGMENT_TEXT];
+    segment->p_type = PT_LOAD;
+    segment->p_flags = PF_R | PF_X;
+    segment->p_vaddr = segment->p_paddr = EXECUTABLE_BASE;
+    segment->p_filesz = segment->p_memsz =
+        offsets[X86_64_SECTION_TEXT] + text->size;
+    segment->p_align = PAGE_SIZE;
+
+    segment = &segments[SEGMENT_RODATA];
+    segment->p_type = PT_LOAD;
+    segment->p_flags = PF_R;
+    segment->p_offset = offsets[X86_64_SECTION_RODATA];
+    segment->p_vaddr = segment->p_paddr = addresses[X86_64_SECTION_RODATA];
+    segment->p_filesz = segment->p_memsz = rodata->size;
+    segment->p_align = PAGE_SIZE;
+
+    segment = &segments[SEGMENT_DATA];
+    segment->p_type = PT_LOAD;
+    segment->p_flags = PF_R | PF_W;
+    segment->p_offset = offsets[X86_64_SECTION_DATA];
+    segment->p_vaddr = segment->p_paddr = addresses[X86_64_SECTION_DATA];
+    segment->p_filesz = data->size;
+    segment->p_memsz = addresses[X86_64_SECTION_BSS] + object->bss_size -
+                       addresses[X86_64_SECTION_DATA];
+    segment->p_align = PAGE_SIZE;
+
+    // Without it, the kernel makes the stack executable.
+    segment = &segments[SEGMENT_STACK];
+    segment->p_type = PT_GNU_STACK;
+    segment->p_flags = PF_R | PF_W;
+    segment->p_align = 16;
+
+    copy_section(buffer + offsets[X86_64_SECTION_TEXT], text);
+    copy_section(buffer + offsets[X86_64_SECTION_RODATA], rodata);
+    copy_section(buffer + offsets[X86_64_SECTION_DATA], data);
+    if (x86_64_relocate(
+            object, addresses, buffer + offsets[X86_64_SECTION_TEXT]) < 0) {
+        free(buffer);
+        return -1;
+    }
+
+    // Sections aren't needed to run the program, they are there for tools
+    // like objdump and gdb.
+    const struct
+    {
+        uint32_t index;
+        enum x86_64_section section;
+        const char *name;
+        uint32_t type;
+        uint64_t flags;
+        uint64_t size;
+    } sections[] = {
+        {EXECUTABLE_SECTION_TEXT,
+         X86_64_SECTION_TEXT,
+         ".text",
+         SHT_PROGBITS,
+         SHF_ALLOC | SHF_EXECINSTR,
+         text->size},
+        {EXECUTABLE_SECTION_RODATA,
+         X86_64_SECTION_RODATA,
+         ".rodata",
+         SHT_PROGBITS,
+         SHF_ALLOC,
+         rodata->size},
+        {EXECUTABLE_SECTION_DATA,
+         X86_64_SECTION_DATA,
+         ".data",
+         SHT_PROGBITS,
+         SHF_ALLOC | SHF_WRITE,
+         data->size},
+        {EXECUTABLE_SECTION_BSS,
+         X86_64_SECTION_BSS,
+         ".bss",
+         SHT_NOBITS,
+         SHF_ALLOC | SHF_WRITE,
+         object->bss_size},
+    };
+
+    Elf64_Shdr *headers = (Elf64_Shdr *)(buffer + headers_offset);
+    for (uint32_t i = 0; i < sizeof(sections) / sizeof(*sections); ++i) {
+        Elf64_Shdr *header = &headers[sections[i].index];
+        header->sh_name = name_offset(
+            section_names, sizeof(section_names), sections[i].name);
+        header->sh_type = sections[i].type;
+        header->sh_flags = sections[i].flags;
+        header->sh_addr = addresses[sections[i].section];
+        header->sh_offset = offsets[sections[i].section];
+        header->sh_size = sections[i].size;
+        header->sh_addralign = object->alignments[sections[i].section];
+    }
+
+    Elf64_Shdr *names = &headers[EXECUTABLE_SECTION_SHSTRTAB];
+    names->sh_name =
+        name_offset(section_names, sizeof(section_names), ".shstrtab");
+    names->sh_type = SHT_STRTAB;
+    names->sh_offset = names_offset;
+    names->sh_size = sizeof(section_names);
+    names->sh_addralign = 1;
+    memcpy(buffer + names_offset, section_names, sizeof(section_names));
+
+    *file = buffer;
+    *file_size = size;
+    return 0;
+}
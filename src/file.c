@@ -3,58 +3,155 @@
  * */
 #include "file.h"
 
-#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
-#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int
-read_file_from_stdin(struct file *file, uint32_t capacity)
+#define READ_CHUNK_SIZE (64U * 1024U)
+
+/*
+ * Reads everything from fd until EOF, growing the buffer geometrically.
+ * */
+static int
+read_fd_in_chunks(struct file *file, int fd)
 {
-    const size_t total = (size_t)capacity + 1;
+    uint64_t capacity = READ_CHUNK_SIZE;
+    uint64_t size = 0;
 
-    file->size = 0;
-    file->buffer = malloc(total);
-    if (!file->buffer)
+    char *buffer = malloc(capacity);
+    if (!buffer)
         return -1;
 
-    char c = (char)fgetc(stdin);
-    while (!feof(stdin) && file->size < capacity) {
-        file->buffer[file->size++] = c;
-        c = (char)fgetc(stdin);
+    while (1) {
+        if (size == capacity) {
+            capacity *= 2;
+            char *new_buffer = realloc(buffer, capacity);
+            if (!new_buffer) {
+                free(buffer);
+                return -1;
+            }
+            buffer = new_buffer;
+        }
+
+        const ssize_t n = read(fd, buffer + size, capacity - size);
+        if (n == 0)
+            break;
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(buffer);
+            return -1;
+        }
+
+        size += (uint64_t)n;
     }
-    file->buffer[file->size] = '\0';
 
+    file->buffer = buffer;
+    file->size = size;
+    file->is_mapped = 0;
     return 0;
 }
 
+int
+read_file_from_stdin(struct file *file)
+{
+    return read_fd_in_chunks(file, STDIN_FILENO);
+}
+
 int
 read_file(struct file *file, const char *pathname)
 {
-    FILE *stream = fopen(pathname, "r");
-    if (!stream)
+    const int fd = open(pathname, O_RDONLY);
+    if (fd < 0)
         return -1;
 
-    fseek(stream, 0, SEEK_END);
-    uint64_t size = ftell(stream);
-    fseek(stream, 0, SEEK_SET);
-
-    file->size = size;
-    file->buffer = malloc(size);
-    if (!file->buffer) {
-        fclose(stream);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
         return -1;
     }
 
-    fread(file->buffer, 1, file->size, stream);
+    // Empty files can't be mapped and pipes can't be mapped at all, read them
+    // the old fashioned way.
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        const int err = read_fd_in_chunks(file, fd);
+        close(fd);
+        return err;
+    }
 
-    fclose(stream);
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps a reference to the file, we don't need the fd anymore.
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    // The lexer goes through the file front to back exactly once, let the
+    // kernel read ahead aggressively. This is only a hint, so ignore errors.
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file->buffer = map;
+    file->size = (uint64_t)st.st_size;
+    file->is_mapped = 1;
     return 0;
 }
 
+static int
+write_file_with_mode(const char *pathname,
+                     const void *buffer,
+                     uint64_t size,
+                     mode_t mode)
+{
+    // An old file is replaced instead of truncated, so that the mode applies
+    // and files hard linked to it (see cache.h) are left alone.
+    if (unlink(pathname) < 0 && errno != ENOENT)
+        return -1;
+
+    const int fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0)
+        return -1;
+
+    const char *ptr = buffer;
+    while (size) {
+        const ssize_t n = write(fd, ptr, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return -1;
+        }
+
+        ptr += n;
+        size -= (uint64_t)n;
+    }
+
+    return close(fd);
+}
+
+int
+write_file(const char *pathname, const void *buffer, uint64_t size)
+{
+    return write_file_with_mode(pathname, buffer, size, 0644);
+}
+
+int
+write_executable_file(const char *pathname, const void *buffer, uint64_t size)
+{
+    return write_file_with_mode(pathname, buffer, size, 0755);
+}
+
 void
 destroy_file(struct file *file)
 {
-    free(file->buffer);
+    if (file->is_mapped)
+        munmap((void *)file->buffer, file->size);
+    else
+        free((void *)file->buffer);
+
     file->buffer = NULL;
     file->size = 0;
+    file->is_mapped = 0;
 }
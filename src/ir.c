@@ -0,0 +1,581 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "ir.h"
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+ir_init(struct ir *ir)
+{
+    memset(ir, 0, sizeof(*ir));
+}
+
+struct ir_instruction *
+ir_append(struct ir *ir)
+{
+    struct ir_block *block = ir->last_block;
+    if (!block || block->count == IR_BLOCK_SIZE) {
+        block = malloc(sizeof(*block));
+        if (!block) {
+            ir->failed = 1;
+            return NULL;
+        }
+
+        block->next = NULL;
+        block->count = 0;
+
+        if (ir->last_block)
+            ir->last_block->next = block;
+        else
+            ir->first_block = block;
+        ir->last_block = block;
+    }
+
+    struct ir_instruction *instruction = &block->instructions[block->count++];
+    memset(instruction, 0, sizeof(*instruction));
+    return instruction;
+}
+
+const uint8_t *
+ir_copy_bytes(struct ir *ir, const void *bytes, uint32_t size)
+{
+    assert(size <= IR_BYTES_BLOCK_SIZE);
+
+    struct ir_bytes_block *block = ir->bytes;
+    if (!block || IR_BYTES_BLOCK_SIZE - block->used < size) {
+        block = malloc(sizeof(*block));
+        if (!block) {
+            ir->failed = 1;
+            return NULL;
+        }
+
+        block->next = ir->bytes;
+        block->used = 0;
+        ir->bytes = block;
+    }
+
+    uint8_t *copy = block->bytes + block->used;
+    memcpy(copy, bytes, size);
+    block->used += size;
+    return copy;
+}
+
+uint32_t
+ir_new_temporary(struct ir *ir, enum ir_base base, uint64_t address)
+{
+    if (ir->temporary_count == ir->temporary_capacity) {
+        const uint32_t capacity =
+            ir->temporary_capacity ? ir->temporary_capacity * 2 : 256;
+        struct ir_temporary *temporaries =
+            realloc(ir->temporaries, capacity * sizeof(*temporaries));
+        if (!temporaries) {
+            ir->failed = 1;
+            return 0;
+        }
+
+        ir->temporaries = temporaries;
+        ir->temporary_capacity = capacity;
+    }
+
+    ir->temporaries[ir->temporary_count] =
+        (struct ir_temporary){.base = base, .address = address};
+    return ir->temporary_count++;
+}
+
+uint8_t
+ir_has_operands(const struct ir_instruction *instruction)
+{
+    switch (instruction->opcode) {
+        case IR_OPCODE_SECTION:
+        case IR_OPCODE_COMMENT:
+        case IR_OPCODE_RESERVE:
+        case IR_OPCODE_DATA:
+        case IR_OPCODE_DELETED:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+uint8_t
+ir_is_float_operand(const struct ir_instruction *instruction, uint32_t index)
+{
+    switch (instruction->opcode) {
+        case IR_OPCODE_MOVSS:
+        case IR_OPCODE_COMISS:
+        case IR_OPCODE_ADDSS:
+        case IR_OPCODE_SUBSS:
+        case IR_OPCODE_MULSS:
+        case IR_OPCODE_DIVSS:
+        case IR_OPCODE_XORPS:
+        case IR_OPCODE_ROUNDSS:
+            return 1;
+        case IR_OPCODE_CVTSI2SS:
+            return index == 0;
+        case IR_OPCODE_CVTSS2SI:
+            return index == 1;
+        default:
+            return 0;
+    }
+}
+
+static const char *
+section_name(enum ir_section section)
+{
+    switch (section) {
+        case IR_SECTION_TEXT:
+            return ".text";
+        case IR_SECTION_BSS:
+            return ".bss";
+        case IR_SECTION_DATA:
+            return ".data";
+        case IR_SECTION_RODATA:
+            return ".rodata";
+        default:
+            UNREACHABLE();
+    }
+}
+
+const char *
+ir_base_name(enum ir_base base)
+{
+    switch (base) {
+        case IR_BASE_TMP:
+            return "TMP";
+        case IR_BASE_UNNIT_MEM:
+            return "UNNIT_MEM";
+        case IR_BASE_INIT_MEM:
+            return "INIT_MEM";
+        case IR_BASE_CONST_MEM:
+            return "CONST_MEM";
+        default:
+            UNREACHABLE();
+    }
+}
+
+static const char *
+register_name(uint8_t reg, uint8_t size)
+{
+    static const char *const names[][16] = {
+        {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b",
+         "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+        {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w",
+         "r11w", "r12w", "r13w", "r14w", "r15w"},
+        {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d",
+         "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+        {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9",
+         "r10", "r11", "r12", "r13", "r14", "r15"},
+    };
+    static const char *const xmm_names[] = {
+        "xmm0", "xmm1", "xmm2",  "xmm3",  "xmm4",  "xmm5",  "xmm6",  "xmm7",
+        "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+
+    if (reg >= IR_REGISTER_XMM0)
+        return xmm_names[reg - IR_REGISTER_XMM0];
+
+    switch (size) {
+        case 1:
+            return names[0][reg];
+        case 2:
+            return names[1][reg];
+        case 4:
+            return names[2][reg];
+        case 8:
+            return names[3][reg];
+        default:
+            UNREACHABLE();
+    }
+}
+
+static const char *
+size_name(uint8_t size)
+{
+    switch (size) {
+        case 1:
+            return "byte";
+        case 2:
+            return "word";
+        case 4:
+            return "dword";
+        case 8:
+            return "qword";
+        default:
+            UNREACHABLE();
+    }
+}
+
+static const char *
+opcode_name(const struct ir_instruction *instruction)
+{
+    static const char *const conditions[] = {
+        [IR_CONDITION_E] = "je",   [IR_CONDITION_NE] = "jne",
+        [IR_CONDITION_L] = "jl",   [IR_CONDITION_LE] = "jle",
+        [IR_CONDITION_G] = "jg",   [IR_CONDITION_GE] = "jge",
+        [IR_CONDITION_B] = "jb",   [IR_CONDITION_BE] = "jbe",
+        [IR_CONDITION_A] = "ja",   [IR_CONDITION_AE] = "jae",
+    };
+    static const char *const set_conditions[] = {
+        [IR_CONDITION_E] = "sete",   [IR_CONDITION_NE] = "setne",
+        [IR_CONDITION_L] = "setl",   [IR_CONDITION_LE] = "setle",
+        [IR_CONDITION_G] = "setg",   [IR_CONDITION_GE] = "setge",
+        [IR_CONDITION_B] = "setb",   [IR_CONDITION_BE] = "setbe",
+        [IR_CONDITION_A] = "seta",   [IR_CONDITION_AE] = "setae",
+    };
+
+    switch (instruction->opcode) {
+        case IR_OPCODE_MOV:
+            return "mov";
+        case IR_OPCODE_MOVSS:
+            return instruction->operands[0].kind == IR_OPERAND_REGISTER &&
+                           instruction->operands[1].kind == IR_OPERAND_REGISTER
+                       ? "movaps"
+                       : "movss";
+        case IR_OPCODE_ADD:
+            return "add";
+        case IR_OPCODE_SUB:
+            return "sub";
+        case IR_OPCODE_IMUL:
+            return "imul";
+        case IR_OPCODE_IDIV:
+            return "idiv";
+        case IR_OPCODE_NEG:
+            return "neg";
+        case IR_OPCODE_CMP:
+            return "cmp";
+        case IR_OPCODE_COMISS:
+            return "comiss";
+        case IR_OPCODE_ADDSS:
+            return "addss";
+        case IR_OPCODE_SUBSS:
+            return "subss";
+        case IR_OPCODE_MULSS:
+            return "mulss";
+        case IR_OPCODE_DIVSS:
+            return "divss";
+        case IR_OPCODE_XORPS:
+            return "xorps";
+        case IR_OPCODE_CVTSI2SS:
+            return "cvtsi2ss";
+        case IR_OPCODE_CVTSS2SI:
+            return "cvtss2si";
+        case IR_OPCODE_ROUNDSS:
+            return "roundss";
+        case IR_OPCODE_CDQ:
+            return "cdq";
+        case IR_OPCODE_CDQE:
+            return "cdqe";
+        case IR_OPCODE_PUSH:
+            return "push";
+        case IR_OPCODE_POP:
+            return "pop";
+        case IR_OPCODE_JMP:
+            return "jmp";
+        case IR_OPCODE_JCC:
+            return conditions[instruction->condition];
+        case IR_OPCODE_SETCC:
+            return set_conditions[instruction->condition];
+        case IR_OPCODE_SYSCALL:
+            return "syscall";
+        default:
+            UNREACHABLE();
+    }
+}
+
+/*
+ * Records are formatted into a line and then written at once, printing is
+ * most of the time spent dumping the program.
+ * */
+#define IR_LINE_SIZE 4096U
+
+struct line
+{
+    uint32_t size;
+    char buffer[IR_LINE_SIZE];
+};
+
+static void
+line_append(struct line *line, const char *string)
+{
+    const size_t size = strlen(string);
+    assert(line->size + size <= IR_LINE_SIZE);
+    memcpy(line->buffer + line->size, string, size);
+    line->size += (uint32_t)size;
+}
+
+static void
+line_append_char(struct line *line, char c)
+{
+    assert(line->size < IR_LINE_SIZE);
+    line->buffer[line->size++] = c;
+}
+
+static void
+line_append_unsigned(struct line *line, uint64_t value, uint32_t base)
+{
+    char digits[20];
+    uint32_t count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+
+    assert(line->size + count <= IR_LINE_SIZE);
+    while (count)
+        line->buffer[line->size++] = digits[--count];
+}
+
+static void
+line_append_signed(struct line *line, int64_t value)
+{
+    if (value < 0) {
+        line_append_char(line, '-');
+        line_append_unsigned(line, 0 - (uint64_t)value, 10);
+    } else {
+        line_append_unsigned(line, (uint64_t)value, 10);
+    }
+}
+
+static void
+append_operand(struct line *line,
+               const struct ir_operand *operand,
+               uint8_t needs_size)
+{
+    switch (operand->kind) {
+        case IR_OPERAND_REGISTER:
+            line_append(line, register_name(operand->reg, operand->size));
+            break;
+        case IR_OPERAND_MEMORY:
+            if (needs_size) {
+                line_append(line, size_name(operand->size));
+                line_append_char(line, ' ');
+            }
+            line_append_char(line, '[');
+            if (operand->base == IR_BASE_REGISTER) {
+                line_append(line,
+                            register_name(operand->reg, operand->reg_size));
+            } else {
+                line_append(line, ir_base_name(operand->base));
+                line_append(line, " + ");
+                line_append_signed(line, operand->value);
+            }
+            line_append_char(line, ']');
+            break;
+        case IR_OPERAND_IMMEDIATE:
+            line_append_signed(line, operand->value);
+            break;
+        case IR_OPERAND_ADDRESS:
+            line_append(line, ir_base_name(operand->base));
+            line_append(line, " + ");
+            line_append_signed(line, operand->value);
+            break;
+        case IR_OPERAND_LABEL:
+            line_append_char(line, 'L');
+            line_append_signed(line, operand->value);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+/*
+ * Appends the bytes of a string, with the printable runs between quotes.
+ * */
+static void
+append_string(struct line *line, const uint8_t *bytes, uint32_t count)
+{
+    uint8_t in_quotes = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t printable =
+            bytes[i] >= ' ' && bytes[i] < 0x7F && bytes[i] != '"';
+        if (printable) {
+            if (!in_quotes)
+                line_append(line, i ? ",\"" : "\"");
+            line_append_char(line, (char)bytes[i]);
+            in_quotes = 1;
+        } else {
+            if (in_quotes)
+                line_append_char(line, '"');
+            if (i)
+                line_append_char(line, ',');
+            line_append_unsigned(line, bytes[i], 10);
+            in_quotes = 0;
+        }
+    }
+
+    if (in_quotes)
+        line_append_char(line, '"');
+}
+
+/*
+ * Appends a float so that NASM reads back exactly the same bits, always with
+ * a '.' so it isn't taken as an integer.
+ * */
+static void
+append_float(struct line *line, uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+
+    char *exponent = strchr(buffer, 'e');
+    if (strchr(buffer, '.')) {
+        line_append(line, buffer);
+    } else if (exponent) {
+        const char exponent_char = *exponent;
+        *exponent = '\0';
+        line_append(line, buffer);
+        line_append(line, ".0");
+        *exponent = exponent_char;
+        line_append(line, exponent);
+    } else {
+        line_append(line, buffer);
+        line_append(line, ".0");
+    }
+}
+
+static void
+append_data(struct line *line, const struct ir_data *data)
+{
+    line_append(line, "\talign ");
+    line_append_unsigned(line, data->align, 10);
+    line_append_char(line, '\n');
+
+    uint32_t initialized;
+    switch (data->kind) {
+        case IR_DATA_BYTE:
+            line_append(line, "\tdb ");
+            line_append_unsigned(line, data->value, 10);
+            initialized = 1;
+            break;
+        case IR_DATA_DWORD:
+            line_append(line, "\tdd ");
+            line_append_signed(line, (int32_t)data->value);
+            initialized = 4;
+            break;
+        case IR_DATA_FLOAT:
+            line_append(line, "\tdd ");
+            append_float(line, data->value);
+            initialized = 4;
+            break;
+        case IR_DATA_STRING:
+            line_append(line, "\tdb ");
+            append_string(line, data->bytes, data->count);
+            initialized = data->count;
+            break;
+        default:
+            UNREACHABLE();
+    }
+
+    line_append(line, "\t; @ 0x");
+    line_append_unsigned(line, data->address, 16);
+    line_append_char(line, '\n');
+
+    if (data->size > initialized) {
+        line_append(line, "\ttimes ");
+        line_append_unsigned(line, data->size - initialized, 10);
+        line_append(line, " db 0\n");
+    }
+}
+
+static void
+append_instruction(struct line *line, const struct ir_instruction *instruction)
+{
+    switch (instruction->opcode) {
+        case IR_OPCODE_SECTION:
+            line_append(line, "\tsection ");
+            line_append(line, section_name(instruction->section));
+            line_append_char(line, '\n');
+            return;
+        case IR_OPCODE_LABEL:
+            line_append_char(line, 'L');
+            line_append_signed(line, instruction->operands[0].value);
+            line_append(line, ":\n");
+            return;
+        case IR_OPCODE_COMMENT:
+            line_append(line, "\t; ");
+            line_append(line, instruction->comment);
+            line_append_char(line, '\n');
+            return;
+        case IR_OPCODE_RESERVE:
+            line_append(line, "\talignb ");
+            line_append_unsigned(line, instruction->data.align, 10);
+            line_append(line, "\n\tresb ");
+            line_append_unsigned(line, instruction->data.size, 10);
+            line_append(line, "\t; @ 0x");
+            line_append_unsigned(line, instruction->data.address, 16);
+            line_append_char(line, '\n');
+            return;
+        case IR_OPCODE_DATA:
+            append_data(line, &instruction->data);
+            return;
+        case IR_OPCODE_DELETED:
+            return;
+        default:
+            break;
+    }
+
+    // Memory operands need a size when there's no register to take it from.
+    uint8_t has_register = 0;
+    for (uint32_t i = 0; i < IR_MAX_OPERANDS; ++i) {
+        if (instruction->operands[i].kind == IR_OPERAND_REGISTER)
+            has_register = 1;
+    }
+
+    line_append_char(line, '\t');
+    line_append(line, opcode_name(instruction));
+    for (uint32_t i = 0; i < IR_MAX_OPERANDS; ++i) {
+        const struct ir_operand *operand = &instruction->operands[i];
+        if (operand->kind == IR_OPERAND_NONE)
+            break;
+
+        line_append(line, i ? ", " : " ");
+        append_operand(line, operand, !has_register);
+    }
+    line_append_char(line, '\n');
+}
+
+void
+ir_print_instruction(const struct ir_instruction *instruction, FILE *file)
+{
+    struct line line;
+    line.size = 0;
+    append_instruction(&line, instruction);
+    fwrite(line.buffer, 1, line.size, file);
+}
+
+void
+ir_print(const struct ir *ir, FILE *file)
+{
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i)
+            ir_print_instruction(&block->instructions[i], file);
+    }
+}
+
+void
+ir_destroy(struct ir *ir)
+{
+    struct ir_block *block = ir->first_block;
+    while (block) {
+        struct ir_block *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    struct ir_bytes_block *bytes = ir->bytes;
+    while (bytes) {
+        struct ir_bytes_block *next = bytes->next;
+        free(bytes);
+        bytes = next;
+    }
+
+    free(ir->temporaries);
+    memset(ir, 0, sizeof(*ir));
+}
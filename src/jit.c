@@ -0,0 +1,151 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "jit.h"
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Longest entry write_entry writes. */
+#define ENTRY_SIZE 128U
+
+/*
+ * Writes code that starts the program at target the way the kernel starts a
+ * process: every general purpose register but rsp and every xmm register
+ * zeroed, the default MXCSR and a fresh x87 state. The generated code
+ * relies on that, and the compiler leaves anything in them.
+ * */
+static void
+write_entry(uint8_t *code, uint64_t target)
+{
+    uint32_t size = 0;
+
+    // fninit and cld.
+    code[size++] = 0xDB;
+    code[size++] = 0xE3;
+    code[size++] = 0xFC;
+
+    // ldmxcsr [rip + mxcsr], patched below.
+    code[size++] = 0x0F;
+    code[size++] = 0xAE;
+    code[size++] = 0x15;
+    const uint32_t mxcsr_displacement = size;
+    size += 4;
+
+    // xor r, r for everything but rsp, 32 bits are zero extended.
+    for (uint8_t reg = 0; reg < 16; ++reg) {
+        if (reg == 4)
+            continue;
+        if (reg >= 8)
+            code[size++] = 0x45;
+        code[size++] = 0x31;
+        code[size++] = (uint8_t)(0xC0 | (reg & 7) << 3 | (reg & 7));
+    }
+
+    // xorps xmm, xmm.
+    for (uint8_t reg = 0; reg < 16; ++reg) {
+        if (reg >= 8)
+            code[size++] = 0x45;
+        code[size++] = 0x0F;
+        code[size++] = 0x57;
+        code[size++] = (uint8_t)(0xC0 | (reg & 7) << 3 | (reg & 7));
+    }
+
+    // jmp [rip + target].
+    code[size++] = 0xFF;
+    code[size++] = 0x25;
+    const uint32_t target_displacement = size;
+    size += 4;
+
+    const uint32_t target_offset = size;
+    memcpy(code + size, &target, sizeof(target));
+    size += sizeof(target);
+
+    const uint32_t mxcsr_offset = size;
+    const uint32_t mxcsr = 0x1F80;
+    memcpy(code + size, &mxcsr, sizeof(mxcsr));
+    size += sizeof(mxcsr);
+
+    // Displacements are from the end of their instructions.
+    const int32_t to_target =
+        (int32_t)(target_offset - target_displacement - 4);
+    const int32_t to_mxcsr = (int32_t)(mxcsr_offset - mxcsr_displacement - 4);
+    memcpy(code + target_displacement, &to_target, sizeof(to_target));
+    memcpy(code + mxcsr_displacement, &to_mxcsr, sizeof(to_mxcsr));
+
+    assert(size <= ENTRY_SIZE);
+}
+
+int
+jit_run(const struct x86_64_object *object)
+{
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+
+    // Every section starts in its own page, so that .text can be made
+    // executable and .rodata read-only. .bss follows .data, and the entry
+    // follows .text.
+    uint64_t offsets[X86_64_SECTION_COUNT];
+    offsets[X86_64_SECTION_TEXT] = 0;
+    const uint64_t entry_offset =
+        align_up(object->sections[X86_64_SECTION_TEXT].size, 16);
+    offsets[X86_64_SECTION_RODATA] =
+        align_up(entry_offset + ENTRY_SIZE, page_size);
+    offsets[X86_64_SECTION_DATA] =
+        offsets[X86_64_SECTION_RODATA] +
+        align_up(object->sections[X86_64_SECTION_RODATA].size, page_size);
+    offsets[X86_64_SECTION_BSS] =
+        align_up(offsets[X86_64_SECTION_DATA] +
+                     object->sections[X86_64_SECTION_DATA].size,
+                 object->alignments[X86_64_SECTION_BSS]);
+    const uint64_t size =
+        align_up(offsets[X86_64_SECTION_BSS] + object->bss_size, page_size);
+
+    uint8_t *memory = mmap(NULL,
+                           size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT,
+                           -1,
+                           0);
+    if (memory == MAP_FAILED)
+        return -1;
+
+    // The mapping is zeroed, which takes care of .bss.
+    uint64_t addresses[X86_64_SECTION_COUNT];
+    for (uint32_t i = 0; i < X86_64_SECTION_COUNT; ++i) {
+        addresses[i] = (uint64_t)(uintptr_t)(memory + offsets[i]);
+        if (i != X86_64_SECTION_BSS && object->sections[i].size) {
+            memcpy(memory + offsets[i],
+                   object->sections[i].bytes,
+                   object->sections[i].size);
+        }
+    }
+
+    if (x86_64_relocate(object, addresses, memory) < 0)
+        goto err;
+
+    write_entry(memory + entry_offset, addresses[X86_64_SECTION_TEXT]);
+
+    const uint64_t text_size = offsets[X86_64_SECTION_RODATA];
+    const uint64_t rodata_size =
+        offsets[X86_64_SECTION_DATA] - offsets[X86_64_SECTION_RODATA];
+    if (mprotect(memory, text_size, PROT_READ | PROT_EXEC) < 0 ||
+        mprotect(memory + text_size, rodata_size, PROT_READ) < 0) {
+        goto err;
+    }
+
+    // The program writes straight to the file descriptors and never comes
+    // back, so anything buffered must be out before it starts.
+    fflush(NULL);
+
+    void (*start)(void) = (void (*)(void))(uintptr_t)(memory + entry_offset);
+    start();
+    UNREACHABLE();
+
+err:
+    munmap(memory, size);
+    return -1;
+}
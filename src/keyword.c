@@ -0,0 +1,78 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "keyword.h"
+
+#define KEYWORD_MIN_SIZE 2U
+#define KEYWORD_MAX_SIZE 7U
+#define KEYWORD_TABLE_SIZE 32U
+
+/*
+ * Perfect hash for the keywords, found by brute force: every keyword lands
+ * in its own slot. It only looks at the first two characters and the size.
+ * Lexemes are made of letters, digits and underscores, so setting the 0x20
+ * bit lowercases letters without making anything else look like a letter.
+ * */
+#define KEYWORD_HASH(first, second, size)                                      \
+    ((((first) | 0x20U) + 3U * ((second) | 0x20U) + 7U * (size)) &           \
+     (KEYWORD_TABLE_SIZE - 1))
+
+struct keyword
+{
+    const char *lexeme;
+    uint8_t size;
+    enum token token;
+};
+
+/*
+ * String literals can't be indexed in a constant expression, so the first
+ * two characters of the keyword are spelled out.
+ * */
+#define KEYWORD(first, second, str, tok)                                       \
+    [KEYWORD_HASH(first, second, sizeof(str) - 1)] = {                         \
+        .lexeme = (str),                                                       \
+        .size = sizeof(str) - 1,                                               \
+        .token = (tok)                                                         \
+    }
+
+// If two keywords ever end up in the same slot, -Woverride-init (or
+// -Winitializer-overrides) will complain about it.
+static const struct keyword keywords[KEYWORD_TABLE_SIZE] = {
+    KEYWORD('c', 'o', "const", TOKEN_CONST),
+    KEYWORD('i', 'n', "int", TOKEN_INT),
+    KEYWORD('c', 'h', "char", TOKEN_CHAR),
+    KEYWORD('w', 'h', "while", TOKEN_WHILE),
+    KEYWORD('i', 'f', "if", TOKEN_IF),
+    KEYWORD('f', 'l', "float", TOKEN_FLOAT),
+    KEYWORD('e', 'l', "else", TOKEN_ELSE),
+    KEYWORD('r', 'e', "readln", TOKEN_READLN),
+    KEYWORD('d', 'i', "div", TOKEN_DIV),
+    KEYWORD('s', 't', "string", TOKEN_STRING),
+    KEYWORD('w', 'r', "write", TOKEN_WRITE),
+    KEYWORD('w', 'r', "writeln", TOKEN_WRITELN),
+    KEYWORD('m', 'o', "mod", TOKEN_MOD),
+    KEYWORD('b', 'o', "boolean", TOKEN_BOOLEAN),
+    KEYWORD('t', 'r', "true", TOKEN_CONSTANT),
+    KEYWORD('f', 'a', "false", TOKEN_CONSTANT),
+};
+
+enum token
+keyword_lookup(const char *lexeme, uint32_t lexeme_size)
+{
+    if (lexeme_size < KEYWORD_MIN_SIZE || lexeme_size > KEYWORD_MAX_SIZE)
+        return TOKEN_IDENTIFIER;
+
+    const struct keyword *k =
+        &keywords[KEYWORD_HASH((unsigned char)lexeme[0],
+                               (unsigned char)lexeme[1],
+                               lexeme_size)];
+    if (k->size != lexeme_size)
+        return TOKEN_IDENTIFIER;
+
+    for (uint32_t i = 0; i < lexeme_size; ++i) {
+        if ((lexeme[i] | 0x20) != k->lexeme[i])
+            return TOKEN_IDENTIFIER;
+    }
+
+    return k->token;
+}
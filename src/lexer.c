@@ -3,34 +3,365 @@
  * */
 #include "lexer.h"
 
+#include "keyword.h"
+#include "scan.h"
 #include "symbol_table.h"
 #include "token.h"
 #include "utils.h"
 
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static void
-lexeme_append_or_error(struct lexeme *l, char c)
+/*
+ * Every byte is mapped to a class, bytes in the same class are treated
+ * exactly the same way by every state of the lexer. Bytes that are not part
+ * of the alphabet map to BYTE_CLASS_INVALID.
+ * */
+enum byte_class
 {
-    // FIXME: This function won't throw an error if compiled with
-    // CMAKE_BUILD_TYPE=Release, because it set's NDEBUG and that disables
-    // assert.
-    l->buffer[l->size++] = c;
-    assert(l->size <= sizeof(l->buffer) && "Lexeme buffer overflow.");
-}
+    BYTE_CLASS_INVALID,
+    BYTE_CLASS_SPACE,         /* ' ' */
+    BYTE_CLASS_NEW_LINE,      /* \n */
+    BYTE_CLASS_CONTROL,       /* \r and 0xFF (EOF), not printable. */
+    BYTE_CLASS_OTHER,         /* @ % ? */
+    BYTE_CLASS_LETTER,        /* g-w y z G-W Y Z */
+    BYTE_CLASS_HEX_LETTER,    /* a-f A-F */
+    BYTE_CLASS_X,             /* x X */
+    BYTE_CLASS_UNDERSCORE,    /* _ */
+    BYTE_CLASS_ZERO,          /* 0 */
+    BYTE_CLASS_DIGIT,         /* 1-9 */
+    BYTE_CLASS_DOT,           /* . */
+    BYTE_CLASS_AMPERSAND,     /* & */
+    BYTE_CLASS_PIPE,          /* | */
+    BYTE_CLASS_EXCLAMATION,   /* ! */
+    BYTE_CLASS_COLON,         /* : */
+    BYTE_CLASS_EQUAL,         /* = */
+    BYTE_CLASS_COMMA,         /* , */
+    BYTE_CLASS_PLUS,          /* + */
+    BYTE_CLASS_MINUS,         /* - */
+    BYTE_CLASS_ASTERISK,      /* * */
+    BYTE_CLASS_SEMICOLON,     /* ; */
+    BYTE_CLASS_OPENING_PAREN, /* ( */
+    BYTE_CLASS_CLOSING_PAREN, /* ) */
+    BYTE_CLASS_OPENING_SQUARE_BRACKET, /* [ */
+    BYTE_CLASS_CLOSING_SQUARE_BRACKET, /* ] */
+    BYTE_CLASS_OPENING_CURLY_BRACKET,  /* { */
+    BYTE_CLASS_CLOSING_CURLY_BRACKET,  /* } */
+    BYTE_CLASS_LESS,                   /* < */
+    BYTE_CLASS_GREATER,                /* > */
+    BYTE_CLASS_SLASH,                  /* / */
+    BYTE_CLASS_QUOTE,                  /* ' */
+    BYTE_CLASS_DOUBLE_QUOTE,           /* " */
+    BYTE_CLASS_COUNT
+};
 
-static int
-is_in_alphabet(char c)
+/*
+ * What the lexer does with the byte it just read, before moving to the next
+ * state.
+ * */
+enum lexer_action
 {
-    if (isalnum((unsigned char)c) || c == EOF)
-        return 1;
-    const char *extra = " _.,;:()[]{}+*-'/|@&%!?><=\"\n\r";
-    return strchr(extra, c) != NULL;
-}
+    /* Just move on, the byte is whitespace, part of a comment or part of the
+     * current lexeme. */
+    LEXER_ACTION_NEXT,
+    /* Start a new lexeme at the byte. */
+    LEXER_ACTION_START,
+    /* Found a token that doesn't carry a lexeme. */
+    LEXER_ACTION_EMIT,
+    /* Found a constant, the byte is its last character. */
+    LEXER_ACTION_EMIT_CONSTANT,
+    /* The byte is not part of the token, give it back and found the token. */
+    LEXER_ACTION_EMIT_PREVIOUS,
+    /* Same as above, but the token is a keyword or an identifier. */
+    LEXER_ACTION_EMIT_IDENTIFIER,
+    /* Start a keyword or an identifier at the byte and read the rest of it
+     * right away, hashing it on the way. */
+    LEXER_ACTION_START_IDENTIFIER,
+    /* Start a new lexeme at the byte and fail, as it's invalid. */
+    LEXER_ACTION_START_AND_FAIL,
+    /* The lexeme up to and including the byte is invalid. */
+    LEXER_ACTION_APPEND_AND_FAIL,
+    /* The lexeme before the byte is invalid. */
+    LEXER_ACTION_FAIL,
+    /* The byte is not part of the alphabet. */
+    LEXER_ACTION_INVALID_CHARACTER,
+    /* A new line inside a string constant. */
+    LEXER_ACTION_NEW_LINE_IN_STRING,
+    /* Same as NEXT, but what follows is probably a long run of bytes that
+     * don't change the state (a comment, indentation or a string), so skip
+     * it with the kernel for the next state. */
+    LEXER_ACTION_SKIP
+};
+
+struct lexer_transition
+{
+    uint8_t next_state;
+    uint8_t action;
+    /* Used only when the action finds a token. */
+    uint8_t token;
+    /* Used only when token = TOKEN_CONSTANT. */
+    uint8_t constant_type;
+};
+
+#define LEXER_STATE_COUNT (LEXER_STATE_FLOAT + 1)
+
+#define GOTO(act, state)                                                       \
+    {                                                                          \
+        .next_state = (state), .action = (act)                                 \
+    }
+
+#define EMIT(tok)                                                              \
+    {                                                                          \
+        .action = LEXER_ACTION_EMIT, .token = (tok)                            \
+    }
+
+#define EMIT_PREVIOUS(tok)                                                     \
+    {                                                                          \
+        .action = LEXER_ACTION_EMIT_PREVIOUS, .token = (tok)                   \
+    }
+
+#define EMIT_CONSTANT(type)                                                    \
+    {                                                                          \
+        .action = LEXER_ACTION_EMIT_CONSTANT, .token = TOKEN_CONSTANT,         \
+        .constant_type = (type)                                                \
+    }
+
+#define EMIT_PREVIOUS_CONSTANT(type)                                           \
+    {                                                                          \
+        .action = LEXER_ACTION_EMIT_PREVIOUS, .token = TOKEN_CONSTANT,         \
+        .constant_type = (type)                                                \
+    }
+
+/*
+ * Every row starts with a default transition for every class, which is then
+ * overridden by the classes that the state cares about. Invalid bytes are
+ * always an error.
+ * */
+#define ROW(...)                                                               \
+    [0 ... BYTE_CLASS_COUNT - 1] = __VA_ARGS__,                                \
+    [BYTE_CLASS_INVALID] = GOTO(LEXER_ACTION_INVALID_CHARACTER,                \
+                                LEXER_STATE_INITIAL)
+
+#define DIGITS(...)                                                            \
+    [BYTE_CLASS_ZERO] = __VA_ARGS__, [BYTE_CLASS_DIGIT] = __VA_ARGS__
+
+#define HEX_DIGITS(...)                                                        \
+    DIGITS(__VA_ARGS__), [BYTE_CLASS_HEX_LETTER] = __VA_ARGS__
+
+#define IDENTIFIER_CHARS(...)                                                  \
+    HEX_DIGITS(__VA_ARGS__), [BYTE_CLASS_LETTER] = __VA_ARGS__,                \
+                             [BYTE_CLASS_X] = __VA_ARGS__,                     \
+                             [BYTE_CLASS_UNDERSCORE] = __VA_ARGS__
+
+// Range designators followed by specific entries are how we express
+// "everything else", so overriding initializers is intended here.
+#pragma GCC diagnostic push
+#if defined(__clang__)
+#pragma GCC diagnostic ignored "-Winitializer-overrides"
+#else
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
+static const uint8_t byte_classes[256] = {
+    [0 ... 255] = BYTE_CLASS_INVALID,
+    [' '] = BYTE_CLASS_SPACE,
+    ['\n'] = BYTE_CLASS_NEW_LINE,
+    ['\r'] = BYTE_CLASS_CONTROL,
+    [0xFF] = BYTE_CLASS_CONTROL,
+    ['@'] = BYTE_CLASS_OTHER,
+    ['%'] = BYTE_CLASS_OTHER,
+    ['?'] = BYTE_CLASS_OTHER,
+    ['a' ... 'z'] = BYTE_CLASS_LETTER,
+    ['A' ... 'Z'] = BYTE_CLASS_LETTER,
+    ['a' ... 'f'] = BYTE_CLASS_HEX_LETTER,
+    ['A' ... 'F'] = BYTE_CLASS_HEX_LETTER,
+    ['x'] = BYTE_CLASS_X,
+    ['X'] = BYTE_CLASS_X,
+    ['_'] = BYTE_CLASS_UNDERSCORE,
+    ['0'] = BYTE_CLASS_ZERO,
+    ['1' ... '9'] = BYTE_CLASS_DIGIT,
+    ['.'] = BYTE_CLASS_DOT,
+    ['&'] = BYTE_CLASS_AMPERSAND,
+    ['|'] = BYTE_CLASS_PIPE,
+    ['!'] = BYTE_CLASS_EXCLAMATION,
+    [':'] = BYTE_CLASS_COLON,
+    ['='] = BYTE_CLASS_EQUAL,
+    [','] = BYTE_CLASS_COMMA,
+    ['+'] = BYTE_CLASS_PLUS,
+    ['-'] = BYTE_CLASS_MINUS,
+    ['*'] = BYTE_CLASS_ASTERISK,
+    [';'] = BYTE_CLASS_SEMICOLON,
+    ['('] = BYTE_CLASS_OPENING_PAREN,
+    [')'] = BYTE_CLASS_CLOSING_PAREN,
+    ['['] = BYTE_CLASS_OPENING_SQUARE_BRACKET,
+    [']'] = BYTE_CLASS_CLOSING_SQUARE_BRACKET,
+    ['{'] = BYTE_CLASS_OPENING_CURLY_BRACKET,
+    ['}'] = BYTE_CLASS_CLOSING_CURLY_BRACKET,
+    ['<'] = BYTE_CLASS_LESS,
+    ['>'] = BYTE_CLASS_GREATER,
+    ['/'] = BYTE_CLASS_SLASH,
+    ['\''] = BYTE_CLASS_QUOTE,
+    ['"'] = BYTE_CLASS_DOUBLE_QUOTE,
+};
+
+static const struct lexer_transition
+    transitions[LEXER_STATE_COUNT][BYTE_CLASS_COUNT] = {
+        [LEXER_STATE_INITIAL] = {
+            ROW(GOTO(LEXER_ACTION_START_AND_FAIL, LEXER_STATE_INITIAL)),
+            [BYTE_CLASS_SPACE] =
+                GOTO(LEXER_ACTION_NEXT, LEXER_STATE_INITIAL),
+            // Indentation comes after new lines.
+            [BYTE_CLASS_NEW_LINE] =
+                GOTO(LEXER_ACTION_SKIP, LEXER_STATE_INITIAL),
+            [BYTE_CLASS_LETTER] = GOTO(LEXER_ACTION_START_IDENTIFIER,
+                                       LEXER_STATE_KEYWORD_OR_IDENTIFIER),
+            [BYTE_CLASS_HEX_LETTER] = GOTO(LEXER_ACTION_START_IDENTIFIER,
+                                           LEXER_STATE_KEYWORD_OR_IDENTIFIER),
+            [BYTE_CLASS_X] = GOTO(LEXER_ACTION_START_IDENTIFIER,
+                                  LEXER_STATE_KEYWORD_OR_IDENTIFIER),
+            [BYTE_CLASS_UNDERSCORE] =
+                GOTO(LEXER_ACTION_START_IDENTIFIER,
+                     LEXER_STATE_KEYWORD_OR_IDENTIFIER),
+            // 0 might be the start of a hexadecimal character.
+            [BYTE_CLASS_ZERO] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_CHAR_OR_NUMBER),
+            [BYTE_CLASS_DIGIT] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_INTEGER_OR_FLOAT),
+            [BYTE_CLASS_DOT] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_START_FLOAT),
+            [BYTE_CLASS_AMPERSAND] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_LOGICAL_AND),
+            [BYTE_CLASS_PIPE] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_LOGICAL_OR),
+            [BYTE_CLASS_EXCLAMATION] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_NOT_OR_NOT_EQUAL),
+            [BYTE_CLASS_COLON] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_ASSIGNMENT),
+            [BYTE_CLASS_LESS] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_LESS_OR_LESS_EQUAL),
+            [BYTE_CLASS_GREATER] = GOTO(LEXER_ACTION_START,
+                                        LEXER_STATE_GREATER_OR_GREATER_EQUAL),
+            [BYTE_CLASS_SLASH] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_DIVISION_OR_COMENTARY),
+            [BYTE_CLASS_QUOTE] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_ENTER_CHAR_CONSTANT),
+            [BYTE_CLASS_DOUBLE_QUOTE] =
+                GOTO(LEXER_ACTION_START, LEXER_STATE_STRING_CONSTANT),
+            [BYTE_CLASS_EQUAL] = EMIT(TOKEN_EQUAL),
+            [BYTE_CLASS_COMMA] = EMIT(TOKEN_COMMA),
+            [BYTE_CLASS_PLUS] = EMIT(TOKEN_PLUS),
+            [BYTE_CLASS_MINUS] = EMIT(TOKEN_MINUS),
+            [BYTE_CLASS_ASTERISK] = EMIT(TOKEN_TIMES),
+            [BYTE_CLASS_SEMICOLON] = EMIT(TOKEN_SEMICOLON),
+            [BYTE_CLASS_OPENING_PAREN] = EMIT(TOKEN_OPENING_PAREN),
+            [BYTE_CLASS_CLOSING_PAREN] = EMIT(TOKEN_CLOSING_PAREN),
+            [BYTE_CLASS_OPENING_SQUARE_BRACKET] =
+                EMIT(TOKEN_OPENING_SQUARE_BRACKET),
+            [BYTE_CLASS_CLOSING_SQUARE_BRACKET] =
+                EMIT(TOKEN_CLOSING_SQUARE_BRACKET),
+            [BYTE_CLASS_OPENING_CURLY_BRACKET] =
+                EMIT(TOKEN_OPENING_CURLY_BRACKET),
+            [BYTE_CLASS_CLOSING_CURLY_BRACKET] =
+                EMIT(TOKEN_CLOSING_CURLY_BRACKET),
+        },
+        [LEXER_STATE_KEYWORD_OR_IDENTIFIER] = {
+            ROW(GOTO(LEXER_ACTION_EMIT_IDENTIFIER, LEXER_STATE_INITIAL)),
+            IDENTIFIER_CHARS(GOTO(LEXER_ACTION_NEXT,
+                                  LEXER_STATE_KEYWORD_OR_IDENTIFIER)),
+        },
+        [LEXER_STATE_LOGICAL_AND] = {
+            ROW(GOTO(LEXER_ACTION_FAIL, LEXER_STATE_INITIAL)),
+            [BYTE_CLASS_AMPERSAND] = EMIT(TOKEN_LOGICAL_AND),
+        },
+        [LEXER_STATE_LOGICAL_OR] = {
+            ROW(GOTO(LEXER_ACTION_FAIL, LEXER_STATE_INITIAL)),
+            [BYTE_CLASS_PIPE] = EMIT(TOKEN_LOGICAL_OR),
+        },
+        [LEXER_STATE_NOT_OR_NOT_EQUAL] = {
+            ROW(EMIT_PREVIOUS(TOKEN_NOT)),
+            [BYTE_CLASS_EQUAL] = EMIT(TOKEN_NOT_EQUAL),
+        },
+        [LEXER_STATE_ASSIGNMENT] = {
+            ROW(GOTO(LEXER_ACTION_FAIL, LEXER_STATE_INITIAL)),
+            [BYTE_CLASS_EQUAL] = EMIT(TOKEN_ASSIGNMENT),
+        },
+        [LEXER_STATE_LESS_OR_LESS_EQUAL] = {
+            ROW(EMIT_PREVIOUS(TOKEN_LESS)),
+            [BYTE_CLASS_EQUAL] = EMIT(TOKEN_LESS_EQUAL),
+        },
+        [LEXER_STATE_GREATER_OR_GREATER_EQUAL] = {
+            ROW(EMIT_PREVIOUS(TOKEN_GREATER)),
+            [BYTE_CLASS_EQUAL] = EMIT(TOKEN_GREATER_EQUAL),
+        },
+        [LEXER_STATE_DIVISION_OR_COMENTARY] = {
+            ROW(EMIT_PREVIOUS(TOKEN_DIVISION)),
+            [BYTE_CLASS_ASTERISK] =
+                GOTO(LEXER_ACTION_SKIP, LEXER_STATE_IN_COMMENTARY),
+        },
+        [LEXER_STATE_IN_COMMENTARY] = {
+            ROW(GOTO(LEXER_ACTION_SKIP, LEXER_STATE_IN_COMMENTARY)),
+            [BYTE_CLASS_ASTERISK] =
+                GOTO(LEXER_ACTION_NEXT, LEXER_STATE_LEAVING_COMMENTARY),
+        },
+        [LEXER_STATE_LEAVING_COMMENTARY] = {
+            ROW(GOTO(LEXER_ACTION_SKIP, LEXER_STATE_IN_COMMENTARY)),
+            [BYTE_CLASS_ASTERISK] =
+                GOTO(LEXER_ACTION_NEXT, LEXER_STATE_LEAVING_COMMENTARY),
+            [BYTE_CLASS_SLASH] = GOTO(LEXER_ACTION_NEXT, LEXER_STATE_INITIAL),
+        },
+        // Anything printable can be a char constant.
+        [LEXER_STATE_ENTER_CHAR_CONSTANT] = {
+            ROW(GOTO(LEXER_ACTION_NEXT,
+                     LEXER_STATE_LEAVE_CHAR_CONSTANT)),
+            [BYTE_CLASS_NEW_LINE] =
+                GOTO(LEXER_ACTION_APPEND_AND_FAIL, LEXER_STATE_INITIAL),
+            [BYTE_CLASS_CONTROL] =
+                GOTO(LEXER_ACTION_APPEND_AND_FAIL, LEXER_STATE_INITIAL),
+        },
+        [LEXER_STATE_LEAVE_CHAR_CONSTANT] = {
+            ROW(GOTO(LEXER_ACTION_APPEND_AND_FAIL, LEXER_STATE_INITIAL)),
+            [BYTE_CLASS_QUOTE] = EMIT_CONSTANT(CONSTANT_TYPE_CHAR),
+        },
+        [LEXER_STATE_STRING_CONSTANT] = {
+            ROW(GOTO(LEXER_ACTION_SKIP, LEXER_STATE_STRING_CONSTANT)),
+            [BYTE_CLASS_NEW_LINE] =
+                GOTO(LEXER_ACTION_NEW_LINE_IN_STRING, LEXER_STATE_INITIAL),
+            [BYTE_CLASS_DOUBLE_QUOTE] = EMIT_CONSTANT(CONSTANT_TYPE_STRING),
+        },
+        [LEXER_STATE_CHAR_OR_NUMBER] = {
+            ROW(EMIT_PREVIOUS_CONSTANT(CONSTANT_TYPE_INTEGER)),
+            [BYTE_CLASS_X] = GOTO(LEXER_ACTION_NEXT,
+                                  LEXER_STATE_ENTER_HEXADECIMAL_CHAR),
+            DIGITS(GOTO(LEXER_ACTION_NEXT, LEXER_STATE_INTEGER_OR_FLOAT)),
+            [BYTE_CLASS_DOT] = GOTO(LEXER_ACTION_NEXT, LEXER_STATE_FLOAT),
+        },
+        [LEXER_STATE_ENTER_HEXADECIMAL_CHAR] = {
+            ROW(GOTO(LEXER_ACTION_APPEND_AND_FAIL, LEXER_STATE_INITIAL)),
+            HEX_DIGITS(GOTO(LEXER_ACTION_NEXT,
+                            LEXER_STATE_HEXADECIMAL_CHAR)),
+        },
+        [LEXER_STATE_HEXADECIMAL_CHAR] = {
+            ROW(GOTO(LEXER_ACTION_APPEND_AND_FAIL, LEXER_STATE_INITIAL)),
+            HEX_DIGITS(EMIT_CONSTANT(CONSTANT_TYPE_CHAR)),
+        },
+        [LEXER_STATE_INTEGER_OR_FLOAT] = {
+            ROW(EMIT_PREVIOUS_CONSTANT(CONSTANT_TYPE_INTEGER)),
+            DIGITS(GOTO(LEXER_ACTION_NEXT, LEXER_STATE_INTEGER_OR_FLOAT)),
+            [BYTE_CLASS_DOT] = GOTO(LEXER_ACTION_NEXT, LEXER_STATE_FLOAT),
+        },
+        [LEXER_STATE_START_FLOAT] = {
+            ROW(GOTO(LEXER_ACTION_FAIL, LEXER_STATE_INITIAL)),
+            DIGITS(GOTO(LEXER_ACTION_NEXT, LEXER_STATE_FLOAT)),
+        },
+        [LEXER_STATE_FLOAT] = {
+            ROW(EMIT_PREVIOUS_CONSTANT(CONSTANT_TYPE_FLOAT)),
+            DIGITS(GOTO(LEXER_ACTION_NEXT, LEXER_STATE_FLOAT)),
+        },
+};
+
+#pragma GCC diagnostic pop
 
 void
 lexer_init(struct lexer *lexer,
@@ -39,11 +370,100 @@ lexer_init(struct lexer *lexer,
 {
     lexer->file = file;
     lexer->symbol_table = table;
+    lexer->diagnostics = ERR_STREAM;
     lexer->error = LEXER_ERROR_NONE;
     lexer->cursor = 0;
     lexer->line = 1;
 }
 
+/*
+ * Checks that the lexeme that ends right before cursor fits into
+ * MAX_LEXEME_SIZE.
+ * */
+static uint8_t
+lexer_finish_lexeme(struct lexer *lexer, uint64_t cursor)
+{
+    const uint64_t size = cursor - lexer->lexeme.offset;
+    if (size > MAX_LEXEME_SIZE)
+        return 0;
+    lexer->lexeme.size = (uint32_t)size;
+    return 1;
+}
+
+static void
+lexer_emit_identifier(struct lexer *lexer,
+                      struct lexical_entry *entry,
+                      uint32_t hash)
+{
+    const char *lexeme = lexer_lexeme_start(lexer, &lexer->lexeme);
+
+    entry->lexeme = lexer->lexeme;
+
+    // Keywords never reach the symbol table.
+    entry->token = keyword_lookup(lexeme, lexer->lexeme.size);
+    if (entry->token != TOKEN_IDENTIFIER)
+        return;
+
+    entry->symbol_table_entry =
+        symbol_table_find_or_insert(lexer->symbol_table,
+                                    lexeme,
+                                    lexer->lexeme.size,
+                                    hash,
+                                    TOKEN_IDENTIFIER,
+                                    &entry->is_new_identifier);
+}
+
+/*
+ * Skips the bytes from cursor on that can't take the lexer out of state,
+ * returning where the state machine has to pick up again.
+ *
+ * The line count has to end up exactly as if the state machine had read every
+ * skipped byte: a new line is only counted once the byte after it is read.
+ * c is the last byte that was read, and is updated to the last byte skipped.
+ * */
+static uint64_t
+lexer_skip(struct lexer *lexer,
+           struct lexical_entry *entry,
+           enum lexer_state state,
+           uint64_t cursor,
+           char *c)
+{
+    const char *buffer = lexer->file->buffer;
+    const uint64_t size = lexer->file->size;
+
+    uint64_t new_lines = 0;
+    uint64_t end;
+    switch (state) {
+        case LEXER_STATE_INITIAL:
+            end = scan_whitespace(buffer, cursor, size, &new_lines);
+            break;
+        case LEXER_STATE_IN_COMMENTARY:
+            end = scan_comment(buffer, cursor, size, &new_lines);
+            break;
+        case LEXER_STATE_STRING_CONSTANT:
+            end = scan_string(buffer, cursor, size);
+            break;
+        default:
+            UNREACHABLE();
+    }
+
+    if (end == cursor)
+        return cursor;
+
+    // The kernels count the new lines in [cursor, end), but the ones that
+    // count are in [cursor - 1, end - 1).
+    new_lines += (*c == '\n');
+    *c = buffer[end - 1];
+    new_lines -= (*c == '\n');
+
+    if (new_lines) {
+        entry->line = lexer->line + (uint32_t)new_lines - 1;
+        lexer->line += (uint32_t)new_lines;
+    }
+
+    return end;
+}
+
 enum lexer_result
 lexer_get_next_token(struct lexer *lexer, struct lexical_entry *entry)
 {
@@ -53,349 +473,260 @@ lexer_get_next_token(struct lexer *lexer, struct lexical_entry *entry)
     memset(entry, 0, sizeof(*entry));
     entry->line = 1;
 
-    lexer->state = LEXER_STATE_INITIAL;
+    const char *buffer = lexer->file->buffer;
+    const uint64_t size = lexer->file->size;
+    uint64_t cursor = lexer->cursor;
+    enum lexer_state state = LEXER_STATE_INITIAL;
 
     char last = '\0';
     char c = '\0';
 
-    while (lexer->cursor != lexer->file->size) {
-
+    while (cursor != size) {
         last = c;
-        c = lexer->file->buffer[lexer->cursor++];
+        c = buffer[cursor++];
 
         if (last == '\n') {
             entry->line = lexer->line;
             ++lexer->line;
         }
 
-        if (!is_in_alphabet(c)) {
-            lexer->error = LEXER_ERROR_INVALID_CHARACTER;
-            return LEXER_RESULT_ERROR;
+        const struct lexer_transition *t =
+            &transitions[state][byte_classes[(unsigned char)c]];
+
+        // Whitespace, comments and the middle of lexemes are by far the most
+        // common, keep them out of the jump table.
+        if (t->action == LEXER_ACTION_NEXT) {
+            state = t->next_state;
+            continue;
         }
 
-        switch (lexer->state) {
-            case LEXER_STATE_INITIAL:
-                memset(&lexer->lexeme, 0, sizeof(lexer->lexeme));
+        switch ((enum lexer_action)t->action) {
+            case LEXER_ACTION_NEXT:
+                break;
+            case LEXER_ACTION_START:
+                lexer->lexeme.offset = cursor - 1;
+                break;
+            case LEXER_ACTION_EMIT:
+                lexer->cursor = cursor;
+                entry->token = t->token;
+                return LEXER_RESULT_FOUND;
+            case LEXER_ACTION_EMIT_CONSTANT:
+            case LEXER_ACTION_EMIT_PREVIOUS:
+                if (t->action == LEXER_ACTION_EMIT_PREVIOUS)
+                    --cursor;
+                lexer->cursor = cursor;
 
-                if (c == ' ' || c == '\n')
-                    break;
+                entry->token = t->token;
+                if (entry->token == TOKEN_CONSTANT) {
+                    if (!lexer_finish_lexeme(lexer, cursor))
+                        goto lexeme_too_big;
+                    entry->constant_type = t->constant_type;
+                    entry->lexeme = lexer->lexeme;
+                }
+                return LEXER_RESULT_FOUND;
+            case LEXER_ACTION_EMIT_IDENTIFIER:
+                // START_IDENTIFIER reads identifiers all the way through.
+                UNREACHABLE();
+                break;
+            case LEXER_ACTION_START_IDENTIFIER: {
+                lexer->lexeme.offset = cursor - 1;
 
-                lexeme_append_or_error(&lexer->lexeme, c);
+                const struct lexer_transition *row =
+                    transitions[LEXER_STATE_KEYWORD_OR_IDENTIFIER];
+                uint64_t hash = symbol_hash_step(SYMBOL_HASH_INIT, c);
 
-                if (isalpha(c) || c == '_') {
-                    lexer->state = LEXER_STATE_KEYWORD_OR_IDENTIFIER;
-                    break;
-                } else if (isdigit(c) && c != '0') {
-                    // 0 is not treated here, because 0 might be the start
-                    // of a hexadecimal character.
-                    lexer->state = LEXER_STATE_INTEGER_OR_FLOAT;
-                    break;
-                }
+                while (cursor != size) {
+                    const char next = buffer[cursor];
+                    const struct lexer_transition *nt =
+                        &row[byte_classes[(unsigned char)next]];
 
-                switch (c) {
-                    case '&':
-                        lexer->state = LEXER_STATE_LOGICAL_AND;
-                        break;
-                    case '|':
-                        lexer->state = LEXER_STATE_LOGICAL_OR;
-                        break;
-                    case '!':
-                        lexer->state = LEXER_STATE_NOT_OR_NOT_EQUAL;
-                        break;
-                    case ':':
-                        lexer->state = LEXER_STATE_ASSIGNMENT;
-                        break;
-                    case '=':
-                        entry->token = TOKEN_EQUAL;
-                        return LEXER_RESULT_FOUND;
-                    case ',':
-                        entry->token = TOKEN_COMMA;
-                        return LEXER_RESULT_FOUND;
-                    case '+':
-                        entry->token = TOKEN_PLUS;
-                        return LEXER_RESULT_FOUND;
-                    case '-':
-                        entry->token = TOKEN_MINUS;
-                        return LEXER_RESULT_FOUND;
-                    case '*':
-                        entry->token = TOKEN_TIMES;
-                        return LEXER_RESULT_FOUND;
-                    case ';':
-                        entry->token = TOKEN_SEMICOLON;
-                        return LEXER_RESULT_FOUND;
-                    case '(':
-                        entry->token = TOKEN_OPENING_PAREN;
-                        return LEXER_RESULT_FOUND;
-                    case ')':
-                        entry->token = TOKEN_CLOSING_PAREN;
-                        return LEXER_RESULT_FOUND;
-                    case '[':
-                        entry->token = TOKEN_OPENING_SQUARE_BRACKET;
-                        return LEXER_RESULT_FOUND;
-                    case ']':
-                        entry->token = TOKEN_CLOSING_SQUARE_BRACKET;
-                        return LEXER_RESULT_FOUND;
-                    case '{':
-                        entry->token = TOKEN_OPENING_CURLY_BRACKET;
-                        return LEXER_RESULT_FOUND;
-                    case '}':
-                        entry->token = TOKEN_CLOSING_CURLY_BRACKET;
-                        return LEXER_RESULT_FOUND;
-                    case '<':
-                        lexer->state = LEXER_STATE_LESS_OR_LESS_EQUAL;
-                        break;
-                    case '>':
-                        lexer->state = LEXER_STATE_GREATER_OR_GREATER_EQUAL;
-                        break;
-                    case '/':
-                        lexer->state = LEXER_STATE_DIVISION_OR_COMENTARY;
-                        break;
-                    case '\'':
-                        lexer->state = LEXER_STATE_ENTER_CHAR_CONSTANT;
-                        break;
-                    case '"':
-                        lexer->state = LEXER_STATE_STRING_CONSTANT;
-                        break;
-                    case '0':
-                        lexer->state = LEXER_STATE_CHAR_OR_NUMBER;
-                        break;
-                    case '.':
-                        lexer->state = LEXER_STATE_START_FLOAT;
-                        break;
-                    default:
-                        lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                        return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_KEYWORD_OR_IDENTIFIER:
-                if (isalnum(c) || c == '_') {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                } else {
-                    --lexer->cursor;
-
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-
-                    struct symbol *s = symbol_table_search(
-                        lexer->symbol_table, lexer->lexeme.buffer);
-                    if (s) {
-                        entry->token = s->token;
-                        if (entry->token == TOKEN_IDENTIFIER)
-                            entry->symbol_table_entry = s;
+                    if (nt->action == LEXER_ACTION_EMIT_IDENTIFIER) {
+                        lexer->cursor = cursor;
+                        if (!lexer_finish_lexeme(lexer, cursor))
+                            goto lexeme_too_big;
+                        lexer_emit_identifier(
+                            lexer, entry, symbol_hash_finish(hash));
                         return LEXER_RESULT_FOUND;
                     }
 
-                    s = symbol_table_insert(lexer->symbol_table,
-                                            lexer->lexeme.buffer,
-                                            TOKEN_IDENTIFIER);
-                    assert(s &&
-                           "symbol_table_insert cannot fail at this point.");
-
-                    entry->is_new_identifier = 1;
-                    entry->token = TOKEN_IDENTIFIER;
-                    entry->symbol_table_entry = s;
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_LOGICAL_AND:
-                if (c == '&') {
-                    entry->token = TOKEN_LOGICAL_AND;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_LOGICAL_OR:
-                if (c == '|') {
-                    entry->token = TOKEN_LOGICAL_OR;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_NOT_OR_NOT_EQUAL:
-                if (c == '=') {
-                    entry->token = TOKEN_NOT_EQUAL;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_NOT;
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_ASSIGNMENT:
-                if (c == '=') {
-                    entry->token = TOKEN_ASSIGNMENT;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_LESS_OR_LESS_EQUAL:
-                if (c == '=') {
-                    entry->token = TOKEN_LESS_EQUAL;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_LESS;
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_GREATER_OR_GREATER_EQUAL:
-                if (c == '=') {
-                    entry->token = TOKEN_GREATER_EQUAL;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_GREATER;
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_DIVISION_OR_COMENTARY:
-                if (c != '*') {
-                    --lexer->cursor;
-                    entry->token = TOKEN_DIVISION;
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    lexer->state = LEXER_STATE_IN_COMMENTARY;
-                }
-                break;
-            case LEXER_STATE_IN_COMMENTARY:
-                if (c == '*')
-                    lexer->state = LEXER_STATE_LEAVING_COMMENTARY;
-                break;
-            case LEXER_STATE_LEAVING_COMMENTARY:
-                if (c == '/')
-                    lexer->state = LEXER_STATE_INITIAL;
-                else if (c != '*')
-                    lexer->state = LEXER_STATE_IN_COMMENTARY;
-                break;
-            case LEXER_STATE_ENTER_CHAR_CONSTANT:
-                lexeme_append_or_error(&lexer->lexeme, c);
-                if (isprint(c)) {
-                    lexer->state = LEXER_STATE_LEAVE_CHAR_CONSTANT;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_LEAVE_CHAR_CONSTANT:
-                lexeme_append_or_error(&lexer->lexeme, c);
-                if (c == '\'') {
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_CHAR;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_STRING_CONSTANT:
-                if (c == '\n') {
-                    // Don't consider a \n inside a string...
-                    // revert the line number and cause an error.
-                    --lexer->line;
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
+                    // Let the state machine deal with anything unusual.
+                    if (nt->action != LEXER_ACTION_NEXT)
+                        break;
 
-                lexeme_append_or_error(&lexer->lexeme, c);
-                if (c == '"') {
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_STRING;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
+                    hash = symbol_hash_step(hash, next);
+                    ++cursor;
                 }
                 break;
-            case LEXER_STATE_CHAR_OR_NUMBER:
-                if (tolower(c) == 'x') {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                    lexer->state = LEXER_STATE_ENTER_HEXADECIMAL_CHAR;
-                } else if (isdigit(c)) {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                    lexer->state = LEXER_STATE_INTEGER_OR_FLOAT;
-                } else if (c == '.') {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                    lexer->state = LEXER_STATE_FLOAT;
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_INTEGER;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_ENTER_HEXADECIMAL_CHAR:
-                lexeme_append_or_error(&lexer->lexeme, c);
-                if (isxdigit(c)) {
-                    lexer->state = LEXER_STATE_HEXADECIMAL_CHAR;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_HEXADECIMAL_CHAR:
-                lexeme_append_or_error(&lexer->lexeme, c);
-                if (isxdigit(c)) {
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_CHAR;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
-                }
+            }
+            case LEXER_ACTION_START_AND_FAIL:
+                lexer->lexeme.offset = cursor - 1;
+                // Fallthrough.
+            case LEXER_ACTION_APPEND_AND_FAIL:
+                lexer->cursor = cursor;
+                lexer->lexeme.size = (uint32_t)(cursor - lexer->lexeme.offset);
                 lexer->error = LEXER_ERROR_INVALID_LEXEME;
                 return LEXER_RESULT_ERROR;
-            case LEXER_STATE_INTEGER_OR_FLOAT:
-                if (c == '.') {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                    lexer->state = LEXER_STATE_FLOAT;
-                } else if (isdigit(c)) {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_INTEGER;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
-                }
-                break;
-            case LEXER_STATE_START_FLOAT:
-                if (isdigit(c)) {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                    lexer->state = LEXER_STATE_FLOAT;
-                } else {
-                    lexer->error = LEXER_ERROR_INVALID_LEXEME;
-                    return LEXER_RESULT_ERROR;
-                }
-                break;
-            case LEXER_STATE_FLOAT:
-                if (isdigit(c)) {
-                    lexeme_append_or_error(&lexer->lexeme, c);
-                } else {
-                    --lexer->cursor;
-                    entry->token = TOKEN_CONSTANT;
-                    entry->constant_type = CONSTANT_TYPE_FLOAT;
-                    memcpy(
-                        &entry->lexeme, &lexer->lexeme, sizeof(struct lexeme));
-                    return LEXER_RESULT_FOUND;
-                }
+            case LEXER_ACTION_FAIL:
+                lexer->cursor = cursor;
+                lexer->lexeme.size =
+                    (uint32_t)(cursor - 1 - lexer->lexeme.offset);
+                lexer->error = LEXER_ERROR_INVALID_LEXEME;
+                return LEXER_RESULT_ERROR;
+            case LEXER_ACTION_INVALID_CHARACTER:
+                lexer->cursor = cursor;
+                lexer->error = LEXER_ERROR_INVALID_CHARACTER;
+                return LEXER_RESULT_ERROR;
+            case LEXER_ACTION_NEW_LINE_IN_STRING:
+                // Don't consider a \n inside a string...
+                // revert the line number and cause an error.
+                --lexer->line;
+                lexer->cursor = cursor;
+                lexer->lexeme.size =
+                    (uint32_t)(cursor - 1 - lexer->lexeme.offset);
+                lexer->error = LEXER_ERROR_INVALID_LEXEME;
+                return LEXER_RESULT_ERROR;
+            case LEXER_ACTION_SKIP:
+                cursor = lexer_skip(lexer, entry, t->next_state, cursor, &c);
                 break;
         }
+
+        state = t->next_state;
     }
 
-    if (lexer->state != LEXER_STATE_INITIAL) {
+    lexer->cursor = cursor;
+
+    if (state != LEXER_STATE_INITIAL) {
         lexer->error = LEXER_ERROR_UNEXPECTED_EOF;
         return LEXER_RESULT_ERROR;
     }
     return LEXER_RESULT_EMPTY;
+
+lexeme_too_big:
+    lexer->error = LEXER_ERROR_LEXEME_TOO_BIG;
+    return LEXER_RESULT_ERROR;
+}
+
+/*
+ * Makes room for at least one more entry than capacity in every array.
+ * */
+static int
+token_buffer_grow(struct token_buffer *tokens, uint32_t capacity)
+{
+#define GROW(array)                                                            \
+    do {                                                                       \
+        void *p = realloc(tokens->array,                                       \
+                          ((size_t)capacity + 1) * sizeof(*tokens->array));    \
+        if (!p)                                                                \
+            return -1;                                                         \
+        tokens->array = p;                                                     \
+    } while (0)
+
+    GROW(tokens);
+    GROW(constant_types);
+    GROW(is_new_identifier);
+    GROW(lines);
+    GROW(lexer_lines);
+    GROW(lexeme_offsets);
+    GROW(lexeme_sizes);
+    GROW(symbols);
+
+#undef GROW
+
+    tokens->capacity = capacity;
+    return 0;
+}
+
+int
+token_buffer_reserve(struct token_buffer *tokens, uint32_t capacity)
+{
+    if (tokens->tokens && capacity <= tokens->capacity)
+        return 0;
+    return token_buffer_grow(tokens, capacity);
+}
+
+static void
+token_buffer_set(struct token_buffer *tokens,
+                 uint32_t index,
+                 const struct lexical_entry *entry,
+                 uint32_t lexer_line)
+{
+    tokens->tokens[index] = (uint8_t)entry->token;
+    tokens->constant_types[index] = (uint8_t)entry->constant_type;
+    tokens->is_new_identifier[index] = entry->is_new_identifier;
+    tokens->lines[index] = entry->line;
+    tokens->lexer_lines[index] = lexer_line;
+    tokens->lexeme_offsets[index] = entry->lexeme.offset;
+    tokens->lexeme_sizes[index] = entry->lexeme.size;
+    tokens->symbols[index] = entry->symbol_table_entry;
+}
+
+int
+lexer_tokenize_all(struct lexer *lexer, struct token_buffer *tokens)
+{
+    tokens->count = 0;
+
+    // Our sources average around one token every five bytes, start a bit
+    // below that.
+    uint64_t capacity = lexer->file->size / 8 + 16;
+    if (capacity > UINT32_MAX / 2)
+        capacity = UINT32_MAX / 2;
+    if (token_buffer_reserve(tokens, (uint32_t)capacity) < 0)
+        goto err;
+
+    // The entry is kept between calls, since lexer_get_next_token doesn't
+    // touch it at all when there's nothing left.
+    struct lexical_entry entry;
+    memset(&entry, 0, sizeof(entry));
+
+    enum lexer_result result;
+    while ((result = lexer_get_next_token(lexer, &entry)) ==
+           LEXER_RESULT_FOUND) {
+        if (tokens->count == tokens->capacity) {
+            if (tokens->capacity > UINT32_MAX / 2 ||
+                token_buffer_grow(tokens, tokens->capacity * 2) < 0)
+                goto err;
+        }
+
+        token_buffer_set(tokens, tokens->count++, &entry, lexer->line);
+    }
+
+    tokens->result = result;
+    token_buffer_set(tokens, tokens->count, &entry, lexer->line);
+    return 0;
+
+err:
+    token_buffer_destroy(tokens);
+    return -1;
+}
+
+void
+token_buffer_get(const struct token_buffer *tokens,
+                 uint32_t index,
+                 struct lexical_entry *entry)
+{
+    assert(index <= tokens->count);
+
+    entry->line = tokens->lines[index];
+    entry->token = (enum token)tokens->tokens[index];
+    entry->lexeme.offset = tokens->lexeme_offsets[index];
+    entry->lexeme.size = tokens->lexeme_sizes[index];
+    entry->constant_type = (enum constant_type)tokens->constant_types[index];
+    entry->symbol_table_entry = tokens->symbols[index];
+    entry->is_new_identifier = tokens->is_new_identifier[index];
+}
+
+void
+token_buffer_destroy(struct token_buffer *tokens)
+{
+    free(tokens->tokens);
+    free(tokens->constant_types);
+    free(tokens->is_new_identifier);
+    free(tokens->lines);
+    free(tokens->lexer_lines);
+    free(tokens->lexeme_offsets);
+    free(tokens->lexeme_sizes);
+    free(tokens->symbols);
+    memset(tokens, 0, sizeof(*tokens));
 }
 
 void
@@ -403,24 +734,36 @@ lexer_print_error(const struct lexer *lexer)
 {
     assert(lexer->error != LEXER_ERROR_NONE);
 
-    fprintf(ERR_STREAM, "%i\nError: ", lexer->line);
+    fprintf(lexer->diagnostics, "%i\nError: ", lexer->line);
     switch (lexer->error) {
         case LEXER_ERROR_UNEXPECTED_EOF:
-            fputs("Unexpected End Of File.\n", ERR_STREAM);
+            fputs("Unexpected End Of File.\n", lexer->diagnostics);
             break;
         case LEXER_ERROR_INVALID_LEXEME:
-            fprintf(ERR_STREAM,
-                    "Unidentified lexeme [%s].\n",
-                    lexer->lexeme.buffer);
+            fprintf(lexer->diagnostics,
+                    "Unidentified lexeme [%.*s].\n",
+                    (int)lexer->lexeme.size,
+                    lexer_lexeme_start(lexer, &lexer->lexeme));
+            break;
+        case LEXER_ERROR_LEXEME_TOO_BIG:
+            fprintf(lexer->diagnostics,
+                    "Lexeme is longer than %u characters.\n",
+                    MAX_LEXEME_SIZE);
             break;
         case LEXER_ERROR_INVALID_CHARACTER:
-            fputs("Invalid character.\n", ERR_STREAM);
+            fputs("Invalid character.\n", lexer->diagnostics);
             break;
         default:
             UNREACHABLE();
     }
 }
 
+const char *
+lexer_lexeme_start(const struct lexer *lexer, const struct lexeme *lexeme)
+{
+    return lexer->file->buffer + lexeme->offset;
+}
+
 const char *
 get_lexeme_from_token(enum token token)
 {
@@ -0,0 +1,322 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "lexer.h"
+
+#include "scan.h"
+#include "symbol_table.h"
+#include "token.h"
+#include "utils.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Chunks smaller than this aren't worth a thread of their own. */
+#define MIN_CHUNK_SIZE (1U * 1024U * 1024U)
+
+/*
+ * A part of the file that is lexed by a lexer of its own, through a view of
+ * the file that starts at begin.
+ *
+ * Every chunk but the first starts at the new line that ends the previous
+ * one. Tokens never span new lines (comments aside), so the first call to
+ * lexer_get_next_token in a chunk finds the same token the sequential lexer
+ * would, and counts that new line just like it would.
+ * */
+struct segment
+{
+    uint64_t begin;
+    uint64_t end;
+    /* New lines are counted in [begin, count_end), which doesn't overlap
+     * with the next chunk. */
+    uint64_t count_end;
+    uint64_t new_lines;
+    /* What lexer->line would be right before the byte at begin is read. */
+    uint32_t first_line;
+    struct file view;
+    struct symbol_table table;
+    struct lexer lexer;
+    struct token_buffer tokens;
+    int status;
+};
+
+static void *
+count_segment(void *arg)
+{
+    struct segment *s = arg;
+    s->new_lines =
+        scan_count_new_lines(s->view.buffer, s->count_end - s->begin);
+    return NULL;
+}
+
+static void *
+lex_segment(void *arg)
+{
+    struct segment *s = arg;
+
+    s->status = symbol_table_create(&s->table, 64);
+    if (s->status < 0)
+        return NULL;
+
+    lexer_init(&s->lexer, &s->view, &s->table);
+    s->lexer.line = s->first_line;
+    s->status = lexer_tokenize_all(&s->lexer, &s->tokens);
+    return NULL;
+}
+
+static void
+segment_init(struct segment *s,
+             const struct file *file,
+             uint64_t begin,
+             uint64_t end)
+{
+    memset(s, 0, sizeof(*s));
+    s->begin = begin;
+    s->end = end;
+    s->view.buffer = file->buffer + begin;
+    s->view.size = end - begin;
+}
+
+static void
+segment_destroy(struct segment *s)
+{
+    token_buffer_destroy(&s->tokens);
+    symbol_table_destroy(&s->table);
+}
+
+/*
+ * Copies the entry at index in the segment's buffer to index in out, moving
+ * it to the file's offsets and the lexer's symbol table.
+ * */
+static void
+append_entry(struct lexer *lexer,
+             struct token_buffer *out,
+             uint32_t out_index,
+             const struct segment *s,
+             uint32_t index)
+{
+    const struct token_buffer *in = &s->tokens;
+
+    out->tokens[out_index] = in->tokens[index];
+    out->constant_types[out_index] = in->constant_types[index];
+    out->lines[out_index] = in->lines[index];
+    out->lexer_lines[out_index] = in->lexer_lines[index];
+    // Tokens without a lexeme have an empty one at offset 0.
+    out->lexeme_sizes[out_index] = in->lexeme_sizes[index];
+    out->lexeme_offsets[out_index] =
+        in->lexeme_offsets[index] + (in->lexeme_sizes[index] ? s->begin : 0);
+    out->is_new_identifier[out_index] = 0;
+    out->symbols[out_index] = NULL;
+
+    struct symbol *local = in->symbols[index];
+    if (!local)
+        return;
+
+    // Only the first time an identifier shows up in the segment needs to go
+    // to the lexer's table, the rest can reuse what that one found.
+    if (in->is_new_identifier[index]) {
+        local->merged = symbol_table_find_or_insert(
+            lexer->symbol_table,
+            local->lexeme,
+            local->lexeme_size,
+            symbol_table_hash(local->lexeme, local->lexeme_size),
+            TOKEN_IDENTIFIER,
+            &out->is_new_identifier[out_index]);
+    }
+
+    out->symbols[out_index] = local->merged;
+}
+
+static int
+append_segment(struct lexer *lexer,
+               struct token_buffer *out,
+               const struct segment *s)
+{
+    const uint64_t needed = (uint64_t)out->count + s->tokens.count;
+    if (needed > UINT32_MAX / 2)
+        return -1;
+
+    if (needed > out->capacity) {
+        const uint32_t doubled = out->capacity * 2;
+        if (token_buffer_reserve(
+                out, doubled > needed ? doubled : (uint32_t)needed) < 0)
+            return -1;
+    }
+
+    for (uint32_t i = 0; i < s->tokens.count; ++i)
+        append_entry(lexer, out, out->count++, s, i);
+
+    return 0;
+}
+
+/*
+ * Leaves out and lexer just like lexer_tokenize_all would after the last
+ * segment was lexed.
+ * */
+static void
+finish(struct lexer *lexer, struct token_buffer *out, const struct segment *s)
+{
+    out->result = s->tokens.result;
+
+    // The entry past the last token is whatever the last call to
+    // lexer_get_next_token left behind, which may be the last token itself.
+    append_entry(lexer, out, out->count, s, s->tokens.count);
+    if (out->symbols[out->count] && out->count) {
+        out->symbols[out->count] = out->symbols[out->count - 1];
+        out->is_new_identifier[out->count] =
+            out->is_new_identifier[out->count - 1];
+    }
+
+    lexer->error = s->lexer.error;
+    lexer->lexeme = s->lexer.lexeme;
+    lexer->lexeme.offset += s->begin;
+    lexer->cursor = s->lexer.cursor + s->begin;
+    lexer->line = s->lexer.line;
+}
+
+/*
+ * Splits the file into at most count chunks, at new lines. Returns how many
+ * chunks there are.
+ * */
+static uint32_t
+split_file(const struct file *file, struct segment *chunks, uint32_t count)
+{
+    uint64_t begins[MAX_THREADS];
+    uint32_t n = 1;
+    begins[0] = 0;
+
+    for (uint32_t i = 1; i < count; ++i) {
+        const uint64_t target = file->size / count * i;
+        if (target <= begins[n - 1])
+            continue;
+
+        const char *nl =
+            memchr(file->buffer + target, '\n', file->size - target);
+        if (!nl)
+            break;
+
+        // The chunk needs at least one byte after its new line.
+        const uint64_t begin = (uint64_t)(nl - file->buffer);
+        if (begin + 1 >= file->size)
+            break;
+
+        begins[n++] = begin;
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint8_t is_last = i == n - 1;
+        segment_init(&chunks[i],
+                     file,
+                     begins[i],
+                     is_last ? file->size : begins[i + 1] + 1);
+        chunks[i].count_end = is_last ? file->size : begins[i + 1];
+    }
+
+    return n;
+}
+
+int
+lexer_tokenize_all_parallel(struct lexer *lexer,
+                            struct token_buffer *tokens,
+                            uint32_t threads)
+{
+    const struct file *file = lexer->file;
+
+    if (threads == 0) {
+        const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        const uint64_t by_size = file->size / MIN_CHUNK_SIZE;
+        threads = processors > 0 ? (uint32_t)processors : 1;
+        if (by_size < threads)
+            threads = (uint32_t)by_size;
+    }
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    // Chunks assume the lexer starts at the beginning of the file.
+    if (threads <= 1 || lexer->cursor != 0 || lexer->line != 1)
+        return lexer_tokenize_all(lexer, tokens);
+
+    struct segment chunks[MAX_THREADS];
+    const uint32_t count = split_file(file, chunks, threads);
+    if (count == 1)
+        return lexer_tokenize_all(lexer, tokens);
+
+    run_on_threads(chunks, count, sizeof(*chunks), count_segment);
+
+    uint32_t first_line = 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        chunks[i].first_line = first_line;
+        first_line += (uint32_t)chunks[i].new_lines;
+    }
+
+    run_on_threads(chunks, count, sizeof(*chunks), lex_segment);
+
+    int status = -1;
+    tokens->count = 0;
+    if (token_buffer_reserve(tokens, 1024) < 0)
+        goto out;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (chunks[i].status < 0)
+            goto out;
+    }
+
+    // Stitch the chunks together. Every chunk was lexed as if it started
+    // outside of a comment, which is only wrong when the one before it ended
+    // in the middle of a comment. In that case, lex again from where the
+    // comment started up to the end of the next chunk.
+    struct segment relexed;
+    memset(&relexed, 0, sizeof(relexed));
+
+    struct segment *current = &chunks[0];
+    uint32_t i = 0;
+    while (1) {
+        if (append_segment(lexer, tokens, current) < 0)
+            goto relexed_out;
+
+        const uint8_t is_last = i == count - 1;
+        if (current->tokens.result == LEXER_RESULT_EMPTY && !is_last) {
+            current = &chunks[++i];
+            continue;
+        }
+
+        // The only way a chunk that isn't the last one can end unexpectedly
+        // is inside a comment, as every other token ends at new lines.
+        if (current->tokens.result != LEXER_RESULT_ERROR || is_last ||
+            current->lexer.error != LEXER_ERROR_UNEXPECTED_EOF)
+            break;
+
+        const uint64_t comment = current->begin + current->lexer.lexeme.offset;
+        assert(file->buffer[comment] == '/');
+
+        const uint32_t comment_line =
+            current->first_line +
+            (uint32_t)scan_count_new_lines(file->buffer + current->begin,
+                                           comment - current->begin);
+
+        segment_destroy(&relexed);
+        segment_init(&relexed, file, comment, chunks[++i].end);
+        relexed.first_line = comment_line;
+        lex_segment(&relexed);
+        if (relexed.status < 0)
+            goto relexed_out;
+
+        current = &relexed;
+    }
+
+    finish(lexer, tokens, current);
+    status = 0;
+
+relexed_out:
+    segment_destroy(&relexed);
+
+out:
+    for (uint32_t j = 0; j < count; ++j)
+        segment_destroy(&chunks[j]);
+
+    if (status < 0)
+        token_buffer_destroy(tokens);
+    return status;
+}
@@ -1,130 +1,148 @@
 /* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
  * José Guilherme de Castro Rodrigues - 651201
  * */
+#include "batch.h"
+#include "cache.h"
 #include "codegen.h"
-#include "file.h"
-#include "lexer.h"
-#include "semantic_and_syntatic.h"
-#include "symbol_table.h"
+#include "compile.h"
+#include "server.h"
 
-#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/*
- * Extracts a filename from pathname. The returned buffer must be freed.
- * Examples:
- *  /home/user/file.txt -> file.txt
- * ./file.txt -> file.txt
- *   file.txt -> file.txt
- * */
-static char *
-extract_filename(const char *pathname)
+static void
+print_usage(const char *program)
 {
-    char *buffer = malloc(256);
-    if (!buffer)
-        return NULL;
-
-    const char *last_separator = strrchr(pathname, '/');
-    if (last_separator)
-        ++last_separator;
-    else
-        last_separator = pathname;
-
-    char *ptr = buffer;
-    while (*last_separator) {
-        *ptr++ = *last_separator++;
-    }
-
-    *ptr = 0;
-    return buffer;
+    fprintf(ERR_STREAM,
+            "Usage: %s <program_file> [--keep-unoptimized] "
+            "[--emit-object] [--assemble-and-link] [--run] "
+            "[--backend=native|vm] [--cache-stats]\n"
+            "       %s --batch <program_file>... [options]\n"
+            "       %s --batch-list <list_file> [options]\n"
+            "       %s --cache-stats\n"
+            "       %s --serve <socket>\n"
+            "       %s --connect <socket> <program_file|->... [options]\n",
+            program,
+            program,
+            program,
+            program,
+            program,
+            program);
 }
 
 int
 main(int argc, const char *argv[])
 {
     if (argc < 2) {
-        fprintf(ERR_STREAM,
-                "Usage: %s <program_file> [--keep-unoptimized] "
-                "[--assemble-and-link]\n",
-                argv[0]);
+        print_usage(argv[0]);
         return -1;
     }
 
     // Checks for optional parameters:
     // --keep-unoptimized will leave a copy of the generated assembly that
     // didn't pass through the peephole.
-    // --assemble-and-link will use nasm and ld to generate an executable for
-    // the program.
-    uint8_t keep_unoptimized = 0;
-    uint8_t assemble_and_link = 0;
-    for (int i = 2; i < argc; ++i) {
-        if (strcmp(argv[i], "--keep-unoptimized") == 0)
-            keep_unoptimized = 1;
-        else if (strcmp(argv[i], "--assemble-and-link") == 0)
-            assemble_and_link = 1;
-    }
-
-    int status = 0;
-
-    // Read the l's program source file.
-    struct file file;
-    status = read_file(&file, argv[1]);
-    if (status < 0) {
-        fprintf(ERR_STREAM, "Failed to read %s\n", argv[1]);
+    // --emit-object will also write the program as an ELF object, to be
+    // linked by hand.
+    // --assemble-and-link will generate a static executable for the program.
+    // --run will run the program right after compiling it, without writing
+    // any file. The other options are ignored.
+    // --backend=vm will run the program like --run, but in the bytecode
+    // interpreter instead of as machine code. --backend=native is the
+    // default.
+    // --batch compiles every program file given, in parallel.
+    // --batch-list does the same for the files listed in list_file, one per
+    // line.
+    // --cache-stats prints how the cache at $L_CACHE_DIR has been doing, after
+    // compiling, if there's anything to compile.
+    // --serve starts a compile server on socket, see server.h.
+    // --connect has the server on socket compile the program files instead,
+    // - sends stdin.
+    // Any other option is an error. Anything else is a program file, only one
+    // of which is allowed without --batch or --connect.
+    struct compile_options options = {.backend = CODEGEN_BACKEND_NATIVE};
+    uint8_t batch = 0;
+    uint8_t cache_stats = 0;
+    const char *list = NULL;
+    const char *serve = NULL;
+    const char *connect = NULL;
+
+    const char **pathnames = malloc((size_t)argc * sizeof(*pathnames));
+    if (!pathnames)
         return -1;
-    }
 
-    // Initialize compiler's main structures.
-    struct symbol_table table;
-    status = symbol_table_create(&table, 64);
-    if (status < 0) {
-        fputs("Failed to create symbol table.\n", ERR_STREAM);
-        goto symbol_table_err;
+    uint32_t count = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--keep-unoptimized") == 0)
+            options.keep_unoptimized = 1;
+        else if (strcmp(argv[i], "--emit-object") == 0)
+            options.emit_object = 1;
+        else if (strcmp(argv[i], "--assemble-and-link") == 0)
+            options.assemble_and_link = 1;
+        else if (strcmp(argv[i], "--run") == 0)
+            options.run = 1;
+        else if (strcmp(argv[i], "--backend=native") == 0)
+            options.backend = CODEGEN_BACKEND_NATIVE;
+        else if (strcmp(argv[i], "--backend=vm") == 0) {
+            options.backend = CODEGEN_BACKEND_VM;
+            options.run = 1;
+        } else if (strcmp(argv[i], "--batch") == 0)
+            batch = 1;
+        else if (strcmp(argv[i], "--batch-list") == 0 && i + 1 < argc)
+            list = argv[++i];
+        else if (strcmp(argv[i], "--cache-stats") == 0)
+            cache_stats = 1;
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve = argv[++i];
+        else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+            connect = argv[++i];
+        else if (strncmp(argv[i], "--", 2) != 0)
+            pathnames[count++] = argv[i];
+        else {
+            fprintf(ERR_STREAM, "Invalid option %s.\n", argv[i]);
+            print_usage(argv[0]);
+            free(pathnames);
+            return -1;
+        }
     }
-    symbol_table_populate_with_keywords(&table);
-
-    struct lexer lexer;
-    lexer_init(&lexer, &file, &table);
-
-    struct syntatic_ctx syntatic_ctx;
-    syntatic_init(&syntatic_ctx, &lexer);
-
-    codegen_init();
 
-    status = -1;
-    enum lexer_result result =
-        lexer_get_next_token(&lexer, &syntatic_ctx.entry);
-    if (result == LEXER_RESULT_ERROR) {
-        lexer_print_error(&lexer);
-        goto lexer_err;
+    int status = -1;
+    if ((batch || list) && options.run) {
+        fputs("Programs can't be run in a batch.\n", ERR_STREAM);
+    } else if (connect && options.run) {
+        fputs("Programs can't be run by the server.\n", ERR_STREAM);
+    } else if (serve) {
+        status = server_serve(serve);
+    } else if (connect && count != 0) {
+        status = server_compile(connect, pathnames, count, &options) == 0 ? 0
+                                                                           : -1;
+    } else if (list) {
+        // Every file is small, the pool already uses every processor.
+        options.lexer_threads = 1;
+        status = batch_compile_list(list, &options) == 0 ? 0 : -1;
+    } else if (batch) {
+        options.lexer_threads = 1;
+        status = batch_compile(pathnames, count, &options) == 0 ? 0 : -1;
+    } else if (count > 1) {
+        fputs("Only one program file can be compiled without --batch.\n",
+              ERR_STREAM);
+        print_usage(argv[0]);
+    } else if (count != 0) {
+        status = compile_file(pathnames[0], &options, ERR_STREAM);
+    } else if (cache_stats) {
+        status = 0;
+    } else {
+        print_usage(argv[0]);
     }
 
-    // If we've found the first token, kickstart the syntatic analyzer.
-    // All the rest will be done inside it.
-    if (result == LEXER_RESULT_FOUND) {
-        status = syntatic_start(&syntatic_ctx);
-        if (status == 0) {
-            // Compilation occurred successfully!
-            char *filename = extract_filename(argv[1]);
-
-            fprintf(ERR_STREAM, "Compiled lines: %u\n", lexer.line);
-
-            if (codegen_dump(filename, keep_unoptimized, assemble_and_link) <
-                0) {
-                fputs("codegen_dump failed.\n", ERR_STREAM);
-                free(filename);
-            }
-        }
+    if (cache_stats) {
+        const char *cache = cache_directory();
+        if (cache)
+            cache_print_stats(cache, stdout);
+        else
+            puts("The cache is disabled, L_CACHE_DIR isn't set.");
     }
 
-    codegen_destroy();
-
-lexer_err:
-    symbol_table_destroy(&table);
-
-symbol_table_err:
-    destroy_file(&file);
+    free(pathnames);
     return status;
 }
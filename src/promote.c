@@ -0,0 +1,568 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "promote.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_LOOP UINT32_MAX
+#define NO_VARIABLE UINT32_MAX
+
+/*
+ * How many variables of each kind a loop and the loops around it keep in
+ * temporaries. The other registers are left to the temporaries of
+ * expressions, which would otherwise push the variables back to memory.
+ * */
+static const uint32_t max_promoted[2] = {4, 8};
+
+/*
+ * An access in a nested loop weighs as much as 1 << NESTED_WEIGHT_SHIFT in
+ * the loop around it, up to MAX_WEIGHT_DEPTH loops deep.
+ * */
+#define NESTED_WEIGHT_SHIFT 3U
+#define MAX_WEIGHT_DEPTH 8U
+
+struct variable
+{
+    uint64_t address;
+    /* Bytes mapped to the variable while it's collected. */
+    uint64_t low;
+    uint64_t high;
+    /* Accesses, weighted by how deeply nested they are. */
+    uint64_t weight;
+    uint32_t temporary;
+    /* enum ir_base */
+    uint8_t base;
+    uint8_t size;
+    uint8_t is_float;
+    /* Accessed with different sizes, kinds or addresses, stays in
+     * memory. */
+    uint8_t is_mixed;
+};
+
+struct loop_info
+{
+    /* Where the start label is, start_block is NULL if it wasn't found. */
+    struct ir_block *start_block;
+    uint32_t start_index;
+    uint32_t start_position;
+    uint32_t end_position;
+    /* Variables of the loop in promotion->promoted. */
+    uint32_t first_promoted;
+    uint32_t promoted_count;
+    /* Integers and floats promoted by the loop and the ones around it. */
+    uint32_t nested_promoted[2];
+};
+
+struct promotion
+{
+    struct ir *ir;
+    const struct promote_loop *loops;
+    struct loop_info *infos;
+    /* Loop each label starts or ends, NO_LOOP for the others. */
+    uint32_t *label_loops;
+    /* Variable at each byte of IR_BASE_INIT_MEM and IR_BASE_UNNIT_MEM,
+     * NO_VARIABLE for the others. */
+    uint32_t *indexes[2];
+    uint64_t index_sizes[2];
+    /* Variables of the loop being promoted. */
+    struct variable *variables;
+    uint32_t variable_count;
+    uint32_t variable_capacity;
+    /* Promoted variables of every loop. */
+    struct variable *promoted;
+    uint32_t promoted_count;
+    uint32_t promoted_capacity;
+};
+
+/*
+ * Slot of the base in promotion->indexes, -1 if its memory doesn't hold
+ * variables.
+ * */
+static int
+base_slot(uint8_t base)
+{
+    switch (base) {
+        case IR_BASE_INIT_MEM:
+            return 0;
+        case IR_BASE_UNNIT_MEM:
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+static uint8_t
+is_variable(const struct ir_operand *operand)
+{
+    return operand->kind == IR_OPERAND_MEMORY &&
+           base_slot(operand->base) >= 0;
+}
+
+static int
+grow(struct variable **variables, uint32_t count, uint32_t *capacity)
+{
+    if (count < *capacity)
+        return 0;
+
+    const uint32_t new_capacity = *capacity ? *capacity * 2 : 64;
+    struct variable *new_variables =
+        realloc(*variables, new_capacity * sizeof(*new_variables));
+    if (!new_variables)
+        return -1;
+
+    *variables = new_variables;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/*
+ * Finds where the loops are and how much of each memory area is used.
+ * */
+static void
+locate_loops(struct promotion *promotion)
+{
+    uint32_t position = 0;
+
+    for (struct ir_block *block = promotion->ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i, ++position) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+            if (!ir_has_operands(instruction))
+                continue;
+
+            if (instruction->opcode == IR_OPCODE_LABEL) {
+                const uint32_t label = (uint32_t)instruction->operands[0].value;
+                const uint32_t loop = promotion->label_loops[label];
+                if (loop == NO_LOOP)
+                    continue;
+
+                struct loop_info *info = &promotion->infos[loop];
+                if (promotion->loops[loop].start_label == label) {
+                    info->start_block = block;
+                    info->start_index = i;
+                    info->start_position = position;
+                } else {
+                    info->end_position = position;
+                }
+                continue;
+            }
+
+            for (uint32_t j = 0; j < IR_MAX_OPERANDS; ++j) {
+                const struct ir_operand *operand = &instruction->operands[j];
+                if (!is_variable(operand))
+                    continue;
+
+                const int slot = base_slot(operand->base);
+                const uint64_t end = (uint64_t)operand->value + operand->size;
+                if (end > promotion->index_sizes[slot])
+                    promotion->index_sizes[slot] = end;
+            }
+        }
+    }
+}
+
+static int
+add_access(struct promotion *promotion,
+           const struct ir_instruction *instruction,
+           uint32_t operand_index,
+           uint32_t depth)
+{
+    const struct ir_operand *operand = &instruction->operands[operand_index];
+    uint32_t *indexes = promotion->indexes[base_slot(operand->base)];
+    const uint64_t address = (uint64_t)operand->value;
+    const uint8_t is_float = ir_is_float_operand(instruction, operand_index);
+
+    uint32_t index = indexes[address];
+    if (index == NO_VARIABLE) {
+        if (grow(&promotion->variables,
+                 promotion->variable_count,
+                 &promotion->variable_capacity) < 0) {
+            return -1;
+        }
+
+        index = promotion->variable_count++;
+        promotion->variables[index] =
+            (struct variable){.address = address,
+                              .low = address,
+                              .high = address,
+                              .base = operand->base,
+                              .size = operand->size,
+                              .is_float = is_float};
+    }
+
+    struct variable *variable = &promotion->variables[index];
+    if (variable->address != address || variable->size != operand->size ||
+        variable->is_float != is_float) {
+        variable->is_mixed = 1;
+    }
+
+    // Accesses that overlap other variables keep both in memory.
+    for (uint64_t byte = address; byte < address + operand->size; ++byte) {
+        if (indexes[byte] == NO_VARIABLE) {
+            indexes[byte] = index;
+        } else if (indexes[byte] != index) {
+            variable->is_mixed = 1;
+            promotion->variables[indexes[byte]].is_mixed = 1;
+        }
+    }
+    if (address < variable->low)
+        variable->low = address;
+    if (address + operand->size > variable->high)
+        variable->high = address + operand->size;
+
+    const uint32_t shift =
+        NESTED_WEIGHT_SHIFT *
+        (depth < MAX_WEIGHT_DEPTH ? depth : MAX_WEIGHT_DEPTH);
+    variable->weight += UINT64_C(1) << shift;
+    return 0;
+}
+
+/*
+ * Collects the variables accessed in the loop, from its start label up to
+ * its end label.
+ * */
+static int
+collect_variables(struct promotion *promotion, uint32_t loop)
+{
+    const struct loop_info *info = &promotion->infos[loop];
+    uint32_t position = info->start_position;
+    uint32_t depth = 0;
+    uint32_t i = info->start_index;
+
+    for (struct ir_block *block = info->start_block; block;
+         block = block->next, i = 0) {
+        for (; i < block->count; ++i, ++position) {
+            if (position == info->end_position)
+                return 0;
+
+            const struct ir_instruction *instruction = &block->instructions[i];
+            if (!ir_has_operands(instruction))
+                continue;
+
+            if (instruction->opcode == IR_OPCODE_LABEL) {
+                const uint32_t label = (uint32_t)instruction->operands[0].value;
+                const uint32_t other = promotion->label_loops[label];
+                if (other == NO_LOOP || other == loop)
+                    continue;
+
+                if (promotion->loops[other].start_label == label)
+                    ++depth;
+                else
+                    --depth;
+                continue;
+            }
+
+            for (uint32_t j = 0; j < IR_MAX_OPERANDS; ++j) {
+                if (is_variable(&instruction->operands[j]) &&
+                    add_access(promotion, instruction, j, depth) < 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int
+compare_variables(const void *lhs, const void *rhs)
+{
+    const struct variable *a = lhs;
+    const struct variable *b = rhs;
+    if (a->weight != b->weight)
+        return (a->weight < b->weight) - (a->weight > b->weight);
+    if (a->base != b->base)
+        return (a->base > b->base) - (a->base < b->base);
+    return (a->address > b->address) - (a->address < b->address);
+}
+
+/*
+ * Gives temporaries to the variables accessed the most, as long as the loop
+ * has room for them, and maps them in promotion->indexes.
+ * */
+static int
+choose_variables(struct promotion *promotion, struct loop_info *info)
+{
+    for (uint32_t i = 0; i < promotion->variable_count; ++i) {
+        const struct variable *variable = &promotion->variables[i];
+        uint32_t *indexes = promotion->indexes[base_slot(variable->base)];
+        for (uint64_t byte = variable->low; byte < variable->high; ++byte)
+            indexes[byte] = NO_VARIABLE;
+    }
+
+    qsort(promotion->variables,
+          promotion->variable_count,
+          sizeof(*promotion->variables),
+          compare_variables);
+
+    info->first_promoted = promotion->promoted_count;
+    for (uint32_t i = 0; i < promotion->variable_count; ++i) {
+        struct variable *variable = &promotion->variables[i];
+        if (variable->is_mixed ||
+            info->nested_promoted[variable->is_float] ==
+                max_promoted[variable->is_float]) {
+            continue;
+        }
+
+        if (grow(&promotion->promoted,
+                 promotion->promoted_count,
+                 &promotion->promoted_capacity) < 0) {
+            return -1;
+        }
+
+        variable->temporary = ir_new_temporary(
+            promotion->ir, variable->base, variable->address);
+        if (promotion->ir->failed)
+            return -1;
+
+        promotion->indexes[base_slot(variable->base)][variable->address] =
+            promotion->promoted_count;
+        promotion->promoted[promotion->promoted_count++] = *variable;
+        ++info->nested_promoted[variable->is_float];
+        ++info->promoted_count;
+    }
+
+    promotion->variable_count = 0;
+    return 0;
+}
+
+/*
+ * Replaces the accesses to the promoted variables of the loop with their
+ * temporaries, and unmaps them.
+ * */
+static void
+replace_variables(struct promotion *promotion, const struct loop_info *info)
+{
+    uint32_t position = info->start_position;
+    uint32_t i = info->start_index;
+
+    for (struct ir_block *block = info->start_block;
+         block && position != info->end_position;
+         block = block->next, i = 0) {
+        for (; i < block->count && position != info->end_position;
+             ++i, ++position) {
+            struct ir_instruction *instruction = &block->instructions[i];
+            if (!ir_has_operands(instruction))
+                continue;
+
+            for (uint32_t j = 0; j < IR_MAX_OPERANDS; ++j) {
+                struct ir_operand *operand = &instruction->operands[j];
+                if (!is_variable(operand))
+                    continue;
+
+                const uint32_t index =
+                    promotion->indexes[base_slot(operand->base)]
+                                      [(uint64_t)operand->value];
+                if (index != NO_VARIABLE) {
+                    *operand = ir_temporary(
+                        promotion->promoted[index].temporary, operand->size);
+                }
+            }
+        }
+    }
+
+    for (uint32_t k = 0; k < info->promoted_count; ++k) {
+        const struct variable *variable =
+            &promotion->promoted[info->first_promoted + k];
+        promotion->indexes[base_slot(variable->base)][variable->address] =
+            NO_VARIABLE;
+    }
+}
+
+static int
+compare_loop_infos(const void *lhs, const void *rhs)
+{
+    const struct loop_info *a = *(const struct loop_info *const *)lhs;
+    const struct loop_info *b = *(const struct loop_info *const *)rhs;
+    return (a->start_position > b->start_position) -
+           (a->start_position < b->start_position);
+}
+
+/*
+ * Promotes the loops from the outermost in, a nested loop only gets the
+ * variables and the room the loops around it left.
+ * */
+static int
+promote_loops(struct promotion *promotion, uint32_t count)
+{
+    struct loop_info **order = malloc((count ? count : 1) * sizeof(*order));
+    struct loop_info **around = malloc((count ? count : 1) * sizeof(*around));
+    int err = -1;
+    if (!order || !around)
+        goto out;
+
+    uint32_t located = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (promotion->infos[i].start_block)
+            order[located++] = &promotion->infos[i];
+    }
+    qsort(order, located, sizeof(*order), compare_loop_infos);
+
+    uint32_t around_count = 0;
+    for (uint32_t i = 0; i < located; ++i) {
+        struct loop_info *info = order[i];
+        while (around_count &&
+               around[around_count - 1]->end_position < info->start_position) {
+            --around_count;
+        }
+        if (around_count) {
+            memcpy(info->nested_promoted,
+                   around[around_count - 1]->nested_promoted,
+                   sizeof(info->nested_promoted));
+        }
+
+        if (collect_variables(promotion, (uint32_t)(info - promotion->infos)) <
+                0 ||
+            choose_variables(promotion, info) < 0) {
+            goto out;
+        }
+        replace_variables(promotion, info);
+        around[around_count++] = info;
+    }
+    err = 0;
+
+out:
+    free(around);
+    free(order);
+    return err;
+}
+
+static void
+append_moves(struct ir *ir,
+             const struct promotion *promotion,
+             const struct loop_info *info,
+             uint8_t is_load)
+{
+    for (uint32_t i = 0; i < info->promoted_count; ++i) {
+        const struct variable *variable =
+            &promotion->promoted[info->first_promoted + i];
+        struct ir_instruction *instruction = ir_append(ir);
+        if (!instruction)
+            return;
+
+        const struct ir_operand temporary =
+            ir_temporary(variable->temporary, variable->size);
+        const struct ir_operand memory = ir_memory(
+            variable->base, (int64_t)variable->address, variable->size);
+
+        instruction->opcode =
+            variable->is_float ? IR_OPCODE_MOVSS : IR_OPCODE_MOV;
+        instruction->operands[0] = is_load ? temporary : memory;
+        instruction->operands[1] = is_load ? memory : temporary;
+    }
+}
+
+/*
+ * Copies the program with the loads of the promoted variables before the
+ * loops and the stores after them.
+ * */
+static int
+insert_moves(struct promotion *promotion)
+{
+    struct ir rebuilt;
+    ir_init(&rebuilt);
+
+    for (const struct ir_block *block = promotion->ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+
+            uint32_t loop = NO_LOOP;
+            if (instruction->opcode == IR_OPCODE_LABEL)
+                loop = promotion->label_loops[instruction->operands[0].value];
+
+            const struct loop_info *info =
+                loop == NO_LOOP ? NULL : &promotion->infos[loop];
+            const uint8_t is_start =
+                info && promotion->loops[loop].start_label ==
+                            (uint32_t)instruction->operands[0].value;
+
+            if (info && is_start)
+                append_moves(&rebuilt, promotion, info, 1);
+
+            struct ir_instruction *copy = ir_append(&rebuilt);
+            if (copy)
+                *copy = *instruction;
+
+            if (info && !is_start)
+                append_moves(&rebuilt, promotion, info, 0);
+        }
+    }
+
+    if (rebuilt.failed) {
+        ir_destroy(&rebuilt);
+        return -1;
+    }
+
+    // Only the records are replaced, the rest stays with the program.
+    struct ir_block *old_first_block = promotion->ir->first_block;
+    promotion->ir->first_block = rebuilt.first_block;
+    promotion->ir->last_block = rebuilt.last_block;
+    rebuilt.first_block = old_first_block;
+    ir_destroy(&rebuilt);
+    return 0;
+}
+
+int
+promote_run(struct ir *ir,
+            const struct promote_loop *loops,
+            uint32_t count,
+            struct promote_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!count)
+        return 0;
+
+    struct promotion promotion;
+    memset(&promotion, 0, sizeof(promotion));
+    promotion.ir = ir;
+    promotion.loops = loops;
+
+    int err = -1;
+    promotion.infos = calloc(count, sizeof(*promotion.infos));
+    promotion.label_loops = malloc(
+        (ir->label_count ? ir->label_count : 1) * sizeof(uint32_t));
+    if (!promotion.infos || !promotion.label_loops)
+        goto out;
+
+    for (uint32_t i = 0; i < ir->label_count; ++i)
+        promotion.label_loops[i] = NO_LOOP;
+    for (uint32_t i = 0; i < count; ++i) {
+        promotion.label_loops[loops[i].start_label] = i;
+        promotion.label_loops[loops[i].end_label] = i;
+    }
+
+    locate_loops(&promotion);
+
+    for (uint32_t slot = 0; slot < 2; ++slot) {
+        const uint64_t size = promotion.index_sizes[slot];
+        promotion.indexes[slot] =
+            malloc((size ? size : 1) * sizeof(uint32_t));
+        if (!promotion.indexes[slot])
+            goto out;
+        for (uint64_t i = 0; i < size; ++i)
+            promotion.indexes[slot][i] = NO_VARIABLE;
+    }
+
+    if (promote_loops(&promotion, count) < 0)
+        goto out;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (promotion.infos[i].promoted_count)
+            ++stats->loops;
+    }
+    stats->variables = promotion.promoted_count;
+
+    err = stats->variables ? insert_moves(&promotion) : 0;
+
+out:
+    free(promotion.promoted);
+    free(promotion.variables);
+    free(promotion.indexes[1]);
+    free(promotion.indexes[0]);
+    free(promotion.label_loops);
+    free(promotion.infos);
+    return err;
+}
@@ -0,0 +1,415 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "regalloc.h"
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_POSITION UINT32_MAX
+#define NO_REGISTER UINT8_MAX
+
+enum register_class
+{
+    REGISTER_CLASS_INTEGER,
+    REGISTER_CLASS_FLOAT,
+    REGISTER_CLASS_COUNT,
+};
+
+#define MAX_CLASS_REGISTERS 12U
+
+struct register_set
+{
+    uint8_t count;
+    uint8_t registers[MAX_CLASS_REGISTERS];
+};
+
+static const struct register_set register_sets[REGISTER_CLASS_COUNT] = {
+    [REGISTER_CLASS_INTEGER] = {7,
+                                {IR_REGISTER_R8,
+                                 IR_REGISTER_R9,
+                                 IR_REGISTER_R10,
+                                 IR_REGISTER_R12,
+                                 IR_REGISTER_R13,
+                                 IR_REGISTER_R14,
+                                 IR_REGISTER_R15}},
+    [REGISTER_CLASS_FLOAT] = {12,
+                              {IR_REGISTER_XMM0 + 4,
+                               IR_REGISTER_XMM0 + 5,
+                               IR_REGISTER_XMM0 + 6,
+                               IR_REGISTER_XMM0 + 7,
+                               IR_REGISTER_XMM0 + 8,
+                               IR_REGISTER_XMM0 + 9,
+                               IR_REGISTER_XMM0 + 10,
+                               IR_REGISTER_XMM0 + 11,
+                               IR_REGISTER_XMM0 + 12,
+                               IR_REGISTER_XMM0 + 13,
+                               IR_REGISTER_XMM0 + 14,
+                               IR_REGISTER_XMM15}},
+};
+
+struct interval
+{
+    /* Positions of the first and last instructions using the temporary,
+     * NO_POSITION if it's never used. */
+    uint32_t start;
+    uint32_t end;
+    /* enum register_class */
+    uint8_t class;
+    /* Index in the class' register set, NO_REGISTER if it's in memory. */
+    uint8_t reg;
+};
+
+/*
+ * A jump back to a label, everything live at head must stay live until
+ * tail.
+ * */
+struct loop
+{
+    uint32_t head;
+    uint32_t tail;
+};
+
+struct allocation
+{
+    /* One per temporary. */
+    struct interval *intervals;
+    /* Position of every label seen so far, NO_POSITION for the others. */
+    uint32_t *label_positions;
+    struct loop *loops;
+    uint32_t loop_count;
+    uint32_t loop_capacity;
+};
+
+/*
+ * Temporaries sorted by the start of their intervals.
+ * */
+struct order_entry
+{
+    uint32_t start;
+    uint32_t temporary;
+};
+
+static int
+add_loop(struct allocation *allocation, uint32_t head, uint32_t tail)
+{
+    if (allocation->loop_count == allocation->loop_capacity) {
+        const uint32_t capacity =
+            allocation->loop_capacity ? allocation->loop_capacity * 2 : 64;
+        struct loop *loops =
+            realloc(allocation->loops, capacity * sizeof(*loops));
+        if (!loops)
+            return -1;
+
+        allocation->loops = loops;
+        allocation->loop_capacity = capacity;
+    }
+
+    allocation->loops[allocation->loop_count++] =
+        (struct loop){.head = head, .tail = tail};
+    return 0;
+}
+
+/*
+ * Finds the interval of every temporary and the loops of the program.
+ * */
+static int
+find_intervals(const struct ir *ir, struct allocation *allocation)
+{
+    uint32_t position = 0;
+
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i, ++position) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+            if (!ir_has_operands(instruction))
+                continue;
+
+            const int64_t label = instruction->operands[0].value;
+            switch (instruction->opcode) {
+                case IR_OPCODE_LABEL:
+                    allocation->label_positions[label] = position;
+                    continue;
+                case IR_OPCODE_JMP:
+                case IR_OPCODE_JCC:
+                    // Labels are only seen before their jumps when they
+                    // jump back.
+                    if (allocation->label_positions[label] != NO_POSITION &&
+                        add_loop(allocation,
+                                 allocation->label_positions[label],
+                                 position) < 0) {
+                        return -1;
+                    }
+                    continue;
+                default:
+                    break;
+            }
+
+            for (uint32_t j = 0; j < IR_MAX_OPERANDS; ++j) {
+                const struct ir_operand *operand = &instruction->operands[j];
+                if (operand->kind != IR_OPERAND_TEMPORARY)
+                    continue;
+
+                struct interval *interval =
+                    &allocation->intervals[operand->value];
+                const enum register_class class =
+                    ir_is_float_operand(instruction, j)
+                        ? REGISTER_CLASS_FLOAT
+                        : REGISTER_CLASS_INTEGER;
+
+                if (interval->start == NO_POSITION) {
+                    interval->start = position;
+                    interval->class = (uint8_t)class;
+                }
+                assert(interval->class == class &&
+                       "Temporaries are either integers or floats.");
+                interval->end = position;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int
+compare_loops(const void *lhs, const void *rhs)
+{
+    const struct loop *a = lhs;
+    const struct loop *b = rhs;
+    return (a->head > b->head) - (a->head < b->head);
+}
+
+/*
+ * A temporary that is live when a loop starts over has to be kept for the
+ * whole loop, even if it's not used after the jump back. The loops are
+ * sorted by their heads.
+ * */
+static void
+stretch_over_loops(const struct allocation *allocation,
+                   struct interval *interval)
+{
+    // First loop that starts after the temporary.
+    uint32_t low = 0;
+    uint32_t high = allocation->loop_count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (allocation->loops[middle].head <= interval->start)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    // The end only moves forward, which brings in the loops that start
+    // before it.
+    for (uint32_t i = low; i < allocation->loop_count &&
+                           allocation->loops[i].head <= interval->end;
+         ++i) {
+        if (allocation->loops[i].tail > interval->end)
+            interval->end = allocation->loops[i].tail;
+    }
+}
+
+static int
+compare_order_entries(const void *lhs, const void *rhs)
+{
+    const struct order_entry *a = lhs;
+    const struct order_entry *b = rhs;
+    if (a->start != b->start)
+        return (a->start > b->start) - (a->start < b->start);
+    return (a->temporary > b->temporary) - (a->temporary < b->temporary);
+}
+
+/*
+ * Temporaries holding a register, for each class.
+ * */
+struct active
+{
+    uint32_t count;
+    uint32_t temporaries[MAX_CLASS_REGISTERS];
+    uint8_t is_taken[MAX_CLASS_REGISTERS];
+};
+
+/*
+ * Frees the registers of the temporaries that are dead before position.
+ * */
+static void
+expire(struct active *active,
+       const struct interval *intervals,
+       uint32_t position)
+{
+    for (uint32_t i = 0; i < active->count;) {
+        const struct interval *interval = &intervals[active->temporaries[i]];
+        if (interval->end < position) {
+            active->is_taken[interval->reg] = 0;
+            active->temporaries[i] = active->temporaries[--active->count];
+        } else {
+            ++i;
+        }
+    }
+}
+
+static void
+allocate_registers(struct interval *intervals,
+                   const struct order_entry *order,
+                   uint32_t count,
+                   struct regalloc_stats *stats)
+{
+    struct active actives[REGISTER_CLASS_COUNT];
+    memset(actives, 0, sizeof(actives));
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t temporary = order[i].temporary;
+        struct interval *interval = &intervals[temporary];
+        const struct register_set *set = &register_sets[interval->class];
+        struct active *active = &actives[interval->class];
+
+        expire(active, intervals, interval->start);
+
+        uint8_t reg = NO_REGISTER;
+        for (uint8_t r = 0; r < set->count && reg == NO_REGISTER; ++r) {
+            if (!active->is_taken[r])
+                reg = r;
+        }
+
+        if (reg != NO_REGISTER) {
+            interval->reg = reg;
+            active->is_taken[reg] = 1;
+            active->temporaries[active->count++] = temporary;
+            continue;
+        }
+
+        // Every register is taken, the one that lives the longest goes to
+        // memory. That leaves the most room for the ones that come next.
+        uint32_t longest = 0;
+        for (uint32_t j = 1; j < active->count; ++j) {
+            if (intervals[active->temporaries[j]].end >
+                intervals[active->temporaries[longest]].end) {
+                longest = j;
+            }
+        }
+
+        struct interval *spilled = &intervals[active->temporaries[longest]];
+        if (spilled->end > interval->end) {
+            interval->reg = spilled->reg;
+            spilled->reg = NO_REGISTER;
+            active->temporaries[longest] = temporary;
+        } else {
+            interval->reg = NO_REGISTER;
+        }
+        ++stats->spilled;
+    }
+}
+
+/*
+ * Whether the instruction moves memory to itself, which happens when a
+ * temporary stays in the memory it's loaded from or stored to.
+ * */
+static uint8_t
+is_move_in_place(const struct ir_instruction *instruction)
+{
+    const struct ir_operand *dst = &instruction->operands[0];
+    const struct ir_operand *src = &instruction->operands[1];
+    return (instruction->opcode == IR_OPCODE_MOV ||
+            instruction->opcode == IR_OPCODE_MOVSS) &&
+           dst->kind == IR_OPERAND_MEMORY && src->kind == IR_OPERAND_MEMORY &&
+           dst->base == src->base && dst->value == src->value &&
+           dst->size == src->size && dst->base != IR_BASE_REGISTER;
+}
+
+static void
+replace_temporaries(struct ir *ir, const struct interval *intervals)
+{
+    for (struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            struct ir_instruction *instruction = &block->instructions[i];
+            if (!ir_has_operands(instruction))
+                continue;
+
+            for (uint32_t j = 0; j < IR_MAX_OPERANDS; ++j) {
+                struct ir_operand *operand = &instruction->operands[j];
+                if (operand->kind != IR_OPERAND_TEMPORARY)
+                    continue;
+
+                const uint64_t temporary = (uint64_t)operand->value;
+                const struct interval *interval = &intervals[temporary];
+                if (interval->reg == NO_REGISTER) {
+                    const struct ir_temporary *home =
+                        &ir->temporaries[temporary];
+                    *operand = ir_memory(
+                        home->base, (int64_t)home->address, operand->size);
+                } else {
+                    *operand = ir_register(
+                        register_sets[interval->class].registers[interval->reg],
+                        operand->size);
+                }
+            }
+
+            if (is_move_in_place(instruction))
+                instruction->opcode = IR_OPCODE_DELETED;
+        }
+    }
+}
+
+int
+regalloc_run(struct ir *ir, struct regalloc_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    struct allocation allocation;
+    memset(&allocation, 0, sizeof(allocation));
+
+    const uint32_t count = ir->temporary_count;
+    struct order_entry *order = NULL;
+    int err = -1;
+
+    allocation.intervals =
+        malloc((count ? count : 1) * sizeof(*allocation.intervals));
+    allocation.label_positions = malloc(
+        (ir->label_count ? ir->label_count : 1) * sizeof(uint32_t));
+    order = malloc((count ? count : 1) * sizeof(*order));
+    if (!allocation.intervals || !allocation.label_positions || !order)
+        goto out;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        allocation.intervals[i] =
+            (struct interval){.start = NO_POSITION, .reg = NO_REGISTER};
+    }
+    for (uint32_t i = 0; i < ir->label_count; ++i)
+        allocation.label_positions[i] = NO_POSITION;
+
+    if (find_intervals(ir, &allocation) < 0)
+        goto out;
+
+    qsort(allocation.loops,
+          allocation.loop_count,
+          sizeof(*allocation.loops),
+          compare_loops);
+
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        struct interval *interval = &allocation.intervals[i];
+        if (interval->start == NO_POSITION)
+            continue;
+
+        stretch_over_loops(&allocation, interval);
+        order[used++] =
+            (struct order_entry){.start = interval->start, .temporary = i};
+    }
+
+    qsort(order, used, sizeof(*order), compare_order_entries);
+
+    stats->temporaries = used;
+    allocate_registers(allocation.intervals, order, used, stats);
+    replace_temporaries(ir, allocation.intervals);
+    err = 0;
+
+out:
+    free(order);
+    free(allocation.loops);
+    free(allocation.label_positions);
+    free(allocation.intervals);
+    return err;
+}
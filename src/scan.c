@@ -0,0 +1,394 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_HAS_X86 1
+#else
+#define SCAN_HAS_X86 0
+#endif
+
+typedef uint64_t (*scan_with_lines_fn)(const char *buffer,
+                                       uint64_t cursor,
+                                       uint64_t size,
+                                       uint64_t *new_lines);
+typedef uint64_t (*scan_fn)(const char *buffer,
+                            uint64_t cursor,
+                            uint64_t size);
+typedef uint64_t (*count_fn)(const char *buffer, uint64_t size);
+
+/*
+ * Scalar fallbacks. They don't skip anything and let the lexer's state
+ * machine do all the work.
+ * */
+static uint64_t
+scan_comment_scalar(const char *buffer,
+                    uint64_t cursor,
+                    uint64_t size,
+                    uint64_t *new_lines)
+{
+    (void)buffer;
+    (void)size;
+    *new_lines = 0;
+    return cursor;
+}
+
+static uint64_t
+scan_whitespace_scalar(const char *buffer,
+                       uint64_t cursor,
+                       uint64_t size,
+                       uint64_t *new_lines)
+{
+    (void)buffer;
+    (void)size;
+    *new_lines = 0;
+    return cursor;
+}
+
+static uint64_t
+scan_string_scalar(const char *buffer, uint64_t cursor, uint64_t size)
+{
+    (void)buffer;
+    (void)size;
+    return cursor;
+}
+
+// Counting has no state machine to fall back to, so this one does count.
+static uint64_t
+count_new_lines_scalar(const char *buffer, uint64_t size)
+{
+    uint64_t lines = 0;
+    for (uint64_t i = 0; i < size; ++i)
+        lines += buffer[i] == '\n';
+    return lines;
+}
+
+#if SCAN_HAS_X86
+/*
+ * Every kernel has to stop at bytes that aren't part of the alphabet, so that
+ * the lexer can report them. Checking for the exact alphabet would take too
+ * many instructions, so these masks are a superset: control characters,
+ * everything from 0x7F up and the six printable characters that aren't part
+ * of the alphabet. '\r' and 0xFF are part of it, but are rare enough that
+ * stopping at them costs nothing.
+ *
+ * Since the comparisons are signed, "less than ' '" catches both the control
+ * characters and everything from 0x80 up.
+ * */
+static inline __m128i
+maybe_invalid_sse2(__m128i v)
+{
+    __m128i m = _mm_cmplt_epi8(v, _mm_set1_epi8(' '));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('^')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+    return m;
+}
+
+static uint64_t
+scan_comment_sse2(const char *buffer,
+                  uint64_t cursor,
+                  uint64_t size,
+                  uint64_t *new_lines)
+{
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i new_line = _mm_set1_epi8('\n');
+    uint64_t lines = 0;
+
+    while (size - cursor >= 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buffer + cursor));
+        const __m128i is_new_line = _mm_cmpeq_epi8(v, new_line);
+        // New lines are counted, not stopped at.
+        const __m128i stop = _mm_or_si128(
+          _mm_cmpeq_epi8(v, star),
+          _mm_andnot_si128(is_new_line, maybe_invalid_sse2(v)));
+
+        const uint32_t nl_mask = (uint32_t)_mm_movemask_epi8(is_new_line);
+        const uint32_t stop_mask = (uint32_t)_mm_movemask_epi8(stop);
+        if (stop_mask) {
+            const uint32_t before = (1U << __builtin_ctz(stop_mask)) - 1;
+            *new_lines = lines + (uint64_t)__builtin_popcount(nl_mask & before);
+            return cursor + (uint64_t)__builtin_ctz(stop_mask);
+        }
+
+        lines += (uint64_t)__builtin_popcount(nl_mask);
+        cursor += 16;
+    }
+
+    *new_lines = lines;
+    return cursor;
+}
+
+static uint64_t
+scan_whitespace_sse2(const char *buffer,
+                     uint64_t cursor,
+                     uint64_t size,
+                     uint64_t *new_lines)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i new_line = _mm_set1_epi8('\n');
+    uint64_t lines = 0;
+
+    while (size - cursor >= 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buffer + cursor));
+        const __m128i is_new_line = _mm_cmpeq_epi8(v, new_line);
+        const __m128i keep =
+          _mm_or_si128(_mm_cmpeq_epi8(v, space), is_new_line);
+
+        const uint32_t nl_mask = (uint32_t)_mm_movemask_epi8(is_new_line);
+        const uint32_t stop_mask = ~(uint32_t)_mm_movemask_epi8(keep) & 0xFFFF;
+        if (stop_mask) {
+            const uint32_t before = (1U << __builtin_ctz(stop_mask)) - 1;
+            *new_lines = lines + (uint64_t)__builtin_popcount(nl_mask & before);
+            return cursor + (uint64_t)__builtin_ctz(stop_mask);
+        }
+
+        lines += (uint64_t)__builtin_popcount(nl_mask);
+        cursor += 16;
+    }
+
+    *new_lines = lines;
+    return cursor;
+}
+
+static uint64_t
+scan_string_sse2(const char *buffer, uint64_t cursor, uint64_t size)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+
+    while (size - cursor >= 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buffer + cursor));
+        // New lines are control characters, so they are already part of the
+        // invalid mask.
+        const __m128i stop =
+          _mm_or_si128(_mm_cmpeq_epi8(v, quote), maybe_invalid_sse2(v));
+
+        const uint32_t stop_mask = (uint32_t)_mm_movemask_epi8(stop);
+        if (stop_mask)
+            return cursor + (uint64_t)__builtin_ctz(stop_mask);
+
+        cursor += 16;
+    }
+
+    return cursor;
+}
+
+static uint64_t
+count_new_lines_sse2(const char *buffer, uint64_t size)
+{
+    const __m128i new_line = _mm_set1_epi8('\n');
+    uint64_t lines = 0;
+    uint64_t i = 0;
+
+    for (; size - i >= 16; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+        lines += (uint64_t)__builtin_popcount(
+            (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, new_line)));
+    }
+
+    return lines + count_new_lines_scalar(buffer + i, size - i);
+}
+
+#define AVX2 __attribute__((target("avx2,popcnt,bmi")))
+
+static inline AVX2 __m256i
+maybe_invalid_avx2(__m256i v)
+{
+    __m256i m = _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), v);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F)));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('^')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('~')));
+    return m;
+}
+
+static AVX2 uint64_t
+scan_comment_avx2(const char *buffer,
+                  uint64_t cursor,
+                  uint64_t size,
+                  uint64_t *new_lines)
+{
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i new_line = _mm256_set1_epi8('\n');
+    uint64_t lines = 0;
+
+    while (size - cursor >= 32) {
+        const __m256i v =
+          _mm256_loadu_si256((const __m256i *)(buffer + cursor));
+        const __m256i is_new_line = _mm256_cmpeq_epi8(v, new_line);
+        const __m256i stop = _mm256_or_si256(
+          _mm256_cmpeq_epi8(v, star),
+          _mm256_andnot_si256(is_new_line, maybe_invalid_avx2(v)));
+
+        const uint32_t nl_mask = (uint32_t)_mm256_movemask_epi8(is_new_line);
+        const uint32_t stop_mask = (uint32_t)_mm256_movemask_epi8(stop);
+        if (stop_mask) {
+            const uint32_t index = (uint32_t)__builtin_ctz(stop_mask);
+            const uint32_t before = index ? (~0U >> (32 - index)) : 0;
+            *new_lines = lines + (uint64_t)__builtin_popcount(nl_mask & before);
+            return cursor + index;
+        }
+
+        lines += (uint64_t)__builtin_popcount(nl_mask);
+        cursor += 32;
+    }
+
+    // Let SSE2 deal with what's left, it may still fit a smaller vector.
+    uint64_t tail_lines;
+    cursor = scan_comment_sse2(buffer, cursor, size, &tail_lines);
+    *new_lines = lines + tail_lines;
+    return cursor;
+}
+
+static AVX2 uint64_t
+scan_whitespace_avx2(const char *buffer,
+                     uint64_t cursor,
+                     uint64_t size,
+                     uint64_t *new_lines)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i new_line = _mm256_set1_epi8('\n');
+    uint64_t lines = 0;
+
+    while (size - cursor >= 32) {
+        const __m256i v =
+          _mm256_loadu_si256((const __m256i *)(buffer + cursor));
+        const __m256i is_new_line = _mm256_cmpeq_epi8(v, new_line);
+        const __m256i keep =
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, space), is_new_line);
+
+        const uint32_t nl_mask = (uint32_t)_mm256_movemask_epi8(is_new_line);
+        const uint32_t stop_mask = ~(uint32_t)_mm256_movemask_epi8(keep);
+        if (stop_mask) {
+            const uint32_t index = (uint32_t)__builtin_ctz(stop_mask);
+            const uint32_t before = index ? (~0U >> (32 - index)) : 0;
+            *new_lines = lines + (uint64_t)__builtin_popcount(nl_mask & before);
+            return cursor + index;
+        }
+
+        lines += (uint64_t)__builtin_popcount(nl_mask);
+        cursor += 32;
+    }
+
+    uint64_t tail_lines;
+    cursor = scan_whitespace_sse2(buffer, cursor, size, &tail_lines);
+    *new_lines = lines + tail_lines;
+    return cursor;
+}
+
+static AVX2 uint64_t
+scan_string_avx2(const char *buffer, uint64_t cursor, uint64_t size)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+
+    while (size - cursor >= 32) {
+        const __m256i v =
+          _mm256_loadu_si256((const __m256i *)(buffer + cursor));
+        const __m256i stop =
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), maybe_invalid_avx2(v));
+
+        const uint32_t stop_mask = (uint32_t)_mm256_movemask_epi8(stop);
+        if (stop_mask)
+            return cursor + (uint64_t)__builtin_ctz(stop_mask);
+
+        cursor += 32;
+    }
+
+    return scan_string_sse2(buffer, cursor, size);
+}
+
+static AVX2 uint64_t
+count_new_lines_avx2(const char *buffer, uint64_t size)
+{
+    const __m256i new_line = _mm256_set1_epi8('\n');
+    uint64_t lines = 0;
+    uint64_t i = 0;
+
+    for (; size - i >= 32; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(buffer + i));
+        lines += (uint64_t)__builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, new_line)));
+    }
+
+    return lines + count_new_lines_sse2(buffer + i, size - i);
+}
+
+#undef AVX2
+#endif
+
+static scan_with_lines_fn comment_kernel = scan_comment_scalar;
+static scan_with_lines_fn whitespace_kernel = scan_whitespace_scalar;
+static scan_fn string_kernel = scan_string_scalar;
+static count_fn count_kernel = count_new_lines_scalar;
+static const char *kernels_name = "scalar";
+
+/*
+ * Runs before main, so the kernels never change while a lexer is running.
+ * */
+__attribute__((constructor)) static void
+scan_select_kernels(void)
+{
+#if SCAN_HAS_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") &&
+        __builtin_cpu_supports("bmi")) {
+        comment_kernel = scan_comment_avx2;
+        whitespace_kernel = scan_whitespace_avx2;
+        string_kernel = scan_string_avx2;
+        count_kernel = count_new_lines_avx2;
+        kernels_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        comment_kernel = scan_comment_sse2;
+        whitespace_kernel = scan_whitespace_sse2;
+        string_kernel = scan_string_sse2;
+        count_kernel = count_new_lines_sse2;
+        kernels_name = "sse2";
+    }
+#endif
+}
+
+uint64_t
+scan_comment(const char *buffer,
+             uint64_t cursor,
+             uint64_t size,
+             uint64_t *new_lines)
+{
+    return comment_kernel(buffer, cursor, size, new_lines);
+}
+
+uint64_t
+scan_whitespace(const char *buffer,
+                uint64_t cursor,
+                uint64_t size,
+                uint64_t *new_lines)
+{
+    return whitespace_kernel(buffer, cursor, size, new_lines);
+}
+
+uint64_t
+scan_string(const char *buffer, uint64_t cursor, uint64_t size)
+{
+    return string_kernel(buffer, cursor, size);
+}
+
+uint64_t
+scan_count_new_lines(const char *buffer, uint64_t size)
+{
+    return count_kernel(buffer, size);
+}
+
+const char *
+scan_kernels_name(void)
+{
+    return kernels_name;
+}
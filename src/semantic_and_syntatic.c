@@ -25,25 +25,32 @@ enum semantic_result
 static void
 semantic_print_error(struct syntatic_ctx *ctx, enum semantic_result sr)
 {
-    fprintf(ERR_STREAM, "%i\nError: ", ctx->last_entry.line);
+    const char *lexeme =
+        lexer_lexeme_start(ctx->lexer, &ctx->last_entry.lexeme);
+    const int lexeme_size = (int)ctx->last_entry.lexeme.size;
+
+    fprintf(ctx->lexer->diagnostics, "%i\nError: ", ctx->last_entry.line);
     switch (sr) {
         case SEMANTIC_ERROR_CLASS_MISMATCH:
-            fprintf(ERR_STREAM,
-                    "Incompatible classes [%s].\n",
-                    ctx->last_entry.lexeme.buffer);
+            fprintf(ctx->lexer->diagnostics,
+                    "Incompatible classes [%.*s].\n",
+                    lexeme_size,
+                    lexeme);
             break;
         case SEMANTIC_ERROR_TYPE_MISMATCH:
-            fprintf(ERR_STREAM, "Incompatible types.\n");
+            fprintf(ctx->lexer->diagnostics, "Incompatible types.\n");
             break;
         case SEMANTIC_ERROR_ID_ALREADY_DECLARED:
-            fprintf(ERR_STREAM,
-                    "Identifier has already been declared [%s].\n",
-                    ctx->last_entry.lexeme.buffer);
+            fprintf(ctx->lexer->diagnostics,
+                    "Identifier has already been declared [%.*s].\n",
+                    lexeme_size,
+                    lexeme);
             break;
         case SEMANTIC_ERROR_ID_NOT_DECLARED:
-            fprintf(ERR_STREAM,
-                    "Identifier has not been declared [%s].\n",
-                    ctx->last_entry.lexeme.buffer);
+            fprintf(ctx->lexer->diagnostics,
+                    "Identifier has not been declared [%.*s].\n",
+                    lexeme_size,
+                    lexeme);
             break;
         case SEMANTIC_OK:
             UNREACHABLE();
@@ -66,7 +73,8 @@ is_st_arithmetic(enum symbol_type type)
 }
 
 static enum semantic_result
-semantic_apply_sr26(enum token operation_tok,
+semantic_apply_sr26(struct codegen_ctx *codegen,
+                    enum token operation_tok,
                     struct codegen_value_info *exp_info,
                     struct codegen_value_info *exps_info)
 {
@@ -79,9 +87,9 @@ semantic_apply_sr26(enum token operation_tok,
             exps_info->type == SYMBOL_TYPE_FLOATING_POINT) {
             // Make sure we convert the other one to floating point as well.
             if (exp_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                codegen_convert_to_floating_point(exp_info);
+                codegen_convert_to_floating_point(codegen, exp_info);
             else if (exps_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                codegen_convert_to_floating_point(exps_info);
+                codegen_convert_to_floating_point(codegen, exps_info);
         }
 
         return SEMANTIC_OK;
@@ -112,7 +120,8 @@ semantic_apply_sr26(enum token operation_tok,
 }
 
 static enum semantic_result
-semantic_apply_sr25(enum token operation_tok,
+semantic_apply_sr25(struct codegen_ctx *codegen,
+                    enum token operation_tok,
                     struct codegen_value_info *exps_info,
                     struct codegen_value_info *t_info)
 {
@@ -129,9 +138,9 @@ semantic_apply_sr25(enum token operation_tok,
                     // Make sure we convert the other one to floating point as
                     // well.
                     if (exps_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                        codegen_convert_to_floating_point(exps_info);
+                        codegen_convert_to_floating_point(codegen, exps_info);
                     else if (t_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                        codegen_convert_to_floating_point(t_info);
+                        codegen_convert_to_floating_point(codegen, t_info);
                 }
             } else {
                 return SEMANTIC_ERROR_TYPE_MISMATCH;
@@ -152,7 +161,8 @@ semantic_apply_sr25(enum token operation_tok,
 }
 
 static enum semantic_result
-semantic_apply_sr24(enum token operation_tok,
+semantic_apply_sr24(struct codegen_ctx *codegen,
+                    enum token operation_tok,
                     struct codegen_value_info *t_info,
                     struct codegen_value_info *f_info)
 {
@@ -169,9 +179,9 @@ semantic_apply_sr24(enum token operation_tok,
                     // Make sure we convert the other one to floating point as
                     // well.
                     if (f_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                        codegen_convert_to_floating_point(f_info);
+                        codegen_convert_to_floating_point(codegen, f_info);
                     else if (t_info->type != SYMBOL_TYPE_FLOATING_POINT)
-                        codegen_convert_to_floating_point(t_info);
+                        codegen_convert_to_floating_point(codegen, t_info);
                 }
             } else {
                 return SEMANTIC_ERROR_TYPE_MISMATCH;
@@ -226,7 +236,9 @@ semantic_apply_sr22(enum symbol_type *exps_type, enum symbol_type t_type)
 }
 
 static enum semantic_result
-semantic_apply_sr21(struct codegen_value_info *t_info, uint8_t had_signal)
+semantic_apply_sr21(struct codegen_ctx *codegen,
+                    struct codegen_value_info *t_info,
+                    uint8_t had_signal)
 {
     if (!had_signal)
         return SEMANTIC_OK;
@@ -236,7 +248,7 @@ semantic_apply_sr21(struct codegen_value_info *t_info, uint8_t had_signal)
         return SEMANTIC_ERROR_TYPE_MISMATCH;
     }
 
-    codegen_negate(t_info);
+    codegen_negate(codegen, t_info);
     return SEMANTIC_OK;
 }
 
@@ -457,12 +469,16 @@ semantic_apply_sr1(struct symbol *symbol, enum token tok)
 static void
 syntatic_report_unexpected_token_error(struct syntatic_ctx *ctx)
 {
-    fprintf(ERR_STREAM, "%i\nError: ", ctx->lexer->line);
+    fprintf(ctx->lexer->diagnostics,
+            "%i\nError: ",
+            ctx->tokens->lexer_lines[ctx->index]);
     if (ctx->entry.lexeme.size) {
-        fprintf(
-            ERR_STREAM, "Unexpected token [%s].\n", ctx->entry.lexeme.buffer);
+        fprintf(ctx->lexer->diagnostics,
+                "Unexpected token [%.*s].\n",
+                (int)ctx->entry.lexeme.size,
+                lexer_lexeme_start(ctx->lexer, &ctx->entry.lexeme));
     } else {
-        fprintf(ERR_STREAM,
+        fprintf(ctx->lexer->diagnostics,
                 "Unexpected token [%s].\n",
                 get_lexeme_from_token(ctx->entry.token));
     }
@@ -471,8 +487,8 @@ syntatic_report_unexpected_token_error(struct syntatic_ctx *ctx)
 static void
 syntatic_report_unexpected_eof_error(struct syntatic_ctx *ctx)
 {
-    fprintf(ERR_STREAM, "%i\n", ctx->entry.line);
-    fputs("Error: Unexpected End Of File.\n", ERR_STREAM);
+    fprintf(ctx->lexer->diagnostics, "%i\n", ctx->entry.line);
+    fputs("Error: Unexpected End Of File.\n", ctx->lexer->diagnostics);
 }
 
 static enum syntatic_result
@@ -486,15 +502,18 @@ syntatic_match_token(struct syntatic_ctx *ctx, enum token token)
     if (ctx->entry.token == token) {
         memcpy(&ctx->last_entry, &ctx->entry, sizeof(ctx->entry));
 
-        enum lexer_result result =
-            lexer_get_next_token(ctx->lexer, &ctx->entry);
-        if (result == LEXER_RESULT_ERROR) {
-            lexer_print_error(ctx->lexer);
-            return SYNTATIC_ERROR;
-        } else if (result == LEXER_RESULT_EMPTY) {
+        ++ctx->index;
+        if (ctx->index == ctx->tokens->count) {
+            // The lexer stopped here, either because of an error or
+            // because there's nothing left.
+            if (ctx->tokens->result == LEXER_RESULT_ERROR) {
+                lexer_print_error(ctx->lexer);
+                return SYNTATIC_ERROR;
+            }
             ctx->found_last_token = 1;
         }
 
+        token_buffer_get(ctx->tokens, ctx->index, &ctx->entry);
         return SYNTATIC_OK;
     }
 
@@ -543,13 +562,16 @@ syntatic_decl_var(struct syntatic_ctx *ctx, enum token type_tok)
     // C.G. 2
     struct codegen_value_info info;
     if (has_assignment) {
-        codegen_add_value(id_entry->symbol_type,
+        codegen_add_value(ctx->codegen,
+                          id_entry->symbol_type,
                           id_entry->symbol_class,
                           has_minus,
-                          ctx->last_entry.lexeme.buffer,
+                          lexer_lexeme_start(ctx->lexer,
+                                             &ctx->last_entry.lexeme),
+                          ctx->last_entry.lexeme.size,
                           &info);
     } else {
-        codegen_add_unnit_value(id_entry->symbol_type, &info);
+        codegen_add_unnit_value(ctx->codegen, id_entry->symbol_type, &info);
     }
 
     id_entry->symbol_section = info.section;
@@ -596,13 +618,17 @@ syntatic_decl_var(struct syntatic_ctx *ctx, enum token type_tok)
             }
 
             if (has_assignment) {
-                codegen_add_value(id_entry->symbol_type,
+                codegen_add_value(ctx->codegen,
+                                  id_entry->symbol_type,
                                   id_entry->symbol_class,
                                   has_minus,
-                                  ctx->last_entry.lexeme.buffer,
+                                  lexer_lexeme_start(ctx->lexer,
+                                                     &ctx->last_entry.lexeme),
+                                  ctx->last_entry.lexeme.size,
                                   &info);
             } else {
-                codegen_add_unnit_value(id_entry->symbol_type, &info);
+                codegen_add_unnit_value(
+                    ctx->codegen, id_entry->symbol_type, &info);
             }
 
             id_entry->symbol_section = info.section;
@@ -644,10 +670,12 @@ syntatic_decl_const(struct syntatic_ctx *ctx)
 
     // C.G. 1
     struct codegen_value_info info;
-    codegen_add_value(id_entry->symbol_type,
+    codegen_add_value(ctx->codegen,
+                      id_entry->symbol_type,
                       id_entry->symbol_class,
                       has_minus,
-                      ctx->last_entry.lexeme.buffer,
+                      lexer_lexeme_start(ctx->lexer, &ctx->last_entry.lexeme),
+                      ctx->last_entry.lexeme.size,
                       &info);
 
     id_entry->size = info.size;
@@ -673,7 +701,7 @@ syntatic_read(struct syntatic_ctx *ctx)
 
     HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr10(id_entry));
 
-    codegen_read_into(id_entry);
+    codegen_read_into(ctx->codegen, id_entry);
 
     MATCH_OR_ERROR(ctx, TOKEN_CLOSING_PAREN);
     MATCH_OR_ERROR(ctx, TOKEN_SEMICOLON);
@@ -719,7 +747,7 @@ syntatic_f(struct syntatic_ctx *ctx, struct codegen_value_info *f_info)
             if (syntatic_f(ctx, f_info) < 0)
                 return -1;
             HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr14(f_info->type));
-            codegen_logic_negate(f_info);
+            codegen_logic_negate(ctx->codegen, f_info);
             break;
         case TOKEN_OPENING_PAREN: {
             MATCH_OR_ERROR(ctx, TOKEN_OPENING_PAREN);
@@ -735,7 +763,7 @@ syntatic_f(struct syntatic_ctx *ctx, struct codegen_value_info *f_info)
                 return -1;
             HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr12(f_info->type));
             MATCH_OR_ERROR(ctx, TOKEN_CLOSING_PAREN);
-            codegen_convert_to_integer(f_info);
+            codegen_convert_to_integer(ctx->codegen, f_info);
             break;
         }
         case TOKEN_FLOAT: {
@@ -745,14 +773,18 @@ syntatic_f(struct syntatic_ctx *ctx, struct codegen_value_info *f_info)
                 return -1;
             HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr13(f_info->type));
             MATCH_OR_ERROR(ctx, TOKEN_CLOSING_PAREN);
-            codegen_convert_to_floating_point(f_info);
+            codegen_convert_to_floating_point(ctx->codegen, f_info);
             break;
         }
         case TOKEN_CONSTANT: {
             MATCH_OR_ERROR(ctx, TOKEN_CONSTANT);
             semantic_apply_sr18(&f_info->type, ctx->last_entry.constant_type);
             codegen_add_tmp(
-                f_info->type, ctx->last_entry.lexeme.buffer, f_info);
+                ctx->codegen,
+                f_info->type,
+                lexer_lexeme_start(ctx->lexer, &ctx->last_entry.lexeme),
+                ctx->last_entry.lexeme.size,
+                f_info);
             break;
         }
         case TOKEN_IDENTIFIER: {
@@ -787,7 +819,8 @@ syntatic_f(struct syntatic_ctx *ctx, struct codegen_value_info *f_info)
                 f_info->type = id_entry->symbol_type;
                 f_info->size = id_entry->size;
             } else {
-                codegen_move_idx_to_tmp(id_entry, &brackets_inner_expr, f_info);
+                codegen_move_idx_to_tmp(
+                    ctx->codegen, id_entry, &brackets_inner_expr, f_info);
             }
             break;
         }
@@ -817,26 +850,32 @@ syntatic_t(struct syntatic_ctx *ctx, struct codegen_value_info *t_info)
 
         MATCH_OR_ERROR(ctx, tok);
 
+        // The right operand of && is only run when the left one is true.
+        struct codegen_logical logical;
+        if (tok == TOKEN_LOGICAL_AND && t_info->type == SYMBOL_TYPE_LOGIC)
+            codegen_start_logical(ctx->codegen, tok, &logical, t_info);
+
         if (syntatic_f(ctx, &f_info) < 0)
             return -1;
 
-        HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr24(tok, t_info, &f_info));
+        HANDLE_SEMANTIC_RESULT(
+            ctx, semantic_apply_sr24(ctx->codegen, tok, t_info, &f_info));
 
         switch (tok) {
             case TOKEN_TIMES:
-                codegen_perform_multiplication(t_info, &f_info);
+                codegen_perform_multiplication(ctx->codegen, t_info, &f_info);
                 break;
             case TOKEN_DIVISION:
-                codegen_perform_division(t_info, &f_info);
+                codegen_perform_division(ctx->codegen, t_info, &f_info);
                 break;
             case TOKEN_LOGICAL_AND:
-                codegen_perform_and(t_info, &f_info);
+                codegen_finish_logical(ctx->codegen, &logical, t_info, &f_info);
                 break;
             case TOKEN_MOD:
-                codegen_perform_mod(t_info, &f_info);
+                codegen_perform_mod(ctx->codegen, t_info, &f_info);
                 break;
             case TOKEN_DIV:
-                codegen_perform_integer_division(t_info, &f_info);
+                codegen_perform_integer_division(ctx->codegen, t_info, &f_info);
                 break;
             default:
                 UNREACHABLE();
@@ -865,7 +904,8 @@ syntatic_exps(struct syntatic_ctx *ctx, struct codegen_value_info *exps_info)
     if (syntatic_t(ctx, &t_info) < 0)
         return -1;
 
-    HANDLE_SEMANTIC_RESULT(ctx, semantic_apply_sr21(&t_info, had_signal));
+    HANDLE_SEMANTIC_RESULT(
+        ctx, semantic_apply_sr21(ctx->codegen, &t_info, had_signal));
 
     semantic_apply_sr22(&exps_info->type, t_info.type);
 
@@ -875,21 +915,27 @@ syntatic_exps(struct syntatic_ctx *ctx, struct codegen_value_info *exps_info)
     while (tok == TOKEN_PLUS || tok == TOKEN_MINUS || tok == TOKEN_LOGICAL_OR) {
         MATCH_OR_ERROR(ctx, tok);
 
+        // The right operand of || is only run when the left one is false.
+        struct codegen_logical logical;
+        if (tok == TOKEN_LOGICAL_OR && exps_info->type == SYMBOL_TYPE_LOGIC)
+            codegen_start_logical(ctx->codegen, tok, &logical, exps_info);
+
         if (syntatic_t(ctx, &t_info) < 0)
             return -1;
 
-        HANDLE_SEMANTIC_RESULT(ctx,
-                               semantic_apply_sr25(tok, exps_info, &t_info));
+        HANDLE_SEMANTIC_RESULT(
+            ctx, semantic_apply_sr25(ctx->codegen, tok, exps_info, &t_info));
 
         switch (tok) {
             case TOKEN_PLUS:
-                codegen_perform_addition(exps_info, &t_info);
+                codegen_perform_addition(ctx->codegen, exps_info, &t_info);
                 break;
             case TOKEN_MINUS:
-                codegen_perform_subtraction(exps_info, &t_info);
+                codegen_perform_subtraction(ctx->codegen, exps_info, &t_info);
                 break;
             case TOKEN_LOGICAL_OR:
-                codegen_perform_logical_or(exps_info, &t_info);
+                codegen_finish_logical(
+                    ctx->codegen, &logical, exps_info, &t_info);
                 break;
             default:
                 UNREACHABLE();
@@ -927,8 +973,11 @@ syntatic_exp(struct syntatic_ctx *ctx, struct codegen_value_info *exp_info)
             MATCH_OR_ERROR(ctx, ctx->entry.token);
             if (syntatic_exps(ctx, &exps_info) < 0)
                 return -1;
-            HANDLE_SEMANTIC_RESULT(
-                ctx, semantic_apply_sr26(operation_tok, exp_info, &exps_info));
+            HANDLE_SEMANTIC_RESULT(ctx,
+                                   semantic_apply_sr26(ctx->codegen,
+                                                       operation_tok,
+                                                       exp_info,
+                                                       &exps_info));
             break;
         }
         default:
@@ -936,7 +985,8 @@ syntatic_exp(struct syntatic_ctx *ctx, struct codegen_value_info *exp_info)
     }
 
     if (had_comparison)
-        codegen_perform_comparison(operation_tok, exp_info, &exps_info);
+        codegen_perform_comparison(
+            ctx->codegen, operation_tok, exp_info, &exps_info);
 
     return 0;
 }
@@ -955,7 +1005,8 @@ syntatic_write(struct syntatic_ctx *ctx)
     if (syntatic_exp(ctx, &exp_info) < 0)
         return -1;
 
-    codegen_write(&exp_info,
+    codegen_write(ctx->codegen,
+                  &exp_info,
                   ctx->entry.token == TOKEN_COMMA ? 0 : needs_new_line);
 
     while (ctx->entry.token == TOKEN_COMMA) {
@@ -963,8 +1014,9 @@ syntatic_write(struct syntatic_ctx *ctx)
         if (syntatic_exp(ctx, &exp_info) < 0)
             return -1;
 
-        codegen_reset_tmp();
-        codegen_write(&exp_info,
+        codegen_reset_tmp(ctx->codegen);
+        codegen_write(ctx->codegen,
+                      &exp_info,
                       ctx->entry.token == TOKEN_COMMA ? 0 : needs_new_line);
     }
 
@@ -1014,9 +1066,10 @@ syntatic_attr(struct syntatic_ctx *ctx)
     MATCH_OR_ERROR(ctx, TOKEN_SEMICOLON);
 
     if (!had_brackets)
-        codegen_move_to_id_entry(id_entry, &exp_info);
+        codegen_move_to_id_entry(ctx->codegen, id_entry, &exp_info);
     else
-        codegen_move_to_id_entry_idx(id_entry, &exp_info, &brackets_inner_expr);
+        codegen_move_to_id_entry_idx(
+            ctx->codegen, id_entry, &exp_info, &brackets_inner_expr);
 
     return 0;
 }
@@ -1063,7 +1116,7 @@ syntatic_command(struct syntatic_ctx *ctx)
 {
     enum token tok = ctx->entry.token;
 
-    codegen_reset_tmp();
+    codegen_reset_tmp(ctx->codegen);
 
     switch (tok) {
         case TOKEN_SEMICOLON:
@@ -1091,7 +1144,12 @@ syntatic_command(struct syntatic_ctx *ctx)
                 return -1;
             break;
         default:
-            UNREACHABLE();
+            // A command was required, as the only one after an else.
+            if (ctx->found_last_token)
+                syntatic_report_unexpected_eof_error(ctx);
+            else
+                syntatic_report_unexpected_token_error(ctx);
+            return -1;
     }
 
     return 0;
@@ -1101,20 +1159,21 @@ static int
 syntatic_while(struct syntatic_ctx *ctx)
 {
     struct codegen_value_info exp;
+    struct codegen_loop loop;
 
     MATCH_OR_ERROR(ctx, TOKEN_WHILE);
 
-    codegen_start_loop();
+    codegen_start_loop(ctx->codegen, &loop);
 
     if (syntatic_paren_exp(ctx, &exp) < 0)
         return -1;
 
-    codegen_eval_loop_expr(&exp);
+    codegen_eval_loop_expr(ctx->codegen, &loop, &exp);
 
     if (syntatic_is_first_of_command(ctx)) {
         if (syntatic_command(ctx) < 0)
             return -1;
-        codegen_finish_loop();
+        codegen_finish_loop(ctx->codegen, &loop);
         return 0;
     } else if (ctx->entry.token == TOKEN_OPENING_CURLY_BRACKET) {
         MATCH_OR_ERROR(ctx, TOKEN_OPENING_CURLY_BRACKET);
@@ -1125,7 +1184,7 @@ syntatic_while(struct syntatic_ctx *ctx)
         }
 
         MATCH_OR_ERROR(ctx, TOKEN_CLOSING_CURLY_BRACKET);
-        codegen_finish_loop();
+        codegen_finish_loop(ctx->codegen, &loop);
         return 0;
     }
 
@@ -1137,13 +1196,14 @@ static int
 syntatic_if(struct syntatic_ctx *ctx)
 {
     struct codegen_value_info exp;
+    struct codegen_if if_info;
 
     MATCH_OR_ERROR(ctx, TOKEN_IF);
 
     if (syntatic_paren_exp(ctx, &exp) < 0)
         return -1;
 
-    codegen_start_if(&exp);
+    codegen_start_if(ctx->codegen, &if_info, &exp);
 
     if (syntatic_is_first_of_command(ctx)) {
         if (syntatic_command(ctx) < 0)
@@ -1153,15 +1213,15 @@ syntatic_if(struct syntatic_ctx *ctx)
         if (ctx->entry.token == TOKEN_ELSE) {
             had_else = 1;
 
-            codegen_if_jmp();
-            codegen_start_else();
+            codegen_if_jmp(ctx->codegen, &if_info);
+            codegen_start_else(ctx->codegen, &if_info);
 
             MATCH_OR_ERROR(ctx, TOKEN_ELSE);
             if (syntatic_command(ctx) < 0)
                 return -1;
         }
 
-        codegen_finish_if(had_else);
+        codegen_finish_if(ctx->codegen, &if_info, had_else);
         return 0;
     } else if (ctx->entry.token == TOKEN_OPENING_CURLY_BRACKET) {
         MATCH_OR_ERROR(ctx, TOKEN_OPENING_CURLY_BRACKET);
@@ -1177,8 +1237,8 @@ syntatic_if(struct syntatic_ctx *ctx)
         if (ctx->entry.token == TOKEN_ELSE) {
             had_else = 1;
 
-            codegen_if_jmp();
-            codegen_start_else();
+            codegen_if_jmp(ctx->codegen, &if_info);
+            codegen_start_else(ctx->codegen, &if_info);
 
             MATCH_OR_ERROR(ctx, TOKEN_ELSE);
             MATCH_OR_ERROR(ctx, TOKEN_OPENING_CURLY_BRACKET);
@@ -1191,12 +1251,12 @@ syntatic_if(struct syntatic_ctx *ctx)
             MATCH_OR_ERROR(ctx, TOKEN_CLOSING_CURLY_BRACKET);
         }
 
-        codegen_finish_if(had_else);
+        codegen_finish_if(ctx->codegen, &if_info, had_else);
         return 0;
     }
 
     syntatic_report_unexpected_token_error(ctx);
-    return 1;
+    return -1;
 }
 
 static int
@@ -1219,12 +1279,20 @@ syntatic_is_first_of_s(struct syntatic_ctx *ctx)
 }
 
 void
-syntatic_init(struct syntatic_ctx *ctx, struct lexer *lexer)
+syntatic_init(struct syntatic_ctx *ctx,
+              struct lexer *lexer,
+              const struct token_buffer *tokens,
+              struct codegen_ctx *codegen)
 {
+    assert(tokens->count > 0);
+
     ctx->lexer = lexer;
+    ctx->tokens = tokens;
+    ctx->codegen = codegen;
+    ctx->index = 0;
     ctx->found_last_token = 0;
     memset(&ctx->last_entry, 0, sizeof(ctx->last_entry));
-    memset(&ctx->entry, 0, sizeof(ctx->entry));
+    token_buffer_get(tokens, 0, &ctx->entry);
 }
 
 int
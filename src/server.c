@@ -0,0 +1,563 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "server.h"
+
+#include "compile.h"
+#include "file.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Biggest inline source the server takes. */
+#define MAX_SOURCE_SIZE (1ULL << 30)
+
+struct pooled_buffers
+{
+    struct pooled_buffers *next;
+    struct compile_buffers buffers;
+};
+
+/*
+ * Buffers that no request is using. Connections may outlive server_serve
+ * for a moment, so the pool lives as long as the process.
+ * */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pooled_buffers *idle_buffers;
+
+struct connection
+{
+    int fd;
+    /* Inline sources are received here, it's kept for the next request. */
+    char *source;
+    uint64_t source_capacity;
+};
+
+static volatile sig_atomic_t should_stop;
+
+static void
+stop(int signal)
+{
+    (void)signal;
+    should_stop = 1;
+}
+
+/*
+ * Reads exactly size bytes from fd. Returns -1 if it fails or fd is closed
+ * before that.
+ * */
+static int
+read_all(int fd, void *buffer, uint64_t size)
+{
+    uint8_t *ptr = buffer;
+    while (size) {
+        const ssize_t n = read(fd, ptr, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        ptr += n;
+        size -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Writes exactly size bytes to the socket fd. A closed socket is an error,
+ * not a SIGPIPE.
+ * */
+static int
+write_all(int fd, const void *buffer, uint64_t size)
+{
+    const uint8_t *ptr = buffer;
+    while (size) {
+        const ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        ptr += n;
+        size -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Takes idle buffers from the pool, or creates new ones if there are none.
+ * */
+static struct pooled_buffers *
+acquire_buffers(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    struct pooled_buffers *pooled = idle_buffers;
+    if (pooled)
+        idle_buffers = pooled->next;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (pooled)
+        return pooled;
+
+    pooled = malloc(sizeof(*pooled));
+    if (pooled && compile_buffers_create(&pooled->buffers) < 0) {
+        free(pooled);
+        pooled = NULL;
+    }
+    return pooled;
+}
+
+static void
+release_buffers(struct pooled_buffers *pooled)
+{
+    pthread_mutex_lock(&pool_lock);
+    pooled->next = idle_buffers;
+    idle_buffers = pooled;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Frees the buffers no request is using.
+ * */
+static void
+empty_pool(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    struct pooled_buffers *pooled = idle_buffers;
+    idle_buffers = NULL;
+    pthread_mutex_unlock(&pool_lock);
+
+    while (pooled) {
+        struct pooled_buffers *tmp = pooled->next;
+        compile_buffers_destroy(&pooled->buffers);
+        free(pooled);
+        pooled = tmp;
+    }
+}
+
+/*
+ * Compiles the program of a request, printing the diagnostics and the
+ * outputs into their streams. Returns what compile_source returned.
+ * */
+static int
+compile_request(struct connection *connection,
+                const struct server_request *request,
+                const char *pathname,
+                const char *directory,
+                FILE *diagnostics,
+                FILE *outputs)
+{
+    struct compile_options options = { .backend = CODEGEN_BACKEND_NATIVE };
+    options.keep_unoptimized =
+        (request->flags & SERVER_FLAG_KEEP_UNOPTIMIZED) != 0;
+    options.emit_object = (request->flags & SERVER_FLAG_EMIT_OBJECT) != 0;
+    options.assemble_and_link =
+        (request->flags & SERVER_FLAG_ASSEMBLE_AND_LINK) != 0;
+
+    // Outputs go to the client's working directory, named after the file.
+    const char *filename = strrchr(pathname, '/');
+    filename = filename ? filename + 1 : pathname;
+
+    char name[PATH_MAX];
+    if (snprintf(name, sizeof(name), "%s/%s", directory, filename) >=
+        (int)sizeof(name)) {
+        fprintf(diagnostics, "Pathname is too long: %s\n", pathname);
+        return -1;
+    }
+
+    const uint8_t is_inline =
+        (request->flags & SERVER_FLAG_INLINE_SOURCE) != 0;
+
+    struct file file;
+    if (is_inline) {
+        file.buffer = connection->source;
+        file.size = request->source_size;
+        file.is_mapped = 0;
+    } else {
+        char source_pathname[PATH_MAX];
+        const int size = pathname[0] == '/'
+                             ? snprintf(source_pathname,
+                                        sizeof(source_pathname),
+                                        "%s",
+                                        pathname)
+                             : snprintf(source_pathname,
+                                        sizeof(source_pathname),
+                                        "%s/%s",
+                                        directory,
+                                        pathname);
+
+        if (size >= (int)sizeof(source_pathname) ||
+            read_file(&file, source_pathname) < 0) {
+            fprintf(diagnostics, "Failed to read %s\n", pathname);
+            return -1;
+        }
+    }
+
+    int status = -1;
+    struct pooled_buffers *pooled = acquire_buffers();
+    if (pooled) {
+        status = compile_source(
+            &file, name, &options, diagnostics, &pooled->buffers);
+        release_buffers(pooled);
+    } else {
+        fputs("Failed to create symbol table.\n", diagnostics);
+    }
+
+    if (status == 0)
+        compile_print_outputs(name, &options, outputs);
+
+    if (!is_inline)
+        destroy_file(&file);
+    return status;
+}
+
+/*
+ * Reads a string of size characters, null terminating it.
+ * */
+static int
+read_string(int fd, char string[PATH_MAX], uint32_t size)
+{
+    if (size >= PATH_MAX || read_all(fd, string, size) < 0)
+        return -1;
+
+    string[size] = '\0';
+    return 0;
+}
+
+/*
+ * Reads a request from the connection and replies to it. Returns -1 once
+ * the connection is closed, or if the client doesn't speak the protocol.
+ * */
+static int
+serve_request(struct connection *connection)
+{
+    const int fd = connection->fd;
+
+    struct server_request request;
+    if (read_all(fd, &request, sizeof(request)) < 0 ||
+        request.magic != SERVER_MAGIC)
+        return -1;
+
+    char pathname[PATH_MAX];
+    char directory[PATH_MAX];
+    if (read_string(fd, pathname, request.pathname_size) < 0 ||
+        read_string(fd, directory, request.directory_size) < 0)
+        return -1;
+
+    if (request.flags & SERVER_FLAG_INLINE_SOURCE) {
+        if (request.source_size > MAX_SOURCE_SIZE)
+            return -1;
+
+        // Even empty sources get a buffer.
+        if (!connection->source ||
+            request.source_size > connection->source_capacity) {
+            const uint64_t capacity =
+                request.source_size ? request.source_size : 1;
+            char *source = realloc(connection->source, capacity);
+            if (!source)
+                return -1;
+
+            connection->source = source;
+            connection->source_capacity = capacity;
+        }
+
+        if (read_all(fd, connection->source, request.source_size) < 0)
+            return -1;
+    }
+
+    char *diagnostics_buffer = NULL;
+    size_t diagnostics_size = 0;
+    char *outputs_buffer = NULL;
+    size_t outputs_size = 0;
+    FILE *diagnostics = open_memstream(&diagnostics_buffer, &diagnostics_size);
+    FILE *outputs = open_memstream(&outputs_buffer, &outputs_size);
+
+    if (!diagnostics || !outputs) {
+        if (diagnostics)
+            fclose(diagnostics);
+        if (outputs)
+            fclose(outputs);
+        free(diagnostics_buffer);
+        free(outputs_buffer);
+        return -1;
+    }
+
+    struct server_reply reply;
+    reply.status = compile_request(
+        connection, &request, pathname, directory, diagnostics, outputs);
+
+    // The buffers are only complete once the streams are closed.
+    int status = fclose(diagnostics) == 0 ? 0 : -1;
+    if (fclose(outputs) != 0)
+        status = -1;
+
+    reply.diagnostics_size = (uint32_t)diagnostics_size;
+    reply.outputs_size = (uint32_t)outputs_size;
+    if (status == 0 &&
+        (write_all(fd, &reply, sizeof(reply)) < 0 ||
+         write_all(fd, diagnostics_buffer, diagnostics_size) < 0 ||
+         write_all(fd, outputs_buffer, outputs_size) < 0))
+        status = -1;
+
+    free(diagnostics_buffer);
+    free(outputs_buffer);
+    return status;
+}
+
+static void *
+serve_connection(void *arg)
+{
+    struct connection *connection = arg;
+    while (serve_request(connection) == 0)
+        ;
+
+    close(connection->fd);
+    free(connection->source);
+    free(connection);
+    return NULL;
+}
+
+/*
+ * Connects to the server at socket_path. Returns the socket, or -1.
+ * */
+static int
+connect_to(const char *socket_path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (const struct sockaddr *)address, sizeof(*address)) < 0) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int
+server_serve(const char *socket_path)
+{
+    // Whatever is at socket_path is only replaced if it's a socket nobody is
+    // listening on anymore.
+    struct sockaddr_un address;
+    const int running = connect_to(socket_path, &address);
+    if (running >= 0) {
+        close(running);
+        fprintf(ERR_STREAM, "A server is already running on %s\n", socket_path);
+        return -1;
+    }
+    if (errno == ENAMETOOLONG) {
+        fprintf(ERR_STREAM, "Socket pathname is too long: %s\n", socket_path);
+        return -1;
+    }
+
+    struct stat st;
+    if (errno == ECONNREFUSED && lstat(socket_path, &st) == 0 &&
+        S_ISSOCK(st.st_mode))
+        unlink(socket_path);
+
+    const int fd =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0 ||
+        bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        fprintf(ERR_STREAM,
+                "Failed to listen on %s: %s\n",
+                socket_path,
+                strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    // The stop signals are blocked everywhere but in pselect, so that they
+    // always interrupt it and none is missed between checking should_stop
+    // and waiting. Connection threads inherit the mask.
+    sigset_t stop_signals;
+    sigset_t previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(ERR_STREAM, "Serving on %s.\n", socket_path);
+
+    while (!should_stop) {
+        fd_set listener;
+        FD_ZERO(&listener);
+        FD_SET(fd, &listener);
+        if (pselect(fd + 1, &listener, NULL, NULL, NULL, &previous) <= 0)
+            continue;
+
+        // The client may have given up since, the socket doesn't block.
+        const int client = accept(fd, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        struct connection *connection = calloc(1, sizeof(*connection));
+        pthread_t thread;
+        if (!connection) {
+            close(client);
+            continue;
+        }
+
+        connection->fd = client;
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+            close(client);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    unlink(socket_path);
+    fputs("Server stopped.\n", ERR_STREAM);
+
+    // Buffers of the connections still being served go away with the
+    // process.
+    empty_pool();
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return 0;
+}
+
+/*
+ * Sends a program to the server and prints its reply. The source is only
+ * sent for "-", which is read from stdin. Returns -1 if the connection is
+ * lost, otherwise sets status to the program's.
+ * */
+static int
+request_compilation(int fd,
+                    const char *pathname,
+                    const char *directory,
+                    const struct compile_options *options,
+                    int32_t *status)
+{
+    struct server_request request;
+    memset(&request, 0, sizeof(request));
+    request.magic = SERVER_MAGIC;
+    if (options->keep_unoptimized)
+        request.flags |= SERVER_FLAG_KEEP_UNOPTIMIZED;
+    if (options->emit_object)
+        request.flags |= SERVER_FLAG_EMIT_OBJECT;
+    if (options->assemble_and_link)
+        request.flags |= SERVER_FLAG_ASSEMBLE_AND_LINK;
+
+    struct file source;
+    memset(&source, 0, sizeof(source));
+    if (strcmp(pathname, "-") == 0) {
+        if (read_file_from_stdin(&source) < 0) {
+            fputs("Failed to read stdin\n", ERR_STREAM);
+            *status = -1;
+            return 0;
+        }
+
+        request.flags |= SERVER_FLAG_INLINE_SOURCE;
+        pathname = "stdin";
+    }
+
+    request.pathname_size = (uint32_t)strlen(pathname);
+    request.directory_size = (uint32_t)strlen(directory);
+    request.source_size = source.size;
+
+    const int err = write_all(fd, &request, sizeof(request)) < 0 ||
+                    write_all(fd, pathname, request.pathname_size) < 0 ||
+                    write_all(fd, directory, request.directory_size) < 0 ||
+                    write_all(fd, source.buffer, source.size) < 0;
+    if (request.flags & SERVER_FLAG_INLINE_SOURCE)
+        destroy_file(&source);
+    if (err)
+        return -1;
+
+    struct server_reply reply;
+    if (read_all(fd, &reply, sizeof(reply)) < 0)
+        return -1;
+
+    const uint64_t size = (uint64_t)reply.diagnostics_size + reply.outputs_size;
+    char *buffer = malloc(size ? size : 1);
+    if (!buffer || read_all(fd, buffer, size) < 0) {
+        free(buffer);
+        return -1;
+    }
+
+    fwrite(buffer, 1, reply.diagnostics_size, ERR_STREAM);
+    fwrite(buffer + reply.diagnostics_size, 1, reply.outputs_size, stdout);
+    free(buffer);
+
+    *status = reply.status;
+    return 0;
+}
+
+int
+server_compile(const char *socket_path,
+               const char *const *pathnames,
+               uint32_t count,
+               const struct compile_options *options)
+{
+    assert(!options->run && "Programs can't be run by the server.");
+
+    char directory[PATH_MAX];
+    if (!getcwd(directory, sizeof(directory))) {
+        fputs("Failed to get the working directory.\n", ERR_STREAM);
+        return -1;
+    }
+
+    struct sockaddr_un address;
+    const int fd = connect_to(socket_path, &address);
+    if (fd < 0) {
+        fprintf(ERR_STREAM,
+                "Failed to connect to %s: %s\n",
+                socket_path,
+                strerror(errno));
+        return -1;
+    }
+
+    int failed = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        // Like in a batch, the diagnostics of many files need their names.
+        if (count > 1)
+            fprintf(ERR_STREAM, "%s:\n", pathnames[i]);
+
+        int32_t status;
+        const int err =
+            request_compilation(fd, pathnames[i], directory, options, &status);
+        if (err < 0) {
+            fputs("Lost the connection to the server.\n", ERR_STREAM);
+            failed = -1;
+            break;
+        }
+        failed += status != 0;
+    }
+
+    close(fd);
+    return failed;
+}
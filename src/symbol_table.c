@@ -6,7 +6,6 @@
 #include "token.h"
 #include "utils.h"
 
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -58,22 +57,34 @@ symbol_section_to_str(enum symbol_section ss)
             return "BSS";
         case SYMBOL_SECTION_RODATA:
             return "RODATA";
+        case SYMBOL_SECTION_TEMPORARY:
+            return "TEMPORARY";
+        case SYMBOL_SECTION_CONSTANT:
+            return "CONSTANT";
         default:
             UNREACHABLE();
     }
 }
 
+_Static_assert(sizeof(struct symbol) <= 64,
+               "struct symbol should fit in a cache line.");
+_Static_assert(MAX_LEXEME_SIZE < SYMBOL_NAME_BLOCK_SIZE,
+               "Every lexeme must fit in a name block.");
+
 static void
-symbol_init(struct symbol *s, const char *lexeme, enum token token)
+symbol_init(struct symbol *s,
+            const char *lexeme,
+            uint32_t lexeme_size,
+            enum token token)
 {
     memset(s, 0, sizeof(*s));
 
-    strncpy(s->lexeme, lexeme, MAX_LEXEME_SIZE);
+    s->lexeme = lexeme;
+    s->lexeme_size = lexeme_size;
     s->token = token;
     s->symbol_class = SYMBOL_CLASS_NONE;
     s->symbol_type = SYMBOL_TYPE_NONE;
     s->symbol_section = SYMBOL_SECTION_NONE;
-    s->next = NULL;
 }
 
 static void
@@ -88,147 +99,255 @@ symbol_print(struct symbol *s, FILE *file)
     fprintf(file, "Lexeme: %s\n", s->lexeme);
 }
 
+uint32_t
+symbol_table_hash(const char *lexeme, uint32_t lexeme_size)
+{
+    uint64_t hash = SYMBOL_HASH_INIT;
+    for (uint32_t i = 0; i < lexeme_size; ++i)
+        hash = symbol_hash_step(hash, lexeme[i]);
+    return symbol_hash_finish(hash);
+}
+
+/*
+ * How far the slot at idx is from where its symbol would ideally be.
+ * */
 static uint32_t
-hash_symbol_lexeme(const char *lexeme)
+probe_distance(const struct symbol_table *table, uint32_t idx)
 {
-    // TODO(Jose): Make a better hashing function.
-    uint32_t sum = 0;
-    while (*lexeme) {
-        sum += tolower(*lexeme);
-        ++lexeme;
+    const uint32_t mask = table->capacity - 1;
+    return (idx - (table->slots[idx].hash & mask)) & mask;
+}
+
+/*
+ * Puts slot into the table, which must have room for it and not contain
+ * its symbol yet. Richer slots (closer to their ideal position) give their
+ * place to poorer ones, which keeps probe sequences short.
+ * */
+static void
+place_slot(struct symbol_table *table, struct symbol_slot slot)
+{
+    const uint32_t mask = table->capacity - 1;
+    uint32_t idx = slot.hash & mask;
+    uint32_t distance = 0;
+
+    while (table->slots[idx].symbol) {
+        const uint32_t other_distance = probe_distance(table, idx);
+        if (other_distance < distance) {
+            const struct symbol_slot tmp = table->slots[idx];
+            table->slots[idx] = slot;
+            slot = tmp;
+            distance = other_distance;
+        }
+
+        idx = (idx + 1) & mask;
+        ++distance;
     }
-    return sum;
+
+    table->slots[idx] = slot;
 }
 
-int
-symbol_table_create(struct symbol_table *table, uint32_t capacity)
+static int
+grow(struct symbol_table *table)
 {
-    table->capacity = capacity;
-    table->symbols = calloc(capacity, sizeof(*table->symbols));
-    if (!table->symbols)
+    struct symbol_slot *old_slots = table->slots;
+    const uint32_t old_capacity = table->capacity;
+
+    table->slots = calloc(old_capacity * 2, sizeof(*table->slots));
+    if (!table->slots) {
+        table->slots = old_slots;
         return -1;
+    }
+    table->capacity = old_capacity * 2;
+
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+        if (old_slots[i].symbol)
+            place_slot(table, old_slots[i]);
+    }
+
+    free(old_slots);
     return 0;
 }
 
-struct symbol *
-symbol_table_search(struct symbol_table *table, const char *lexeme)
+static struct symbol *
+allocate_symbol(struct symbol_table *table)
 {
-    assert(strlen(lexeme) <= MAX_LEXEME_SIZE &&
-           "lexeme bigger than MAX_LEXEME_SIZE");
+    struct symbol_block *block = table->last_block;
+    if (!block || block->count == SYMBOL_BLOCK_SIZE) {
+        block = malloc(sizeof(*block));
+        if (!block)
+            return NULL;
 
-    const uint32_t idx = hash_symbol_lexeme(lexeme) % table->capacity;
+        block->next = NULL;
+        block->count = 0;
+        if (table->last_block)
+            table->last_block->next = block;
+        else
+            table->first_block = block;
+        table->last_block = block;
+    }
 
-    struct symbol *s = &table->symbols[idx];
-    if (s->lexeme[0] == '\0')
-        return NULL;
+    return &block->symbols[block->count++];
+}
 
-    while (s) {
-        if (is_case_insensitive_equal(s->lexeme, lexeme))
-            return s;
-        s = s->next;
+/*
+ * Copies lexeme into the name arena, null terminating it.
+ * */
+static const char *
+intern_name(struct symbol_table *table,
+            const char *lexeme,
+            uint32_t lexeme_size)
+{
+    struct symbol_name_block *block = table->names;
+    if (!block || SYMBOL_NAME_BLOCK_SIZE - block->used < lexeme_size + 1) {
+        block = malloc(sizeof(*block));
+        if (!block)
+            return NULL;
+
+        block->next = table->names;
+        block->used = 0;
+        table->names = block;
     }
 
-    return NULL;
+    char *name = &block->names[block->used];
+    memcpy(name, lexeme, lexeme_size);
+    name[lexeme_size] = '\0';
+    block->used += lexeme_size + 1;
+    return name;
+}
+
+int
+symbol_table_create(struct symbol_table *table, uint32_t capacity)
+{
+    uint32_t rounded = 8;
+    while (rounded < capacity)
+        rounded *= 2;
+
+    table->capacity = rounded;
+    table->count = 0;
+    table->first_block = NULL;
+    table->last_block = NULL;
+    table->names = NULL;
+    table->slots = calloc(rounded, sizeof(*table->slots));
+    if (!table->slots)
+        return -1;
+    return 0;
 }
 
 struct symbol *
-symbol_table_insert(struct symbol_table *table,
-                    const char *lexeme,
-                    enum token token)
+symbol_table_find_or_insert(struct symbol_table *table,
+                            const char *lexeme,
+                            uint32_t lexeme_size,
+                            uint32_t hash,
+                            enum token token,
+                            uint8_t *is_new)
 {
-    assert(strlen(lexeme) <= MAX_LEXEME_SIZE &&
+    assert(lexeme_size <= MAX_LEXEME_SIZE &&
            "lexeme bigger than MAX_LEXEME_SIZE");
 
-    const uint32_t idx = hash_symbol_lexeme(lexeme) % table->capacity;
+    const uint32_t mask = table->capacity - 1;
+    uint32_t idx = hash & mask;
+    uint32_t distance = 0;
+
+    while (1) {
+        const struct symbol_slot *slot = &table->slots[idx];
+        // Had the symbol been inserted, it would have taken this slot.
+        if (!slot->symbol || probe_distance(table, idx) < distance)
+            break;
+
+        if (slot->hash == hash && slot->symbol->lexeme_size == lexeme_size &&
+            is_case_insensitive_equal_n(
+                slot->symbol->lexeme, lexeme, lexeme_size)) {
+            *is_new = 0;
+            return slot->symbol;
+        }
 
-    struct symbol *s = &table->symbols[idx];
-    // Empty entry, great!
-    if (s->lexeme[0] == '\0') {
-        symbol_init(s, lexeme, token);
-        return s;
+        idx = (idx + 1) & mask;
+        ++distance;
     }
 
-    // Collision, go to the end of the symbols while checking if
-    // any of them is already what we are trying to insert, so
-    // that we don't insert any duplicates in the table.
-    if (is_case_insensitive_equal(s->lexeme, lexeme))
-        return NULL;
-
-    struct symbol *previous = s;
-    struct symbol *next = s->next;
-    while (next) {
-        if (is_case_insensitive_equal(next->lexeme, lexeme))
-            return NULL;
-        previous = next;
-        next = next->next;
+    if ((table->count + 1) * 4 > table->capacity * 3) {
+        const int err = grow(table);
+        assert(!err && "failed to grow the symbol table.");
     }
 
-    next = malloc(sizeof(*next));
-    assert(next && "failed to allocate memory for new symbol.");
+    struct symbol *s = allocate_symbol(table);
+    const char *name = intern_name(table, lexeme, lexeme_size);
+    assert(s && name && "failed to allocate memory for new symbol.");
 
-    symbol_init(next, lexeme, token);
+    symbol_init(s, name, lexeme_size, token);
+    place_slot(table, (struct symbol_slot){ .symbol = s, .hash = hash });
+    ++table->count;
 
-    previous->next = next;
-    return next;
+    *is_new = 1;
+    return s;
 }
 
 void
-symbol_table_populate_with_keywords(struct symbol_table *table)
-{
-    int err = 0;
-
-    err += symbol_table_insert(table, "const", TOKEN_CONST) == NULL;
-    err += symbol_table_insert(table, "int", TOKEN_INT) == NULL;
-    err += symbol_table_insert(table, "char", TOKEN_CHAR) == NULL;
-    err += symbol_table_insert(table, "while", TOKEN_WHILE) == NULL;
-    err += symbol_table_insert(table, "if", TOKEN_IF) == NULL;
-    err += symbol_table_insert(table, "float", TOKEN_FLOAT) == NULL;
-    err += symbol_table_insert(table, "else", TOKEN_ELSE) == NULL;
-    err += symbol_table_insert(table, "readln", TOKEN_READLN) == NULL;
-    err += symbol_table_insert(table, "div", TOKEN_DIV) == NULL;
-    err += symbol_table_insert(table, "string", TOKEN_STRING) == NULL;
-    err += symbol_table_insert(table, "write", TOKEN_WRITE) == NULL;
-    err += symbol_table_insert(table, "writeln", TOKEN_WRITELN) == NULL;
-    err += symbol_table_insert(table, "mod", TOKEN_MOD) == NULL;
-    err += symbol_table_insert(table, "boolean", TOKEN_BOOLEAN) == NULL;
-    err += symbol_table_insert(table, "true", TOKEN_CONSTANT) == NULL;
-    err += symbol_table_insert(table, "false", TOKEN_CONSTANT) == NULL;
-
-    assert(!err && "symbol_table_insert failed.");
+symbol_table_clear(struct symbol_table *table)
+{
+    struct symbol_block *block = table->first_block;
+    if (block) {
+        block = block->next;
+        table->first_block->next = NULL;
+        table->first_block->count = 0;
+        table->last_block = table->first_block;
+    }
+    while (block) {
+        struct symbol_block *tmp = block->next;
+        free(block);
+        block = tmp;
+    }
+
+    // The newest name block is the first one.
+    struct symbol_name_block *names = table->names;
+    if (names) {
+        names = names->next;
+        table->names->next = NULL;
+        table->names->used = 0;
+    }
+    while (names) {
+        struct symbol_name_block *tmp = names->next;
+        free(names);
+        names = tmp;
+    }
+
+    memset(table->slots, 0, table->capacity * sizeof(*table->slots));
+    table->count = 0;
 }
 
 void
 symbol_table_destroy(struct symbol_table *table)
 {
-    for (uint32_t i = 0; i < table->capacity; ++i) {
-        struct symbol *s = &table->symbols[i];
-        if (s->lexeme[0] == '\0')
-            continue;
+    struct symbol_block *block = table->first_block;
+    while (block) {
+        struct symbol_block *tmp = block->next;
+        free(block);
+        block = tmp;
+    }
 
-        s = s->next;
-        while (s) {
-            struct symbol *tmp = s->next;
-            free(s);
-            s = tmp;
-        }
+    struct symbol_name_block *names = table->names;
+    while (names) {
+        struct symbol_name_block *tmp = names->next;
+        free(names);
+        names = tmp;
     }
 
-    free(table->symbols);
-    table->symbols = NULL;
+    free(table->slots);
+    table->slots = NULL;
     table->capacity = 0;
+    table->count = 0;
+    table->first_block = NULL;
+    table->last_block = NULL;
+    table->names = NULL;
 }
 
 void
 symbol_table_dump_to(struct symbol_table *table, FILE *file)
 {
-    for (uint32_t i = 0; i != table->capacity; ++i) {
-        struct symbol *s = &table->symbols[i];
-
-        if (s->lexeme[0] != '\0' && s->token == TOKEN_IDENTIFIER)
-            symbol_print(s, file);
-
-        while (s->next) {
-            s = s->next;
+    for (struct symbol_block *block = table->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i != block->count; ++i) {
+            struct symbol *s = &block->symbols[i];
             if (s->token == TOKEN_IDENTIFIER)
                 symbol_print(s, file);
         }
@@ -4,6 +4,7 @@
 #include "utils.h"
 
 #include <ctype.h>
+#include <pthread.h>
 
 uint8_t
 is_case_insensitive_equal(const char *lhs, const char *rhs)
@@ -18,3 +19,39 @@ is_case_insensitive_equal(const char *lhs, const char *rhs)
 
     return *lhs == '\0' && *rhs == '\0';
 }
+
+uint8_t
+is_case_insensitive_equal_n(const char *lhs, const char *rhs, uint32_t rhs_size)
+{
+    for (uint32_t i = 0; i < rhs_size; ++i) {
+        if (lhs[i] == '\0')
+            return 0;
+        if (tolower((unsigned char)lhs[i]) != tolower((unsigned char)rhs[i]))
+            return 0;
+    }
+
+    return lhs[rhs_size] == '\0';
+}
+
+void
+run_on_threads(void *args, uint32_t count, size_t size, void *(*fn)(void *))
+{
+    assert(count <= MAX_THREADS);
+
+    pthread_t threads[MAX_THREADS];
+    uint8_t started[MAX_THREADS];
+    char *arg = args;
+
+    for (uint32_t i = 1; i < count; ++i)
+        started[i] =
+            pthread_create(&threads[i], NULL, fn, arg + i * size) == 0;
+
+    fn(arg);
+
+    for (uint32_t i = 1; i < count; ++i) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            fn(arg + i * size);
+    }
+}
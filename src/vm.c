@@ -0,0 +1,1150 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "vm.h"
+
+#include "utils.h"
+#include "x86_64.h"
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Address of the beginning of the memory, so that 0 is never valid. */
+#define VM_BASE 0x1000U
+#define VM_STACK_SIZE (1024U * 1024U)
+
+/* General purpose registers are numbered like enum ir_register, then come
+ * the ones only the translation uses. */
+#define VM_SCRATCH 16U
+#define VM_SCRATCH_DESTINATION 17U
+/* Always zero, the base of absolute memory operands. */
+#define VM_ZERO 18U
+#define VM_REGISTER_COUNT 32U
+/* Same for xmm registers. */
+#define VM_XMM_SCRATCH 16U
+#define VM_XMM_REGISTER_COUNT 17U
+
+/* Memory operands are a register byte followed by a 32 bit displacement.
+ * This bit of the register byte truncates the address to 32 bits. */
+#define VM_ADDRESS_32 0x80U
+#define VM_MEMORY_OPERAND_SIZE 5U
+
+/* Results of the last comparison, like the flags register. */
+#define VM_FLAG_E 1U
+#define VM_FLAG_L 2U
+#define VM_FLAG_B 4U
+
+#define VM_OPCODE_SIZED(X, NAME)                                               \
+    X(NAME##_8) X(NAME##_16) X(NAME##_32) X(NAME##_64)
+
+/*
+ * Every opcode of the bytecode. Opcodes for the sizes of an instruction are
+ * consecutive, from 8 to 64 bits. The operands follow the opcode:
+ *  r: register, 1 byte.
+ *  m: memory, VM_MEMORY_OPERAND_SIZE bytes.
+ *  iN: immediate of N bytes, sign extended if it's smaller than the size.
+ *  l: target of a jump, 4 bytes offset in the code.
+ * */
+#define VM_OPCODES(X)                                                          \
+    /* r, i1/i2/i4/i8 */                                                       \
+    VM_OPCODE_SIZED(X, MOVI)                                                   \
+    /* r, r */                                                                 \
+    VM_OPCODE_SIZED(X, MOV)                                                    \
+    /* r, m */                                                                 \
+    VM_OPCODE_SIZED(X, LOAD)                                                   \
+    /* m, r */                                                                 \
+    VM_OPCODE_SIZED(X, STORE)                                                  \
+    /* m, i1/i2/i4/i4 */                                                       \
+    VM_OPCODE_SIZED(X, STOREI)                                                 \
+    /* r, r or r, i4 */                                                        \
+    VM_OPCODE_SIZED(X, ADD_RR)                                                 \
+    VM_OPCODE_SIZED(X, ADD_RI)                                                 \
+    VM_OPCODE_SIZED(X, SUB_RR)                                                 \
+    VM_OPCODE_SIZED(X, SUB_RI)                                                 \
+    VM_OPCODE_SIZED(X, CMP_RR)                                                 \
+    VM_OPCODE_SIZED(X, CMP_RI)                                                 \
+    /* r */                                                                    \
+    VM_OPCODE_SIZED(X, NEG)                                                    \
+    X(IMUL_32) X(IMUL_64) X(IDIV_32) X(IDIV_64)                                \
+    X(PUSH_16) X(PUSH_64) X(POP_16) X(POP_64)                                  \
+    /* No operands. */                                                         \
+    X(CDQ) X(CDQE) X(SYSCALL)                                                  \
+    /* xmm, xmm */                                                             \
+    X(MOVSS) X(ADDSS) X(SUBSS) X(MULSS) X(DIVSS) X(XORPS) X(COMISS)            \
+    /* xmm, m and m, xmm */                                                    \
+    X(MOVSS_LOAD) X(MOVSS_STORE)                                               \
+    /* xmm, r and r, xmm */                                                    \
+    X(CVTSI2SS_32) X(CVTSI2SS_64) X(CVTSS2SI_32) X(CVTSS2SI_64)                \
+    /* xmm, xmm, i1 */                                                         \
+    X(ROUNDSS)                                                                 \
+    /* l */                                                                    \
+    X(JMP)                                                                     \
+    /* Mask of the flags it jumps with (1 byte), l */                          \
+    X(JCC)                                                                     \
+    /* r, mask of the flags it sets the byte with (1 byte) */                  \
+    X(SETCC)
+
+#define VM_OPCODE_ENUM(NAME) VM_OPCODE_##NAME,
+
+enum vm_opcode
+{
+    VM_OPCODES(VM_OPCODE_ENUM)
+};
+
+/*
+ * Translation state.
+ * */
+struct translation
+{
+    struct vm_program *program;
+    /* Address of the beginning of each section. */
+    uint64_t addresses[X86_64_SECTION_COUNT];
+    /* Offset in the code of every label. */
+    uint32_t *labels;
+    /* Offsets of the jump targets, that hold label numbers until the end
+     * of the translation. */
+    uint64_t *jumps;
+    uint64_t jump_count;
+    uint64_t jump_capacity;
+};
+
+static void
+emit_bytes(struct vm_program *program, const void *bytes, uint64_t size)
+{
+    if (program->code_capacity - program->code_size < size) {
+        uint64_t capacity =
+            program->code_capacity ? program->code_capacity * 2 : 4096;
+        while (capacity - program->code_size < size)
+            capacity *= 2;
+
+        uint8_t *code = realloc(program->code, capacity);
+        if (!code) {
+            program->failed = 1;
+            return;
+        }
+
+        program->code = code;
+        program->code_capacity = capacity;
+    }
+
+    memcpy(program->code + program->code_size, bytes, size);
+    program->code_size += size;
+}
+
+static void
+emit_byte(struct vm_program *program, uint8_t byte)
+{
+    emit_bytes(program, &byte, 1);
+}
+
+/*
+ * Little endian, size bytes of value.
+ * */
+static void
+emit_value(struct vm_program *program, uint64_t value, uint8_t size)
+{
+    uint8_t bytes[8];
+    for (uint8_t i = 0; i < size; ++i)
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    emit_bytes(program, bytes, size);
+}
+
+/*
+ * Opcode of the size among the consecutive sized opcodes from first.
+ * */
+static uint8_t
+sized_opcode(enum vm_opcode first, uint8_t size)
+{
+    switch (size) {
+        case 1:
+            return first;
+        case 2:
+            return first + 1;
+        case 4:
+            return first + 2;
+        case 8:
+            return first + 3;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static uint8_t
+gpr(const struct ir_operand *operand)
+{
+    assert(operand->kind == IR_OPERAND_REGISTER &&
+           operand->reg < IR_REGISTER_XMM0);
+    return operand->reg;
+}
+
+static uint8_t
+xmm(const struct ir_operand *operand)
+{
+    assert(operand->kind == IR_OPERAND_REGISTER &&
+           operand->reg >= IR_REGISTER_XMM0);
+    return operand->reg - IR_REGISTER_XMM0;
+}
+
+static uint64_t
+base_address(const struct translation *translation, enum ir_base base)
+{
+    return translation->addresses[x86_64_base_section(base)] +
+           x86_64_base_offset(base);
+}
+
+/*
+ * Value of immediates and addresses used as immediates.
+ * */
+static int64_t
+immediate_value(const struct translation *translation,
+                const struct ir_operand *operand)
+{
+    if (operand->kind == IR_OPERAND_ADDRESS)
+        return (int64_t)base_address(translation, operand->base) +
+               operand->value;
+
+    assert(operand->kind == IR_OPERAND_IMMEDIATE);
+    return operand->value;
+}
+
+static void
+emit_memory(struct translation *translation, const struct ir_operand *operand)
+{
+    assert(operand->kind == IR_OPERAND_MEMORY);
+
+    if (operand->base == IR_BASE_REGISTER) {
+        emit_byte(translation->program,
+                  operand->reg | (operand->reg_size == 4 ? VM_ADDRESS_32 : 0));
+        emit_value(translation->program, 0, 4);
+    } else {
+        emit_byte(translation->program, VM_ZERO);
+        emit_value(translation->program,
+                   base_address(translation, operand->base) +
+                       (uint64_t)operand->value,
+                   4);
+    }
+}
+
+static void
+emit_load(struct translation *translation,
+          uint8_t reg,
+          const struct ir_operand *memory)
+{
+    emit_byte(translation->program,
+              sized_opcode(VM_OPCODE_LOAD_8, memory->size));
+    emit_byte(translation->program, reg);
+    emit_memory(translation, memory);
+}
+
+static void
+emit_store(struct translation *translation,
+           const struct ir_operand *memory,
+           uint8_t reg)
+{
+    emit_byte(translation->program,
+              sized_opcode(VM_OPCODE_STORE_8, memory->size));
+    emit_memory(translation, memory);
+    emit_byte(translation->program, reg);
+}
+
+/*
+ * Register holding the value of a register or memory operand, memory is
+ * loaded into reg.
+ * */
+static uint8_t
+gpr_or_load(struct translation *translation,
+            const struct ir_operand *operand,
+            uint8_t reg)
+{
+    if (operand->kind == IR_OPERAND_REGISTER)
+        return gpr(operand);
+
+    emit_load(translation, reg, operand);
+    return reg;
+}
+
+static uint8_t
+xmm_or_load(struct translation *translation, const struct ir_operand *operand)
+{
+    if (operand->kind == IR_OPERAND_REGISTER)
+        return xmm(operand);
+
+    emit_byte(translation->program, VM_OPCODE_MOVSS_LOAD);
+    emit_byte(translation->program, VM_XMM_SCRATCH);
+    emit_memory(translation, operand);
+    return VM_XMM_SCRATCH;
+}
+
+static void
+translate_mov(struct translation *translation,
+              const struct ir_operand *dst,
+              const struct ir_operand *src)
+{
+    struct vm_program *program = translation->program;
+
+    if (dst->kind == IR_OPERAND_REGISTER) {
+        if (src->kind == IR_OPERAND_REGISTER) {
+            emit_byte(program, sized_opcode(VM_OPCODE_MOV_8, dst->size));
+            emit_byte(program, gpr(dst));
+            emit_byte(program, gpr(src));
+        } else if (src->kind == IR_OPERAND_MEMORY) {
+            emit_load(translation, gpr(dst), src);
+        } else {
+            const int64_t value = immediate_value(translation, src);
+            // Writing 32 bits zeroes the rest of the register, like for
+            // x86-64.
+            uint8_t size = dst->size;
+            if (size == 8 && value >= 0 && value <= UINT32_MAX)
+                size = 4;
+
+            emit_byte(program, sized_opcode(VM_OPCODE_MOVI_8, size));
+            emit_byte(program, gpr(dst));
+            emit_value(program, (uint64_t)value, size);
+        }
+    } else if (src->kind == IR_OPERAND_REGISTER) {
+        emit_store(translation, dst, gpr(src));
+    } else {
+        emit_byte(program, sized_opcode(VM_OPCODE_STOREI_8, dst->size));
+        emit_memory(translation, dst);
+        emit_value(program,
+                   (uint64_t)immediate_value(translation, src),
+                   dst->size == 8 ? 4 : dst->size);
+    }
+}
+
+/*
+ * add, sub and cmp. rr is the opcode for 8 bit registers, the one for
+ * immediates comes after the sizes of rr.
+ * */
+static void
+translate_arithmetic(struct translation *translation,
+                     enum vm_opcode rr,
+                     uint8_t writes_back,
+                     const struct ir_operand *dst,
+                     const struct ir_operand *src)
+{
+    struct vm_program *program = translation->program;
+    const uint8_t size = dst->size;
+
+    const uint8_t reg = gpr_or_load(translation, dst, VM_SCRATCH_DESTINATION);
+    if (src->kind == IR_OPERAND_IMMEDIATE || src->kind == IR_OPERAND_ADDRESS) {
+        emit_byte(program, sized_opcode(rr + 4, size));
+        emit_byte(program, reg);
+        emit_value(program, (uint64_t)immediate_value(translation, src), 4);
+    } else {
+        const uint8_t src_reg = gpr_or_load(translation, src, VM_SCRATCH);
+        emit_byte(program, sized_opcode(rr, size));
+        emit_byte(program, reg);
+        emit_byte(program, src_reg);
+    }
+
+    if (writes_back && dst->kind == IR_OPERAND_MEMORY)
+        emit_store(translation, dst, reg);
+}
+
+/*
+ * imul and idiv, which work on rdx:rax.
+ * */
+static void
+translate_multiplication(struct translation *translation,
+                         enum vm_opcode opcode_32,
+                         const struct ir_operand *operand)
+{
+    assert((operand->size == 4 || operand->size == 8) &&
+           "Only 32 and 64 bit multiplications are generated.");
+
+    const uint8_t reg = gpr_or_load(translation, operand, VM_SCRATCH);
+    emit_byte(translation->program, opcode_32 + (operand->size == 8));
+    emit_byte(translation->program, reg);
+}
+
+static void
+translate_sse(struct translation *translation,
+              enum vm_opcode opcode,
+              const struct ir_operand *dst,
+              const struct ir_operand *src)
+{
+    const uint8_t src_reg = xmm_or_load(translation, src);
+    emit_byte(translation->program, opcode);
+    emit_byte(translation->program, xmm(dst));
+    emit_byte(translation->program, src_reg);
+}
+
+static void
+emit_jump(struct translation *translation, uint32_t label)
+{
+    struct vm_program *program = translation->program;
+
+    if (translation->jump_count == translation->jump_capacity) {
+        const uint64_t capacity =
+            translation->jump_capacity ? translation->jump_capacity * 2 : 256;
+        uint64_t *jumps =
+            realloc(translation->jumps, capacity * sizeof(*jumps));
+        if (!jumps) {
+            program->failed = 1;
+            return;
+        }
+
+        translation->jumps = jumps;
+        translation->jump_capacity = capacity;
+    }
+
+    translation->jumps[translation->jump_count++] = program->code_size;
+    emit_value(program, label, 4);
+}
+
+/*
+ * Mask with a bit set for each combination of flags the condition holds
+ * for.
+ * */
+static uint8_t
+condition_mask(enum ir_condition condition)
+{
+    uint8_t mask = 0;
+    for (uint8_t flags = 0; flags < 8; ++flags) {
+        const uint8_t e = (flags & VM_FLAG_E) != 0;
+        const uint8_t l = (flags & VM_FLAG_L) != 0;
+        const uint8_t b = (flags & VM_FLAG_B) != 0;
+
+        uint8_t holds;
+        switch (condition) {
+            case IR_CONDITION_E:
+                holds = e;
+                break;
+            case IR_CONDITION_NE:
+                holds = !e;
+                break;
+            case IR_CONDITION_L:
+                holds = l;
+                break;
+            case IR_CONDITION_LE:
+                holds = l || e;
+                break;
+            case IR_CONDITION_G:
+                holds = !l && !e;
+                break;
+            case IR_CONDITION_GE:
+                holds = !l;
+                break;
+            case IR_CONDITION_B:
+                holds = b;
+                break;
+            case IR_CONDITION_BE:
+                holds = b || e;
+                break;
+            case IR_CONDITION_A:
+                holds = !b && !e;
+                break;
+            case IR_CONDITION_AE:
+                holds = !b;
+                break;
+            default:
+                UNREACHABLE();
+        }
+
+        mask |= holds << flags;
+    }
+
+    return mask;
+}
+
+static void
+translate_instruction(struct translation *translation,
+                      const struct ir_instruction *instruction)
+{
+    struct vm_program *program = translation->program;
+    const struct ir_operand *first = &instruction->operands[0];
+    const struct ir_operand *second = &instruction->operands[1];
+
+    switch (instruction->opcode) {
+        case IR_OPCODE_SECTION:
+        case IR_OPCODE_COMMENT:
+        case IR_OPCODE_RESERVE:
+        case IR_OPCODE_DATA:
+        case IR_OPCODE_DELETED:
+            break;
+        case IR_OPCODE_LABEL:
+            translation->labels[first->value] = (uint32_t)program->code_size;
+            break;
+        case IR_OPCODE_MOV:
+            translate_mov(translation, first, second);
+            break;
+        case IR_OPCODE_MOVSS:
+            if (first->kind == IR_OPERAND_MEMORY) {
+                emit_byte(program, VM_OPCODE_MOVSS_STORE);
+                emit_memory(translation, first);
+                emit_byte(program, xmm(second));
+            } else {
+                translate_sse(translation, VM_OPCODE_MOVSS, first, second);
+            }
+            break;
+        case IR_OPCODE_ADD:
+            translate_arithmetic(
+                translation, VM_OPCODE_ADD_RR_8, 1, first, second);
+            break;
+        case IR_OPCODE_SUB:
+            translate_arithmetic(
+                translation, VM_OPCODE_SUB_RR_8, 1, first, second);
+            break;
+        case IR_OPCODE_CMP:
+            translate_arithmetic(
+                translation, VM_OPCODE_CMP_RR_8, 0, first, second);
+            break;
+        case IR_OPCODE_NEG: {
+            const uint8_t reg =
+                gpr_or_load(translation, first, VM_SCRATCH_DESTINATION);
+            emit_byte(program, sized_opcode(VM_OPCODE_NEG_8, first->size));
+            emit_byte(program, reg);
+            if (first->kind == IR_OPERAND_MEMORY)
+                emit_store(translation, first, reg);
+            break;
+        }
+        case IR_OPCODE_IMUL:
+            translate_multiplication(translation, VM_OPCODE_IMUL_32, first);
+            break;
+        case IR_OPCODE_IDIV:
+            translate_multiplication(translation, VM_OPCODE_IDIV_32, first);
+            break;
+        case IR_OPCODE_COMISS:
+            translate_sse(translation, VM_OPCODE_COMISS, first, second);
+            break;
+        case IR_OPCODE_ADDSS:
+            translate_sse(translation, VM_OPCODE_ADDSS, first, second);
+            break;
+        case IR_OPCODE_SUBSS:
+            translate_sse(translation, VM_OPCODE_SUBSS, first, second);
+            break;
+        case IR_OPCODE_MULSS:
+            translate_sse(translation, VM_OPCODE_MULSS, first, second);
+            break;
+        case IR_OPCODE_XORPS:
+            translate_sse(translation, VM_OPCODE_XORPS, first, second);
+            break;
+        case IR_OPCODE_DIVSS:
+            translate_sse(translation, VM_OPCODE_DIVSS, first, second);
+            break;
+        case IR_OPCODE_CVTSI2SS: {
+            const uint8_t reg = gpr_or_load(translation, second, VM_SCRATCH);
+            emit_byte(program,
+                      second->size == 8 ? VM_OPCODE_CVTSI2SS_64
+                                        : VM_OPCODE_CVTSI2SS_32);
+            emit_byte(program, xmm(first));
+            emit_byte(program, reg);
+            break;
+        }
+        case IR_OPCODE_CVTSS2SI: {
+            const uint8_t reg = xmm_or_load(translation, second);
+            emit_byte(program,
+                      first->size == 8 ? VM_OPCODE_CVTSS2SI_64
+                                       : VM_OPCODE_CVTSS2SI_32);
+            emit_byte(program, gpr(first));
+            emit_byte(program, reg);
+            break;
+        }
+        case IR_OPCODE_ROUNDSS:
+            translate_sse(translation, VM_OPCODE_ROUNDSS, first, second);
+            emit_byte(program, (uint8_t)instruction->operands[2].value);
+            break;
+        case IR_OPCODE_CDQ:
+            emit_byte(program, VM_OPCODE_CDQ);
+            break;
+        case IR_OPCODE_CDQE:
+            emit_byte(program, VM_OPCODE_CDQE);
+            break;
+        case IR_OPCODE_PUSH:
+        case IR_OPCODE_POP: {
+            assert((first->size == 2 || first->size == 8) &&
+                   "Only 16 and 64 bit registers can be pushed.");
+            const enum vm_opcode opcode = instruction->opcode == IR_OPCODE_PUSH
+                                              ? VM_OPCODE_PUSH_16
+                                              : VM_OPCODE_POP_16;
+            emit_byte(program, opcode + (first->size == 8));
+            emit_byte(program, gpr(first));
+            break;
+        }
+        case IR_OPCODE_JMP:
+            emit_byte(program, VM_OPCODE_JMP);
+            emit_jump(translation, (uint32_t)first->value);
+            break;
+        case IR_OPCODE_JCC:
+            emit_byte(program, VM_OPCODE_JCC);
+            emit_byte(program, condition_mask(instruction->condition));
+            emit_jump(translation, (uint32_t)first->value);
+            break;
+        case IR_OPCODE_SETCC: {
+            const uint8_t reg =
+                gpr_or_load(translation, first, VM_SCRATCH_DESTINATION);
+            emit_byte(program, VM_OPCODE_SETCC);
+            emit_byte(program, reg);
+            emit_byte(program, condition_mask(instruction->condition));
+            if (first->kind == IR_OPERAND_MEMORY)
+                emit_store(translation, first, reg);
+            break;
+        }
+        case IR_OPCODE_SYSCALL:
+            emit_byte(program, VM_OPCODE_SYSCALL);
+            break;
+        default:
+            UNREACHABLE();
+    }
+}
+
+/*
+ * Lays out the memory of the program: .rodata, .data, .bss and the stack,
+ * one after the other.
+ * */
+static int
+load_memory(const struct ir *ir, struct translation *translation)
+{
+    struct vm_program *program = translation->program;
+
+    struct x86_64_object object;
+    if (x86_64_assemble_data(ir, &object) < 0)
+        return -1;
+
+    uint64_t offsets[X86_64_SECTION_COUNT];
+    offsets[X86_64_SECTION_TEXT] = 0;
+    offsets[X86_64_SECTION_RODATA] = 0;
+    offsets[X86_64_SECTION_DATA] =
+        align_up(object.sections[X86_64_SECTION_RODATA].size,
+                 object.alignments[X86_64_SECTION_DATA]);
+    offsets[X86_64_SECTION_BSS] =
+        align_up(offsets[X86_64_SECTION_DATA] +
+                     object.sections[X86_64_SECTION_DATA].size,
+                 object.alignments[X86_64_SECTION_BSS]);
+
+    const uint64_t stack_offset =
+        align_up(offsets[X86_64_SECTION_BSS] + object.bss_size, 16);
+    program->memory_size = stack_offset + VM_STACK_SIZE;
+    program->stack_top = VM_BASE + program->memory_size;
+
+    // Zeroed, which takes care of .bss.
+    program->memory = calloc(1, program->memory_size);
+    if (!program->memory) {
+        x86_64_object_destroy(&object);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < X86_64_SECTION_COUNT; ++i) {
+        translation->addresses[i] = VM_BASE + offsets[i];
+        if (i != X86_64_SECTION_TEXT && i != X86_64_SECTION_BSS &&
+            object.sections[i].size) {
+            memcpy(program->memory + offsets[i],
+                   object.sections[i].bytes,
+                   object.sections[i].size);
+        }
+    }
+
+    x86_64_object_destroy(&object);
+    return 0;
+}
+
+int
+vm_compile(const struct ir *ir, struct vm_program *program)
+{
+    memset(program, 0, sizeof(*program));
+
+    struct translation translation;
+    memset(&translation, 0, sizeof(translation));
+    translation.program = program;
+
+    translation.labels =
+        malloc((ir->label_count ? ir->label_count : 1) * sizeof(uint32_t));
+    if (!translation.labels || load_memory(ir, &translation) < 0) {
+        free(translation.labels);
+        return -1;
+    }
+
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i)
+            translate_instruction(&translation, &block->instructions[i]);
+    }
+
+    // Now every label has its offset.
+    if (!program->failed) {
+        for (uint64_t i = 0; i < translation.jump_count; ++i) {
+            uint8_t *target = program->code + translation.jumps[i];
+
+            uint32_t label;
+            memcpy(&label, target, sizeof(label));
+            memcpy(target, &translation.labels[label], sizeof(uint32_t));
+        }
+    }
+
+    free(translation.labels);
+    free(translation.jumps);
+
+    if (program->failed) {
+        vm_program_destroy(program);
+        return -1;
+    }
+    return 0;
+}
+
+static _Noreturn void
+fault(int signal)
+{
+    raise(signal);
+    // In case the signal is handled or ignored.
+    abort();
+}
+
+/*
+ * Pointer to size bytes of the program's memory at address, faults if they
+ * aren't all in the program's memory.
+ * */
+static inline uint8_t *
+pointer(const struct vm_program *program, uint64_t address, uint64_t size)
+{
+    const uint64_t offset = address - VM_BASE;
+    if (offset > program->memory_size || size > program->memory_size - offset)
+        fault(SIGSEGV);
+
+    return program->memory + offset;
+}
+
+static inline uint32_t
+read_u32(const uint8_t *code)
+{
+    uint32_t value;
+    memcpy(&value, code, sizeof(value));
+    return value;
+}
+
+/*
+ * Reads an immediate of size bytes, sign extended.
+ * */
+static inline int64_t
+read_immediate(const uint8_t *code, uint8_t size)
+{
+    switch (size) {
+        case 1:
+            return (int8_t)code[0];
+        case 2: {
+            int16_t value;
+            memcpy(&value, code, sizeof(value));
+            return value;
+        }
+        case 4: {
+            int32_t value;
+            memcpy(&value, code, sizeof(value));
+            return value;
+        }
+        default: {
+            int64_t value;
+            memcpy(&value, code, sizeof(value));
+            return value;
+        }
+    }
+}
+
+/*
+ * Conversion of a float to an integer like cvtss2si, rounding to nearest
+ * even and giving the smallest integer if it doesn't fit.
+ * */
+static inline int64_t
+float_to_integer(float value, int64_t min)
+{
+    // The range is [min, -min), NaN is out of it too.
+    const float rounded = nearbyintf(value);
+    if (!(rounded >= (float)min && rounded < -(float)min))
+        return min;
+    return (int64_t)rounded;
+}
+
+static inline float
+round_float(float value, uint8_t mode)
+{
+    // Bit 2 selects the current rounding mode, which is to nearest even.
+    if (mode & 4)
+        return nearbyintf(value);
+
+    switch (mode & 3) {
+        case 0:
+            return nearbyintf(value);
+        case 1:
+            return floorf(value);
+        case 2:
+            return ceilf(value);
+        default:
+            return truncf(value);
+    }
+}
+
+/*
+ * Makes the system calls the generated code uses, arguments in registers
+ * like for Linux. Returns -1 if the program didn't exit, otherwise its exit
+ * code.
+ * */
+static int
+system_call(const struct vm_program *program, uint64_t *registers)
+{
+    const uint64_t number = registers[IR_REGISTER_A];
+    const uint64_t count = registers[IR_REGISTER_D];
+
+    ssize_t result;
+    switch (number) {
+        case 0:
+            result = read((int)registers[IR_REGISTER_DI],
+                          pointer(program, registers[IR_REGISTER_SI], count),
+                          count);
+            break;
+        case 1:
+            result = write((int)registers[IR_REGISTER_DI],
+                           pointer(program, registers[IR_REGISTER_SI], count),
+                           count);
+            break;
+        case 60:
+            return (int)(registers[IR_REGISTER_DI] & 0xFF);
+        default:
+            result = -1;
+            errno = ENOSYS;
+            break;
+    }
+
+    // Like the kernel returns them.
+    registers[IR_REGISTER_A] = result < 0 ? (uint64_t)-errno : (uint64_t)result;
+    return -1;
+}
+
+#define WRITE_8(reg, value)                                                    \
+    registers[reg] = (registers[reg] & ~UINT64_C(0xFF)) | (uint8_t)(value)
+#define WRITE_16(reg, value)                                                   \
+    registers[reg] = (registers[reg] & ~UINT64_C(0xFFFF)) | (uint16_t)(value)
+// Writing 32 bits zeroes the rest of the register.
+#define WRITE_32(reg, value) registers[reg] = (uint32_t)(value)
+#define WRITE_64(reg, value) registers[reg] = (uint64_t)(value)
+
+#define MEMORY_ADDRESS(code)                                                   \
+    ((registers[(code)[0] & ~VM_ADDRESS_32] &                                  \
+      address_masks[(code)[0] >> 7]) +                                         \
+     read_u32((code) + 1))
+
+#define COMPARE(lhs, rhs, N)                                                   \
+    flags = ((uint##N##_t)(lhs) == (uint##N##_t)(rhs) ? VM_FLAG_E : 0) |       \
+            ((int##N##_t)(lhs) < (int##N##_t)(rhs) ? VM_FLAG_L : 0) |          \
+            ((uint##N##_t)(lhs) < (uint##N##_t)(rhs) ? VM_FLAG_B : 0)
+
+#define DISPATCH() goto *handlers[*code++]
+
+/*
+ * Handlers of the instructions that exist for every size.
+ * */
+#define SIZED_HANDLERS(N)                                                      \
+    op_MOVI_##N : {                                                            \
+        WRITE_##N(code[0], read_immediate(code + 1, N / 8));                   \
+        code += 1 + N / 8;                                                     \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_MOV_##N : {                                                             \
+        WRITE_##N(code[0], registers[code[1]]);                                \
+        code += 2;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_LOAD_##N : {                                                            \
+        uint##N##_t value;                                                     \
+        memcpy(&value,                                                         \
+               pointer(program, MEMORY_ADDRESS(code + 1), sizeof(value)),      \
+               sizeof(value));                                                 \
+        WRITE_##N(code[0], value);                                             \
+        code += 1 + VM_MEMORY_OPERAND_SIZE;                                    \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_STORE_##N : {                                                           \
+        const uint##N##_t value =                                              \
+            (uint##N##_t)registers[code[VM_MEMORY_OPERAND_SIZE]];              \
+        memcpy(pointer(program, MEMORY_ADDRESS(code), sizeof(value)),          \
+               &value,                                                         \
+               sizeof(value));                                                 \
+        code += VM_MEMORY_OPERAND_SIZE + 1;                                    \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_STOREI_##N : {                                                          \
+        const uint8_t size = N == 64 ? 4 : N / 8;                              \
+        const uint##N##_t value = (uint##N##_t)read_immediate(                 \
+            code + VM_MEMORY_OPERAND_SIZE, size);                              \
+        memcpy(pointer(program, MEMORY_ADDRESS(code), sizeof(value)),          \
+               &value,                                                         \
+               sizeof(value));                                                 \
+        code += VM_MEMORY_OPERAND_SIZE + size;                                 \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_ADD_RR_##N : {                                                          \
+        WRITE_##N(code[0], registers[code[0]] + registers[code[1]]);           \
+        code += 2;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_ADD_RI_##N : {                                                          \
+        WRITE_##N(code[0],                                                     \
+                  registers[code[0]] + (uint64_t)read_immediate(code + 1, 4)); \
+        code += 5;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_SUB_RR_##N : {                                                          \
+        WRITE_##N(code[0], registers[code[0]] - registers[code[1]]);           \
+        code += 2;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_SUB_RI_##N : {                                                          \
+        WRITE_##N(code[0],                                                     \
+                  registers[code[0]] - (uint64_t)read_immediate(code + 1, 4)); \
+        code += 5;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_CMP_RR_##N : {                                                          \
+        COMPARE(registers[code[0]], registers[code[1]], N);                    \
+        code += 2;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_CMP_RI_##N : {                                                          \
+        COMPARE(registers[code[0]], read_immediate(code + 1, 4), N);           \
+        code += 5;                                                             \
+        DISPATCH();                                                            \
+    }                                                                          \
+    op_NEG_##N : {                                                             \
+        WRITE_##N(code[0], -registers[code[0]]);                               \
+        code += 1;                                                             \
+        DISPATCH();                                                            \
+    }
+
+#define VM_OPCODE_HANDLER(NAME) [VM_OPCODE_##NAME] = &&op_##NAME,
+
+int
+vm_run(struct vm_program *program)
+{
+    static const void *const handlers[] = {VM_OPCODES(VM_OPCODE_HANDLER)};
+    static const uint64_t address_masks[] = {UINT64_MAX, UINT32_MAX};
+
+    uint64_t registers[VM_REGISTER_COUNT];
+    memset(registers, 0, sizeof(registers));
+    registers[IR_REGISTER_SP] = program->stack_top;
+
+    float xmm_registers[VM_XMM_REGISTER_COUNT];
+    memset(xmm_registers, 0, sizeof(xmm_registers));
+
+    uint8_t flags = 0;
+    const uint8_t *code = program->code;
+    DISPATCH();
+
+    SIZED_HANDLERS(8)
+    SIZED_HANDLERS(16)
+    SIZED_HANDLERS(32)
+    SIZED_HANDLERS(64)
+
+op_IMUL_32: {
+    const int64_t product = (int64_t)(int32_t)registers[IR_REGISTER_A] *
+                            (int32_t)registers[code[0]];
+    WRITE_32(IR_REGISTER_A, product);
+    WRITE_32(IR_REGISTER_D, (uint64_t)product >> 32);
+    code += 1;
+    DISPATCH();
+}
+op_IMUL_64: {
+    const __int128 product = (__int128)(int64_t)registers[IR_REGISTER_A] *
+                             (int64_t)registers[code[0]];
+    WRITE_64(IR_REGISTER_A, product);
+    WRITE_64(IR_REGISTER_D, (unsigned __int128)product >> 64);
+    code += 1;
+    DISPATCH();
+}
+op_IDIV_32: {
+    const int64_t dividend =
+        (int64_t)(((uint64_t)(uint32_t)registers[IR_REGISTER_D] << 32) |
+                  (uint32_t)registers[IR_REGISTER_A]);
+    const int32_t divisor = (int32_t)registers[code[0]];
+    if (divisor == 0)
+        fault(SIGFPE);
+
+    const int64_t quotient = dividend / divisor;
+    if (quotient < INT32_MIN || quotient > INT32_MAX)
+        fault(SIGFPE);
+
+    WRITE_32(IR_REGISTER_A, quotient);
+    WRITE_32(IR_REGISTER_D, dividend % divisor);
+    code += 1;
+    DISPATCH();
+}
+op_IDIV_64: {
+    const __int128 dividend =
+        (__int128)(((unsigned __int128)registers[IR_REGISTER_D] << 64) |
+                   registers[IR_REGISTER_A]);
+    const int64_t divisor = (int64_t)registers[code[0]];
+    if (divisor == 0)
+        fault(SIGFPE);
+
+    const __int128 quotient = dividend / divisor;
+    if (quotient < INT64_MIN || quotient > INT64_MAX)
+        fault(SIGFPE);
+
+    WRITE_64(IR_REGISTER_A, quotient);
+    WRITE_64(IR_REGISTER_D, dividend % divisor);
+    code += 1;
+    DISPATCH();
+}
+op_PUSH_16: {
+    registers[IR_REGISTER_SP] -= 2;
+    const uint16_t value = (uint16_t)registers[code[0]];
+    memcpy(pointer(program, registers[IR_REGISTER_SP], sizeof(value)),
+           &value,
+           sizeof(value));
+    code += 1;
+    DISPATCH();
+}
+op_PUSH_64: {
+    registers[IR_REGISTER_SP] -= 8;
+    memcpy(pointer(program, registers[IR_REGISTER_SP], 8),
+           &registers[code[0]],
+           8);
+    code += 1;
+    DISPATCH();
+}
+op_POP_16: {
+    uint16_t value;
+    memcpy(&value,
+           pointer(program, registers[IR_REGISTER_SP], sizeof(value)),
+           sizeof(value));
+    WRITE_16(code[0], value);
+    registers[IR_REGISTER_SP] += 2;
+    code += 1;
+    DISPATCH();
+}
+op_POP_64: {
+    memcpy(&registers[code[0]],
+           pointer(program, registers[IR_REGISTER_SP], 8),
+           8);
+    registers[IR_REGISTER_SP] += 8;
+    code += 1;
+    DISPATCH();
+}
+op_CDQ: {
+    WRITE_32(IR_REGISTER_D,
+             (int32_t)registers[IR_REGISTER_A] < 0 ? UINT32_MAX : 0);
+    DISPATCH();
+}
+op_CDQE: {
+    WRITE_64(IR_REGISTER_A, (int64_t)(int32_t)registers[IR_REGISTER_A]);
+    DISPATCH();
+}
+op_SYSCALL: {
+    const int exit_code = system_call(program, registers);
+    if (exit_code >= 0)
+        return exit_code;
+    DISPATCH();
+}
+op_MOVSS: {
+    xmm_registers[code[0]] = xmm_registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_ADDSS: {
+    xmm_registers[code[0]] += xmm_registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_SUBSS: {
+    xmm_registers[code[0]] -= xmm_registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_MULSS: {
+    xmm_registers[code[0]] *= xmm_registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_DIVSS: {
+    xmm_registers[code[0]] /= xmm_registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_XORPS: {
+    uint32_t lhs;
+    uint32_t rhs;
+    memcpy(&lhs, &xmm_registers[code[0]], sizeof(lhs));
+    memcpy(&rhs, &xmm_registers[code[1]], sizeof(rhs));
+    lhs ^= rhs;
+    memcpy(&xmm_registers[code[0]], &lhs, sizeof(lhs));
+    code += 2;
+    DISPATCH();
+}
+op_COMISS: {
+    const float lhs = xmm_registers[code[0]];
+    const float rhs = xmm_registers[code[1]];
+    // Unordered sets the same flags as equal and below.
+    if (lhs != lhs || rhs != rhs)
+        flags = VM_FLAG_E | VM_FLAG_B;
+    else
+        flags = (lhs == rhs ? VM_FLAG_E : 0) | (lhs < rhs ? VM_FLAG_B : 0);
+    code += 2;
+    DISPATCH();
+}
+op_MOVSS_LOAD: {
+    memcpy(&xmm_registers[code[0]],
+           pointer(program, MEMORY_ADDRESS(code + 1), sizeof(float)),
+           sizeof(float));
+    code += 1 + VM_MEMORY_OPERAND_SIZE;
+    DISPATCH();
+}
+op_MOVSS_STORE: {
+    memcpy(pointer(program, MEMORY_ADDRESS(code), sizeof(float)),
+           &xmm_registers[code[VM_MEMORY_OPERAND_SIZE]],
+           sizeof(float));
+    code += VM_MEMORY_OPERAND_SIZE + 1;
+    DISPATCH();
+}
+op_CVTSI2SS_32: {
+    xmm_registers[code[0]] = (float)(int32_t)registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_CVTSI2SS_64: {
+    xmm_registers[code[0]] = (float)(int64_t)registers[code[1]];
+    code += 2;
+    DISPATCH();
+}
+op_CVTSS2SI_32: {
+    WRITE_32(code[0],
+             float_to_integer(xmm_registers[code[1]], INT32_MIN));
+    code += 2;
+    DISPATCH();
+}
+op_CVTSS2SI_64: {
+    WRITE_64(code[0],
+             float_to_integer(xmm_registers[code[1]], INT64_MIN));
+    code += 2;
+    DISPATCH();
+}
+op_ROUNDSS: {
+    xmm_registers[code[0]] = round_float(xmm_registers[code[1]], code[2]);
+    code += 3;
+    DISPATCH();
+}
+op_JMP: {
+    code = program->code + read_u32(code);
+    DISPATCH();
+}
+op_JCC: {
+    if ((code[0] >> flags) & 1)
+        code = program->code + read_u32(code + 1);
+    else
+        code += 5;
+    DISPATCH();
+}
+op_SETCC: {
+    WRITE_8(code[0], (code[1] >> flags) & 1);
+    code += 2;
+    DISPATCH();
+}
+}
+
+void
+vm_program_destroy(struct vm_program *program)
+{
+    free(program->code);
+    free(program->memory);
+    memset(program, 0, sizeof(*program));
+}
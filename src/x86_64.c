@@ -0,0 +1,975 @@
+/* Compiladores - Ciência da Computação - Coração Eucarístico - 2022/2
+ * José Guilherme de Castro Rodrigues - 651201
+ * */
+#include "x86_64.h"
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INSTRUCTION_SIZE 15U
+
+/* Sizes of the two forms of jumps. */
+#define SHORT_JUMP_SIZE 2U
+#define NEAR_JMP_SIZE 5U
+#define NEAR_JCC_SIZE 6U
+
+/* Byte NASM aligns data with. */
+#define ALIGNMENT_FILL 0x90
+
+#define REX 0x40
+#define REX_W 0x08
+#define REX_R 0x04
+#define REX_X 0x02
+#define REX_B 0x01
+
+/*
+ * How an instruction is laid out, filled by the functions that know each
+ * opcode and then turned into bytes by encode_form.
+ * */
+struct form
+{
+    /* 0x66 or 0xF3, either as operand size or mandatory prefix. */
+    uint8_t prefix;
+    uint8_t rex;
+    /* Set when REX is needed even without any of its bits, to access spl,
+     * bpl, sil and dil. */
+    uint8_t needs_rex;
+    uint8_t opcode[4];
+    uint8_t opcode_size;
+
+    uint8_t has_modrm;
+    /* Register or opcode extension in ModRM.reg. */
+    uint8_t modrm_reg;
+    const struct ir_operand *modrm_rm;
+
+    uint8_t immediate_size;
+    /* IR_OPERAND_IMMEDIATE or IR_OPERAND_ADDRESS. */
+    const struct ir_operand *immediate;
+};
+
+struct encoding
+{
+    uint8_t bytes[MAX_INSTRUCTION_SIZE];
+    uint8_t size;
+    uint8_t has_relocation;
+    /* Offset relative to the beginning of the instruction. */
+    struct x86_64_relocation relocation;
+};
+
+static const uint8_t condition_codes[] = {
+    [IR_CONDITION_E] = 0x4,  [IR_CONDITION_NE] = 0x5, [IR_CONDITION_L] = 0xC,
+    [IR_CONDITION_LE] = 0xE, [IR_CONDITION_G] = 0xF,  [IR_CONDITION_GE] = 0xD,
+    [IR_CONDITION_B] = 0x2,  [IR_CONDITION_BE] = 0x6, [IR_CONDITION_A] = 0x7,
+    [IR_CONDITION_AE] = 0x3,
+};
+
+enum x86_64_section
+x86_64_base_section(enum ir_base base)
+{
+    switch (base) {
+        case IR_BASE_TMP:
+        case IR_BASE_UNNIT_MEM:
+            return X86_64_SECTION_BSS;
+        case IR_BASE_INIT_MEM:
+            return X86_64_SECTION_DATA;
+        case IR_BASE_CONST_MEM:
+            return X86_64_SECTION_RODATA;
+        default:
+            UNREACHABLE();
+    }
+}
+
+uint64_t
+x86_64_base_offset(enum ir_base base)
+{
+    // UNNIT_MEM comes right after the temporary storage.
+    return base == IR_BASE_UNNIT_MEM ? IR_TMP_SIZE : 0;
+}
+
+static enum x86_64_section
+section_from_ir(enum ir_section section)
+{
+    switch (section) {
+        case IR_SECTION_TEXT:
+            return X86_64_SECTION_TEXT;
+        case IR_SECTION_BSS:
+            return X86_64_SECTION_BSS;
+        case IR_SECTION_DATA:
+            return X86_64_SECTION_DATA;
+        case IR_SECTION_RODATA:
+            return X86_64_SECTION_RODATA;
+        default:
+            UNREACHABLE();
+    }
+}
+
+static uint8_t
+is_register(const struct ir_operand *operand)
+{
+    return operand->kind == IR_OPERAND_REGISTER;
+}
+
+static uint8_t
+is_memory(const struct ir_operand *operand)
+{
+    return operand->kind == IR_OPERAND_MEMORY;
+}
+
+static uint8_t
+is_immediate(const struct ir_operand *operand)
+{
+    return operand->kind == IR_OPERAND_IMMEDIATE ||
+           operand->kind == IR_OPERAND_ADDRESS;
+}
+
+static uint8_t
+fits_in_int8(const struct ir_operand *operand)
+{
+    return operand->kind == IR_OPERAND_IMMEDIATE &&
+           operand->value >= INT8_MIN && operand->value <= INT8_MAX;
+}
+
+/*
+ * Number of the register in ModRM, SIB and REX.
+ * */
+static uint8_t
+register_number(uint8_t reg)
+{
+    return reg >= IR_REGISTER_XMM0 ? reg - IR_REGISTER_XMM0 : reg;
+}
+
+/*
+ * Sets the operand size of a general purpose instruction.
+ * */
+static void
+set_operand_size(struct form *form, uint8_t size)
+{
+    if (size == 2)
+        form->prefix = 0x66;
+    else if (size == 8)
+        form->rex |= REX_W;
+}
+
+static void
+set_opcode(struct form *form, uint8_t opcode)
+{
+    form->opcode[0] = opcode;
+    form->opcode_size = 1;
+}
+
+/*
+ * Opcodes with the register in its lower 3 bits.
+ * */
+static void
+set_opcode_register(struct form *form, uint8_t opcode, uint8_t reg)
+{
+    set_opcode(form, opcode + (register_number(reg) & 7));
+    if (register_number(reg) >= 8)
+        form->rex |= REX_B;
+}
+
+static void
+set_modrm(struct form *form, uint8_t reg, const struct ir_operand *rm)
+{
+    form->has_modrm = 1;
+    form->modrm_reg = reg;
+    form->modrm_rm = rm;
+}
+
+static void
+set_immediate(struct form *form,
+              const struct ir_operand *immediate,
+              uint8_t size)
+{
+    form->immediate = immediate;
+    form->immediate_size = size;
+}
+
+static void
+add_byte(struct encoding *encoding, uint8_t byte)
+{
+    assert(encoding->size < MAX_INSTRUCTION_SIZE);
+    encoding->bytes[encoding->size++] = byte;
+}
+
+static void
+add_value(struct encoding *encoding, uint64_t value, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; ++i)
+        add_byte(encoding, (uint8_t)(value >> (8 * i)));
+}
+
+/*
+ * Adds a field of size bytes that is filled with the address of the memory
+ * area plus offset when the program is linked.
+ * */
+static void
+add_address(struct encoding *encoding,
+            enum ir_base base,
+            int64_t offset,
+            enum x86_64_relocation_type type,
+            uint8_t size)
+{
+    assert(!encoding->has_relocation && "One relocation per instruction.");
+
+    encoding->has_relocation = 1;
+    encoding->relocation.offset = encoding->size;
+    encoding->relocation.addend = (int64_t)x86_64_base_offset(base) + offset;
+    encoding->relocation.type = type;
+    encoding->relocation.section = x86_64_base_section(base);
+
+    add_value(encoding, 0, size);
+}
+
+static uint8_t
+needs_rex_for_byte_register(const struct ir_operand *operand)
+{
+    // Without REX, these encode ah, ch, dh and bh.
+    return operand && is_register(operand) && operand->size == 1 &&
+           operand->reg >= IR_REGISTER_SP && operand->reg <= IR_REGISTER_DI;
+}
+
+static void
+encode_form(const struct form *form, struct encoding *encoding)
+{
+    const struct ir_operand *rm = form->modrm_rm;
+    uint8_t rex = form->rex;
+
+    if (form->has_modrm) {
+        if (form->modrm_reg >= 8)
+            rex |= REX_R;
+
+        if (rm && is_register(rm) && register_number(rm->reg) >= 8)
+            rex |= REX_B;
+        if (rm && is_memory(rm) && rm->base == IR_BASE_REGISTER &&
+            rm->reg >= IR_REGISTER_R8) {
+            rex |= REX_B;
+        }
+    }
+
+    // Addresses in 32 bit registers.
+    if (rm && is_memory(rm) && rm->base == IR_BASE_REGISTER &&
+        rm->reg_size == 4) {
+        add_byte(encoding, 0x67);
+    }
+
+    if (form->prefix)
+        add_byte(encoding, form->prefix);
+
+    if (rex || form->needs_rex || needs_rex_for_byte_register(rm))
+        add_byte(encoding, REX | rex);
+
+    for (uint8_t i = 0; i < form->opcode_size; ++i)
+        add_byte(encoding, form->opcode[i]);
+
+    if (form->has_modrm) {
+        const uint8_t reg = (form->modrm_reg & 7) << 3;
+
+        if (is_register(rm)) {
+            add_byte(encoding, 0xC0 | reg | (register_number(rm->reg) & 7));
+        } else if (rm->base == IR_BASE_REGISTER) {
+            const uint8_t base = register_number(rm->reg) & 7;
+            if (base == 4) {
+                // rsp and r12 need a SIB.
+                add_byte(encoding, reg | 4);
+                add_byte(encoding, 0x24);
+            } else if (base == 5) {
+                // rbp and r13 need a displacement.
+                add_byte(encoding, 0x40 | reg | 5);
+                add_byte(encoding, 0);
+            } else {
+                add_byte(encoding, reg | base);
+            }
+        } else {
+            // Absolute address, SIB without base or index. Without the SIB
+            // it would be relative to rip.
+            add_byte(encoding, reg | 4);
+            add_byte(encoding, 0x25);
+            add_address(encoding,
+                        rm->base,
+                        rm->value,
+                        X86_64_RELOCATION_32S,
+                        4);
+        }
+    }
+
+    if (form->immediate_size) {
+        const struct ir_operand *immediate = form->immediate;
+        if (immediate->kind == IR_OPERAND_ADDRESS) {
+            add_address(encoding,
+                        immediate->base,
+                        immediate->value,
+                        form->immediate_size == 8 ? X86_64_RELOCATION_64
+                                                  : X86_64_RELOCATION_32,
+                        form->immediate_size);
+        } else {
+            add_value(encoding,
+                      (uint64_t)immediate->value,
+                      form->immediate_size);
+        }
+    }
+}
+
+static void
+form_mov(struct form *form,
+         const struct ir_operand *dst,
+         const struct ir_operand *src)
+{
+    if (is_register(dst) && is_immediate(src)) {
+        const uint8_t size = dst->size;
+        if (size == 1) {
+            set_opcode_register(form, 0xB0, dst->reg);
+            form->needs_rex = needs_rex_for_byte_register(dst);
+            set_immediate(form, src, 1);
+        } else if (size != 8) {
+            set_operand_size(form, size);
+            set_opcode_register(form, 0xB8, dst->reg);
+            set_immediate(form, src, size);
+        } else if (src->kind == IR_OPERAND_ADDRESS) {
+            form->rex |= REX_W;
+            set_opcode_register(form, 0xB8, dst->reg);
+            set_immediate(form, src, 8);
+        } else if (src->value >= 0 && src->value <= UINT32_MAX) {
+            // Writing the 32 bit register zeroes the upper half.
+            set_opcode_register(form, 0xB8, dst->reg);
+            set_immediate(form, src, 4);
+        } else if (src->value >= INT32_MIN && src->value <= INT32_MAX) {
+            form->rex |= REX_W;
+            set_opcode(form, 0xC7);
+            set_modrm(form, 0, dst);
+            set_immediate(form, src, 4);
+        } else {
+            form->rex |= REX_W;
+            set_opcode_register(form, 0xB8, dst->reg);
+            set_immediate(form, src, 8);
+        }
+    } else if (is_memory(dst) && is_immediate(src)) {
+        set_operand_size(form, dst->size);
+        set_opcode(form, dst->size == 1 ? 0xC6 : 0xC7);
+        set_modrm(form, 0, dst);
+        set_immediate(form, src, dst->size == 8 ? 4 : dst->size);
+    } else if (is_register(src)) {
+        set_operand_size(form, src->size);
+        set_opcode(form, src->size == 1 ? 0x88 : 0x89);
+        set_modrm(form, register_number(src->reg), dst);
+        form->needs_rex = needs_rex_for_byte_register(src);
+    } else if (is_register(dst) && is_memory(src)) {
+        set_operand_size(form, dst->size);
+        set_opcode(form, dst->size == 1 ? 0x8A : 0x8B);
+        set_modrm(form, register_number(dst->reg), src);
+        form->needs_rex = needs_rex_for_byte_register(dst);
+    } else {
+        UNREACHABLE();
+    }
+}
+
+/*
+ * add, sub and cmp share their encodings, opcode is the one of the
+ * r/m8, r8 form and extension goes in ModRM.reg for immediates.
+ * */
+static void
+form_arithmetic(struct form *form,
+                uint8_t opcode,
+                uint8_t extension,
+                const struct ir_operand *dst,
+                const struct ir_operand *src)
+{
+    const uint8_t size = dst->size;
+    const uint8_t is_accumulator =
+        is_register(dst) && dst->reg == IR_REGISTER_A;
+
+    set_operand_size(form, size);
+
+    if (is_register(src)) {
+        set_opcode(form, opcode + (size == 1 ? 0 : 1));
+        set_modrm(form, register_number(src->reg), dst);
+        form->needs_rex = needs_rex_for_byte_register(src);
+    } else if (is_memory(src)) {
+        set_opcode(form, opcode + (size == 1 ? 2 : 3));
+        set_modrm(form, register_number(dst->reg), src);
+        form->needs_rex = needs_rex_for_byte_register(dst);
+    } else if (size == 1) {
+        if (is_accumulator) {
+            set_opcode(form, opcode + 4);
+        } else {
+            set_opcode(form, 0x80);
+            set_modrm(form, extension, dst);
+        }
+        set_immediate(form, src, 1);
+    } else if (fits_in_int8(src)) {
+        set_opcode(form, 0x83);
+        set_modrm(form, extension, dst);
+        set_immediate(form, src, 1);
+    } else {
+        if (is_accumulator) {
+            set_opcode(form, opcode + 5);
+        } else {
+            set_opcode(form, 0x81);
+            set_modrm(form, extension, dst);
+        }
+        set_immediate(form, src, size == 2 ? 2 : 4);
+    }
+}
+
+/*
+ * Instructions with a single r/m operand, opcode is the one of the r/m8
+ * form, the others are opcode + 1.
+ * */
+static void
+form_unary(struct form *form,
+           uint8_t opcode,
+           uint8_t extension,
+           const struct ir_operand *operand)
+{
+    set_operand_size(form, operand->size);
+    set_opcode(form, opcode + (operand->size == 1 ? 0 : 1));
+    set_modrm(form, extension, operand);
+}
+
+/*
+ * SSE instructions, the operand in ModRM.reg is always reg.
+ * */
+static void
+form_sse(struct form *form,
+         uint8_t prefix,
+         uint8_t opcode,
+         const struct ir_operand *reg,
+         const struct ir_operand *rm)
+{
+    form->prefix = prefix;
+    form->opcode[0] = 0x0F;
+    form->opcode[1] = opcode;
+    form->opcode_size = 2;
+    set_modrm(form, register_number(reg->reg), rm);
+}
+
+static void
+encode_instruction(const struct ir_instruction *instruction,
+                   struct encoding *encoding)
+{
+    const struct ir_operand *first = &instruction->operands[0];
+    const struct ir_operand *second = &instruction->operands[1];
+
+    struct form form;
+    memset(&form, 0, sizeof(form));
+
+    switch (instruction->opcode) {
+        case IR_OPCODE_MOV:
+            form_mov(&form, first, second);
+            break;
+        case IR_OPCODE_MOVSS:
+            if (is_memory(first))
+                form_sse(&form, 0xF3, 0x11, second, first);
+            else if (is_memory(second))
+                form_sse(&form, 0xF3, 0x10, first, second);
+            else
+                form_sse(&form, 0, 0x28, first, second);
+            break;
+        case IR_OPCODE_ADD:
+            form_arithmetic(&form, 0x00, 0, first, second);
+            break;
+        case IR_OPCODE_SUB:
+            form_arithmetic(&form, 0x28, 5, first, second);
+            break;
+        case IR_OPCODE_CMP:
+            form_arithmetic(&form, 0x38, 7, first, second);
+            break;
+        case IR_OPCODE_IMUL:
+            form_unary(&form, 0xF6, 5, first);
+            break;
+        case IR_OPCODE_IDIV:
+            form_unary(&form, 0xF6, 7, first);
+            break;
+        case IR_OPCODE_NEG:
+            form_unary(&form, 0xF6, 3, first);
+            break;
+        case IR_OPCODE_COMISS:
+            form_sse(&form, 0, 0x2F, first, second);
+            break;
+        case IR_OPCODE_ADDSS:
+            form_sse(&form, 0xF3, 0x58, first, second);
+            break;
+        case IR_OPCODE_SUBSS:
+            form_sse(&form, 0xF3, 0x5C, first, second);
+            break;
+        case IR_OPCODE_MULSS:
+            form_sse(&form, 0xF3, 0x59, first, second);
+            break;
+        case IR_OPCODE_DIVSS:
+            form_sse(&form, 0xF3, 0x5E, first, second);
+            break;
+        case IR_OPCODE_XORPS:
+            form_sse(&form, 0, 0x57, first, second);
+            break;
+        case IR_OPCODE_CVTSI2SS:
+            form_sse(&form, 0xF3, 0x2A, first, second);
+            if (second->size == 8)
+                form.rex |= REX_W;
+            break;
+        case IR_OPCODE_CVTSS2SI:
+            form_sse(&form, 0xF3, 0x2D, first, second);
+            if (first->size == 8)
+                form.rex |= REX_W;
+            break;
+        case IR_OPCODE_ROUNDSS:
+            form.prefix = 0x66;
+            form.opcode[0] = 0x0F;
+            form.opcode[1] = 0x3A;
+            form.opcode[2] = 0x0A;
+            form.opcode_size = 3;
+            set_modrm(&form, register_number(first->reg), second);
+            set_immediate(&form, &instruction->operands[2], 1);
+            break;
+        case IR_OPCODE_CDQ:
+            set_opcode(&form, 0x99);
+            break;
+        case IR_OPCODE_CDQE:
+            form.rex = REX_W;
+            set_opcode(&form, 0x98);
+            break;
+        case IR_OPCODE_PUSH:
+        case IR_OPCODE_POP:
+            // 64 bits is the default operand size of push and pop.
+            if (first->size == 2)
+                form.prefix = 0x66;
+            set_opcode_register(&form,
+                                instruction->opcode == IR_OPCODE_PUSH ? 0x50
+                                                                      : 0x58,
+                                first->reg);
+            break;
+        case IR_OPCODE_SETCC:
+            form.opcode[0] = 0x0F;
+            form.opcode[1] = 0x90 + condition_codes[instruction->condition];
+            form.opcode_size = 2;
+            set_modrm(&form, 0, first);
+            break;
+        case IR_OPCODE_SYSCALL:
+            form.opcode[0] = 0x0F;
+            form.opcode[1] = 0x05;
+            form.opcode_size = 2;
+            break;
+        default:
+            UNREACHABLE();
+    }
+
+    encode_form(&form, encoding);
+}
+
+static uint8_t
+is_jump(const struct ir_instruction *instruction)
+{
+    return instruction->opcode == IR_OPCODE_JMP ||
+           instruction->opcode == IR_OPCODE_JCC;
+}
+
+static void
+encode_jump(const struct ir_instruction *instruction,
+            uint8_t size,
+            int64_t displacement,
+            struct encoding *encoding)
+{
+    const uint8_t is_jcc = instruction->opcode == IR_OPCODE_JCC;
+    const uint8_t condition_code = condition_codes[instruction->condition];
+
+    if (size == SHORT_JUMP_SIZE) {
+        assert(displacement >= INT8_MIN && displacement <= INT8_MAX);
+        add_byte(encoding, is_jcc ? 0x70 + condition_code : 0xEB);
+        add_value(encoding, (uint64_t)displacement, 1);
+    } else {
+        assert(displacement >= INT32_MIN && displacement <= INT32_MAX);
+        if (is_jcc) {
+            add_byte(encoding, 0x0F);
+            add_byte(encoding, 0x80 + condition_code);
+        } else {
+            add_byte(encoding, 0xE9);
+        }
+        add_value(encoding, (uint64_t)displacement, 4);
+    }
+}
+
+static int
+buffer_reserve(struct x86_64_buffer *buffer, uint64_t size)
+{
+    if (buffer->capacity - buffer->size >= size)
+        return 0;
+
+    uint64_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity - buffer->size < size)
+        capacity *= 2;
+
+    uint8_t *bytes = realloc(buffer->bytes, capacity);
+    if (!bytes)
+        return -1;
+
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int
+buffer_append(struct x86_64_buffer *buffer, const void *bytes, uint64_t size)
+{
+    if (buffer_reserve(buffer, size) < 0)
+        return -1;
+
+    memcpy(buffer->bytes + buffer->size, bytes, size);
+    buffer->size += size;
+    return 0;
+}
+
+static int
+buffer_fill(struct x86_64_buffer *buffer, uint8_t byte, uint64_t size)
+{
+    if (buffer_reserve(buffer, size) < 0)
+        return -1;
+
+    memset(buffer->bytes + buffer->size, byte, size);
+    buffer->size += size;
+    return 0;
+}
+
+static int
+add_relocation(struct x86_64_object *object,
+               const struct x86_64_relocation *relocation)
+{
+    if (object->relocation_count == object->relocation_capacity) {
+        const uint64_t capacity =
+            object->relocation_capacity ? object->relocation_capacity * 2 : 256;
+        struct x86_64_relocation *relocations =
+            realloc(object->relocations, capacity * sizeof(*relocations));
+        if (!relocations)
+            return -1;
+
+        object->relocations = relocations;
+        object->relocation_capacity = capacity;
+    }
+
+    object->relocations[object->relocation_count++] = *relocation;
+    return 0;
+}
+
+static int
+add_data(struct x86_64_object *object, const struct ir_data *data)
+{
+    const enum x86_64_section section = section_from_ir(data->section);
+    struct x86_64_buffer *buffer = &object->sections[section];
+
+    // Like NASM, aligning data also aligns its section.
+    if (data->align > object->alignments[section])
+        object->alignments[section] = data->align;
+
+    assert(data->address >= buffer->size && "Data out of order.");
+    if (buffer_fill(buffer, ALIGNMENT_FILL, data->address - buffer->size) < 0)
+        return -1;
+
+    uint32_t initialized;
+    switch (data->kind) {
+        case IR_DATA_BYTE: {
+            const uint8_t value = (uint8_t)data->value;
+            if (buffer_append(buffer, &value, 1) < 0)
+                return -1;
+            initialized = 1;
+            break;
+        }
+        case IR_DATA_DWORD:
+        case IR_DATA_FLOAT: {
+            const uint8_t value[4] = {(uint8_t)data->value,
+                                      (uint8_t)(data->value >> 8),
+                                      (uint8_t)(data->value >> 16),
+                                      (uint8_t)(data->value >> 24)};
+            if (buffer_append(buffer, value, sizeof(value)) < 0)
+                return -1;
+            initialized = 4;
+            break;
+        }
+        case IR_DATA_STRING:
+            if (buffer_append(buffer, data->bytes, data->count) < 0)
+                return -1;
+            initialized = data->count;
+            break;
+        default:
+            UNREACHABLE();
+    }
+
+    if (data->size > initialized)
+        return buffer_fill(buffer, 0, data->size - initialized);
+    return 0;
+}
+
+/*
+ * Instructions and labels of .text, in order. Deleted records, comments
+ * and section switches are skipped.
+ * */
+static uint8_t
+is_text_record(const struct ir_instruction *instruction)
+{
+    switch (instruction->opcode) {
+        case IR_OPCODE_SECTION:
+        case IR_OPCODE_COMMENT:
+        case IR_OPCODE_RESERVE:
+        case IR_OPCODE_DATA:
+        case IR_OPCODE_DELETED:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/*
+ * Walks .text computing the offset of every label from the sizes of the
+ * instructions. Then grows every short jump whose target is out of reach.
+ * Jumps only grow, so repeating it until nothing changes finishes, with
+ * the same sizes NASM picks.
+ * */
+static void
+place_labels(const struct ir *ir, uint8_t *sizes, uint64_t *labels)
+{
+    uint8_t changed = 1;
+    while (changed) {
+        changed = 0;
+
+        uint64_t offset = 0;
+        uint64_t index = 0;
+        for (const struct ir_block *block = ir->first_block; block;
+             block = block->next) {
+            for (uint32_t i = 0; i < block->count; ++i) {
+                const struct ir_instruction *instruction =
+                    &block->instructions[i];
+                if (!is_text_record(instruction))
+                    continue;
+
+                if (instruction->opcode == IR_OPCODE_LABEL)
+                    labels[instruction->operands[0].value] = offset;
+                offset += sizes[index++];
+            }
+        }
+
+        offset = 0;
+        index = 0;
+        for (const struct ir_block *block = ir->first_block; block;
+             block = block->next) {
+            for (uint32_t i = 0; i < block->count; ++i) {
+                const struct ir_instruction *instruction =
+                    &block->instructions[i];
+                if (!is_text_record(instruction))
+                    continue;
+
+                uint8_t *size = &sizes[index++];
+                offset += *size;
+
+                if (!is_jump(instruction) || *size != SHORT_JUMP_SIZE)
+                    continue;
+
+                const int64_t displacement =
+                    (int64_t)labels[instruction->operands[0].value] -
+                    (int64_t)offset;
+                if (displacement < INT8_MIN || displacement > INT8_MAX) {
+                    *size = instruction->opcode == IR_OPCODE_JMP
+                                ? NEAR_JMP_SIZE
+                                : NEAR_JCC_SIZE;
+                    changed = 1;
+                }
+            }
+        }
+    }
+}
+
+static int
+emit_text(const struct ir *ir,
+          const uint8_t *sizes,
+          const uint64_t *labels,
+          struct x86_64_object *object)
+{
+    struct x86_64_buffer *text = &object->sections[X86_64_SECTION_TEXT];
+
+    uint64_t index = 0;
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+            if (!is_text_record(instruction))
+                continue;
+
+            const uint8_t size = sizes[index++];
+            if (instruction->opcode == IR_OPCODE_LABEL)
+                continue;
+
+            struct encoding encoding;
+            encoding.size = 0;
+            encoding.has_relocation = 0;
+
+            if (is_jump(instruction)) {
+                const int64_t displacement =
+                    (int64_t)labels[instruction->operands[0].value] -
+                    (int64_t)(text->size + size);
+                encode_jump(instruction, size, displacement, &encoding);
+            } else {
+                encode_instruction(instruction, &encoding);
+            }
+            assert(encoding.size == size);
+
+            if (encoding.has_relocation) {
+                encoding.relocation.offset += text->size;
+                if (add_relocation(object, &encoding.relocation) < 0)
+                    return -1;
+            }
+
+            if (buffer_append(text, encoding.bytes, encoding.size) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+x86_64_assemble_data(const struct ir *ir, struct x86_64_object *object)
+{
+    memset(object, 0, sizeof(*object));
+    object->alignments[X86_64_SECTION_TEXT] = 16;
+    object->alignments[X86_64_SECTION_DATA] = 4;
+    object->alignments[X86_64_SECTION_RODATA] = 4;
+    object->alignments[X86_64_SECTION_BSS] = 4;
+    object->bss_size = IR_TMP_SIZE;
+
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+            const struct ir_data *data = &instruction->data;
+
+            switch (instruction->opcode) {
+                case IR_OPCODE_DATA:
+                    if (add_data(object, data) < 0) {
+                        x86_64_object_destroy(object);
+                        return -1;
+                    }
+                    break;
+                case IR_OPCODE_RESERVE: {
+                    if (data->align > object->alignments[X86_64_SECTION_BSS])
+                        object->alignments[X86_64_SECTION_BSS] = data->align;
+
+                    const uint64_t end =
+                        x86_64_base_offset(IR_BASE_UNNIT_MEM) + data->address +
+                        data->size;
+                    if (end > object->bss_size)
+                        object->bss_size = end;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+x86_64_assemble(const struct ir *ir, struct x86_64_object *object)
+{
+    if (x86_64_assemble_data(ir, object) < 0)
+        return -1;
+
+    // Instructions are only counted first, so that their sizes can be
+    // computed.
+    uint64_t text_record_count = 0;
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i)
+            text_record_count += is_text_record(&block->instructions[i]);
+    }
+
+    uint8_t *sizes = malloc(text_record_count ? text_record_count : 1);
+    uint64_t *labels = calloc(ir->label_count ? ir->label_count : 1,
+                              sizeof(*labels));
+    if (!sizes || !labels) {
+        free(sizes);
+        free(labels);
+        goto err;
+    }
+
+    // Every jump starts short.
+    uint64_t index = 0;
+    for (const struct ir_block *block = ir->first_block; block;
+         block = block->next) {
+        for (uint32_t i = 0; i < block->count; ++i) {
+            const struct ir_instruction *instruction = &block->instructions[i];
+            if (!is_text_record(instruction))
+                continue;
+
+            uint8_t size = 0;
+            if (is_jump(instruction)) {
+                size = SHORT_JUMP_SIZE;
+            } else if (instruction->opcode != IR_OPCODE_LABEL) {
+                struct encoding encoding;
+                encoding.size = 0;
+                encoding.has_relocation = 0;
+                encode_instruction(instruction, &encoding);
+                size = encoding.size;
+            }
+            sizes[index++] = size;
+        }
+    }
+
+    place_labels(ir, sizes, labels);
+    const int text_err = emit_text(ir, sizes, labels, object);
+
+    free(sizes);
+    free(labels);
+
+    if (text_err < 0)
+        goto err;
+    return 0;
+
+err:
+    x86_64_object_destroy(object);
+    return -1;
+}
+
+int
+x86_64_relocate(const struct x86_64_object *object,
+                const uint64_t *addresses,
+                uint8_t *text)
+{
+    for (uint64_t i = 0; i < object->relocation_count; ++i) {
+        const struct x86_64_relocation *relocation = &object->relocations[i];
+        const uint64_t address =
+            addresses[relocation->section] + (uint64_t)relocation->addend;
+
+        uint8_t size;
+        switch (relocation->type) {
+            case X86_64_RELOCATION_32:
+                if (address > UINT32_MAX)
+                    return -1;
+                size = 4;
+                break;
+            case X86_64_RELOCATION_32S:
+                if (address > INT32_MAX)
+                    return -1;
+                size = 4;
+                break;
+            case X86_64_RELOCATION_64:
+                size = 8;
+                break;
+            default:
+                UNREACHABLE();
+        }
+
+        for (uint8_t j = 0; j < size; ++j)
+            text[relocation->offset + j] = (uint8_t)(address >> (8 * j));
+    }
+
+    return 0;
+}
+
+void
+x86_64_object_destroy(struct x86_64_object *object)
+{
+    for (uint32_t i = 0; i < X86_64_SECTION_COUNT; ++i)
+        free(object->sections[i].bytes);
+    free(object->relocations);
+    memset(object, 0, sizeof(*object));
+}
@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Compares the objects written by the internal assembler against the ones
+# nasm assembles from the same assembly, section by section, byte for byte.
+#
+# The internal assembler picks the forms nasm 2.09 and later pick with their
+# default optimization (-Ox): mov r64, imm becomes mov r32, imm when imm fits
+# in 32 unsigned bits, addresses moved to 64 bit registers take a 64 bit
+# immediate with an R_X86_64_64 relocation, and jumps are short when they can
+# be. Other assemblers (or nasm -O0) choose differently and won't match.
+
+COMPILER=$(realpath "${1:-./build/l-compiler}")
+PROGRAMS="test-cases/mc l-samples"
+WORK_DIR=$(mktemp -d)
+
+RESET="\033[0m"
+GREEN="\033[38;2;0;255;0m"
+RED="\033[38;2;255;0;0m"
+
+if ! command -v nasm &> /dev/null; then
+    echo "nasm not found, skipping."
+    exit 0
+fi
+
+failed=0
+
+for dir in $PROGRAMS; do
+    for file in $(ls $dir); do
+        printf "Comparing $dir/$file..."
+
+        # The output is written to the current directory.
+        (cd $WORK_DIR && $COMPILER $OLDPWD/$dir/$file --emit-object) &> /dev/null
+
+        # Programs that don't compile have nothing to compare.
+        if [ ! -f $WORK_DIR/$file.asm.o ]; then
+            printf "$RESET skipped.\n"
+            continue
+        fi
+
+        nasm -f elf64 $WORK_DIR/$file.asm -o $WORK_DIR/nasm.o
+
+        same=1
+        for section in .text .data .rodata; do
+            objcopy -O binary -j $section $WORK_DIR/nasm.o $WORK_DIR/nasm.bin
+            objcopy -O binary -j $section $WORK_DIR/$file.asm.o $WORK_DIR/ours.bin
+            cmp -s $WORK_DIR/nasm.bin $WORK_DIR/ours.bin || same=0
+        done
+
+        # .bss has no contents, only its size and alignment, counted from the
+        # end of the line since "[ 4]" and "[10]" split into different fields.
+        bss_nasm=$(readelf -S -W $WORK_DIR/nasm.o | awk '$2 == ".bss" || $3 == ".bss" {print $(NF - 5), $NF}')
+        bss_ours=$(readelf -S -W $WORK_DIR/$file.asm.o | awk '$2 == ".bss" || $3 == ".bss" {print $(NF - 5), $NF}')
+        [ "$bss_nasm" = "$bss_ours" ] || same=0
+
+        # Offset, type, section and addend of every relocation.
+        relocations_nasm=$(readelf -r -W $WORK_DIR/nasm.o | awk '/^0/ {print $1, $3, $5, $7}')
+        relocations_ours=$(readelf -r -W $WORK_DIR/$file.asm.o | awk '/^0/ {print $1, $3, $5, $7}')
+        [ "$relocations_nasm" = "$relocations_ours" ] || same=0
+
+        if [ "$same" -eq 1 ]; then
+            printf "$GREEN Ok"
+        else
+            printf "$RED Error"
+            failed=1
+        fi
+
+        printf "$RESET.\n"
+    done
+done
+
+rm -rf $WORK_DIR
+exit $failed
@@ -3,18 +3,24 @@
 TEST_DIR="test-cases"
 MUST_FAIL="$TEST_DIR/mf"
 MUST_COMP="$TEST_DIR/mc"
+MUST_OUTPUT="$TEST_DIR/mo"
+SAMPLES="l-samples"
+WORK_DIR=$(mktemp -d)
 
 RESET="\033[0m"
 GREEN="\033[38;2;0;255;0m"
 RED="\033[38;2;255;0;0m"
 
+# Must-fail programs are compiled one by one, so that one crashing the
+# compiler can't take the others with it.
 for file in $(ls $MUST_FAIL); do
     printf "Running $MUST_FAIL/$file..."
 
     ./build/l-compiler $MUST_FAIL/$file &> /dev/null
 
-    # Make sure the compiler exit with non zero status.
-    if [ "$?" -ne 0 ]; then
+    # Make sure the compiler reported an error (exit status -1) instead of
+    # succeeding or being killed by a signal.
+    if [ "$?" -eq 255 ]; then
         printf "$GREEN Ok"
     else
         printf "$RED Error"
@@ -23,13 +29,79 @@ for file in $(ls $MUST_FAIL); do
     printf "$RESET.\n"
 done
 
+# Must-compile programs are compiled in a single batch, the summary at the end
+# lists the files that failed. A batch that never gets to its summary failed
+# them all.
+failed_in() {
+    summary=$(./build/l-compiler --batch $1/* 2>&1 > /dev/null)
+    if grep -q "^Batch: " <<< "$summary"; then
+        sed -n 's/^Failed: //p' <<< "$summary"
+    else
+        ls $1/*
+    fi
+}
+
+failed=$(failed_in $MUST_COMP)
 for file in $(ls $MUST_COMP); do
     printf "Running $MUST_COMP/$file..."
 
-    ./build/l-compiler $MUST_COMP/$file &> /dev/null
+    # Make sure the compiler succeeded.
+    if ! grep -qxF "$MUST_COMP/$file" <<< "$failed"; then
+        printf "$GREEN Ok"
+    else
+        printf "$RED Error"
+    fi
+
+    printf "$RESET.\n"
+done
+
+# The parallel lexer must find the same tokens, lines and errors as the
+# sequential one. The file is split in 4 chunks, two of them inside a comment,
+# with an invalid character after the comment.
+chunks=$(mktemp --suffix=.l)
+awk 'BEGIN {
+    for (i = 0; i < 200; ++i)
+        printf "int a%d := %d; string s%d := \"x\";\n", i, i, i
+    print "/* A comment over the chunks"
+    for (i = 0; i < 1200; ++i)
+        print " * int b" i ";"
+    print " */"
+    for (i = 0; i < 190; ++i)
+        printf "char c%d := 0x%02X;\n", i, i
+    print "a1 := a1 $ 2;"
+    for (i = 0; i < 10; ++i)
+        print "a" i " := " i ";"
+}' > $chunks
+
+printf "Running the parallel lexer..."
+./build/lexer-bench $chunks 1 1 tokens &> $chunks.1
+./build/lexer-bench $chunks 1 4 tokens &> $chunks.4
 
-    # Make sure the compiler exit with zero status.
-    if [ "$?" -eq 0 ]; then
+# The error must be there too, or a lexer that crashes on both would pass.
+if grep -q "^Error: Invalid character" $chunks.1 &&
+   cmp -s $chunks.1 $chunks.4; then
+    printf "$GREEN Ok"
+else
+    printf "$RED Error"
+fi
+printf "$RESET.\n"
+rm -f $chunks $chunks.1 $chunks.4
+
+# Programs in $MUST_OUTPUT must print what's in the .out next to them, given
+# the .in next to them if there's one, both natively and in the VM.
+for file in $(ls $MUST_OUTPUT/*.l); do
+    printf "Running $file..."
+
+    input=${file%.l}.in
+    [ -f $input ] || input=/dev/null
+
+    same=1
+    for backend in native vm; do
+        timeout 10 ./build/l-compiler $file --run --backend=$backend < $input > $WORK_DIR/output 2> /dev/null
+        cmp -s ${file%.l}.out $WORK_DIR/output || same=0
+    done
+
+    if [ "$same" -eq 1 ]; then
         printf "$GREEN Ok"
     else
         printf "$RED Error"
@@ -37,3 +109,70 @@ for file in $(ls $MUST_COMP); do
 
     printf "$RESET.\n"
 done
+
+# Programs run in memory with --run must behave like the executables linked
+# from them, which start from a fresh process.
+for file in $(ls $SAMPLES/*.l $MUST_COMP/*.l $MUST_OUTPUT/*.l); do
+    printf "Running $file with --run..."
+
+    # The executable is written to the current directory.
+    (cd $WORK_DIR && $OLDPWD/build/l-compiler $OLDPWD/$file --assemble-and-link) &> /dev/null
+    executable=$WORK_DIR/$(basename $file).asm.out
+
+    # Programs that don't compile have nothing to compare.
+    if [ ! -f $executable ]; then
+        printf "$RESET skipped.\n"
+        continue
+    fi
+
+    input=${file%.l}.in
+    [ -f $input ] || input=/dev/null
+
+    timeout 10 $executable < $input > $WORK_DIR/linked 2> /dev/null
+    timeout 10 ./build/l-compiler $file --run < $input > $WORK_DIR/run 2> /dev/null
+
+    if cmp -s $WORK_DIR/linked $WORK_DIR/run; then
+        printf "$GREEN Ok"
+    else
+        printf "$RED Error"
+    fi
+
+    printf "$RESET.\n"
+done
+
+# The compile server must write what the compiler writes on its own and fail
+# where it fails, and keep serving after programs that fail, which go first.
+SOCKET=$WORK_DIR/server.sock
+./build/l-compiler --serve $SOCKET &> /dev/null &
+server=$!
+for i in $(seq 50); do
+    [ -S $SOCKET ] && break
+    sleep 0.1
+done
+
+for file in $(ls $MUST_FAIL/*.l) $(ls $MUST_COMP/*.l); do
+    printf "Running $file through the server..."
+
+    # The assembly is written to the current directory.
+    output=$WORK_DIR/$(basename $file).asm
+    rm -f $output
+    (cd $WORK_DIR && $OLDPWD/build/l-compiler $OLDPWD/$file) &> /dev/null
+    status=$?
+    [ -f $output ] && mv $output $WORK_DIR/local.asm
+    (cd $WORK_DIR && $OLDPWD/build/l-compiler --connect $SOCKET $OLDPWD/$file) &> /dev/null
+
+    if [ "$?" -ne "$status" ]; then
+        printf "$RED Error"
+    elif [ "$status" -eq 0 ] && ! cmp -s $WORK_DIR/local.asm $output; then
+        printf "$RED Error"
+    else
+        printf "$GREEN Ok"
+    fi
+
+    printf "$RESET.\n"
+done
+
+kill $server
+wait $server
+
+rm -rf $WORK_DIR